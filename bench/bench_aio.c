@@ -0,0 +1,327 @@
+// bench_aio.c - I/O queue and kept-open files against per-operation opens
+//
+// build: make bench
+// usage: ./bench_aio [ops] [dir]   (default 200000 /tmp/fv-aio)
+//
+// First the I/O layer alone, 4 KiB reads at random offsets of a 64 MiB
+// file in the page cache: opening the file by its fan-out path, fstat,
+// pread and close for every read, the way each model operation went
+// before store files were kept open; fstat and pread on a descriptor
+// kept open; and batches of 8 through ioq.h, on blocking calls and on
+// io_uring. Then the model: whole reads of small files with the content
+// cache off, 100-byte appends, and whole reads of a 16 MiB file, with
+// asynchronous I/O off and on.
+//
+// Each case reports operations per second and system calls per
+// operation. The calls are counted exactly, in a child process traced
+// with ptrace between two getppid() markers; that run is not timed.
+
+#include "fanout.h"
+#include "ioq.h"
+#include "kdf.h"
+#include "model.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FILE_SIZE  (64L << 20)
+#define READ_SIZE  4096
+#define BATCH      8
+#define SMALL      64         /* small vault files */
+#define BIG_SIZE   (16 << 20)
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+/* empties dir, vault.store and all */
+static void clearDir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    char path[1024];
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (unlink(path) != 0 && errno == EISDIR) {
+            clearDir(path);
+            rmdir(path);
+        }
+    }
+    closedir(d);
+}
+
+/* ---------- cases ---------- */
+
+typedef struct {
+    int       dirFd;              /* holds the fan-out tree */
+    char      path[FANOUT_PATH_LEN];
+    int       fd;                 /* the same file, kept open */
+    IoQueue  *q;
+    VaultCtx *v;
+    char     *buf;
+    unsigned  seed;
+} Bench;
+
+typedef void (*CaseFn)(Bench *b, long ops);
+
+static uint64_t randomOffset(Bench *b) {
+    uint64_t r = (uint64_t)rand_r(&b->seed) << 16 ^ (uint64_t)rand_r(&b->seed);
+    return r % (FILE_SIZE / READ_SIZE) * READ_SIZE;
+}
+
+static void openEach(Bench *b, long ops) {
+    struct stat st;
+    for (long i = 0; i < ops; i++) {
+        int fd = fanout_open(b->dirFd, b->path, O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0 || fstat(fd, &st) != 0 ||
+            pread(fd, b->buf, READ_SIZE, (off_t)randomOffset(b)) != READ_SIZE)
+            die("pread");
+        close(fd);
+    }
+}
+
+static void keptOpen(Bench *b, long ops) {
+    struct stat st;
+    for (long i = 0; i < ops; i++)
+        if (fstat(b->fd, &st) != 0 ||
+            pread(b->fd, b->buf, READ_SIZE, (off_t)randomOffset(b)) != READ_SIZE)
+            die("pread");
+}
+
+static void queued(Bench *b, long ops) {
+    IoqDone done[BATCH];
+    for (long i = 0; i < ops; i += BATCH) {
+        for (int j = 0; j < BATCH; j++)
+            ioq_read(b->q, b->fd, b->buf + (size_t)j * READ_SIZE, READ_SIZE, randomOffset(b),
+                     (uint64_t)j);
+        for (int got = 0; got < BATCH;) {
+            int n = ioq_reap(b->q, done, BATCH, BATCH - got);
+            if (n < 0) die("ioq_reap");
+            for (int j = 0; j < n; j++)
+                if (done[j].res != READ_SIZE) die("ioq read");
+            got += n;
+        }
+    }
+}
+
+static int countChunk(void *ctx, const char *data, size_t len) {
+    (void)data;
+    *(long long *)ctx += (long long)len;
+    return 0;
+}
+
+static void readSmall(Bench *b, long ops) {
+    char name[32];
+    for (long i = 0; i < ops; i++) {
+        long long got = 0;
+        snprintf(name, sizeof(name), "small-%02ld", i % SMALL);
+        if (vault_readFile(b->v, name, countChunk, &got) != 0 || got != READ_SIZE)
+            die("vault_readFile");
+    }
+}
+
+static void appendSmall(Bench *b, long ops) {
+    char name[32];
+    long long out;
+    for (long i = 0; i < ops; i++) {
+        snprintf(name, sizeof(name), "small-%02ld", i % SMALL);
+        if (vault_appendToFile(b->v, name, "2026-10-17T12:00:00Z worker-07 request "
+                                           "id=0000abcd status=200 ms=12 ok ok ok\n",
+                               &out) != 0)
+            die("vault_appendToFile");
+    }
+}
+
+static void readBig(Bench *b, long ops) {
+    for (long i = 0; i < ops; i++) {
+        long long got = 0;
+        if (vault_readFile(b->v, "big", countChunk, &got) != 0 || got != BIG_SIZE)
+            die("vault_readFile");
+    }
+}
+
+/* ---------- measuring ---------- */
+
+static VaultCtx *openVault(const char *dir, int async) {
+    model_setAsyncIo(async);
+    VaultCtx *v = model_open(dir);
+    if (!v) die("model_open");
+    vault_setKdfCost(v, KDF_MIN_COST);
+    vault_setSyncPolicy(v, MODEL_SYNC_NONE, 0, 0);
+    vault_setCacheSize(v, 0);
+    return v;
+}
+
+/* a fresh handle has every file locked */
+static void unlockAll(VaultCtx *v) {
+    char name[32];
+    for (int i = 0; i < SMALL; i++) {
+        snprintf(name, sizeof(name), "small-%02d", i);
+        if (vault_verifyPassword(v, name, "pw") != 1) die("vault_verifyPassword");
+    }
+    if (vault_verifyPassword(v, "big", "pw") != 1) die("vault_verifyPassword");
+}
+
+/* milliseconds fn takes for ops operations, after a warm-up */
+static double timeCase(Bench *b, CaseFn fn, long ops) {
+    fn(b, ops / 10 + 1);
+    double t0 = nowMs();
+    fn(b, ops);
+    return nowMs() - t0;
+}
+
+/* system calls fn makes per operation, counted in a traced child. an
+ * io_uring ring is shared across fork, so the child opens its own queue,
+ * and its own vault from vdir (the parent's is closed by then) */
+static double countCase(Bench *b, const char *vdir, int async, CaseFn fn, long ops) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) die("fork");
+    if (pid == 0) {
+        if (b->q) b->q = ioq_open(BATCH, async);
+        if (vdir) {
+            b->v = openVault(vdir, async);
+            unlockAll(b->v);
+        }
+        fn(b, ops / 10 + 1);
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        raise(SIGSTOP);
+        getppid();
+        fn(b, ops);
+        getppid();
+        _exit(0);
+    }
+    int  status, marks = 0;
+    long calls = 0;
+    waitpid(pid, &status, 0);
+    ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)PTRACE_O_TRACESYSGOOD);
+    for (;;) {
+        if (ptrace(PTRACE_SYSCALL, pid, NULL, NULL) != 0 || waitpid(pid, &status, 0) < 0 ||
+            WIFEXITED(status) || WIFSIGNALED(status))
+            break;
+        if (!WIFSTOPPED(status) || WSTOPSIG(status) != (SIGTRAP | 0x80)) continue;
+        struct __ptrace_syscall_info info;
+        if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, (void *)sizeof(info), &info) <= 0 ||
+            info.op != PTRACE_SYSCALL_INFO_ENTRY)
+            continue;
+        if (info.entry.nr == __NR_getppid) marks++;
+        else if (marks == 1) calls++;
+    }
+    if (marks != 2) die("ptrace");
+    return (double)calls / (double)ops;
+}
+
+static void report(const char *what, long ops, double ms, double calls) {
+    printf("%-32s %10.0f ops/s %9.2f us/op %8.2f syscalls/op\n", what,
+           (double)ops * 1e3 / ms, ms * 1e3 / (double)ops, calls);
+}
+
+int main(int argc, char **argv) {
+    long        ops = argc > 1 ? atol(argv[1]) : 200000;
+    const char *dir = argc > 2 ? argv[2] : "/tmp/fv-aio";
+    if (ops < BATCH * 100) {
+        fprintf(stderr, "usage: %s [ops] [dir]\n", argv[0]);
+        return 1;
+    }
+    ops -= ops % BATCH;
+    clearDir(dir);
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) die(dir);
+
+    Bench b;
+    memset(&b, 0, sizeof(b));
+    b.seed  = 7;
+    b.buf   = (char *)malloc(BIG_SIZE);
+    b.dirFd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (!b.buf || b.dirFd < 0) die(dir);
+    fanout_path("data", b.path);
+    b.fd = fanout_open(b.dirFd, b.path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (b.fd < 0) die("data");
+    memset(b.buf, 'x', BIG_SIZE);
+    for (long at = 0; at < FILE_SIZE; at += BIG_SIZE)
+        if (pwrite(b.fd, b.buf, BIG_SIZE, at) != BIG_SIZE) die("pwrite");
+
+    long traced = ops / 20 - ops / 20 % BATCH;
+    printf("I/O layer: 4 KiB reads at random offsets of a 64 MiB file\n");
+    report("open + fstat + pread + close", ops, timeCase(&b, openEach, ops),
+           countCase(&b, NULL, 0, openEach, traced));
+    report("kept open: fstat + pread", ops, timeCase(&b, keptOpen, ops),
+           countCase(&b, NULL, 0, keptOpen, traced));
+    for (int async = 0; async <= 1; async++) {
+        b.q = ioq_open(BATCH, async);
+        if (!b.q) die("ioq_open");
+        if (async && !ioq_async(b.q))
+            printf("%-32s no io_uring here\n", "ioq, io_uring, batches of 8");
+        else
+            report(async ? "ioq, io_uring, batches of 8" : "ioq, blocking, batches of 8", ops,
+                   timeCase(&b, queued, ops), countCase(&b, NULL, async, queued, traced));
+        ioq_close(b.q);
+        b.q = NULL;
+    }
+
+    printf("model: %d files of 4 KiB and one of 16 MiB, content cache off\n", SMALL);
+    for (int async = 0; async <= 1; async++) {
+        char vdir[512], label[3][64];
+        snprintf(vdir, sizeof(vdir), "%s/vault", dir);
+        clearDir(vdir);
+        b.v = openVault(vdir, async);
+        long long out;
+        for (int i = 0; i < SMALL; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "small-%02d", i);
+            memset(b.buf, 'a' + i % 26, READ_SIZE);
+            b.buf[READ_SIZE] = '\0';
+            if (vault_addFile(b.v, name, "pw") != 0 ||
+                vault_appendToFile(b.v, name, b.buf, &out) != 0)
+                die("vault_addFile");
+        }
+        memset(b.buf, 'b', BIG_SIZE);
+        b.buf[BIG_SIZE - 1] = '\0';
+        if (vault_addFile(b.v, "big", "pw") != 0 ||
+            vault_appendToFile(b.v, "big", b.buf, &out) != 0 ||
+            vault_appendToFile(b.v, "big", "\n", &out) != 0)
+            die("big");
+
+        /* appends last: they grow the small files */
+        long   small = ops / 10, big = 20;
+        double ms[2];
+        ms[0] = timeCase(&b, readSmall, small);
+        ms[1] = timeCase(&b, readBig, big);
+        model_close(b.v);
+        snprintf(label[0], sizeof(label[0]), "readFile 4 KiB, aio %s", async ? "on" : "off");
+        snprintf(label[1], sizeof(label[1]), "readFile 16 MiB, aio %s", async ? "on" : "off");
+        snprintf(label[2], sizeof(label[2]), "append 100 B, aio %s", async ? "on" : "off");
+        report(label[0], small, ms[0], countCase(&b, vdir, async, readSmall, traced / 10));
+        report(label[1], big, ms[1], countCase(&b, vdir, async, readBig, 4));
+
+        b.v = openVault(vdir, async);
+        unlockAll(b.v);
+        ms[0] = timeCase(&b, appendSmall, small);
+        model_close(b.v);
+        b.v = NULL;
+        report(label[2], small, ms[0], countCase(&b, vdir, async, appendSmall, traced / 10));
+    }
+
+    close(b.fd);
+    close(b.dirFd);
+    free(b.buf);
+    clearDir(dir);
+    return 0;
+}
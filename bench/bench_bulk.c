@@ -0,0 +1,210 @@
+// bench_bulk.c - bulk import and archive export/restore against file-by-file adds
+//
+// build: make bench
+// usage: ./bench_bulk [files] [size] [kdf cost] [dir]
+//        (default 20000 4096 1000 /tmp/fv-bulk)
+//
+// Writes a source tree of files files of size bytes of log lines, 100
+// per directory, then brings it into an empty vault three ways: one
+// vault_addFile and vault_appendStream per file, as a script driving
+// "add" and "append" would; vault_importTree on one thread; and on one
+// thread per CPU. Then exports the vault with vault_exportArchive and
+// restores the archive into another empty vault, which needs no KDF run.
+// The vault's own sync policy applies throughout. The KDF cost defaults
+// to the minimum so the rest shows: at the default cost every add or
+// import pays some 60 ms per file per core on top.
+
+#include "kdf.h"
+#include "model.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PER_DIR 100
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+/* empties dir, subdirectories and all */
+static void clearDir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    char path[1024];
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (unlink(path) != 0 && errno == EISDIR) {
+            clearDir(path);
+            rmdir(path);
+        }
+    }
+    closedir(d);
+}
+
+static void fresh(const char *path) {
+    clearDir(path);
+    rmdir(path);
+    if (mkdir(path, 0700) != 0) die(path);
+}
+
+static size_t fillLines(char *buf, size_t len, unsigned *seed) {
+    size_t n = 0;
+    while (n + 120 < len) {
+        n += (size_t)sprintf(buf + n,
+                             "2026-10-17T12:%02d:%02dZ worker-%02d request id=%08x "
+                             "status=%d ms=%d\n",
+                             rand_r(seed) % 60, rand_r(seed) % 60, rand_r(seed) % 32,
+                             (unsigned)rand_r(seed), rand_r(seed) % 50 ? 200 : 500,
+                             rand_r(seed) % 300);
+    }
+    while (n < len) buf[n++] = '.';
+    return n;
+}
+
+static void fileName(char *out, size_t cap, long i) {
+    snprintf(out, cap, "d%03ld/f%06ld.log", i / PER_DIR, i);
+}
+
+static void makeTree(const char *src, long files, size_t size) {
+    char    *buf  = (char *)malloc(size + 1);
+    unsigned seed = 5;
+    char     path[1024], name[64];
+    if (!buf) die("malloc");
+    fresh(src);
+    for (long i = 0; i < files; i++) {
+        fileName(name, sizeof(name), i);
+        if (i % PER_DIR == 0) {
+            snprintf(path, sizeof(path), "%s/d%03ld", src, i / PER_DIR);
+            if (mkdir(path, 0700) != 0) die(path);
+        }
+        snprintf(path, sizeof(path), "%s/%s", src, name);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0 || write(fd, buf, fillLines(buf, size, &seed)) != (ssize_t)size) die(path);
+        close(fd);
+    }
+    free(buf);
+}
+
+static VaultCtx *openVault(const char *dir, uint32_t cost) {
+    fresh(dir);
+    VaultCtx *v = model_open(dir);
+    if (!v) die("model_open");
+    vault_setKdfCost(v, cost);
+    return v;
+}
+
+typedef struct {
+    int  fd;
+    char buf[64 * 1024];
+} FileSource;
+
+static long readSource(void *ctx, const char **data) {
+    FileSource *s = (FileSource *)ctx;
+    ssize_t     n = read(s->fd, s->buf, sizeof(s->buf));
+    *data = s->buf;
+    return n < 0 ? -1 : (long)n;
+}
+
+static void report(const char *what, long files, long long bytes, double ms) {
+    printf("%-28s %7ld files %9.0f files/s %8.1f MiB/s %9.1f ms\n", what, files,
+           (double)files * 1e3 / ms, (double)bytes / (1 << 20) * 1e3 / ms, ms);
+}
+
+static void check(const char *what, int rc, const ModelBulk *r, long files) {
+    if (rc != 0 || r->files != files || r->failed != 0) {
+        fprintf(stderr, "%s: rc %d, %ld files, %ld skipped, %ld failed\n", what, rc,
+                r->files, r->skipped, r->failed);
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv) {
+    long        files = argc > 1 ? atol(argv[1]) : 20000;
+    size_t      size  = argc > 2 ? (size_t)atol(argv[2]) : 4096;
+    uint32_t    cost  = argc > 3 ? (uint32_t)atol(argv[3]) : KDF_MIN_COST;
+    const char *dir   = argc > 4 ? argv[4] : "/tmp/fv-bulk";
+    if (files < 1 || size < 1 || cost < KDF_MIN_COST) {
+        fprintf(stderr, "usage: %s [files] [size] [kdf cost] [dir]\n", argv[0]);
+        return 1;
+    }
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) die(dir);
+
+    char src[512], vdir[512], archive[512], path[1024], name[64];
+    snprintf(src, sizeof(src), "%s/src", dir);
+    snprintf(vdir, sizeof(vdir), "%s/vault", dir);
+    snprintf(archive, sizeof(archive), "%s/vault.fva", dir);
+    makeTree(src, files, size);
+    long long total = (long long)files * (long long)size;
+    long      cpus  = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%ld files of %zu bytes, KDF cost %u, %ld CPU%s\n", files, size, cost, cpus,
+           cpus == 1 ? "" : "s");
+
+    /* file by file */
+    VaultCtx  *v = openVault(vdir, cost);
+    FileSource in;
+    double     t0 = nowMs();
+    for (long i = 0; i < files; i++) {
+        fileName(name, sizeof(name), i);
+        snprintf(path, sizeof(path), "%s/%s", src, name);
+        long long len;
+        if (vault_addFile(v, name, "pw") != 0) die("vault_addFile");
+        if ((in.fd = open(path, O_RDONLY)) < 0) die(path);
+        if (vault_appendStream(v, name, readSource, &in, &len) != 0) die("vault_appendStream");
+        close(in.fd);
+    }
+    report("add + append per file", files, total, nowMs() - t0);
+    model_close(v);
+
+    ModelBulk r;
+    int       threads[] = { 1, 0 };
+    for (int t = 0; t < (cpus > 1 ? 2 : 1); t++) {
+        v  = openVault(vdir, cost);
+        t0 = nowMs();
+        int rc = vault_importTree(v, src, "pw", NULL, threads[t], &r);
+        double ms = nowMs() - t0;
+        check("vault_importTree", rc, &r, files);
+        snprintf(path, sizeof(path), "importTree, %ld thread%s", threads[t] ? 1 : cpus,
+                 threads[t] || cpus == 1 ? "" : "s");
+        report(path, r.files, r.bytes, ms);
+        if (t == (cpus > 1 ? 1 : 0)) break;   /* kept for the export */
+        model_close(v);
+    }
+
+    t0 = nowMs();
+    int rc = vault_exportArchive(v, archive, 0, &r);
+    double ms = nowMs() - t0;
+    check("vault_exportArchive", rc, &r, files);
+    report("exportArchive", r.files, r.bytes, ms);
+    model_close(v);
+
+    v  = openVault(vdir, cost);
+    t0 = nowMs();
+    rc = vault_importArchive(v, archive, 0, &r);
+    ms = nowMs() - t0;
+    check("vault_importArchive", rc, &r, files);
+    report("importArchive (no KDF)", r.files, r.bytes, ms);
+
+    /* what was restored reads back */
+    fileName(name, sizeof(name), files - 1);
+    if (vault_verifyPassword(v, name, "pw") != 1 || vault_getFileSize(v, name) != (long long)size)
+        die("restored file");
+    model_close(v);
+
+    clearDir(dir);
+    return 0;
+}
@@ -0,0 +1,163 @@
+// bench_cache.c - content cache: repeat reads, append then read, outside changes
+//
+// build: make bench
+// usage: ./bench_cache [reads] [dir]   (default 200 /tmp/fv-cache)
+//
+// One vault file of 64 KiB, 1 MiB and 8 MiB of log lines, compression
+// off and on. For each, with the cache off and on (MODEL_CACHE_BYTES):
+// the time of a full vault_readFile repeated reads times, as a "view"
+// does; then rounds of a 4 KiB append followed by a full read, which
+// the cache serves by extending its copy; and, with the cache on, a
+// read right after the file was touched from outside (utimensat), which
+// must notice the change and read the file again.
+
+#include "fanout.h"
+#include "kdf.h"
+#include "model.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define APPEND_SIZE 4096
+#define ROUNDS      100
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+/* empties dir, vault.store and all */
+static void clearDir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    char path[1024];
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (unlink(path) != 0 && errno == EISDIR) {
+            clearDir(path);
+            rmdir(path);
+        }
+    }
+    closedir(d);
+}
+
+/* where the vault in dir keeps the bytes of name */
+static void storePath(char *out, size_t cap, const char *dir, const char *name) {
+    char rel[FANOUT_PATH_LEN];
+    fanout_path(name, rel);
+    snprintf(out, cap, "%s/" FANOUT_ROOT "/%s", dir, rel);
+}
+
+static size_t fillLines(char *buf, size_t len, unsigned *seed) {
+    size_t n = 0;
+    while (n + 120 < len) {
+        n += (size_t)sprintf(buf + n,
+                             "2026-10-17T12:%02d:%02dZ worker-%02d request id=%08x "
+                             "status=%d ms=%d\n",
+                             rand_r(seed) % 60, rand_r(seed) % 60, rand_r(seed) % 32,
+                             (unsigned)rand_r(seed), rand_r(seed) % 50 ? 200 : 500,
+                             rand_r(seed) % 300);
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+static int countChunk(void *ctx, const char *data, size_t len) {
+    (void)data;
+    *(long long *)ctx += (long long)len;
+    return 0;
+}
+
+static long long readAll(VaultCtx *v) {
+    long long got = 0;
+    if (vault_readFile(v, "log", countChunk, &got) != 0) die("vault_readFile");
+    return got;
+}
+
+static void bench(const char *dir, size_t size, int compress, int reads) {
+    char *buf = (char *)malloc(size + APPEND_SIZE + 256);
+    if (!buf) die("malloc");
+    unsigned seed = 3;
+    double   offReadUs = 0, offRoundUs = 0;
+
+    for (int cached = 0; cached <= 1; cached++) {
+        clearDir(dir);
+        VaultCtx *v = model_open(dir);
+        if (!v) die("model_open");
+        vault_setKdfCost(v, KDF_MIN_COST);
+        vault_setSyncPolicy(v, MODEL_SYNC_NONE, 0, 0);
+        vault_setCompression(v, compress);
+        vault_setCacheSize(v, cached ? MODEL_CACHE_BYTES : 0);
+        if (vault_addFile(v, "log", "pw") != 0) die("vault_addFile");
+        fillLines(buf, size, &seed);
+        long long out;
+        if (vault_appendToFile(v, "log", buf, &out) != 0) die("vault_appendToFile");
+
+        double t0    = nowMs();
+        double first = 0;
+        for (int i = 0; i < reads; i++) {
+            readAll(v);
+            if (i == 0) first = nowMs() - t0;
+        }
+        double readUs = (nowMs() - t0 - first) * 1e3 / (reads - 1);
+
+        t0 = nowMs();
+        for (int i = 0; i < ROUNDS; i++) {
+            fillLines(buf, APPEND_SIZE, &seed);
+            if (vault_appendToFile(v, "log", buf, &out) != 0) die("vault_appendToFile");
+            readAll(v);
+        }
+        double roundUs = (nowMs() - t0) * 1e3 / ROUNDS;
+
+        printf("%5zu KiB compress %-3s cache %-3s: first read %8.1f us, repeat %8.1f us, "
+               "append 4K + read %8.1f us",
+               size >> 10, compress ? "on" : "off", cached ? "on" : "off", first * 1e3,
+               readUs, roundUs);
+        if (!cached) {
+            offReadUs  = readUs;
+            offRoundUs = roundUs;
+        } else {
+            printf(" (%.0fx, %.1fx)", offReadUs / readUs, offRoundUs / roundUs);
+            /* same bytes, new mtime: the event makes the next read check */
+            char path[1024];
+            storePath(path, sizeof(path), dir, "log");
+            if (utimensat(AT_FDCWD, path, NULL, 0) != 0) die(path);
+            t0 = nowMs();
+            readAll(v);
+            printf(", after touch %.1f us", (nowMs() - t0) * 1e3);
+        }
+        printf("\n");
+        model_close(v);
+    }
+    free(buf);
+}
+
+int main(int argc, char **argv) {
+    int         reads = argc > 1 ? atoi(argv[1]) : 200;
+    const char *dir   = argc > 2 ? argv[2] : "/tmp/fv-cache";
+    if (reads < 2) {
+        fprintf(stderr, "usage: %s [reads] [dir]\n", argv[0]);
+        return 1;
+    }
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) die(dir);
+
+    size_t sizes[] = { 64 << 10, 1 << 20, 8 << 20 };
+    for (int c = 0; c <= 1; c++)
+        for (int s = 0; s < 3; s++) bench(dir, sizes[s], c, reads);
+    clearDir(dir);
+    return 0;
+}
@@ -0,0 +1,253 @@
+// bench_compress.c - compressed storage: ratio, append cost and read speed
+//
+// build: make bench
+// usage: ./bench_compress [MiB] [dir]   (default 64 /tmp/fv-compress)
+//
+// First the codec alone (lz.h) on 64 KiB blocks of three inputs: log
+// lines, Zipf-distributed words and random bytes, for the compression
+// ratio and compress / decompress speed. Then one vault file is filled
+// with MiB of log lines, with compression off and on, in 4 KiB appends
+// and (for an eighth of the size) in 128-byte appends, which recompress
+// the tail block every time. For each: append speed, bytes on disk, a
+// full read, and random 4 KiB range reads.
+
+#include "cipher.h"
+#include "fanout.h"
+#include "kdf.h"
+#include "lz.h"
+#include "model.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK       FRAME_BLOCK_MAX
+#define VOCAB       20000
+#define RANGE_LEN   4096
+#define RANGE_READS 2000
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+/* ---------- inputs ---------- */
+
+static const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+static const char *paths[]  = { "/api/v1/items", "/api/v1/users", "/login",
+                                "/static/app.js", "/api/v1/orders", "/health" };
+
+static size_t logLine(char *out, unsigned *seed, long n) {
+    int ms = (int)(n * 37 % 1000);
+    return (size_t)sprintf(out,
+        "2026-10-17T12:%02ld:%02ld.%03dZ %-5s worker-%02d request id=%08x "
+        "path=%s/%d status=%d bytes=%d ms=%d\n",
+        n / 6000 % 60, n / 100 % 60, ms, levels[rand_r(seed) % 6],
+        rand_r(seed) % 32, (unsigned)rand_r(seed), paths[rand_r(seed) % 6],
+        rand_r(seed) % 100000, rand_r(seed) % 50 ? 200 : 500,
+        rand_r(seed) % 20000, rand_r(seed) % 300);
+}
+
+static double cumulative[VOCAB];
+
+static size_t wordText(char *out, size_t len, unsigned *seed) {
+    static int ready;
+    if (!ready) {
+        double sum = 0;
+        for (int i = 0; i < VOCAB; i++) cumulative[i] = sum += 1.0 / (i + 1);
+        for (int i = 0; i < VOCAB; i++) cumulative[i] /= sum;
+        ready = 1;
+    }
+    size_t n = 0;
+    while (n + 16 < len) {
+        double u = (double)rand_r(seed) / RAND_MAX;
+        int lo = 0, hi = VOCAB - 1;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (cumulative[mid] < u) lo = mid + 1;
+            else hi = mid;
+        }
+        n += (size_t)sprintf(out + n, "w");
+        for (int r = lo; ; r /= 26) {
+            out[n++] = (char)('a' + r % 26);
+            if (r < 26) break;
+        }
+        out[n++] = rand_r(seed) % 12 == 0 ? '\n' : ' ';
+    }
+    return n;
+}
+
+/* len bytes of the given kind: 0 log lines, 1 words, 2 random */
+static void fill(char *buf, size_t len, int kind, unsigned seed) {
+    char   line[256];
+    size_t n = 0;
+    long   k = 0;
+    if (kind == 1) n = wordText(buf, len, &seed);
+    while (kind == 0 && n < len) {
+        size_t m = logLine(line, &seed, k++);
+        if (m > len - n) m = len - n;
+        memcpy(buf + n, line, m);
+        n += m;
+    }
+    for (; n < len; n++) buf[n] = (char)rand_r(&seed);
+}
+
+/* ---------- codec ---------- */
+
+static void benchCodec(const char *label, int kind, size_t total) {
+    char          *in   = (char *)malloc(total);
+    unsigned char *out  = (unsigned char *)malloc(total / BLOCK * lz_bound(BLOCK));
+    size_t        *lens = (size_t *)malloc(sizeof(size_t) * (total / BLOCK));
+    char          *back = (char *)malloc(BLOCK);
+    if (!in || !out || !lens || !back) die("malloc");
+    fill(in, total, kind, 7);
+
+    size_t blocks = total / BLOCK, packed = 0, stride = lz_bound(BLOCK);
+    double t0 = nowMs();
+    for (size_t b = 0; b < blocks; b++) {
+        lens[b] = lz_compress(in + b * BLOCK, BLOCK, out + b * stride, stride);
+        packed += lens[b];
+    }
+    double cms = nowMs() - t0;
+
+    t0 = nowMs();
+    for (size_t b = 0; b < blocks; b++)
+        if (lz_decompress(out + b * stride, lens[b], back, BLOCK) != 0 ||
+            memcmp(back, in + b * BLOCK, BLOCK) != 0) {
+            fprintf(stderr, "%s: block %zu does not round-trip\n", label, b);
+            exit(1);
+        }
+    double dms = nowMs() - t0;
+
+    double mib = (double)(blocks * BLOCK) / (1 << 20);
+    printf("codec  %-8s ratio %5.2f  compress %7.1f MiB/s  decompress %7.1f MiB/s"
+           "  (incl. compare)\n",
+           label, (double)(blocks * BLOCK) / (double)packed,
+           mib / (cms / 1e3), mib / (dms / 1e3));
+    free(in);
+    free(out);
+    free(lens);
+    free(back);
+}
+
+/* ---------- vault ---------- */
+
+/* empties dir, vault.store and all */
+static void clearDir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    char path[1024];
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (unlink(path) != 0 && errno == EISDIR) {
+            clearDir(path);
+            rmdir(path);
+        }
+    }
+    closedir(d);
+}
+
+/* where the vault in dir keeps the bytes of name */
+static void storePath(char *out, size_t cap, const char *dir, const char *name) {
+    char rel[FANOUT_PATH_LEN];
+    fanout_path(name, rel);
+    snprintf(out, cap, "%s/" FANOUT_ROOT "/%s", dir, rel);
+}
+
+static int countChunk(void *ctx, const char *data, size_t len) {
+    (void)data;
+    *(long long *)ctx += (long long)len;
+    return 0;
+}
+
+static void benchVault(const char *dir, const char *text, size_t total,
+                       size_t appendSize, int compress) {
+    clearDir(dir);
+    VaultCtx *v = model_open(dir);
+    if (!v) die("model_open");
+    vault_setKdfCost(v, KDF_MIN_COST);
+    vault_setSyncPolicy(v, MODEL_SYNC_NONE, 0, 0);
+    vault_setCompression(v, compress);
+    if (vault_addFile(v, "log", "pw") != 0) die("vault_addFile");
+
+    long long appended = 0;
+    double    t0       = nowMs();
+    for (size_t off = 0; off < total; off += appendSize) {
+        size_t      n = total - off < appendSize ? total - off : appendSize;
+        char       *chunk = strndup(text + off, n);
+        long long   out;
+        if (!chunk || vault_appendToFile(v, "log", chunk, &out) != 0)
+            die("vault_appendToFile");
+        free(chunk);
+        appended += out;
+    }
+    double appendMs = nowMs() - t0;
+
+    char        path[1024];
+    struct stat st;
+    storePath(path, sizeof(path), dir, "log");
+    if (stat(path, &st) != 0) die(path);
+
+    long long read = 0;
+    t0 = nowMs();
+    if (vault_readFile(v, "log", countChunk, &read) != 0 || read != appended)
+        die("vault_readFile");
+    double readMs = nowMs() - t0;
+
+    unsigned seed = 3;
+    t0 = nowMs();
+    for (int r = 0; r < RANGE_READS; r++) {
+        long long off = (long long)(((uint64_t)rand_r(&seed) << 16 ^ (uint64_t)rand_r(&seed)) %
+                                    (uint64_t)(appended - RANGE_LEN));
+        long long got = 0;
+        if (vault_readRange(v, "log", off, RANGE_LEN, countChunk, &got) != 0 ||
+            got != RANGE_LEN)
+            die("vault_readRange");
+    }
+    double rangeUs = (nowMs() - t0) * 1e3 / RANGE_READS;
+
+    double mib = (double)appended / (1 << 20);
+    printf("vault  %-4s %5zu B appends  %6.1f MiB -> %6.1f MiB on disk (%4.2fx)  "
+           "append %6.1f MiB/s  read %6.1f MiB/s  4K range %6.1f us\n",
+           compress ? "on" : "off", appendSize, mib, (double)st.st_size / (1 << 20),
+           (double)appended / (double)st.st_size, mib / (appendMs / 1e3),
+           mib / (readMs / 1e3), rangeUs);
+    model_close(v);
+}
+
+int main(int argc, char **argv) {
+    long        mib = argc > 1 ? atol(argv[1]) : 64;
+    const char *dir = argc > 2 ? argv[2] : "/tmp/fv-compress";
+    if (mib < 1) {
+        fprintf(stderr, "usage: %s [MiB] [dir]\n", argv[0]);
+        return 1;
+    }
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) die(dir);
+
+    size_t total = (size_t)mib << 20;
+    benchCodec("log", 0, total);
+    benchCodec("words", 1, total);
+    benchCodec("random", 2, total);
+
+    char *text = (char *)malloc(total);
+    if (!text) die("malloc");
+    fill(text, total, 0, 11);
+    for (int c = 0; c <= 1; c++) benchVault(dir, text, total, 4096, c);
+    for (int c = 0; c <= 1; c++) benchVault(dir, text, total / 8, 128, c);
+
+    clearDir(dir);
+    free(text);
+    return 0;
+}
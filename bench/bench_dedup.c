@@ -0,0 +1,235 @@
+// bench_dedup.c - shared chunks: dedup ratio, ingest and read speed
+//
+// build: make bench
+// usage: ./bench_dedup [files] [MiB per file] [dir]   (default 32 4 /tmp/fv-dedup)
+//
+// First the chunker alone (cdc.h): cut speed and the chunk sizes it
+// makes. Then a vault is filled with files that are near-copies of one
+// template of log lines, as with rotated logs or exported reports: each
+// file inserts a few lines of its own, every 512 KiB or so, and drops a
+// few others. Files are appended in 1 MiB pieces, once in 64 KiB ones.
+// For each mode (plain, compressed, deduplicated, both) the bench
+// reports ingest speed, bytes on disk (the files plus vault.chunks and
+// its log), the ratio of logical to on-disk bytes, and a full read of
+// every file.
+
+#include "cdc.h"
+#include "fanout.h"
+#include "kdf.h"
+#include "model.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EDIT_EVERY (512 * 1024)
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+/* empties dir, vault.store and all */
+static void clearDir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    char path[1024];
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (unlink(path) != 0 && errno == EISDIR) {
+            clearDir(path);
+            rmdir(path);
+        }
+    }
+    closedir(d);
+}
+
+/* file data on disk: the store (store = 1 inside it) and the chunks,
+ * none of the vault's own bookkeeping */
+static long long dataBytes(const char *dir, int store) {
+    DIR *d = opendir(dir);
+    if (!d) die(dir);
+    struct dirent *e;
+    struct stat    st;
+    char           path[1024];
+    long long      total = 0;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (store || strcmp(e->d_name, FANOUT_ROOT) == 0) {
+            if (stat(path, &st) == 0)
+                total += S_ISDIR(st.st_mode) ? dataBytes(path, 1) : (long long)st.st_size;
+        } else if (strncmp(e->d_name, "vault.chunks", 12) == 0 && stat(path, &st) == 0) {
+            total += (long long)st.st_size;
+        }
+    }
+    closedir(d);
+    return total;
+}
+
+static size_t logLine(char *out, unsigned *seed) {
+    return (size_t)sprintf(out,
+                           "2026-10-17T12:%02d:%02dZ worker-%02d request id=%08x "
+                           "status=%d ms=%d\n",
+                           rand_r(seed) % 60, rand_r(seed) % 60, rand_r(seed) % 32,
+                           (unsigned)rand_r(seed), rand_r(seed) % 50 ? 200 : 500,
+                           rand_r(seed) % 300);
+}
+
+/* the template with file's edits: a line of its own about every
+ * EDIT_EVERY bytes, and as often a template line left out */
+static size_t makeFile(const char *base, size_t baseLen, int file, char *out) {
+    unsigned seed = 1000u + (unsigned)file;
+    size_t   n = 0, i = 0;
+    while (i < baseLen) {
+        const char *nl  = memchr(base + i, '\n', baseLen - i);
+        size_t      len = nl ? (size_t)(nl - (base + i)) + 1 : baseLen - i;
+        int         r   = rand_r(&seed) % (EDIT_EVERY / 80);
+        if (r == 0) {
+            n += (size_t)sprintf(out + n, "file-%d edit %08x\n", file, (unsigned)rand_r(&seed));
+        }
+        if (r != 1) {
+            memcpy(out + n, base + i, len);
+            n += len;
+        }
+        i += len;
+    }
+    return n;
+}
+
+typedef struct {
+    const char *data;
+    size_t      left;
+    size_t      piece;
+} Source;
+
+static long sourceNext(void *ctx, const char **data) {
+    Source *s = (Source *)ctx;
+    size_t  n = s->left < s->piece ? s->left : s->piece;
+    *data    = s->data;
+    s->data += n;
+    s->left -= n;
+    return (long)n;
+}
+
+static int countChunk(void *ctx, const char *data, size_t len) {
+    (void)data;
+    *(long long *)ctx += (long long)len;
+    return 0;
+}
+
+static void benchCut(const char *data, size_t len) {
+    long   chunks = 0;
+    size_t min = (size_t)-1, max = 0;
+    double t0 = nowMs();
+    for (size_t at = 0; at < len; chunks++) {
+        size_t n = cdc_cut(data + at, len - at);
+        if (at + n < len) {   /* the last one is whatever is left */
+            if (n < min) min = n;
+            if (n > max) max = n;
+        }
+        at += n;
+    }
+    double ms = nowMs() - t0;
+    printf("cdc_cut: %.0f MiB/s, %ld chunks, average %.0f bytes (%zu..%zu)\n",
+           (double)len / (1 << 20) / (ms / 1e3), chunks, (double)len / (double)chunks,
+           min, max);
+}
+
+static void bench(const char *dir, char **files, const size_t *lens, int count,
+                  size_t piece, int compress, int dedup) {
+    clearDir(dir);
+    VaultCtx *v = model_open(dir);
+    if (!v) die("model_open");
+    vault_setKdfCost(v, KDF_MIN_COST);
+    vault_setSyncPolicy(v, MODEL_SYNC_NONE, 0, 0);
+    vault_setCompression(v, compress);
+    vault_setDedup(v, dedup);
+
+    char      name[32];
+    long long logical = 0;
+    double    t0      = nowMs();
+    for (int f = 0; f < count; f++) {
+        snprintf(name, sizeof(name), "f%03d", f);
+        if (vault_addFile(v, name, "pw") != 0) die("vault_addFile");
+        Source    src = { files[f], lens[f], piece };
+        long long got;
+        if (vault_appendStream(v, name, sourceNext, &src, &got) != 0)
+            die("vault_appendStream");
+        logical += got;
+    }
+    double ingestMs = nowMs() - t0;
+    long long disk  = dataBytes(dir, 0);
+
+    long long read = 0;
+    t0 = nowMs();
+    for (int f = 0; f < count; f++) {
+        snprintf(name, sizeof(name), "f%03d", f);
+        if (vault_readFile(v, name, countChunk, &read) != 0) die("vault_readFile");
+    }
+    double readMs = nowMs() - t0;
+    model_close(v);
+    if (read != logical) {
+        fprintf(stderr, "read %lld of %lld bytes\n", read, logical);
+        exit(1);
+    }
+
+    printf("%-14s %4zu KiB appends: ingest %6.1f MiB/s  on disk %7.1f of %6.1f MiB "
+           "(%5.2fx)  read %6.1f MiB/s\n",
+           dedup ? (compress ? "dedup+compress" : "dedup") : (compress ? "compress" : "plain"),
+           piece >> 10, (double)logical / (1 << 20) / (ingestMs / 1e3),
+           (double)disk / (1 << 20), (double)logical / (1 << 20),
+           (double)logical / (double)disk, (double)read / (1 << 20) / (readMs / 1e3));
+}
+
+int main(int argc, char **argv) {
+    int         count = argc > 1 ? atoi(argv[1]) : 32;
+    long        mib   = argc > 2 ? atol(argv[2]) : 4;
+    const char *dir   = argc > 3 ? argv[3] : "/tmp/fv-dedup";
+    if (count < 1 || count > 999 || mib < 1) {
+        fprintf(stderr, "usage: %s [files] [MiB per file] [dir]\n", argv[0]);
+        return 1;
+    }
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) die(dir);
+
+    size_t   baseLen = 0, cap = (size_t)mib << 20;
+    char    *base    = (char *)malloc(cap + 256);
+    unsigned seed    = 11;
+    if (!base) die("malloc");
+    while (baseLen < cap) baseLen += logLine(base + baseLen, &seed);
+
+    char  **files = (char **)malloc(sizeof(char *) * (size_t)count);
+    size_t *lens  = (size_t *)malloc(sizeof(size_t) * (size_t)count);
+    if (!files || !lens) die("malloc");
+    for (int f = 0; f < count; f++) {
+        files[f] = (char *)malloc(baseLen * 2);
+        if (!files[f]) die("malloc");
+        lens[f] = makeFile(base, baseLen, f, files[f]);
+    }
+
+    benchCut(base, baseLen);
+    bench(dir, files, lens, count, 1 << 20, 0, 0);
+    bench(dir, files, lens, count, 1 << 20, 1, 0);
+    bench(dir, files, lens, count, 1 << 20, 0, 1);
+    bench(dir, files, lens, count, 1 << 20, 1, 1);
+    bench(dir, files, lens, count, 64 << 10, 0, 1);
+    clearDir(dir);
+
+    for (int f = 0; f < count; f++) free(files[f]);
+    free(files);
+    free(lens);
+    free(base);
+    return 0;
+}
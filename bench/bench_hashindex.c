@@ -0,0 +1,115 @@
+// bench_hashindex.c - lookup latency of the vault filename index
+//
+// build: cc -O2 -Isrc bench/bench_hashindex.c src/hashindex.c -o bench_hashindex
+// usage: ./bench_hashindex            (1k, 100k and 1M entries)
+
+#include "hashindex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NAME_LEN 32
+
+static char *names;   /* n fixed-width keys, "file%07d.txt" */
+
+static const char *keyAt(void *ctx, int id) {
+    (void)ctx;
+    return names + (size_t)id * NAME_LEN;
+}
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static unsigned long long rngState = 88172645463325252ULL;
+
+static unsigned long long nextRand(void) {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return rngState;
+}
+
+/* the findFileIndex this index replaced */
+static int linearFind(int n, const char *key) {
+    for (int i = 0; i < n; i++) {
+        if (strcmp(names + (size_t)i * NAME_LEN, key) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void runSize(int n) {
+    names = (char *)malloc((size_t)n * NAME_LEN);
+    if (!names) {
+        fprintf(stderr, "out of memory at n=%d\n", n);
+        exit(1);
+    }
+    for (int i = 0; i < n; i++)
+        snprintf(names + (size_t)i * NAME_LEN, NAME_LEN, "file%07d.txt", i);
+
+    HashIndex hi;
+    hashindex_init(&hi, 0, keyAt, NULL);   /* grow incrementally, as adds do */
+
+    double t0 = nowNs();
+    for (int i = 0; i < n; i++) {
+        const char *k = keyAt(NULL, i);
+        hashindex_insert(&hi, k, hashindex_hash(k), i);
+    }
+    double insertNs = (nowNs() - t0) / n;
+
+    const int lookups = 1000000;
+    int *probe = (int *)malloc(sizeof(int) * lookups);
+    for (int i = 0; i < lookups; i++)
+        probe[i] = (int)(nextRand() % (unsigned long long)n);
+
+    long found = 0;
+    t0 = nowNs();
+    for (int i = 0; i < lookups; i++) {
+        const char *k = keyAt(NULL, probe[i]);
+        found += hashindex_find(&hi, k, hashindex_hash(k)) >= 0;
+    }
+    double hitNs = (nowNs() - t0) / lookups;
+
+    char miss[NAME_LEN];
+    t0 = nowNs();
+    for (int i = 0; i < lookups; i++) {
+        snprintf(miss, sizeof(miss), "nofile%07d", probe[i]);
+        found += hashindex_find(&hi, miss, hashindex_hash(miss)) >= 0;
+    }
+    double missNs = (nowNs() - t0) / lookups;
+
+    /* the linear scan is O(n), so sample fewer lookups as n grows */
+    int linLookups = n >= 1000000 ? 20 : (n >= 100000 ? 200 : 20000);
+    t0 = nowNs();
+    for (int i = 0; i < linLookups; i++)
+        found += linearFind(n, keyAt(NULL, probe[i])) >= 0;
+    double linearNs = (nowNs() - t0) / linLookups;
+
+    t0 = nowNs();
+    for (int i = 0; i < n; i++) {
+        const char *k = keyAt(NULL, i);
+        hashindex_remove(&hi, k, hashindex_hash(k));
+    }
+    double removeNs = (nowNs() - t0) / n;
+
+    printf("%9d  %10.1f  %10.1f  %10.1f  %10.1f  %14.1f   (%ld)\n",
+           n, insertNs, hitNs, missNs, removeNs, linearNs, found);
+
+    hashindex_free(&hi);
+    free(probe);
+    free(names);
+}
+
+int main(void) {
+    printf("%9s  %10s  %10s  %10s  %10s  %14s\n",
+           "entries", "insert ns", "hit ns", "miss ns", "remove ns",
+           "linear hit ns");
+    runSize(1000);
+    runSize(100000);
+    runSize(1000000);
+    return 0;
+}
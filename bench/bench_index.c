@@ -0,0 +1,104 @@
+// bench_index.c - vault open time and lookups over the mapped vault.idx
+//
+// build: make bench
+// usage: ./bench_index [dir]      (default /tmp/fv-index)
+//
+// For each vault size a vault.txt is written and opened twice: the first
+// open imports it into vault.idx, the second only maps vault.idx. Then
+// fileExists is timed over random names, first right after the open
+// (no page of the mapping touched yet) and again warm.
+
+#include "kdf.h"
+#include "model.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOOKUPS 100000
+
+static double nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static void prefill(const char *dir, long entries, const char *secret) {
+    static const char *state[] = { "vault.idx", "vault.txt.imported",
+                                   "vault.journal", "vault.journal.old",
+                                   "vault.undo", "vault.redo", "vault.recent",
+                                   "vault.search", "vault.search.log" };
+    char path[512];
+    for (size_t k = 0; k < sizeof(state) / sizeof(state[0]); k++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, state[k]);
+        unlink(path);
+    }
+
+    snprintf(path, sizeof(path), "%s/vault.txt", dir);
+    FILE *fp = fopen(path, "w");
+    if (!fp) die(path);
+    for (long i = 0; i < entries; i++)
+        fprintf(fp, "file-%08ld %s\n", i, secret);
+    if (fclose(fp) != 0) die(path);
+}
+
+/* mean ns per vault_fileExists over LOOKUPS random present names */
+static double lookupNs(VaultCtx *v, long entries, unsigned *seed) {
+    char   name[32];
+    int    found = 0;
+    double t0    = nowUs();
+    for (int i = 0; i < LOOKUPS; i++) {
+        snprintf(name, sizeof(name), "file-%08ld", (long)(rand_r(seed) % entries));
+        found += vault_fileExists(v, name);
+    }
+    double ns = (nowUs() - t0) * 1e3 / LOOKUPS;
+    if (found != LOOKUPS) {
+        fprintf(stderr, "lookup missed %d names\n", LOOKUPS - found);
+        exit(1);
+    }
+    return ns;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc > 1 ? argv[1] : "/tmp/fv-index";
+    static const long sizes[] = { 1000, 10000, 100000, 1000000 };
+    static const unsigned char key[KDF_KEY_LEN];
+    char secret[KDF_ENCODED_MAX];
+
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) die(dir);
+    if (kdf_hashKey("pw", 1000, key, secret) != 0) die("kdf_hashKey");
+
+    printf("%9s  %12s  %12s  %14s  %14s\n", "entries", "import ms",
+           "open us", "exists ns cold", "exists ns warm");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        unsigned seed = 1;
+        prefill(dir, sizes[s], secret);
+
+        double    t0 = nowUs();
+        VaultCtx *v  = model_open(dir);
+        double    importMs = (nowUs() - t0) / 1e3;
+        if (!v) die("model_open");
+        model_close(v);
+
+        t0 = nowUs();
+        v  = model_open(dir);
+        double openUs = nowUs() - t0;
+        if (!v) die("model_open");
+
+        double cold = lookupNs(v, sizes[s], &seed);
+        double warm = lookupNs(v, sizes[s], &seed);
+        model_close(v);
+
+        printf("%9ld  %12.1f  %12.1f  %14.1f  %14.1f\n", sizes[s], importMs,
+               openUs, cold, warm);
+    }
+    return 0;
+}
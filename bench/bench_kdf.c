@@ -0,0 +1,81 @@
+// bench_kdf.c - password verification cost vs KDF iterations, with and
+// without the session cache
+//
+// build: cc -O2 -Isrc bench/bench_kdf.c src/model.c src/kdf.c src/vtable.c src/arena.c src/hashindex.c src/journal.c src/undolog.c -o bench_kdf -pthread
+// usage: ./bench_kdf [dir]   (default /tmp/fv-kdf)
+//
+// For each cost: time one uncached verification, one cached verification,
+// then 2000 verifications spread over 32 files and report the hit rate.
+
+#include "model.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define FILES    32
+#define REQUESTS 2000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    const char *root = argc > 1 ? argv[1] : "/tmp/fv-kdf";
+    static const unsigned costs[] = { 1000, 10000, 100000, 300000 };
+    mkdir(root, 0700);
+
+    printf("%8s  %12s  %12s  %12s  %12s  %9s\n", "cost", "add ms",
+           "miss ms", "hit us", "mixed us/op", "hit rate");
+
+    for (size_t c = 0; c < sizeof(costs) / sizeof(costs[0]); c++) {
+        char dir[512], name[64];
+        snprintf(dir, sizeof(dir), "%s/cost-%u", root, costs[c]);
+        VaultCtx *v = model_open(dir);
+        if (!v) {
+            perror(dir);
+            return 1;
+        }
+        vault_setSyncPolicy(v, MODEL_SYNC_NONE, 0, 0);
+        vault_setKdfCost(v, costs[c]);
+
+        double t0 = now();
+        for (int f = 0; f < FILES; f++) {
+            snprintf(name, sizeof(name), "f%02d.txt", f);
+            vault_addFile(v, name, "correct horse");
+        }
+        double addMs = (now() - t0) * 1e3 / FILES;
+
+        /* fresh vault: the first check of f00 is a miss, the second a hit */
+        VaultCtx *w = model_open(dir);
+        t0 = now();
+        vault_verifyPassword(w, "f00.txt", "correct horse");
+        double missMs = (now() - t0) * 1e3;
+        t0 = now();
+        for (int i = 0; i < 1000; i++)
+            vault_verifyPassword(w, "f00.txt", "correct horse");
+        double hitUs = (now() - t0) * 1e6 / 1000;
+        model_close(w);
+
+        /* a session touching FILES files REQUESTS times */
+        w = model_open(dir);
+        unsigned seed = 1;
+        t0 = now();
+        for (int i = 0; i < REQUESTS; i++) {
+            seed = seed * 1103515245u + 12345u;
+            snprintf(name, sizeof(name), "f%02u.txt", (seed >> 16) % FILES);
+            vault_verifyPassword(w, name, "correct horse");
+        }
+        double mixedUs = (now() - t0) * 1e6 / REQUESTS;
+        long hits, misses;
+        vault_getSessionStats(w, &hits, &misses);
+        model_close(w);
+        model_close(v);
+
+        printf("%8u  %12.2f  %12.2f  %12.2f  %12.1f  %8.1f%%\n", costs[c],
+               addMs, missMs, hitUs, mixedUs, 100.0 * hits / (hits + misses));
+    }
+    return 0;
+}
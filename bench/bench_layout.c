@@ -0,0 +1,124 @@
+// bench_layout.c - flat directory against the hashed fan-out tree
+//
+// build: make bench
+// usage: ./bench_layout [files] [opens] [dir]   (default 1000000 200000 /tmp/fv-layout)
+//
+// Creates files empty files the way vault_addFile does, first all in one
+// directory under their own names (the layout before vault.store), then
+// in the a/b/<id> tree of fanout.h, with the name hashed on every
+// call as the model does. Creation is timed per tenth of the run, to
+// show how it holds up as the directory fills. Then opens random
+// existing files, the first step of every read and append, reporting
+// the mean and the 99th percentile. The directory cache stays warm:
+// this is the cost of the layouts themselves, not of the disk.
+
+#define _GNU_SOURCE   /* nftw */
+#include "fanout.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SLICES 10
+
+static double nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static int removeOne(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+static void clearTree(const char *dir) {
+    nftw(dir, removeOne, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+static int cmpDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int openNamed(int dirFd, int fanned, const char *name, int flags) {
+    if (!fanned) return openat(dirFd, name, flags, 0644);
+    char path[FANOUT_PATH_LEN];
+    fanout_path(name, path);
+    return fanout_open(dirFd, path, flags, 0644);
+}
+
+static void bench(const char *dir, int fanned, long files, long opens) {
+    clearTree(dir);
+    if (mkdir(dir, 0700) != 0) die(dir);
+    int dirFd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) die(dir);
+
+    const char *label = fanned ? "fan-out" : "flat   ";
+    char        name[32];
+    double      slice[SLICES];
+    long        per = files / SLICES;
+    double      t0  = nowUs();
+    for (long i = 0; i < files; i++) {
+        snprintf(name, sizeof(name), "report-%07ld.log", i);
+        int fd = openNamed(dirFd, fanned, name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC);
+        if (fd < 0) die(name);
+        close(fd);
+        if ((i + 1) % per == 0 && (i + 1) / per <= SLICES) {
+            double t1 = nowUs();
+            slice[(i + 1) / per - 1] = (t1 - t0) / (double)per;
+            t0 = t1;
+        }
+    }
+    printf("%s create us/file by tenth:", label);
+    for (int s = 0; s < SLICES; s++) printf(" %.2f", slice[s]);
+    printf("\n");
+
+    double  *lat  = (double *)malloc(sizeof(double) * (size_t)opens);
+    unsigned seed = 11;
+    double   sum  = 0;
+    if (!lat) die("malloc");
+    for (long i = 0; i < opens; i++) {
+        long pick = (long)(((unsigned long)rand_r(&seed) << 16 ^ (unsigned long)rand_r(&seed)) %
+                           (unsigned long)files);
+        snprintf(name, sizeof(name), "report-%07ld.log", pick);
+        double t = nowUs();
+        int    fd = openNamed(dirFd, fanned, name, O_RDONLY | O_CLOEXEC);
+        lat[i] = nowUs() - t;
+        if (fd < 0) die(name);
+        close(fd);
+        sum += lat[i];
+    }
+    qsort(lat, (size_t)opens, sizeof(double), cmpDouble);
+    printf("%s open   %.2f us mean, %.2f us p99 (%ld files)\n", label, sum / (double)opens,
+           lat[opens * 99 / 100], files);
+    free(lat);
+    close(dirFd);
+    clearTree(dir);
+}
+
+int main(int argc, char **argv) {
+    long        files = argc > 1 ? atol(argv[1]) : 1000000;
+    long        opens = argc > 2 ? atol(argv[2]) : 200000;
+    const char *dir   = argc > 3 ? argv[3] : "/tmp/fv-layout";
+    if (files < SLICES || opens < 1) {
+        fprintf(stderr, "usage: %s [files] [opens] [dir]\n", argv[0]);
+        return 1;
+    }
+    bench(dir, 0, files, opens);
+    bench(dir, 1, files, opens);
+    return 0;
+}
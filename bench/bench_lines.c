@@ -0,0 +1,168 @@
+// bench_lines.c - line index: tail, line ranges and byte ranges
+//
+// build: make bench
+// usage: ./bench_lines [MiB] [dir]   (default 256 /tmp/fv-lines)
+//
+// Fills one vault file with MiB of log lines in 64 KiB appends, with
+// compression off and on. Then times, per lookup: the last 10 lines,
+// 100 lines at a random line number, and 4 KiB at a random byte offset,
+// each as find + read. The same file is then reopened, to time the first
+// line lookup that must build the index from scratch, and for reference
+// a full read, which is what any of these cost before.
+
+#include "kdf.h"
+#include "model.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define APPEND_SIZE (64 * 1024)
+#define LOOKUPS     500
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+/* empties dir, vault.store and all */
+static void clearDir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    char path[1024];
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (unlink(path) != 0 && errno == EISDIR) {
+            clearDir(path);
+            rmdir(path);
+        }
+    }
+    closedir(d);
+}
+
+/* a block of whole log lines, about APPEND_SIZE bytes; returns lines */
+static long fillLines(char *buf, size_t *len, long first, unsigned *seed) {
+    size_t n = 0;
+    long   k = first;
+    while (n + 200 < APPEND_SIZE) {
+        n += (size_t)sprintf(buf + n,
+                             "%ld 2026-10-17T12:00:00Z worker-%02d request id=%08x "
+                             "status=%d ms=%d\n",
+                             k++, rand_r(seed) % 32, (unsigned)rand_r(seed),
+                             rand_r(seed) % 50 ? 200 : 500, rand_r(seed) % 300);
+    }
+    *len = n;
+    return k - first;
+}
+
+static int countChunk(void *ctx, const char *data, size_t len) {
+    (void)data;
+    *(long long *)ctx += (long long)len;
+    return 0;
+}
+
+static long long readSpan(VaultCtx *v, long long offset, long long length) {
+    long long got = 0;
+    if (vault_readRange(v, "log", offset, length, countChunk, &got) < 0)
+        die("vault_readRange");
+    return got;
+}
+
+static VaultCtx *openVault(const char *dir, int compress) {
+    VaultCtx *v = model_open(dir);
+    if (!v) die("model_open");
+    vault_setKdfCost(v, KDF_MIN_COST);
+    vault_setSyncPolicy(v, MODEL_SYNC_NONE, 0, 0);
+    vault_setCompression(v, compress);
+    return v;
+}
+
+static void bench(const char *dir, long mib, int compress) {
+    clearDir(dir);
+    VaultCtx *v = openVault(dir, compress);
+    if (vault_addFile(v, "log", "pw") != 0) die("vault_addFile");
+
+    char    *buf   = (char *)malloc(APPEND_SIZE + 1);
+    unsigned seed  = 5;
+    long     lines = 0;
+    if (!buf) die("malloc");
+    for (long long bytes = 0; bytes < (long long)mib << 20; ) {
+        size_t len;
+        lines += fillLines(buf, &len, lines, &seed);
+        buf[len] = '\0';
+        long long out;
+        if (vault_appendToFile(v, "log", buf, &out) != 0) die("vault_appendToFile");
+        bytes += out;
+    }
+    free(buf);
+
+    long long offset, length, size = vault_getFileSize(v, "log");
+    double    t0 = nowMs();
+    for (int i = 0; i < LOOKUPS; i++) {
+        if (vault_findTail(v, "log", 10, &offset, &length) != 0) die("vault_findTail");
+        readSpan(v, offset, length);
+    }
+    double tailUs = (nowMs() - t0) * 1e3 / LOOKUPS;
+
+    t0 = nowMs();
+    for (int i = 0; i < LOOKUPS; i++) {
+        long long first = 1 + rand_r(&seed) % lines;
+        if (vault_findLines(v, "log", first, 100, &offset, &length) != 0)
+            die("vault_findLines");
+        readSpan(v, offset, length);
+    }
+    double linesUs = (nowMs() - t0) * 1e3 / LOOKUPS;
+
+    t0 = nowMs();
+    for (int i = 0; i < LOOKUPS; i++)
+        readSpan(v, ((long long)rand_r(&seed) << 16 ^ rand_r(&seed)) % size, 4096);
+    double bytesUs = (nowMs() - t0) * 1e3 / LOOKUPS;
+    model_close(v);
+
+    /* cold: a fresh handle has no block map and no marks */
+    v = openVault(dir, compress);
+    if (vault_verifyPassword(v, "log", "pw") != 1) die("vault_verifyPassword");
+    t0 = nowMs();
+    if (vault_findLines(v, "log", lines - 100, 100, &offset, &length) != 0)
+        die("vault_findLines");
+    readSpan(v, offset, length);
+    double coldMs = nowMs() - t0;
+
+    long long read = 0;
+    t0 = nowMs();
+    if (vault_readFile(v, "log", countChunk, &read) != 0 || read != size)
+        die("vault_readFile");
+    double fullMs = nowMs() - t0;
+    model_close(v);
+
+    printf("compress %-3s %ld MiB, %ld lines: tail 10 %7.1f us  lines 100 %7.1f us  "
+           "bytes 4K %7.1f us  first lookup %7.1f ms  full read %7.1f ms\n",
+           compress ? "on" : "off", mib, lines, tailUs, linesUs, bytesUs, coldMs, fullMs);
+}
+
+int main(int argc, char **argv) {
+    long        mib = argc > 1 ? atol(argv[1]) : 256;
+    const char *dir = argc > 2 ? argv[2] : "/tmp/fv-lines";
+    if (mib < 1) {
+        fprintf(stderr, "usage: %s [MiB] [dir]\n", argv[0]);
+        return 1;
+    }
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) die(dir);
+
+    bench(dir, mib, 0);
+    bench(dir, mib, 1);
+    clearDir(dir);
+    return 0;
+}
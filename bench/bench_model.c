@@ -0,0 +1,356 @@
+// bench_model.c - latency of every model_* operation across vault and
+// file sizes, reported as percentiles in CSV or JSON
+//
+// build: make bench        (or: cc -O2 -Isrc bench/bench_model.c src/model.c
+//           src/kdf.c src/cipher.c src/lru.c src/undolog.c src/journal.c
+//           src/vindex.c src/vtable.c src/arena.c src/hashindex.c src/stats.c
+//           src/search.c -o bench_model -pthread)
+// usage: ./bench_model [--json] [--quick] [--stats] [--reps N] [--warmup N]
+//                      [--kdf-cost N] [--sync none|always|group] [--dir D]
+//
+// Each vault size gets a fresh directory whose vault.txt is pre-filled
+// with that many entries (all sharing one precomputed hash, so setup does
+// not pay the KDF per entry) and imported into vault.idx on open. Every operation is run `warmup` times
+// untimed, then `reps` times timed one call at a time. --stats turns on
+// the built-in histograms (stats.h) to measure their overhead.
+
+#include "kdf.h"
+#include "model.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_SIZES      8
+#define CONTENT_BUDGET (256L * 1024 * 1024)   /* bytes read per cell, at most */
+#define APPEND_TEXT    "0123456789abcdef0123456789abcdef0123456789abcdef012345678901234\n"
+
+typedef struct {
+    int        json;
+    int        reps;
+    int        warmup;
+    uint32_t   kdfCost;
+    int        syncMode;      /* -1 = model default */
+    const char *dir;
+    long       vaultSizes[MAX_SIZES];
+    int        nVault;
+    long       fileSizes[MAX_SIZES];
+    int        nFile;
+} Options;
+
+static Options opt = {
+    .reps = 200, .warmup = 20, .kdfCost = 1000, .syncMode = -1,
+    .dir = "/tmp/fv-bench-model",
+    .vaultSizes = { 1000, 10000, 100000 }, .nVault = 3,
+    .fileSizes  = { 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 }, .nFile = 4,
+};
+
+static int firstRow = 1;
+
+/* ---------- helper: timing ---------- */
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int cmpDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double pct(const double *sorted, int n, double p) {
+    int i = (int)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+/* sorts ns[] and prints one row */
+static void report(const char *op, long vaultSize, long fileSize,
+                   double *ns, int n) {
+    if (n <= 0) return;
+    qsort(ns, (size_t)n, sizeof(double), cmpDouble);
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += ns[i];
+
+    double v[6] = { ns[0], pct(ns, n, 0.50), pct(ns, n, 0.90),
+                    pct(ns, n, 0.99), ns[n - 1], sum / n };
+    for (int i = 0; i < 6; i++) v[i] /= 1e3;   /* microseconds */
+
+    if (opt.json) {
+        printf("%s  {\"op\": \"%s\", \"vault_size\": %ld, \"file_size\": %ld, "
+               "\"reps\": %d, \"min_us\": %.3f, \"p50_us\": %.3f, "
+               "\"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f, "
+               "\"mean_us\": %.3f}",
+               firstRow ? "" : ",\n", op, vaultSize, fileSize, n,
+               v[0], v[1], v[2], v[3], v[4], v[5]);
+    } else {
+        printf("%s,%ld,%ld,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+               op, vaultSize, fileSize, n, v[0], v[1], v[2], v[3], v[4], v[5]);
+    }
+    firstRow = 0;
+    fflush(stdout);
+}
+
+/* ---------- helper: setup ---------- */
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static void prefillVault(long entries) {
+    static const unsigned char key[KDF_KEY_LEN];
+    char hashed[KDF_ENCODED_MAX];
+    if (kdf_hashKey("pw", opt.kdfCost, key, hashed) != 0) die("kdf_hashKey");
+
+    FILE *fp = fopen("vault.txt", "w");
+    if (!fp) die("vault.txt");
+    for (long i = 0; i < entries; i++)
+        fprintf(fp, "pre-%08ld %s\n", i, hashed);
+    if (fclose(fp) != 0) die("vault.txt");
+}
+
+/* a registered file of exactly size bytes of plaintext */
+static void makeFile(const char *name, long size) {
+    int rc = model_addFile(name, "pw");
+    if (rc != 0 && rc != -2) die("model_addFile");
+    if (model_verifyPassword(name, "pw") != 1) die("model_verifyPassword");
+    if (model_getFileSize(name) == size) return;
+
+    static char block[64 * 1024 + 1];
+    memset(block, 'x', sizeof(block) - 1);
+    for (long left = size; left > 0; ) {
+        long n = left < (long)sizeof(block) - 1 ? left : (long)sizeof(block) - 1;
+        long long appended;
+        block[n] = '\0';
+        if (model_appendToFile(name, block, &appended) != 0) die(name);
+        block[n] = 'x';
+        left -= n;
+    }
+}
+
+/* ---------- benchmarks ---------- */
+
+static void benchTable(long vaultSize, double *ns) {
+    char name[64];
+    int  total = opt.warmup + opt.reps;
+
+    /* add: new names into a table of vaultSize entries */
+    for (int i = 0; i < total; i++) {
+        snprintf(name, sizeof(name), "new-%08d", i);
+        double t0 = nowNs();
+        model_addFile(name, "pw");
+        if (i >= opt.warmup) ns[i - opt.warmup] = nowNs() - t0;
+    }
+    report("addFile", vaultSize, 0, ns, opt.reps);
+
+    /* verify, first time per name: pays the KDF */
+    for (int i = 0; i < total; i++) {
+        snprintf(name, sizeof(name), "pre-%08ld", (long)i % vaultSize);
+        double t0 = nowNs();
+        model_verifyPassword(name, "pw");
+        if (i >= opt.warmup) ns[i - opt.warmup] = nowNs() - t0;
+    }
+    report("verifyPassword_miss", vaultSize, 0, ns, opt.reps);
+
+    /* verify again: answered by the session cache */
+    for (int i = 0; i < total; i++) {
+        snprintf(name, sizeof(name), "pre-%08ld", (long)i % vaultSize);
+        double t0 = nowNs();
+        model_verifyPassword(name, "pw");
+        if (i >= opt.warmup) ns[i - opt.warmup] = nowNs() - t0;
+    }
+    report("verifyPassword_hit", vaultSize, 0, ns, opt.reps);
+
+    for (int i = 0; i < total; i++) {
+        snprintf(name, sizeof(name), "pre-%08ld", (long)(i * 7919L) % vaultSize);
+        double t0 = nowNs();
+        model_fileExists(name);
+        if (i >= opt.warmup) ns[i - opt.warmup] = nowNs() - t0;
+    }
+    report("fileExists", vaultSize, 0, ns, opt.reps);
+
+    /* recent: touch names spread over twice the list capacity */
+    unsigned seed = 1;
+    for (int i = 0; i < total; i++) {
+        seed = seed * 1103515245u + 12345u;
+        snprintf(name, sizeof(name), "pre-%08ld",
+                 (long)((seed >> 8) % (2 * MODEL_RECENT_CAPACITY)) % vaultSize);
+        double t0 = nowNs();
+        model_recordRecent(name);
+        if (i >= opt.warmup) ns[i - opt.warmup] = nowNs() - t0;
+    }
+    report("recordRecent", vaultSize, 0, ns, opt.reps);
+
+    static char names[50][MAX_LEN];
+    for (int i = 0; i < total; i++) {
+        double t0 = nowNs();
+        model_getRecent(names, RECENT_MAX);
+        if (i >= opt.warmup) ns[i - opt.warmup] = nowNs() - t0;
+    }
+    report("getRecent_5", vaultSize, 0, ns, opt.reps);
+
+    for (int i = 0; i < total; i++) {
+        double t0 = nowNs();
+        model_getRecentPage(names, 100, 50);
+        if (i >= opt.warmup) ns[i - opt.warmup] = nowNs() - t0;
+    }
+    report("getRecentPage_50", vaultSize, 0, ns, opt.reps);
+}
+
+static void benchContent(long vaultSize, long fileSize, double *ns) {
+    char name[64];
+    snprintf(name, sizeof(name), "blob-%ld", fileSize);
+    makeFile(name, fileSize);
+
+    /* whole-file reads: cap the bytes moved per cell */
+    int reps = fileSize > 0 ? (int)(CONTENT_BUDGET / fileSize) : opt.reps;
+    if (reps < 5) reps = 5;
+    if (reps > opt.reps) reps = opt.reps;
+    int warm = opt.warmup < reps ? opt.warmup : reps;
+    for (int i = 0; i < warm + reps; i++) {
+        double t0 = nowNs();
+        char *buf = model_getFileContents(name);
+        if (i >= warm) ns[i - warm] = nowNs() - t0;
+        free(buf);
+    }
+    report("getFileContents", vaultSize, fileSize, ns, reps);
+
+    int       total = opt.warmup + opt.reps;
+    long long len;
+    for (int i = 0; i < total; i++) {
+        double t0 = nowNs();
+        model_appendToFile(name, APPEND_TEXT, &len);
+        if (i >= opt.warmup) ns[i - opt.warmup] = nowNs() - t0;
+    }
+    report("appendToFile", vaultSize, fileSize, ns, opt.reps);
+
+    /* undo: each rep appends (untimed) and undoes it (timed) */
+    for (int i = 0; i < total; i++) {
+        model_appendToFile(name, APPEND_TEXT, &len);
+        double t0 = nowNs();
+        model_undoLastAppend(NULL, 0);
+        if (i >= opt.warmup) ns[i - opt.warmup] = nowNs() - t0;
+    }
+    report("undoLastAppend", vaultSize, fileSize, ns, opt.reps);
+}
+
+/* ---------- main ---------- */
+
+/* "1000,64k,16m" */
+static int parseList(const char *s, long *out) {
+    int n = 0;
+    while (*s && n < MAX_SIZES) {
+        char *end;
+        long  v = strtol(s, &end, 10);
+        if (end == s) break;
+        if (*end == 'k' || *end == 'K') v <<= 10, end++;
+        else if (*end == 'm' || *end == 'M') v <<= 20, end++;
+        out[n++] = v;
+        s = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [--json] [--quick] [--stats] [--reps N] [--warmup N]\n"
+            "       [--kdf-cost N] [--sync none|always|group]\n"
+            "       [--vault-sizes a,b,..] [--file-sizes a,b,..] [--dir D]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--json") == 0) {
+            opt.json = 1;
+            continue;
+        }
+        if (strcmp(a, "--stats") == 0) {
+            stats_enable();
+            continue;
+        }
+        if (strcmp(a, "--quick") == 0) {
+            opt.reps   = 50;
+            opt.warmup = 5;
+            opt.nVault = parseList("1000,10000", opt.vaultSizes);
+            opt.nFile  = parseList("1k,1m", opt.fileSizes);
+            continue;
+        }
+
+        if (i + 1 >= argc) usage(argv[0]);
+        const char *val = argv[++i];
+        if (strcmp(a, "--reps") == 0) {
+            opt.reps = atoi(val);
+        } else if (strcmp(a, "--warmup") == 0) {
+            opt.warmup = atoi(val);
+        } else if (strcmp(a, "--kdf-cost") == 0) {
+            opt.kdfCost = (uint32_t)atol(val);
+        } else if (strcmp(a, "--sync") == 0) {
+            opt.syncMode = strcmp(val, "none") == 0   ? MODEL_SYNC_NONE :
+                           strcmp(val, "always") == 0 ? MODEL_SYNC_ALWAYS :
+                                                        MODEL_SYNC_GROUP;
+        } else if (strcmp(a, "--vault-sizes") == 0) {
+            opt.nVault = parseList(val, opt.vaultSizes);
+        } else if (strcmp(a, "--file-sizes") == 0) {
+            opt.nFile = parseList(val, opt.fileSizes);
+        } else if (strcmp(a, "--dir") == 0) {
+            opt.dir = val;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (opt.reps < 1) opt.reps = 1;
+    if (opt.warmup < 0) opt.warmup = 0;
+
+    double *ns = (double *)malloc(sizeof(double) * (size_t)opt.reps);
+    if (!ns) die("malloc");
+    if (mkdir(opt.dir, 0700) != 0 && errno != EEXIST) die(opt.dir);
+    if (chdir(opt.dir) != 0) die(opt.dir);
+
+    model_setKdfCost(opt.kdfCost);
+    if (opt.syncMode == MODEL_SYNC_ALWAYS)
+        model_setSyncPolicy(MODEL_SYNC_ALWAYS, 1, 0);
+    else if (opt.syncMode >= 0)
+        model_setSyncPolicy(opt.syncMode, 32, 50);
+
+    if (opt.json)
+        printf("[\n");
+    else
+        printf("op,vault_size,file_size,reps,min_us,p50_us,p90_us,p99_us,max_us,mean_us\n");
+
+    for (int v = 0; v < opt.nVault; v++) {
+        char sub[64];
+        snprintf(sub, sizeof(sub), "vault-%ld", opt.vaultSizes[v]);
+        if (mkdir(sub, 0700) != 0 && errno != EEXIST) die(sub);
+        if (chdir(sub) != 0) die(sub);
+
+        /* start from nothing but the pre-filled snapshot */
+        static const char *state[] = { "vault.idx", "vault.txt.imported",
+                                       "vault.journal", "vault.journal.old",
+                                       "vault.undo", "vault.redo", "vault.recent",
+                                       "vault.search", "vault.search.log" };
+        for (size_t k = 0; k < sizeof(state) / sizeof(state[0]); k++)
+            unlink(state[k]);
+        prefillVault(opt.vaultSizes[v]);
+
+        model_init();
+        benchTable(opt.vaultSizes[v], ns);
+        for (int f = 0; f < opt.nFile; f++)
+            benchContent(opt.vaultSizes[v], opt.fileSizes[f], ns);
+        model_shutdown();
+
+        if (chdir("..") != 0) die("..");
+    }
+
+    if (opt.json) printf("\n]\n");
+    free(ns);
+    return 0;
+}
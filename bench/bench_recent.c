@@ -0,0 +1,110 @@
+// bench_recent.c - recent-files touch cost: old queue rebuild vs LRU
+//
+// build: cc -O2 -Isrc bench/bench_recent.c src/lru.c src/hashindex.c -o bench_recent
+//
+// Touches names drawn from a working set twice the list capacity, so
+// about half the touches hit and half evict.
+
+#include "lru.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NAME_LEN 4096   /* MAX_LEN: the old queue stored names inline */
+
+/* the previous model_recordRecent: drain into a temp queue dropping the
+ * name, then copy the whole queue back */
+typedef struct {
+    char (*data)[NAME_LEN];
+    int front, rear, count, cap;
+} OldQueue;
+
+static void oldTouch(OldQueue *q, OldQueue *tmp, const char *name) {
+    tmp->front = 0;
+    tmp->rear  = -1;
+    tmp->count = 0;
+    while (q->count > 0) {
+        const char *cur = q->data[q->front];
+        q->front = (q->front + 1) % q->cap;
+        q->count--;
+        if (strcmp(cur, name) != 0) {
+            tmp->rear = (tmp->rear + 1) % tmp->cap;
+            strcpy(tmp->data[tmp->rear], cur);
+            tmp->count++;
+        }
+    }
+    if (tmp->count == tmp->cap) {
+        tmp->front = (tmp->front + 1) % tmp->cap;
+        tmp->count--;
+    }
+    tmp->rear = (tmp->rear + 1) % tmp->cap;
+    strcpy(tmp->data[tmp->rear], name);
+    tmp->count++;
+
+    /* recentQ = tempQ copied the full fixed-size struct */
+    memcpy(q->data, tmp->data, sizeof(*q->data) * (size_t)q->cap);
+    q->front = tmp->front;
+    q->rear  = tmp->rear;
+    q->count = tmp->count;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    static const int caps[] = { 5, 100, 1000, 10000, 100000 };
+
+    printf("%8s  %14s  %14s  %16s\n", "capacity", "queue ns/touch",
+           "lru ns/touch", "lru page(50) ns");
+
+    for (size_t c = 0; c < sizeof(caps) / sizeof(caps[0]); c++) {
+        int cap = caps[c], working = 2 * cap;
+        char (*names)[32] = malloc(sizeof(*names) * (size_t)working);
+        for (int i = 0; i < working; i++)
+            snprintf(names[i], sizeof(names[i]), "dir/file-%07d.txt", i);
+
+        unsigned seed = 1;
+        double   queueNs = -1;
+        if (cap <= 1000) {
+            OldQueue q = { malloc(sizeof(*q.data) * (size_t)cap), 0, -1, 0, cap };
+            OldQueue t = { malloc(sizeof(*t.data) * (size_t)cap), 0, -1, 0, cap };
+            int reps = cap <= 100 ? 20000 : 500;
+            double t0 = now();
+            for (int i = 0; i < reps; i++) {
+                seed = seed * 1103515245u + 12345u;
+                oldTouch(&q, &t, names[(seed >> 8) % (unsigned)working]);
+            }
+            queueNs = (now() - t0) * 1e9 / reps;
+            free(q.data);
+            free(t.data);
+        }
+
+        Lru l;
+        lru_init(&l, cap);
+        int reps = 1000000;
+        double t0 = now();
+        for (int i = 0; i < reps; i++) {
+            seed = seed * 1103515245u + 12345u;
+            lru_touch(&l, names[(seed >> 8) % (unsigned)working]);
+        }
+        double lruNs = (now() - t0) * 1e9 / reps;
+
+        const char *page[50];
+        t0 = now();
+        for (int i = 0; i < 10000; i++)
+            lru_list(&l, 0, 50, page);
+        double pageNs = (now() - t0) * 1e9 / 10000;
+        lru_free(&l);
+        free(names);
+
+        if (queueNs < 0)
+            printf("%8d  %14s  %14.0f  %16.0f\n", cap, "-", lruNs, pageNs);
+        else
+            printf("%8d  %14.0f  %14.0f  %16.0f\n", cap, queueNs, lruNs, pageNs);
+    }
+    return 0;
+}
@@ -0,0 +1,270 @@
+// bench_search.c - full-text index: append throughput and query latency
+//
+// build: make bench
+// usage: ./bench_search [files] [MiB] [dir]   (default 2000 256 /tmp/fv-search)
+//
+// Fills a fresh vault with the given number of files and MiB of text in
+// 4 KiB appends, words drawn from a Zipf-like vocabulary plus one word
+// unique to each file. Queries are timed for a very common, a mid-rank,
+// a unique and an absent word, against a full scan (decrypt every file
+// and look for the word) as the alternative. The vault is then reopened
+// and every file unlocked again, to time queries served from the merged
+// index and the replayed log.
+
+#define _GNU_SOURCE   /* memmem */
+
+#include "kdf.h"
+#include "model.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define VOCAB       50000
+#define APPEND_SIZE 4096
+#define QUERY_REPS  20
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static void wordAt(int rank, char *out) {
+    int n = sprintf(out, "w");
+    for (int r = rank; ; r /= 26) {
+        out[n++] = (char)('a' + r % 26);
+        if (r < 26) break;
+    }
+    out[n] = '\0';
+}
+
+/* ranks with probability ~ 1/rank */
+static double cumulative[VOCAB];
+
+static void initVocab(void) {
+    double sum = 0;
+    for (int i = 0; i < VOCAB; i++) cumulative[i] = sum += 1.0 / (i + 1);
+    for (int i = 0; i < VOCAB; i++) cumulative[i] /= sum;
+}
+
+static int drawRank(unsigned *seed) {
+    double u = (double)rand_r(seed) / RAND_MAX;
+    int lo = 0, hi = VOCAB - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cumulative[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* one append of APPEND_SIZE bytes or a little less */
+static size_t fillText(char *buf, unsigned *seed, int file, int first) {
+    size_t len = first ? (size_t)sprintf(buf, "unique%06d ", file) : 0;
+    char   word[16];
+    while (len + 16 < APPEND_SIZE) {
+        wordAt(drawRank(seed), word);
+        len += (size_t)sprintf(buf + len, "%s%c", word,
+                               rand_r(seed) % 12 == 0 ? '\n' : ' ');
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/* empties dir, vault.store and all */
+static void clearDir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    char path[1024];
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (unlink(path) != 0 && errno == EISDIR) {
+            clearDir(path);
+            rmdir(path);
+        }
+    }
+    closedir(d);
+}
+
+static long long fileBytes(const char *dir, const char *name) {
+    char        path[1024];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return stat(path, &st) == 0 ? (long long)st.st_size : 0;
+}
+
+static int countHit(void *ctx, const char *filename, long long hits) {
+    (void)filename;
+    *(long long *)ctx += hits;
+    return 0;
+}
+
+/* ---------- full scan ---------- */
+
+typedef struct {
+    const char *word;
+    size_t      len;
+    char        carry[64];
+    size_t      carryLen;
+    long long   hits;
+} Scan;
+
+static int isWord(unsigned char c) {
+    return (unsigned)((c | 0x20) - 'a') < 26u || (unsigned)(c - '0') < 10u ||
+           c == '_' || c >= 0x80;
+}
+
+/* whole-word matches, also across chunk boundaries: a match is counted
+ * once the byte after it is seen, so the carry keeps the last len bytes
+ * and the one before them */
+static int scanChunk(void *ctx, const char *data, size_t len) {
+    Scan  *s = (Scan *)ctx;
+    char   buf[64 + 2 * MODEL_CHUNK_SIZE];
+    size_t n = s->carryLen;
+    memcpy(buf, s->carry, n);
+    memcpy(buf + n, data, len);
+    n += len;
+
+    const char *p = buf + (s->carryLen > s->len), *end = buf + n;
+    while ((p = memmem(p, (size_t)(end - p), s->word, s->len)) != NULL &&
+           p + s->len < end) {
+        if ((p == buf || !isWord((unsigned char)p[-1])) &&
+            !isWord((unsigned char)p[s->len]))
+            s->hits++;
+        p++;
+    }
+    s->carryLen = n < s->len + 1 ? n : s->len + 1;
+    memcpy(s->carry, end - s->carryLen, s->carryLen);
+    return 0;
+}
+
+/* a match ending the file */
+static void scanEnd(Scan *s) {
+    if (s->carryLen < s->len) return;
+    const char *p = s->carry + s->carryLen - s->len;
+    if (memcmp(p, s->word, s->len) == 0 &&
+        (p == s->carry || !isWord((unsigned char)p[-1])))
+        s->hits++;
+}
+
+static long long fullScan(VaultCtx *v, int files, const char *word) {
+    Scan s;
+    memset(&s, 0, sizeof(s));
+    s.word = word;
+    s.len  = strlen(word);
+    char name[32];
+    for (int f = 0; f < files; f++) {
+        snprintf(name, sizeof(name), "doc%06d", f);
+        s.carryLen = 0;
+        if (vault_readFile(v, name, scanChunk, &s) != 0) die("vault_readFile");
+        scanEnd(&s);
+    }
+    return s.hits;
+}
+
+/* ---------- queries ---------- */
+
+static void runQueries(VaultCtx *v, int files, const char *label, int scan) {
+    char common[16], mid[16], unique[32];
+    wordAt(0, common);
+    wordAt(999, mid);
+    sprintf(unique, "unique%06d", files / 2);
+    const char *words[] = { common, mid, unique, "absent" };
+
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        long long hits = 0;
+        double    t0   = nowMs();
+        int       found = vault_search(v, words[i], countHit, &hits);
+        double    first = nowMs() - t0;
+
+        t0 = nowMs();
+        for (int r = 0; r < QUERY_REPS; r++) {
+            long long h = 0;
+            vault_search(v, words[i], countHit, &h);
+        }
+        double warm = (nowMs() - t0) / QUERY_REPS;
+
+        printf("%-8s %-12s %6d files %9lld hits  first %8.2f ms  warm %7.2f ms",
+               label, words[i], found, hits, first, warm);
+        if (scan) {
+            t0 = nowMs();
+            long long scanned = fullScan(v, files, words[i]);
+            printf("  scan %8.1f ms%s", nowMs() - t0, scanned == hits ? "" : "  MISMATCH");
+        }
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv) {
+    int         files = argc > 1 ? atoi(argv[1]) : 2000;
+    long        mib   = argc > 2 ? atol(argv[2]) : 256;
+    const char *dir   = argc > 3 ? argv[3] : "/tmp/fv-search";
+    if (files < 1 || mib < 1) {
+        fprintf(stderr, "usage: %s [files] [MiB] [dir]\n", argv[0]);
+        return 1;
+    }
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) die(dir);
+    clearDir(dir);
+    initVocab();
+
+    VaultCtx *v = model_open(dir);
+    if (!v) die("model_open");
+    vault_setKdfCost(v, KDF_MIN_COST);
+
+    char name[32];
+    for (int f = 0; f < files; f++) {
+        snprintf(name, sizeof(name), "doc%06d", f);
+        if (vault_addFile(v, name, "pw") != 0) die("vault_addFile");
+    }
+
+    long      appends = (mib << 20) / APPEND_SIZE;
+    char     *text    = (char *)malloc(APPEND_SIZE);
+    unsigned  seed    = 1;
+    long long bytes   = 0;
+    if (!text) die("malloc");
+    double t0 = nowMs();
+    for (long a = 0; a < appends; a++) {
+        int    f   = (int)(a % files);
+        size_t len = fillText(text, &seed, f, a < files);
+        long long out;
+        snprintf(name, sizeof(name), "doc%06d", f);
+        if (vault_appendToFile(v, name, text, &out) != 0) die("vault_appendToFile");
+        bytes += (long long)len;
+    }
+    double ms = nowMs() - t0;
+    printf("appended %.1f MiB in %ld appends to %d files: %.0f ms, %.1f MiB/s\n",
+           (double)bytes / (1 << 20), appends, files, ms,
+           (double)bytes / (1 << 20) / (ms / 1e3));
+    printf("index: merged %.1f MiB, log %.1f MiB\n",
+           (double)fileBytes(dir, "vault.search") / (1 << 20),
+           (double)fileBytes(dir, "vault.search.log") / (1 << 20));
+
+    runQueries(v, files, "live", 1);
+    model_close(v);
+
+    t0 = nowMs();
+    v  = model_open(dir);
+    if (!v) die("model_open");
+    for (int f = 0; f < files; f++) {
+        snprintf(name, sizeof(name), "doc%06d", f);
+        if (vault_verifyPassword(v, name, "pw") != 1) die("vault_verifyPassword");
+    }
+    printf("reopened and unlocked %d files: %.0f ms\n", files, nowMs() - t0);
+    runQueries(v, files, "reopen", 0);
+    model_close(v);
+
+    free(text);
+    return 0;
+}
@@ -0,0 +1,103 @@
+// bench_shards.c - one shared vault vs one vault per thread
+//
+// build: cc -O2 -Isrc bench/bench_shards.c src/model.c src/kdf.c src/vtable.c src/arena.c src/hashindex.c src/journal.c src/undolog.c -o bench_shards -pthread
+// usage: ./bench_shards [dir] [ops per thread]   (default /tmp/fv-shards, 20000)
+//
+// Each thread adds its own files and then runs 80% verify / 20% append
+// against them, first with every thread on one VaultCtx, then with each
+// thread on a VaultCtx of its own.
+
+#include "model.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define MAX_THREADS    16
+#define FILES_PER_TASK 64
+
+typedef struct {
+    VaultCtx *v;
+    int       id;
+    long      ops;
+} Task;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *worker(void *arg) {
+    Task *t = (Task *)arg;
+    char  name[64];
+    long long len;
+
+    for (int f = 0; f < FILES_PER_TASK; f++) {
+        snprintf(name, sizeof(name), "t%02d-%03d.txt", t->id, f);
+        vault_addFile(t->v, name, "pw");
+    }
+
+    unsigned seed = (unsigned)t->id + 1;
+    for (long i = 0; i < t->ops; i++) {
+        seed = seed * 1103515245u + 12345u;
+        snprintf(name, sizeof(name), "t%02d-%03u.txt",
+                 t->id, (seed >> 8) % FILES_PER_TASK);
+        if ((seed >> 16) % 5 == 0)
+            vault_appendToFile(t->v, name, "0123456789abcdef\n", &len);
+        else
+            vault_verifyPassword(t->v, name, "pw");
+    }
+    return NULL;
+}
+
+static double run(const char *root, int threads, int sharded, long ops) {
+    VaultCtx *vaults[MAX_THREADS] = { 0 };
+    Task      tasks[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+    char      dir[512];
+
+    for (int i = 0; i < threads; i++) {
+        if (i == 0 || sharded) {
+            snprintf(dir, sizeof(dir), "%s/%s-%d-%d", root,
+                     sharded ? "shard" : "shared", threads, i);
+            vaults[i] = model_open(dir);
+            if (!vaults[i]) {
+                perror(dir);
+                exit(1);
+            }
+            vault_setSyncPolicy(vaults[i], MODEL_SYNC_NONE, 0, 0);
+            vault_setKdfCost(vaults[i], 1000);   /* measure locking, not PBKDF2 */
+        }
+        tasks[i].v   = sharded ? vaults[i] : vaults[0];
+        tasks[i].id  = i;
+        tasks[i].ops = ops;
+    }
+
+    double t0 = now();
+    for (int i = 0; i < threads; i++)
+        pthread_create(&tids[i], NULL, worker, &tasks[i]);
+    for (int i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    double secs = now() - t0;
+
+    for (int i = 0; i < threads; i++)
+        model_close(vaults[i]);
+    return (double)threads * (double)ops / secs;
+}
+
+int main(int argc, char **argv) {
+    const char *root = argc > 1 ? argv[1] : "/tmp/fv-shards";
+    long        ops  = argc > 2 ? atol(argv[2]) : 20000;
+    mkdir(root, 0700);
+
+    printf("%8s  %14s  %14s\n", "threads", "shared ops/s", "sharded ops/s");
+    for (int n = 1; n <= MAX_THREADS; n *= 2) {
+        double shared  = run(root, n, 0, ops);
+        double sharded = run(root, n, 1, ops);
+        printf("%8d  %14.0f  %14.0f\n", n, shared, sharded);
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+// bench_undo.c - undo latency as a function of file size
+//
+// build: cc -O2 -Isrc bench/bench_undo.c src/model.c src/journal.c
+//           src/undolog.c src/kdf.c src/vtable.c src/arena.c src/hashindex.c
+//           -o bench_undo -pthread
+// usage: ./bench_undo [dir]      (default: a fresh directory under /tmp)
+//
+// Files are grown sparsely with ftruncate, then a 10-byte append is
+// undone. The "rewrite" column is the previous algorithm (read the
+// surviving prefix, rewrite the file), run only up to 256 MiB.
+
+#include "fanout.h"
+#include "model.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPS 20
+
+static double nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static int cmpDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *v, int n) {
+    qsort(v, (size_t)n, sizeof(double), cmpDouble);
+    return v[n / 2];
+}
+
+/* what model_undoLastAppend used to do */
+static void rewriteUndo(const char *path, long length) {
+    FILE *fp = fopen(path, "rb");
+    fseek(fp, 0, SEEK_END);
+    long newSize = ftell(fp) - length;
+    rewind(fp);
+    char *buf = (char *)malloc((size_t)newSize + 1);
+    size_t got = fread(buf, 1, (size_t)newSize, fp);
+    fclose(fp);
+    fp = fopen(path, "wb");
+    fwrite(buf, 1, got, fp);
+    fclose(fp);
+    free(buf);
+}
+
+int main(int argc, char **argv) {
+    char dir[] = "/tmp/fv-bench-undo-XXXXXX";
+    const char *where = argc > 1 ? argv[1] : mkdtemp(dir);
+    if (!where || chdir(where) != 0) {
+        perror("bench dir");
+        return 1;
+    }
+
+    model_init();
+    model_addFile("big.txt", "pw");
+    char rel[FANOUT_PATH_LEN], path[64];
+    fanout_path("big.txt", rel);
+    snprintf(path, sizeof(path), FANOUT_ROOT "/%s", rel);
+
+    const long long sizes[] = { 1LL << 20, 16LL << 20, 256LL << 20,
+                                1LL << 30, 4LL << 30 };
+    printf("%12s  %14s  %14s\n", "file size", "undo us (p50)",
+           "rewrite us (p50)");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double undo[REPS], rewrite[REPS];
+        long long appended;
+
+        for (int r = 0; r < REPS; r++) {
+            if (truncate(path, sizes[s]) != 0) {
+                perror("truncate");
+                return 1;
+            }
+            model_appendToFile("big.txt", "0123456789", &appended);
+            double t0 = nowUs();
+            model_undoLastAppend(NULL, 0);
+            undo[r] = nowUs() - t0;
+        }
+
+        int doRewrite = sizes[s] <= (256LL << 20);
+        int reps      = sizes[s] >= (256LL << 20) ? 3 : REPS;
+        for (int r = 0; doRewrite && r < reps; r++) {
+            model_appendToFile("big.txt", "0123456789", &appended);
+            double t0 = nowUs();
+            rewriteUndo(path, appended);
+            rewrite[r] = nowUs() - t0;
+        }
+
+        char rewriteCol[32] = "-";
+        if (doRewrite)
+            snprintf(rewriteCol, sizeof(rewriteCol), "%.0f",
+                     median(rewrite, reps));
+        printf("%9lld MiB  %14.1f  %14s\n", sizes[s] >> 20,
+               median(undo, REPS), rewriteCol);
+    }
+
+    model_shutdown();
+    unlink("big.txt");
+    return 0;
+}
@@ -0,0 +1,180 @@
+// bench_versions.c - version history: as-of reads checked across chunks
+//
+// build: make bench
+// usage: ./bench_versions [small appends] [dir]   (default 20000 /tmp/fv-versions)
+//
+// Appends of awkward sizes first: larger than one 64 KiB read chunk,
+// exactly one, one byte over, and pairs that straddle a chunk boundary.
+// Then many small appends. Versions are read back with vault_readVersion
+// and compared with what was appended, on the open handle and again after
+// a reopen, with compression off, on, and with deduplication; any
+// mismatch or -2 exits 1. The awkward ones and the first small ones are
+// all checked, the rest sampled. Then times an as-of read of the whole
+// file against a plain range read of the same bytes.
+
+#include "kdf.h"
+#include "model.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SMALL_APPEND 64
+#define SAMPLE_EVERY 997   /* small versions past the first few */
+
+static const size_t awkward[] = {
+    65000, 1000,                       /* the second crosses 64 KiB */
+    65537, 1, 65535, 65536, 200000,    /* several chunks and frames */
+    7, 131073, 65529,
+};
+#define AWKWARD_COUNT (sizeof(awkward) / sizeof(awkward[0]))
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+/* empties dir, vault.store and all */
+static void clearDir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    char path[1024];
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (unlink(path) != 0 && errno == EISDIR) {
+            clearDir(path);
+            rmdir(path);
+        }
+    }
+    closedir(d);
+}
+
+static VaultCtx *openVault(const char *dir, int mode) {
+    VaultCtx *v = model_open(dir);
+    if (!v) die("model_open");
+    vault_setKdfCost(v, KDF_MIN_COST);
+    vault_setSyncPolicy(v, MODEL_SYNC_NONE, 0, 0);
+    vault_setCompression(v, mode == 1);
+    vault_setDedup(v, mode == 2);
+    return v;
+}
+
+/* compares what a read hands over with the expected bytes */
+typedef struct {
+    const char *want;
+    long long   at, len;
+    int         differs;
+} Compare;
+
+static int compareChunk(void *ctx, const char *data, size_t len) {
+    Compare *c = (Compare *)ctx;
+    if (c->at + (long long)len > c->len || memcmp(c->want + c->at, data, len) != 0)
+        c->differs = 1;
+    c->at += (long long)len;
+    return 0;
+}
+
+static int countChunk(void *ctx, const char *data, size_t len) {
+    (void)data;
+    *(long long *)ctx += (long long)len;
+    return 0;
+}
+
+/* reads back versions of "f"; ends[i] is where version i + 1 ends */
+static void checkAll(VaultCtx *v, const char *mode, const char *content,
+                     const long long *ends, long count) {
+    if (vault_countVersions(v, "f") != count) {
+        fprintf(stderr, "%s: %lld versions, expected %ld\n", mode,
+                vault_countVersions(v, "f"), count);
+        exit(1);
+    }
+    for (long i = 0; i < count; i++) {
+        if (i >= (long)AWKWARD_COUNT + 64 && i % SAMPLE_EVERY != 0 && i != count - 1)
+            continue;
+        Compare c  = { content, 0, ends[i], 0 };
+        int     rc = vault_readVersion(v, "f", i + 1, compareChunk, &c);
+        if (rc != 0 || c.differs || c.at != ends[i]) {
+            fprintf(stderr, "%s: version %ld of %lld bytes: rc %d, %lld bytes read%s\n",
+                    mode, i + 1, ends[i], rc, c.at, c.differs ? ", content differs" : "");
+            exit(1);
+        }
+    }
+}
+
+static void bench(const char *dir, int mode, long small) {
+    static const char *names[] = { "off", "compress", "dedup" };
+    clearDir(dir);
+    VaultCtx *v = openVault(dir, mode);
+    if (vault_addFile(v, "f", "pw") != 0) die("vault_addFile");
+
+    size_t total = small * SMALL_APPEND;
+    for (size_t i = 0; i < AWKWARD_COUNT; i++) total += awkward[i];
+    long       count   = (long)AWKWARD_COUNT + small;
+    char      *content = (char *)malloc(total + 1);
+    long long *ends    = (long long *)malloc(sizeof(long long) * (size_t)count);
+    if (!content || !ends) die("malloc");
+
+    unsigned seed = 11;
+    size_t   end  = 0;
+    for (long i = 0; i < count; i++) {
+        size_t len = i < (long)AWKWARD_COUNT ? awkward[i] : SMALL_APPEND;
+        for (size_t k = 0; k < len; k++)   /* text: appends stop at a NUL */
+            content[end + k] = (char)('a' + rand_r(&seed) % 26);
+        char keep = content[end + len];
+        content[end + len] = '\0';
+        long long out;
+        if (vault_appendToFile(v, "f", content + end, &out) != 0 || out != (long long)len)
+            die("vault_appendToFile");
+        content[end + len] = keep;
+        end    += len;
+        ends[i] = (long long)end;
+    }
+
+    checkAll(v, names[mode], content, ends, count);
+    model_close(v);
+    v = openVault(dir, mode);
+    if (vault_verifyPassword(v, "f", "pw") != 1) die("vault_verifyPassword");
+    checkAll(v, names[mode], content, ends, count);
+
+    long long read = 0;
+    double    t0   = nowMs();
+    if (vault_readVersion(v, "f", count, countChunk, &read) != 0) die("vault_readVersion");
+    double asofMs = nowMs() - t0;
+    read = 0;
+    t0   = nowMs();
+    if (vault_readRange(v, "f", 0, (long long)end, countChunk, &read) != 0)
+        die("vault_readRange");
+    double rangeMs = nowMs() - t0;
+    model_close(v);
+
+    printf("%-8s %ld versions, %zu bytes: checked; as-of read %7.1f ms, "
+           "range read %7.1f ms\n", names[mode], count, end, asofMs, rangeMs);
+    free(content);
+    free(ends);
+}
+
+int main(int argc, char **argv) {
+    long        small = argc > 1 ? atol(argv[1]) : 20000;
+    const char *dir   = argc > 2 ? argv[2] : "/tmp/fv-versions";
+    if (small < 0) {
+        fprintf(stderr, "usage: %s [small appends] [dir]\n", argv[0]);
+        return 1;
+    }
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) die(dir);
+
+    for (int mode = 0; mode < 3; mode++) bench(dir, mode, small);
+    clearDir(dir);
+    return 0;
+}
@@ -0,0 +1,119 @@
+// bench_vtable_mem.c - resident memory of the vault table at 1M entries
+//
+// build: cc -O2 -Isrc bench/bench_vtable_mem.c src/vtable.c src/arena.c
+//           src/hashindex.c -o bench_vtable_mem
+// usage: ./bench_vtable_mem [entries]      (default 1000000)
+//
+// Each layout is measured in its own child process so one cannot
+// inflate the other's resident set.
+
+#include "vtable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* the layout vtable replaced: two fixed 100-byte arrays per entry */
+typedef struct {
+    char filename[100];
+    char password[100];
+} FixedVault;
+
+static FixedVault *fixedVaults;
+
+static const char *fixedKey(void *ctx, int id) {
+    (void)ctx;
+    return fixedVaults[id].filename;
+}
+
+static long residentKiB(void) {
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (!fp) return -1;
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = -1;
+    fclose(fp);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void makeEntry(int i, char *name, char *pwd) {
+    snprintf(name, 32, "file%07d.txt", i);
+    snprintf(pwd, 32, "pw%07d", i);
+}
+
+static void runFixed(int n) {
+    long before = residentKiB();
+    fixedVaults = (FixedVault *)calloc((size_t)n, sizeof(FixedVault));
+    HashIndex hi;
+    hashindex_init(&hi, 0, fixedKey, NULL);
+    for (int i = 0; i < n; i++) {
+        makeEntry(i, fixedVaults[i].filename, fixedVaults[i].password);
+        hashindex_insert(&hi, fixedVaults[i].filename,
+                         hashindex_hash(fixedVaults[i].filename), i);
+    }
+    long after = residentKiB();
+
+    double t0 = nowNs();
+    long hits = 0;
+    char name[32], pwd[32];
+    for (int i = 0; i < n; i++) {
+        makeEntry((int)((i * 7919L) % n), name, pwd);
+        hits += hashindex_find(&hi, name, hashindex_hash(name)) >= 0;
+    }
+    double lookupNs = (nowNs() - t0) / n;
+
+    printf("%-22s %10ld KiB  %7.1f B/entry  %7.1f ns/lookup  (%ld)\n",
+           "fixed Vault[] + index", after - before,
+           (after - before) * 1024.0 / n, lookupNs, hits);
+}
+
+static void runTable(int n) {
+    long before = residentKiB();
+    VaultTable t;
+    vtable_init(&t, 0);
+    char name[32], pwd[32];
+    for (int i = 0; i < n; i++) {
+        makeEntry(i, name, pwd);
+        vtable_put(&t, name, pwd);
+    }
+    long after = residentKiB();
+
+    double t0 = nowNs();
+    long hits = 0;
+    for (int i = 0; i < n; i++) {
+        makeEntry((int)((i * 7919L) % n), name, pwd);
+        hits += vtable_find(&t, name) >= 0;
+    }
+    double lookupNs = (nowNs() - t0) / n;
+
+    printf("%-22s %10ld KiB  %7.1f B/entry  %7.1f ns/lookup  (%ld)\n",
+           "VaultTable (SoA+arena)", after - before,
+           (after - before) * 1024.0 / n, lookupNs, hits);
+    printf("%-22s %10zu KiB allocated\n", "", vtable_memoryUsage(&t) / 1024);
+}
+
+static void inChild(void (*fn)(int), int n) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        fn(n);
+        fflush(stdout);
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    printf("entries: %d\n", n);
+    inChild(runFixed, n);
+    inChild(runTable, n);
+    return 0;
+}
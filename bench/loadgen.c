@@ -0,0 +1,173 @@
+// loadgen.c - load generator for the vault daemon (fv --serve)
+//
+// build: cc -O2 -Isrc bench/loadgen.c src/proto.c -o loadgen -pthread
+// usage: ./loadgen [socket] [seconds per level]   (default vault.sock, 2)
+//
+// For 1, 2, 4 ... 64 concurrent clients, each client keeps one
+// connection and issues a mix of 70% verify, 20% read and 10% append
+// against its own file. Reports throughput and p50/p99 latency.
+
+#include "proto.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CLIENTS  64
+#define MAX_SAMPLES  (1 << 20)
+
+typedef struct {
+    int       id;
+    double    seconds;
+    double   *lat;      /* microseconds */
+    long      count;
+    long      errors;
+} Client;
+
+static const char *socketPath = "vault.sock";
+
+static double nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static int connectServer(void) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* one round trip; discards any payload. returns status or -1000 on I/O error */
+static int call(int fd, int op, const char *name, const char *pwd,
+                const char *data) {
+    const char *field[3] = { name, pwd, data };
+    uint32_t    len[3]   = { (uint32_t)strlen(name), (uint32_t)strlen(pwd),
+                             data ? (uint32_t)strlen(data) : 0 };
+    if (proto_sendRequest(fd, op, data ? 3 : 2, field, len) != 0)
+        return -1000;
+
+    int32_t  status;
+    uint64_t payload;
+    if (proto_recvResponseHeader(fd, &status, &payload) != 0) return -1000;
+
+    char buf[65536];
+    while (payload > 0) {
+        size_t n = payload < sizeof(buf) ? (size_t)payload : sizeof(buf);
+        if (proto_readFull(fd, buf, n) != 0) return -1000;
+        payload -= n;
+    }
+    return status;
+}
+
+static void *clientMain(void *arg) {
+    Client *c  = (Client *)arg;
+    int     fd = connectServer();
+    if (fd < 0) {
+        c->errors++;
+        return NULL;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "loadgen-%02d.txt", c->id);
+    static const char line[] =
+        "0123456789abcdef0123456789abcdef0123456789abcdef012345678901234\n";
+
+    unsigned seed = (unsigned)c->id * 2654435761u;
+    double   end  = nowUs() + c->seconds * 1e6;
+    while (c->count < MAX_SAMPLES) {
+        double t0 = nowUs();
+        if (t0 >= end) break;
+
+        seed = seed * 1103515245u + 12345u;
+        unsigned pick = (seed >> 16) % 10;
+        int status;
+        if (pick < 7)
+            status = call(fd, PROTO_OP_VERIFY, name, "pw", NULL);
+        else if (pick < 9)
+            status = call(fd, PROTO_OP_READ, name, "pw", NULL);
+        else
+            status = call(fd, PROTO_OP_APPEND, name, "pw", line);
+
+        c->lat[c->count++] = nowUs() - t0;
+        if (status < 0) c->errors++;
+        if (status == -1000) break;
+    }
+    close(fd);
+    return NULL;
+}
+
+static int cmpDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) socketPath = argv[1];
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+
+    /* provision one file per client; "already exists" is fine */
+    int fd = connectServer();
+    if (fd < 0) {
+        perror(socketPath);
+        return 1;
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "loadgen-%02d.txt", i);
+        call(fd, PROTO_OP_ADD, name, "pw", NULL);
+    }
+    close(fd);
+
+    printf("%8s  %12s  %10s  %10s  %8s\n",
+           "clients", "ops/s", "p50 us", "p99 us", "errors");
+
+    Client    clients[MAX_CLIENTS];
+    pthread_t threads[MAX_CLIENTS];
+    for (int n = 1; n <= MAX_CLIENTS; n *= 2) {
+        for (int i = 0; i < n; i++) {
+            clients[i].id      = i;
+            clients[i].seconds = seconds;
+            clients[i].count   = 0;
+            clients[i].errors  = 0;
+            clients[i].lat     = (double *)malloc(sizeof(double) * MAX_SAMPLES);
+            pthread_create(&threads[i], NULL, clientMain, &clients[i]);
+        }
+
+        long total = 0, errors = 0;
+        for (int i = 0; i < n; i++) {
+            pthread_join(threads[i], NULL);
+            total  += clients[i].count;
+            errors += clients[i].errors;
+        }
+
+        double *all = (double *)malloc(sizeof(double) * (size_t)(total + 1));
+        long    k   = 0;
+        for (int i = 0; i < n; i++) {
+            memcpy(all + k, clients[i].lat, sizeof(double) * (size_t)clients[i].count);
+            k += clients[i].count;
+            free(clients[i].lat);
+        }
+        qsort(all, (size_t)total, sizeof(double), cmpDouble);
+
+        double p50 = total ? all[total / 2] : 0;
+        double p99 = total ? all[(long)(total * 0.99)] : 0;
+        printf("%8d  %12.0f  %10.1f  %10.1f  %8ld\n",
+               n, total / seconds, p50, p99, errors);
+        free(all);
+    }
+    return 0;
+}
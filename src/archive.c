@@ -0,0 +1,208 @@
+// archive.c - packed vault archive: index writer and reader
+
+#include "archive.h"
+#include "journal.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAGIC       "FVARCHV\n"
+#define HEADER_CRC  60            /* the CRC covers bytes before this */
+#define FILE_FIXED  24            /* nameLen, secretLen, offset, length, crc */
+#define CHUNK_FIXED (CHUNK_KEY_LEN + 8 + 4 + 4 + 1)
+#define ENTRY_MAX   0xffff        /* longest name or secret */
+
+/* ---------- helper: little-endian fields ---------- */
+
+static uint32_t get16(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+static uint32_t get32(const unsigned char *p) {
+    return get16(p) | get16(p + 2) << 16;
+}
+
+static uint64_t get64(const unsigned char *p) {
+    return (uint64_t)get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+static void put16(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static void put64(unsigned char *p, uint64_t v) {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static int writeAt(int fd, const unsigned char *buf, size_t len, uint64_t at) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, buf + done, len - done, (off_t)(at + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+static int readAt(int fd, unsigned char *buf, size_t len, uint64_t at) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, (off_t)(at + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/* ---------- public ---------- */
+
+int archive_write(int fd, uint64_t indexOff, const Archive *a) {
+    size_t len = (size_t)a->chunkCount * CHUNK_FIXED;
+    for (uint32_t i = 0; i < a->fileCount; i++) {
+        size_t nl = strlen(a->files[i].name), sl = strlen(a->files[i].secret);
+        if (nl > ENTRY_MAX || sl > ENTRY_MAX) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        len += FILE_FIXED + nl + sl;
+    }
+
+    unsigned char *buf = (unsigned char *)malloc(len + 1);
+    if (!buf) return -1;
+    unsigned char *p = buf;
+    for (uint32_t i = 0; i < a->fileCount; i++) {
+        const ArchiveFile *f  = &a->files[i];
+        size_t             nl = strlen(f->name), sl = strlen(f->secret);
+        put16(p, (uint32_t)nl);
+        put16(p + 2, (uint32_t)sl);
+        put64(p + 4, f->offset);
+        put64(p + 12, f->length);
+        put32(p + 20, f->crc);
+        memcpy(p + FILE_FIXED, f->name, nl);
+        memcpy(p + FILE_FIXED + nl, f->secret, sl);
+        p += FILE_FIXED + nl + sl;
+    }
+    for (uint32_t i = 0; i < a->chunkCount; i++) {
+        const ArchiveChunk *c = &a->chunks[i];
+        memcpy(p, c->id, CHUNK_KEY_LEN);
+        put64(p + CHUNK_KEY_LEN, c->loc.offset);
+        put32(p + CHUNK_KEY_LEN + 8, c->loc.stored);
+        put32(p + CHUNK_KEY_LEN + 12, c->loc.length);
+        p[CHUNK_KEY_LEN + 16] = (unsigned char)c->loc.packed;
+        p += CHUNK_FIXED;
+    }
+
+    unsigned char h[ARCHIVE_DATA_START] = { 0 };
+    memcpy(h, MAGIC, 8);
+    put32(h + 8, ARCHIVE_VERSION);
+    put32(h + 12, a->fileCount);
+    put32(h + 16, a->chunkCount);
+    put32(h + 20, journal_crc(buf, len));
+    put64(h + 24, indexOff);
+    put64(h + 32, (uint64_t)len);
+    put64(h + 40, a->packOff);
+    put64(h + 48, a->packLen);
+    put32(h + 56, a->packCrc);
+    put32(h + HEADER_CRC, journal_crc(h, HEADER_CRC));
+
+    /* everything else is on disk before the header names it */
+    int rc = writeAt(fd, buf, len, indexOff) == 0 &&
+             ftruncate(fd, (off_t)(indexOff + len)) == 0 && fsync(fd) == 0 &&
+             writeAt(fd, h, sizeof(h), 0) == 0 && fsync(fd) == 0 ? 0 : -1;
+    free(buf);
+    return rc;
+}
+
+int archive_read(int fd, Archive *a) {
+    memset(a, 0, sizeof(*a));
+    unsigned char h[ARCHIVE_DATA_START];
+    if (readAt(fd, h, sizeof(h), 0) != 0) return -2;
+
+    uint32_t files   = get32(h + 12);
+    uint32_t chunks  = get32(h + 16);
+    uint64_t indexAt = get64(h + 24);
+    uint64_t len     = get64(h + 32);
+    if (memcmp(h, MAGIC, 8) != 0 || get32(h + 8) != ARCHIVE_VERSION ||
+        journal_crc(h, HEADER_CRC) != get32(h + HEADER_CRC) ||
+        len < (uint64_t)files * FILE_FIXED + (uint64_t)chunks * CHUNK_FIXED ||
+        len > SIZE_MAX / 2)
+        return -2;
+
+    unsigned char *buf = (unsigned char *)malloc((size_t)len + 1);
+    a->files   = (ArchiveFile *)malloc(sizeof(ArchiveFile) * ((size_t)files + 1));
+    a->chunks  = (ArchiveChunk *)malloc(sizeof(ArchiveChunk) * ((size_t)chunks + 1));
+    a->strings = (char *)malloc((size_t)len + 2 * (size_t)files + 1);
+    if (!buf || !a->files || !a->chunks || !a->strings) {
+        free(buf);
+        archive_free(a);
+        return -1;
+    }
+    int rc = readAt(fd, buf, (size_t)len, indexAt) != 0 ? -2 :
+             journal_crc(buf, (size_t)len) != get32(h + 20) ? -2 : 0;
+
+    /* names and secrets are copied out NUL-terminated */
+    const unsigned char *p   = buf, *end = buf + len;
+    char                *str = a->strings;
+    for (uint32_t i = 0; rc == 0 && i < files; i++) {
+        size_t nl = end - p >= FILE_FIXED ? get16(p) : 0;
+        size_t sl = end - p >= FILE_FIXED ? get16(p + 2) : 0;
+        if (end - p < FILE_FIXED || (size_t)(end - p) - FILE_FIXED < nl + sl || nl == 0) {
+            rc = -2;
+            break;
+        }
+        ArchiveFile *f = &a->files[i];
+        f->offset = get64(p + 4);
+        f->length = get64(p + 12);
+        f->crc    = get32(p + 20);
+        memcpy(str, p + FILE_FIXED, nl);
+        str[nl] = '\0';
+        f->name = str;
+        str    += nl + 1;
+        memcpy(str, p + FILE_FIXED + nl, sl);
+        str[sl]   = '\0';
+        f->secret = str;
+        str      += sl + 1;
+        p        += FILE_FIXED + nl + sl;
+    }
+    for (uint32_t i = 0; rc == 0 && i < chunks; i++) {
+        if (end - p < CHUNK_FIXED) {
+            rc = -2;
+            break;
+        }
+        ArchiveChunk *c = &a->chunks[i];
+        memcpy(c->id, p, CHUNK_KEY_LEN);
+        c->loc.offset = get64(p + CHUNK_KEY_LEN);
+        c->loc.stored = get32(p + CHUNK_KEY_LEN + 8);
+        c->loc.length = get32(p + CHUNK_KEY_LEN + 12);
+        c->loc.packed = p[CHUNK_KEY_LEN + 16] != 0;
+        p += CHUNK_FIXED;
+    }
+    free(buf);
+    if (rc != 0) {
+        archive_free(a);
+        return rc;
+    }
+    a->fileCount  = files;
+    a->chunkCount = chunks;
+    a->packOff    = get64(h + 40);
+    a->packLen    = get64(h + 48);
+    a->packCrc    = get32(h + 56);
+    return 0;
+}
+
+void archive_free(Archive *a) {
+    free(a->files);
+    free(a->chunks);
+    free(a->strings);
+    memset(a, 0, sizeof(*a));
+}
@@ -0,0 +1,74 @@
+// archive.h - packed vault archive: files as stored, their secrets, an index
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "chunkstore.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * One file carrying a whole vault, or part of one, to another: every
+ * file's bytes exactly as stored (still encrypted) with its stored
+ * secret, plus the shared chunks its frames may refer to, so bringing
+ * it in needs neither passwords nor a KDF run. On-disk layout, all
+ * little-endian:
+ *
+ *   header   64 bytes: magic "FVARCHV\n", u32 version, u32 fileCount,
+ *            u32 chunkCount, u32 indexCrc, u64 indexOff, u64 indexLen,
+ *            u64 packOff, u64 packLen, u32 packCrc, u32 CRC-32C of
+ *            bytes 0..59
+ *   data     from ARCHIVE_DATA_START: the files' bytes, in any order
+ *   pack     chunk bodies as chunkstore.h stores them, back to back
+ *   index    fileCount x { u16 nameLen | u16 secretLen | u64 offset |
+ *            u64 length | u32 crc | name | secret }, crc being the
+ *            CRC-32C of the file's bytes; then chunkCount x { id[32] |
+ *            u64 offset in the pack | u32 stored | u32 length | u8 packed }
+ *
+ * The header is written last, so an archive cut short by a crash does
+ * not open.
+ */
+#define ARCHIVE_VERSION    1
+#define ARCHIVE_DATA_START 64
+
+typedef struct {
+    const char *name;
+    const char *secret;
+    uint64_t    offset;
+    uint64_t    length;
+    uint32_t    crc;
+} ArchiveFile;
+
+typedef struct {
+    unsigned char id[CHUNK_KEY_LEN];
+    ChunkLoc      loc;       /* offset within the pack */
+} ArchiveChunk;
+
+typedef struct {
+    ArchiveFile  *files;
+    uint32_t      fileCount;
+    ArchiveChunk *chunks;
+    uint32_t      chunkCount;
+    uint64_t      packOff;
+    uint64_t      packLen;
+    uint32_t      packCrc;
+    char         *strings;   /* archive_read: the names and secrets */
+} Archive;
+
+int  archive_write(int fd, uint64_t indexOff, const Archive *a);
+/* writes a's index at indexOff, the end of its data and pack, then the
+ * header, and fsyncs fd. returns 0, or -1 (errno set) */
+
+int  archive_read(int fd, Archive *a);
+/* loads the header and index of the archive open as fd; free with
+ * archive_free.
+ * returns:
+ *   0 = success
+ *  -1 = read error or out of memory
+ *  -2 = not an archive of this version, or its header or index is
+ *       damaged
+ */
+
+void archive_free(Archive *a);
+
+#endif // ARCHIVE_H
@@ -0,0 +1,42 @@
+// arena.c - bump allocator for strings, addressed by offset
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_MIN_CAP 4096
+
+void arena_init(Arena *a) {
+    a->base = NULL;
+    a->used = 0;
+    a->cap  = 0;
+    a->dead = 0;
+}
+
+void arena_free(Arena *a) {
+    free(a->base);
+    arena_init(a);
+}
+
+uint32_t arena_strdup(Arena *a, const char *s) {
+    size_t len = strlen(s) + 1;
+    if (a->used + len > UINT32_MAX) return ARENA_NONE;
+
+    if (a->used + len > a->cap) {
+        size_t cap = a->cap ? a->cap : ARENA_MIN_CAP;
+        while (cap < a->used + len) cap *= 2;
+        char *base = (char *)realloc(a->base, cap);
+        if (!base) return ARENA_NONE;
+        a->base = base;
+        a->cap  = cap;
+    }
+
+    uint32_t off = (uint32_t)a->used;
+    memcpy(a->base + off, s, len);
+    a->used += len;
+    return off;
+}
+
+void arena_release(Arena *a, uint32_t off) {
+    a->dead += strlen(a->base + off) + 1;
+}
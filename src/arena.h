@@ -0,0 +1,36 @@
+// arena.h - bump allocator for strings, addressed by offset
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Strings are appended back to back in one growable block and referred
+ * to by their 32-bit offset, so growing the block never invalidates a
+ * reference. Nothing is freed individually; superseded strings are
+ * counted in `dead` and reclaimed by copying the live ones to a new
+ * arena. */
+typedef struct {
+    char   *base;
+    size_t  used;
+    size_t  cap;
+    size_t  dead;
+} Arena;
+
+#define ARENA_NONE UINT32_MAX
+
+void arena_init(Arena *a);
+void arena_free(Arena *a);
+
+uint32_t arena_strdup(Arena *a, const char *s);
+/* returns offset of the copy, or ARENA_NONE when out of memory */
+
+static inline const char *arena_str(const Arena *a, uint32_t off) {
+    return a->base + off;
+}
+
+/* marks the string at off as garbage */
+void arena_release(Arena *a, uint32_t off);
+
+#endif // ARENA_H
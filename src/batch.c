@@ -0,0 +1,633 @@
+// batch.c - non-interactive controller: one command per input line
+
+#include "batch.h"
+#include "model.h"
+#include "stats.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BATCH_OUT_BUF    (1 << 20)
+#define BATCH_TAIL_LINES 10   /* "tail" without a count */
+#define VERSIONS_MAX     4096 /* versions per "versions" reply */
+
+typedef int (*BatchCmdFn)(char *args, FILE *out);
+
+/* ---------- helper: parsing ---------- */
+
+/* Cuts the next field out of *cursor, unescaping it in place.
+ * Returns NULL when the line has no more fields. */
+static char *nextField(char **cursor) {
+    char *p = *cursor;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '\0') {
+        *cursor = p;
+        return NULL;
+    }
+
+    char *field = p, *w = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t') {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+            *w++ = *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+            p++;
+        } else {
+            *w++ = *p++;
+        }
+    }
+    if (*p != '\0') p++;
+    *w = '\0';
+    *cursor = p;
+    return field;
+}
+
+/* the rest of the line as one unescaped field (may contain spaces) */
+static char *restOfLine(char **cursor) {
+    char *p = *cursor;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '\0') return NULL;
+
+    char *field = p, *w = p;
+    while (*p != '\0') {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+            *w++ = *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+            p++;
+        } else {
+            *w++ = *p++;
+        }
+    }
+    *w = '\0';
+    *cursor = p;
+    return field;
+}
+
+static void putEscaped(FILE *out, const char *s) {
+    for (; *s; s++) {
+        switch (*s) {
+            case ' ':  fputs("\\ ", out);  break;
+            case '\n': fputs("\\n", out);  break;
+            case '\t': fputs("\\t", out);  break;
+            case '\\': fputs("\\\\", out); break;
+            default:   putc(*s, out);      break;
+        }
+    }
+}
+
+/* ---------- helper: results ---------- */
+
+static int fail(FILE *out, const char *cmd, int code, const char *msg) {
+    fprintf(out, "err %s %d %s\n", cmd, code, msg);
+    return -1;
+}
+
+static int usage(FILE *out, const char *cmd) {
+    return fail(out, cmd, 0, "missing arguments");
+}
+
+/* shared by view/append: the same checks controller_accessFile makes */
+static int unlock(FILE *out, const char *cmd, const char *name,
+                  const char *pwd) {
+    int v = model_verifyPassword(name, pwd);
+    if (v == -1) return fail(out, cmd, -1, "file not found");
+    if (v != 1)  return fail(out, cmd, -2, "incorrect password");
+    model_recordRecent(name);
+    return 0;
+}
+
+/* ---------- commands ---------- */
+
+static int cmdAdd(char *args, FILE *out) {
+    char *name = nextField(&args);
+    char *pwd  = nextField(&args);
+    if (!name || !pwd) return usage(out, "add");
+
+    int res = model_addFile(name, pwd);
+    if (res == -1) return fail(out, "add", res, "out of memory");
+    if (res == -2) return fail(out, "add", res, "file already exists");
+    if (res != 0)  return fail(out, "add", res, "failed to create file");
+    fputs("ok add\n", out);
+    return 0;
+}
+
+static int cmdAppend(char *args, FILE *out) {
+    char *name = nextField(&args);
+    char *pwd  = nextField(&args);
+    char *text = restOfLine(&args);
+    if (!name || !pwd || !text) return usage(out, "append");
+    if (unlock(out, "append", name, pwd) != 0) return -1;
+
+    long long appendedLen = 0;
+    int       res = model_appendToFile(name, text, &appendedLen);
+    if (res == -1) return fail(out, "append", res, "failed to open or write to file");
+    if (res != 0)  return fail(out, "append", res, "nothing was appended");
+    fprintf(out, "ok append %lld\n", appendedLen);
+    return 0;
+}
+
+typedef struct {
+    FILE      *out;
+    long long  left;   /* bytes promised in the header still to send */
+} ViewSink;
+
+static int viewChunk(void *ctx, const char *data, size_t len) {
+    ViewSink *sink = (ViewSink *)ctx;
+    if ((long long)len > sink->left) len = (size_t)sink->left;
+    fwrite(data, 1, len, sink->out);
+    sink->left -= (long long)len;
+    return sink->left == 0;
+}
+
+/* after the content: the bytes a shrunken file no longer has, or that a
+ * failed read never delivered, are NULs, then the rest of the line is
+ * empty or, if the read failed, an err line */
+static int endBody(FILE *out, const char *cmd, int res, ViewSink *sink) {
+    while (sink->left-- > 0) putc('\0', out);
+    if (res < 0) return fail(out, cmd, res, "error reading file");
+    putc('\n', out);
+    return 0;
+}
+
+static int cmdView(char *args, FILE *out) {
+    char *name = nextField(&args);
+    char *pwd  = nextField(&args);
+    if (!name || !pwd) return usage(out, "view");
+    if (unlock(out, "view", name, pwd) != 0) return -1;
+
+    long long size = model_getFileSize(name);
+    if (size < 0) return fail(out, "view", -1, "error reading file");
+
+    fprintf(out, "ok view %lld\n", size);
+    ViewSink sink = { out, size };
+    return endBody(out, "view", size > 0 ? model_readFile(name, viewChunk, &sink) : 0, &sink);
+}
+
+/* a decimal count >= 0 */
+static int parseCount(const char *field, long long *value) {
+    char *end;
+    if (!field || *field < '0' || *field > '9') return -1;
+    errno  = 0;
+    *value = strtoll(field, &end, 10);
+    return *end == '\0' && errno == 0 ? 0 : -1;
+}
+
+/* shared by tail/lines/bytes: the plaintext [offset, offset + length),
+ * framed like view */
+static int sendRange(FILE *out, const char *cmd, const char *name,
+                     long long offset, long long length) {
+    long long size = model_getFileSize(name);
+    if (size < 0) return fail(out, cmd, -1, "error reading file");
+    if (offset > size) offset = size;
+    if (length > size - offset) length = size - offset;
+
+    fprintf(out, "ok %s %lld\n", cmd, length);
+    ViewSink sink = { out, length };
+    return endBody(out, cmd,
+                   length > 0 ? model_readRange(name, offset, length, viewChunk, &sink) : 0,
+                   &sink);
+}
+
+static int cmdTail(char *args, FILE *out) {
+    char     *name = nextField(&args);
+    char     *pwd  = nextField(&args);
+    char     *n    = nextField(&args);
+    long long count = BATCH_TAIL_LINES, offset, length;
+    if (!name || !pwd) return usage(out, "tail");
+    if (n && parseCount(n, &count) != 0) return fail(out, "tail", 0, "bad line count");
+    if (unlock(out, "tail", name, pwd) != 0) return -1;
+
+    if (model_findTail(name, count, &offset, &length) != 0)
+        return fail(out, "tail", -1, "error reading file");
+    return sendRange(out, "tail", name, offset, length);
+}
+
+static int cmdLines(char *args, FILE *out) {
+    char     *name  = nextField(&args);
+    char     *pwd   = nextField(&args);
+    char     *from  = nextField(&args);
+    char     *until = nextField(&args);
+    long long first, last, offset, length;
+    if (!name || !pwd || !from || !until) return usage(out, "lines");
+    if (parseCount(from, &first) != 0 || parseCount(until, &last) != 0 ||
+        first < 1 || last < first)
+        return fail(out, "lines", 0, "bad line range");
+    if (unlock(out, "lines", name, pwd) != 0) return -1;
+
+    if (model_findLines(name, first, last - first + 1, &offset, &length) != 0)
+        return fail(out, "lines", -1, "error reading file");
+    return sendRange(out, "lines", name, offset, length);
+}
+
+static int cmdBytes(char *args, FILE *out) {
+    char     *name = nextField(&args);
+    char     *pwd  = nextField(&args);
+    char     *off  = nextField(&args);
+    char     *len  = nextField(&args);
+    long long offset, length;
+    if (!name || !pwd || !off || !len) return usage(out, "bytes");
+    if (parseCount(off, &offset) != 0 || parseCount(len, &length) != 0)
+        return fail(out, "bytes", 0, "bad byte range");
+    if (unlock(out, "bytes", name, pwd) != 0) return -1;
+    return sendRange(out, "bytes", name, offset, length);
+}
+
+static int cmdVersions(char *args, FILE *out) {
+    char     *name  = nextField(&args);
+    char     *pwd   = nextField(&args);
+    char     *from  = nextField(&args);
+    char     *count = nextField(&args);
+    long long first = 1, want = VERSIONS_MAX;
+    if (!name || !pwd) return usage(out, "versions");
+    if ((from && (parseCount(from, &first) != 0 || first < 1)) ||
+        (count && parseCount(count, &want) != 0))
+        return fail(out, "versions", 0, "bad version range");
+    if (unlock(out, "versions", name, pwd) != 0) return -1;
+
+    long long total = model_countVersions(name);
+    if (want > VERSIONS_MAX) want = VERSIONS_MAX;
+    ModelVersion *list = (ModelVersion *)malloc(sizeof(ModelVersion) * (size_t)(want + 1));
+    if (!list) return fail(out, "versions", -1, "out of memory");
+    int n = total < 0 ? -1 : model_getVersions(name, first, list, (int)want);
+    if (n < 0) {
+        free(list);
+        return fail(out, "versions", -1, "error reading history");
+    }
+    fprintf(out, "ok versions %lld %d", total, n);
+    for (int i = 0; i < n; i++)
+        fprintf(out, " %lld %lld %lld %08x", list[i].offset, list[i].length, list[i].time,
+                (unsigned)list[i].check);
+    putc('\n', out);
+    free(list);
+    return 0;
+}
+
+static int discardChunk(void *ctx, const char *data, size_t len) {
+    (void)ctx;
+    (void)data;
+    (void)len;
+    return 0;
+}
+
+static int cmdAsof(char *args, FILE *out) {
+    char     *name = nextField(&args);
+    char     *pwd  = nextField(&args);
+    char     *at   = nextField(&args);
+    long long version, offset, length;
+    if (!name || !pwd || !at) return usage(out, "asof");
+    int byTime = at[0] == '@';
+    if (parseCount(at + byTime, &version) != 0)
+        return fail(out, "asof", 0, "bad version or time");
+    if (unlock(out, "asof", name, pwd) != 0) return -1;
+    if (byTime && (version = model_findVersion(name, version)) < 0)
+        return fail(out, "asof", -1, "error reading history");
+
+    /* checked in a first pass, so a mismatch is reported before any
+     * content is sent and nothing is held in memory */
+    int res = model_readVersion(name, version, discardChunk, NULL);
+    if (res == -2) return fail(out, "asof", res, "content does not match its versions");
+    if (res != 0 || model_diffVersions(name, 0, version, &offset, &length) != 0)
+        return fail(out, "asof", -1, "no such version or error reading file");
+
+    fprintf(out, "ok asof %lld %lld\n", version, length);
+    ViewSink sink = { out, length };
+    return endBody(out, "asof",
+                   length > 0 ? model_readRange(name, 0, length, viewChunk, &sink) : 0, &sink);
+}
+
+static int cmdDiff(char *args, FILE *out) {
+    char     *name = nextField(&args);
+    char     *pwd  = nextField(&args);
+    char     *a    = nextField(&args);
+    char     *b    = nextField(&args);
+    long long from, to, offset, length;
+    if (!name || !pwd || !a || !b) return usage(out, "diff");
+    if (parseCount(a, &from) != 0 || parseCount(b, &to) != 0)
+        return fail(out, "diff", 0, "bad version");
+    if (unlock(out, "diff", name, pwd) != 0) return -1;
+
+    if (model_diffVersions(name, from, to, &offset, &length) != 0)
+        return fail(out, "diff", -1, "no such version or error reading history");
+    return sendRange(out, "diff", name, offset, length);
+}
+
+static int cmdChpass(char *args, FILE *out) {
+    char *name   = nextField(&args);
+    char *oldPwd = nextField(&args);
+    char *newPwd = nextField(&args);
+    if (!name || !oldPwd || !newPwd) return usage(out, "chpass");
+
+    int res = model_changePassword(name, oldPwd, newPwd);
+    if (res == -1) return fail(out, "chpass", res, "file not found");
+    if (res == -2) return fail(out, "chpass", res, "incorrect password");
+    if (res != 0)  return fail(out, "chpass", res, "new password is too long");
+    fputs("ok chpass\n", out);
+    return 0;
+}
+
+/* a password unlocks the file first, which undoing or redoing an append
+ * that recompressed a block needs */
+static int undoRedo(char *args, FILE *out, int redo) {
+    const char *cmd  = redo ? "redo" : "undo";
+    char       *name = nextField(&args);
+    char       *pwd  = nextField(&args);
+    char        done[MAX_LEN];
+    int res;
+
+    if (name && pwd && unlock(out, cmd, name, pwd) != 0) return -1;
+    if (name) {
+        res = redo ? model_redoFileAppend(name) : model_undoFileAppend(name);
+        strncpy(done, name, sizeof(done) - 1);
+        done[sizeof(done) - 1] = '\0';
+    } else {
+        res = redo ? model_redoLastUndo(done, sizeof(done))
+                   : model_undoLastAppend(done, sizeof(done));
+    }
+
+    if (res == 0)  return fail(out, cmd, res, "nothing to do");
+    if (res == -2) return fail(out, cmd, res, "file was changed outside the vault");
+    if (res == -3) {
+        fprintf(out, "err %s %d file is not unlocked; run: %s ", cmd, res, cmd);
+        putEscaped(out, done);
+        fputs(" <password>\n", out);
+        return -1;
+    }
+    if (res != 1)  return fail(out, cmd, res, "file or memory error");
+    fprintf(out, "ok %s ", cmd);
+    putEscaped(out, done);
+    putc('\n', out);
+    return 0;
+}
+
+static int cmdUndo(char *args, FILE *out) {
+    return undoRedo(args, out, 0);
+}
+
+static int cmdRedo(char *args, FILE *out) {
+    return undoRedo(args, out, 1);
+}
+
+#define RECENT_BATCH_MAX 1024   /* names per "recent" reply */
+
+static int cmdRecent(char *args, FILE *out) {
+    char *countArg  = nextField(&args);
+    char *offsetArg = nextField(&args);
+    int   want      = countArg ? atoi(countArg) : RECENT_MAX;
+    int   offset    = offsetArg ? atoi(offsetArg) : 0;
+    if (want < 0) want = 0;
+    if (want > RECENT_BATCH_MAX) want = RECENT_BATCH_MAX;
+
+    char (*names)[MAX_LEN] = NULL;
+    if (want > 0) {
+        names = (char (*)[MAX_LEN])malloc(sizeof(*names) * (size_t)want);
+        if (!names) return fail(out, "recent", -1, "out of memory");
+    }
+
+    int count = names ? model_getRecentPage(names, offset, want) : 0;
+    fprintf(out, "ok recent %d", count);
+    for (int i = 0; i < count; i++) {
+        putc(' ', out);
+        putEscaped(out, names[i]);
+    }
+    putc('\n', out);
+    free(names);
+    return 0;
+}
+
+static int countHit(void *ctx, const char *filename, long long hits) {
+    (void)ctx;
+    (void)filename;
+    (void)hits;
+    return 0;
+}
+
+typedef struct {
+    FILE *out;
+    int   left;   /* pairs the result line announced */
+} HitSink;
+
+static int putHit(void *ctx, const char *filename, long long hits) {
+    HitSink *s = (HitSink *)ctx;
+    if (s->left == 0) return 1;
+    s->left--;
+    putc(' ', s->out);
+    putEscaped(s->out, filename);
+    fprintf(s->out, " %lld", hits);
+    return 0;
+}
+
+static int cmdSearch(char *args, FILE *out) {
+    char *term = restOfLine(&args);
+    if (!term) return usage(out, "search");
+
+    /* the count comes first: taken in a first pass, which only looks
+     * the word up in the index, so the pairs are sent as they come */
+    int res = model_search(term, countHit, NULL);
+    if (res == -2) return fail(out, "search", res, "not a single word");
+    if (res < 0)   return fail(out, "search", res, "index unavailable");
+
+    fprintf(out, "ok search %d", res);
+    HitSink sink = { out, res };
+    if (res > 0) model_search(term, putHit, &sink);
+    putc('\n', out);
+    return 0;
+}
+
+static int cmdVerify(char *args, FILE *out) {
+    char *name = nextField(&args);
+    if (!name) return usage(out, "verify");
+
+    int res = model_verifyFile(name);
+    if (res == -1) return fail(out, "verify", res, "file not found or unreadable");
+    if (res == MODEL_SUM_CHANGED)
+        return fail(out, "verify", res, "file was changed outside the vault");
+    if (res == MODEL_SUM_DAMAGED) return fail(out, "verify", res, "checksum mismatch");
+    fprintf(out, "ok verify %s\n", res == MODEL_SUM_NEW ? "new" : "ok");
+    return 0;
+}
+
+static const char *sumWord(int status) {
+    switch (status) {
+        case MODEL_SUM_OK:      return "ok";
+        case MODEL_SUM_NEW:     return "new";
+        case MODEL_SUM_CHANGED: return "changed";
+        case MODEL_SUM_DAMAGED: return "damaged";
+        default:                return "unreadable";
+    }
+}
+
+/* the result line of a scrub, its head sent once the totals are in */
+typedef struct {
+    FILE                  *out;
+    const ModelScrub      *r;
+    const struct timespec *t0;
+    int                    started;
+} ScrubSink;
+
+static void scrubHead(ScrubSink *s) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    const ModelScrub *r    = s->r;
+    double            secs = (double)(t1.tv_sec - s->t0->tv_sec) +
+                             (double)(t1.tv_nsec - s->t0->tv_nsec) / 1e9;
+    long              n    = r->files - r->status[MODEL_SUM_OK] + (r->indexDamaged ? 1 : 0);
+    fprintf(s->out, "ok scrub %ld %lld %.1f %ld", r->files, r->bytes,
+            secs > 0 ? (double)r->bytes / (1 << 20) / secs : 0.0, n);
+    s->started = 1;
+}
+
+static int putProblem(void *ctx, const char *filename, int status) {
+    ScrubSink *s = (ScrubSink *)ctx;
+    if (!s->started) scrubHead(s);
+    putc(' ', s->out);
+    putEscaped(s->out, filename);
+    fprintf(s->out, " %s", sumWord(status));
+    return 0;
+}
+
+static int cmdScrub(char *args, FILE *out) {
+    char *threadsArg = nextField(&args);
+    int   threads    = threadsArg ? atoi(threadsArg) : 0;
+    if (threads < 0) threads = 0;
+
+    /* the totals come first; model_scrub has them before the first
+     * problem is handed over, so the pairs are sent as they come */
+    struct timespec t0;
+    ModelScrub      r;
+    ScrubSink       sink = { out, &r, &t0, 0 };
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int res = model_scrub(threads, putProblem, &sink, &r);
+    if (res != 0) return fail(out, "scrub", res, "out of memory");
+    if (r.indexDamaged) putProblem(&sink, "vault.idx", MODEL_SUM_DAMAGED);
+    if (!sink.started) scrubHead(&sink);
+    putc('\n', out);
+    return 0;
+}
+
+/* shared by import/export/restore: the result line, rate included */
+static int bulkResult(FILE *out, const char *cmd, const ModelBulk *r,
+                      const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0->tv_sec) + (double)(t1.tv_nsec - t0->tv_nsec) / 1e9;
+    fprintf(out, "ok %s %ld %lld %.1f %ld %ld\n", cmd, r->files, r->bytes,
+            secs > 0 ? (double)r->bytes / (1 << 20) / secs : 0.0, r->skipped, r->failed);
+    return 0;
+}
+
+static int cmdImport(char *args, FILE *out) {
+    char *dir        = nextField(&args);
+    char *pwd        = nextField(&args);
+    char *threadsArg = nextField(&args);
+    char *manifest   = nextField(&args);
+    int   threads    = threadsArg ? atoi(threadsArg) : 0;
+    if (!dir || !pwd) return usage(out, "import");
+    if (strcmp(pwd, "-") == 0) pwd = NULL;
+
+    struct timespec t0;
+    ModelBulk       r;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int res = model_importTree(dir, pwd, manifest, threads < 0 ? 0 : threads, &r);
+    if (res != 0) return fail(out, "import", res, "cannot read the directory or manifest");
+    return bulkResult(out, "import", &r, &t0);
+}
+
+static int cmdExport(char *args, FILE *out) {
+    char *path       = nextField(&args);
+    char *threadsArg = nextField(&args);
+    int   threads    = threadsArg ? atoi(threadsArg) : 0;
+    if (!path) return usage(out, "export");
+
+    struct timespec t0;
+    ModelBulk       r;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int res = model_exportArchive(path, threads < 0 ? 0 : threads, &r);
+    if (res != 0) return fail(out, "export", res, "cannot write the archive");
+    return bulkResult(out, "export", &r, &t0);
+}
+
+static int cmdRestore(char *args, FILE *out) {
+    char *path       = nextField(&args);
+    char *threadsArg = nextField(&args);
+    int   threads    = threadsArg ? atoi(threadsArg) : 0;
+    if (!path) return usage(out, "restore");
+
+    struct timespec t0;
+    ModelBulk       r;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int res = model_importArchive(path, threads < 0 ? 0 : threads, &r);
+    if (res == -2) return fail(out, "restore", res, "archive is damaged");
+    if (res != 0)  return fail(out, "restore", res, "cannot read the archive");
+    return bulkResult(out, "restore", &r, &t0);
+}
+
+static int cmdStats(char *args, FILE *out) {
+    (void)args;
+    fprintf(out, "ok stats ");
+    stats_writeJson(out, 0);
+    putc('\n', out);
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    BatchCmdFn  fn;
+} commands[] = {
+    { "add",    cmdAdd    },
+    { "append", cmdAppend },
+    { "view",   cmdView   },
+    { "tail",   cmdTail   },
+    { "lines",  cmdLines  },
+    { "bytes",  cmdBytes  },
+    { "versions", cmdVersions },
+    { "asof",   cmdAsof   },
+    { "diff",   cmdDiff   },
+    { "chpass", cmdChpass },
+    { "undo",   cmdUndo   },
+    { "redo",   cmdRedo   },
+    { "recent", cmdRecent },
+    { "search", cmdSearch },
+    { "verify", cmdVerify },
+    { "scrub",  cmdScrub  },
+    { "import", cmdImport },
+    { "export", cmdExport },
+    { "restore", cmdRestore },
+    { "stats",  cmdStats  },
+};
+
+/* ---------- public ---------- */
+
+int batch_run(FILE *in, FILE *out) {
+    static char outBuf[BATCH_OUT_BUF];
+    setvbuf(out, outBuf, _IOFBF, sizeof(outBuf));
+
+    char  *line = NULL;
+    size_t cap  = 0;
+    int    failed = 0;
+    ssize_t len;
+
+    while ((len = getline(&line, &cap, in)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+
+        char *cursor = line;
+        char *cmd    = nextField(&cursor);
+        if (!cmd || cmd[0] == '#') continue;
+
+        size_t i = 0, n = sizeof(commands) / sizeof(commands[0]);
+        while (i < n && strcmp(commands[i].name, cmd) != 0) i++;
+
+        if (i == n) {
+            fprintf(out, "err ");
+            putEscaped(out, cmd);
+            fprintf(out, " 0 unknown command\n");
+            failed++;
+        } else if (commands[i].fn(cursor, out) != 0) {
+            failed++;
+        }
+    }
+
+    free(line);
+    fflush(out);
+    return failed;
+}
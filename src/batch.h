@@ -0,0 +1,62 @@
+// batch.h - non-interactive controller: one command per input line
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+
+/*
+ * Commands (fields separated by spaces; inside a field "\ " is a space,
+ * "\n" a newline, "\t" a tab and "\\" a backslash):
+ *
+ *   add    <name> <password>
+ *   append <name> <password> <text...>     text is the rest of the line
+ *   view   <name> <password>
+ *   tail   <name> <password> [n]           the last n lines (default 10)
+ *   lines  <name> <password> <first> <last>   lines counted from 1
+ *   bytes  <name> <password> <offset> <length>
+ *   versions <name> <password> [first [count]]   versions counted from 1
+ *   asof   <name> <password> <version|@ms>   the file as of a version, or
+ *                                          of the time in ms since 1970
+ *   diff   <name> <password> <from> <to>   what the later version added
+ *   chpass <name> <old> <new>
+ *   undo   [name [password]]               the password unlocks name first,
+ *   redo   [name [password]]               as a recompressed block needs
+ *   recent [count [offset]]
+ *   search <word>                          files unlocked by this session
+ *   verify <name>                          the file against its checksum
+ *   scrub  [threads]                       verify every file (0 = per CPU)
+ *   import <dir> <password> [threads [manifest]]
+ *                                          every file under dir; password
+ *                                          "-" = only those in the manifest
+ *   export <archive> [threads]             the whole vault, as stored
+ *   restore <archive> [threads]            the files of an archive
+ *   stats                                  one-line JSON (see stats.h)
+ *
+ * Each command produces exactly one result line on out:
+ *
+ *   ok <command> [fields...]
+ *   err <command> <code> <message>
+ *
+ * "ok search <n>" is followed by n pairs "<name> <matches>", most
+ * matches first.
+ * "ok scrub <files> <bytes> <MiB/s> <n>" is followed by n pairs
+ * "<name> <new|changed|damaged|unreadable>", vault.idx included.
+ * "ok import|export|restore <files> <bytes> <MiB/s> <skipped> <failed>".
+ * "ok versions <total> <n>" is followed by n groups "<offset> <length>
+ * <ms> <check>" for versions first to first + n - 1, check in hex.
+ * "ok asof <version> <n>" is followed by n raw content bytes and a
+ * newline, checked against the versions' records before any is sent.
+ * "ok view <n>" is followed by exactly n raw content bytes and a newline,
+ * and so are "ok tail", "ok lines", "ok bytes" and "ok diff". If reading
+ * fails after the result line went out, the bytes not read are NULs and
+ * the newline becomes "err <command> <code> <message>" and a newline,
+ * so the command still fails; a file that shrank meanwhile is only
+ * padded with NULs.
+ * Blank lines and lines starting with '#' are ignored.
+ */
+
+int batch_run(FILE *in, FILE *out);
+/* returns the number of commands that failed */
+
+#endif // BATCH_H
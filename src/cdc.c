@@ -0,0 +1,44 @@
+// cdc.c - gear-hash chunk boundaries
+
+#include "cdc.h"
+#include <pthread.h>
+#include <stdint.h>
+
+/* FastCDC's masks for 8 KiB chunks: 15 and 11 bits, spread out */
+#define MASK_SMALL 0x0000d9f003530000ull   /* before CDC_AVG */
+#define MASK_LARGE 0x0000d90003530000ull   /* from CDC_AVG on */
+
+static uint64_t       gear[256];
+static pthread_once_t gearOnce = PTHREAD_ONCE_INIT;
+
+/* splitmix64 from a fixed seed: any 256 well-mixed values would do, as
+ * long as they never change */
+static void initGear(void) {
+    uint64_t x = 0x46562d4344432d31ull;   /* "FV-CDC-1" */
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+size_t cdc_cut(const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    if (len <= CDC_MIN) return len;
+    pthread_once(&gearOnce, initGear);
+
+    size_t   end    = len < CDC_MAX ? len : CDC_MAX;
+    size_t   normal = end < CDC_AVG ? end : CDC_AVG;
+    size_t   i      = CDC_MIN;
+    uint64_t h      = 0;
+    for (; i < normal; i++) {
+        h = (h << 1) + gear[p[i]];
+        if (!(h & MASK_SMALL)) return i + 1;
+    }
+    for (; i < end; i++) {
+        h = (h << 1) + gear[p[i]];
+        if (!(h & MASK_LARGE)) return i + 1;
+    }
+    return end;
+}
@@ -0,0 +1,28 @@
+// cdc.h - content-defined chunking with a gear rolling hash (FastCDC)
+
+#ifndef CDC_H
+#define CDC_H
+
+#include <stddef.h>
+
+/*
+ * Chunk boundaries depend only on the bytes just before them, so an
+ * insertion or a shifted copy of some text moves the boundaries around
+ * it and leaves the rest where they were: equal regions of different
+ * files come out as equal chunks. The hash is a gear hash,
+ * h = (h << 1) + gear[byte], cut where its masked bits are all zero.
+ * Past CDC_MIN a mask with more bits makes cuts rarer until CDC_AVG and
+ * one with fewer makes them likelier after ("normalized chunking"), so
+ * chunk sizes gather around CDC_AVG. The gear table is fixed: the same
+ * bytes are cut the same way in every process and version.
+ */
+#define CDC_MIN (2 * 1024)
+#define CDC_AVG (8 * 1024)
+#define CDC_MAX (64 * 1024)
+
+size_t cdc_cut(const void *data, size_t len);
+/* the length of the chunk data starts with: a content-defined cut
+ * between CDC_MIN and CDC_MAX, or CDC_MAX, or all of len when it is
+ * shorter than that and holds no cut */
+
+#endif // CDC_H
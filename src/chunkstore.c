@@ -0,0 +1,303 @@
+// chunkstore.c - content-addressed chunk pack with a journaled index
+
+#include "chunkstore.h"
+#include "cipher.h"
+#include "journal.h"
+#include "kdf.h"
+#include "lz.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RECORD_LEN (CHUNK_KEY_LEN + 8 + 4 + 4 + 1)
+
+typedef struct {
+    unsigned char id[CHUNK_KEY_LEN];
+    ChunkLoc      loc;
+} ChunkEntry;
+
+struct ChunkStore {
+    int         packFd;
+    uint64_t    packEnd;         /* where the next body goes */
+    Journal     log;
+    int         syncAlways;
+    ChunkEntry *entries;
+    int         count, cap;
+    int32_t    *slots;           /* entry index, -1 = empty */
+    size_t      slotCap;         /* power of two, at least twice count */
+    uint64_t    plainBytes, storedBytes;
+};
+
+static const unsigned char zeroNonce[CIPHER_NONCE_LEN];
+
+/* ---------- helper: encoding ---------- */
+
+static void putU32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t getU32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void putU64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t getU64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+static void idOf(const unsigned char key[CHUNK_KEY_LEN], unsigned char id[CHUNK_KEY_LEN]) {
+    Sha256 h;
+    sha256_init(&h);
+    sha256_update(&h, key, CHUNK_KEY_LEN);
+    sha256_final(&h, id);
+}
+
+/* ---------- helper: table ---------- */
+
+/* ids are hashes already: their first bytes pick the slot */
+static size_t slotOf(const ChunkStore *s, const unsigned char *id) {
+    return (size_t)getU64(id) & (s->slotCap - 1);
+}
+
+static int lookup(const ChunkStore *s, const unsigned char *id) {
+    if (s->slotCap == 0) return -1;
+    for (size_t i = slotOf(s, id); s->slots[i] >= 0; i = (i + 1) & (s->slotCap - 1))
+        if (memcmp(s->entries[s->slots[i]].id, id, CHUNK_KEY_LEN) == 0)
+            return s->slots[i];
+    return -1;
+}
+
+static int grow(ChunkStore *s) {
+    if (s->count == s->cap) {
+        int         cap = s->cap ? s->cap * 2 : 1024;
+        ChunkEntry *e   = (ChunkEntry *)realloc(s->entries, sizeof(ChunkEntry) * (size_t)cap);
+        if (!e) return -1;
+        s->entries = e;
+        s->cap     = cap;
+    }
+    if ((size_t)(s->count + 1) * 2 <= s->slotCap) return 0;
+
+    size_t   cap   = s->slotCap ? s->slotCap * 2 : 2048;
+    int32_t *slots = (int32_t *)malloc(sizeof(int32_t) * cap);
+    if (!slots) return -1;
+    memset(slots, 0xff, sizeof(int32_t) * cap);
+    free(s->slots);
+    s->slots   = slots;
+    s->slotCap = cap;
+    for (int n = 0; n < s->count; n++) {
+        size_t i = slotOf(s, s->entries[n].id);
+        while (slots[i] >= 0) i = (i + 1) & (cap - 1);
+        slots[i] = n;
+    }
+    return 0;
+}
+
+static int insert(ChunkStore *s, const unsigned char *id, const ChunkLoc *loc) {
+    if (grow(s) != 0) return -1;
+    size_t i = slotOf(s, id);
+    while (s->slots[i] >= 0) i = (i + 1) & (s->slotCap - 1);
+    memcpy(s->entries[s->count].id, id, CHUNK_KEY_LEN);
+    s->entries[s->count].loc = *loc;
+    s->slots[i]     = s->count++;
+    s->plainBytes  += loc->length;
+    s->storedBytes += loc->stored;
+    return 0;
+}
+
+static void replayRecord(void *ctx, const unsigned char *rec, size_t len) {
+    ChunkStore *s = (ChunkStore *)ctx;
+    if (len != RECORD_LEN) return;
+
+    ChunkLoc loc;
+    loc.offset = getU64(rec + CHUNK_KEY_LEN);
+    loc.stored = getU32(rec + CHUNK_KEY_LEN + 8);
+    loc.length = getU32(rec + CHUNK_KEY_LEN + 12);
+    loc.packed = rec[CHUNK_KEY_LEN + 16] != 0;
+    if (loc.stored == 0 || loc.length == 0 || loc.length > CHUNK_MAX ||
+        loc.offset + loc.stored > s->packEnd || lookup(s, rec) >= 0)
+        return;   /* torn body, or a record written twice */
+    insert(s, rec, &loc);
+}
+
+/* writes the stored body of chunk id at loc->offset, the end of the
+ * pack, then its record. returns 1 or -1 */
+static int appendBody(ChunkStore *s, const unsigned char *id, const ChunkLoc *loc,
+                      const unsigned char *body) {
+    /* the body first: a record must never point at bytes not written */
+    size_t n = loc->stored, done = 0;
+    while (done < n) {
+        ssize_t w = pwrite(s->packFd, body + done, n - done, (off_t)(loc->offset + done));
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) break;
+        done += (size_t)w;
+    }
+    if (done < n || (s->syncAlways && fdatasync(s->packFd) != 0)) return -1;
+    s->packEnd += n;
+
+    unsigned char rec[RECORD_LEN];
+    memcpy(rec, id, CHUNK_KEY_LEN);
+    putU64(rec + CHUNK_KEY_LEN, loc->offset);
+    putU32(rec + CHUNK_KEY_LEN + 8, loc->stored);
+    putU32(rec + CHUNK_KEY_LEN + 12, loc->length);
+    rec[CHUNK_KEY_LEN + 16] = (unsigned char)loc->packed;
+    if (journal_append(&s->log, rec, sizeof(rec)) != 0 || insert(s, id, loc) != 0)
+        return -1;
+    return 1;
+}
+
+/* ---------- public ---------- */
+
+ChunkStore *chunkstore_open(const char *packPath, const char *logPath) {
+    ChunkStore *s = (ChunkStore *)calloc(1, sizeof(ChunkStore));
+    if (!s) return NULL;
+    s->log.fd = -1;
+    s->packFd = open(packPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+    struct stat st;
+    if (s->packFd < 0 || fstat(s->packFd, &st) != 0) {
+        chunkstore_close(s);
+        return NULL;
+    }
+    s->packEnd = (uint64_t)st.st_size;
+
+    long valid = journal_replay(logPath, replayRecord, s);
+    if (journal_open(&s->log, logPath, valid) != 0) {
+        chunkstore_close(s);
+        return NULL;
+    }
+    journal_setSync(&s->log, JOURNAL_SYNC_NONE, 0, 0);
+    return s;
+}
+
+void chunkstore_close(ChunkStore *s) {
+    if (!s) return;
+    journal_close(&s->log);
+    if (s->packFd >= 0) close(s->packFd);
+    free(s->entries);
+    free(s->slots);
+    free(s);
+}
+
+void chunkstore_setSync(ChunkStore *s, int mode, int groupSize, int groupMs) {
+    journal_setSync(&s->log, mode, groupSize, groupMs);
+    s->syncAlways = mode == JOURNAL_SYNC_ALWAYS;
+}
+
+void chunkstore_key(const void *data, size_t len, unsigned char key[CHUNK_KEY_LEN]) {
+    Sha256 h;
+    sha256_init(&h);
+    sha256_update(&h, data, len);
+    sha256_final(&h, key);
+}
+
+int chunkstore_put(ChunkStore *s, const unsigned char key[CHUNK_KEY_LEN],
+                   const void *data, size_t len, int compress) {
+    unsigned char id[CHUNK_KEY_LEN];
+    idOf(key, id);
+    if (lookup(s, id) >= 0) return 0;
+    if (len == 0 || len > CHUNK_MAX) return -1;
+
+    unsigned char *body = (unsigned char *)malloc(len);
+    if (!body) return -1;
+    ChunkLoc loc = { s->packEnd, 0, (uint32_t)len, 0 };
+    size_t   n   = compress ? lz_compress(data, len, body, len - 1) : 0;
+    if (n > 0) {
+        loc.packed = 1;
+    } else {
+        memcpy(body, data, len);
+        n = len;
+    }
+    loc.stored = (uint32_t)n;
+    chacha20_xor(key, zeroNonce, 0, body, body, n);
+    int rc = appendBody(s, id, &loc, body);
+    free(body);
+    return rc;
+}
+
+int chunkstore_putStored(ChunkStore *s, const unsigned char id[CHUNK_KEY_LEN],
+                         const ChunkLoc *loc, const void *body) {
+    if (lookup(s, id) >= 0) return 0;
+    if (loc->stored == 0 || loc->length == 0 || loc->length > CHUNK_MAX) return -1;
+    ChunkLoc at = *loc;
+    at.offset   = s->packEnd;
+    return appendBody(s, id, &at, body);
+}
+
+int chunkstore_find(const ChunkStore *s, const unsigned char key[CHUNK_KEY_LEN],
+                    ChunkLoc *loc) {
+    unsigned char id[CHUNK_KEY_LEN];
+    idOf(key, id);
+    int n = lookup(s, id);
+    if (n < 0) return -1;
+    *loc = s->entries[n].loc;
+    return 0;
+}
+
+int chunkstore_load(const ChunkStore *s, const ChunkLoc *loc,
+                    const unsigned char key[CHUNK_KEY_LEN], void *out) {
+    unsigned char *body = loc->packed ? (unsigned char *)malloc(loc->stored)
+                                      : (unsigned char *)out;
+    if (!body || (!loc->packed && loc->stored != loc->length)) {
+        if (loc->packed) free(body);
+        return -1;
+    }
+
+    size_t done = 0;
+    while (done < loc->stored) {
+        ssize_t n = pread(s->packFd, body + done, loc->stored - done,
+                          (off_t)(loc->offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    int rc = done == loc->stored ? 0 : -1;
+    if (rc == 0) chacha20_xor(key, zeroNonce, 0, body, body, loc->stored);
+    if (rc == 0 && loc->packed)
+        rc = lz_decompress(body, loc->stored, out, loc->length);
+    if (loc->packed) free(body);
+
+    unsigned char check[CHUNK_KEY_LEN];
+    if (rc == 0) {
+        chunkstore_key(out, loc->length, check);
+        if (memcmp(check, key, CHUNK_KEY_LEN) != 0) rc = -1;
+    }
+    return rc;
+}
+
+int chunkstore_readStored(const ChunkStore *s, const ChunkLoc *loc, void *out) {
+    size_t done = 0;
+    while (done < loc->stored) {
+        ssize_t n = pread(s->packFd, (unsigned char *)out + done, loc->stored - done,
+                          (off_t)(loc->offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    return done == loc->stored ? 0 : -1;
+}
+
+int chunkstore_count(const ChunkStore *s) {
+    return s->count;
+}
+
+void chunkstore_entry(const ChunkStore *s, int i, unsigned char id[CHUNK_KEY_LEN],
+                      ChunkLoc *loc) {
+    memcpy(id, s->entries[i].id, CHUNK_KEY_LEN);
+    *loc = s->entries[i].loc;
+}
+
+void chunkstore_usage(const ChunkStore *s, uint64_t *chunks,
+                      uint64_t *plainBytes, uint64_t *storedBytes) {
+    *chunks      = (uint64_t)s->count;
+    *plainBytes  = s->plainBytes;
+    *storedBytes = s->storedBytes;
+}
@@ -0,0 +1,98 @@
+// chunkstore.h - content-addressed store of encrypted chunks shared by files
+
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A chunk is stored once however many files hold it. Its key is the
+ * SHA-256 of its plaintext and its id the SHA-256 of the key: the store
+ * finds chunks by id, but only a holder of the key, which files keep in
+ * their frames under their own data key (cipher.h), can read one. This
+ * is convergent encryption; equal chunks encrypt equally, which is what
+ * lets files with different keys share them, and which also lets anyone
+ * who can guess a chunk's whole plaintext confirm that it is stored.
+ *
+ * Storage, all little-endian:
+ *   vault.chunks      the chunk bodies back to back, each ChaCha20 under
+ *                     its key with a zero nonce (a key only ever
+ *                     encrypts one plaintext), lz.h-compressed first
+ *                     when asked to and that pays
+ *   vault.chunks.log  one journal record per chunk (journal.h):
+ *                     id[32] | u64 offset | u32 stored length |
+ *                     u32 plaintext length | u8 compressed
+ * A body is written before its record, and records pointing past the
+ * end of vault.chunks are dropped at open; loads check every chunk
+ * against its key. Chunks are never removed, since undone appends keep
+ * their frames for redo.
+ *
+ * Not thread-safe: callers serialize open/put/find/close. chunkstore_load
+ * and chunkstore_readStored only read the pack, so they may run
+ * alongside them.
+ */
+#define CHUNK_KEY_LEN 32
+#define CHUNK_MAX     (64 * 1024)
+
+typedef struct {
+    uint64_t offset;
+    uint32_t stored;         /* bytes in vault.chunks */
+    uint32_t length;         /* plaintext bytes */
+    int      packed;
+} ChunkLoc;
+
+typedef struct ChunkStore ChunkStore;
+
+ChunkStore *chunkstore_open(const char *packPath, const char *logPath);
+/* returns the store, its files created if needed, or NULL */
+
+void chunkstore_close(ChunkStore *s);
+
+void chunkstore_setSync(ChunkStore *s, int mode, int groupSize, int groupMs);
+/* journal.h policies; with JOURNAL_SYNC_ALWAYS the body is synced
+ * before its record too */
+
+void chunkstore_key(const void *data, size_t len, unsigned char key[CHUNK_KEY_LEN]);
+
+int  chunkstore_put(ChunkStore *s, const unsigned char key[CHUNK_KEY_LEN],
+                    const void *data, size_t len, int compress);
+/* stores the len bytes (1..CHUNK_MAX) whose key is key, unless stored.
+ * returns:
+ *   1 = stored
+ *   0 = already stored
+ *  -1 = write error or out of memory
+ */
+
+int  chunkstore_find(const ChunkStore *s, const unsigned char key[CHUNK_KEY_LEN],
+                     ChunkLoc *loc);
+/* returns 0, or -1 if no chunk has this key */
+
+int  chunkstore_load(const ChunkStore *s, const ChunkLoc *loc,
+                     const unsigned char key[CHUNK_KEY_LEN], void *out);
+/* decrypts the chunk at loc into out (loc->length bytes).
+ * returns 0, or -1 on a read error or a chunk not matching its key */
+
+/* Moving chunks between stores as they are, for archives: neither side
+ * needs a key, and an id is stored at most once either way. */
+int  chunkstore_count(const ChunkStore *s);
+void chunkstore_entry(const ChunkStore *s, int i, unsigned char id[CHUNK_KEY_LEN],
+                      ChunkLoc *loc);
+/* the id and location of the i-th chunk stored (0 <= i < count), in the
+ * order they were stored */
+
+int  chunkstore_readStored(const ChunkStore *s, const ChunkLoc *loc, void *out);
+/* copies the loc->stored bytes at loc, still encrypted, into out.
+ * returns 0 or -1 */
+
+int  chunkstore_putStored(ChunkStore *s, const unsigned char id[CHUNK_KEY_LEN],
+                          const ChunkLoc *loc, const void *body);
+/* stores body, a chunk as another store holds it under id (loc gives
+ * its lengths and packing; its offset is ignored), unless id is stored.
+ * returns the chunkstore_put codes */
+
+void chunkstore_usage(const ChunkStore *s, uint64_t *chunks,
+                      uint64_t *plainBytes, uint64_t *storedBytes);
+/* what the store holds: chunks, their plaintext and their stored size */
+
+#endif // CHUNKSTORE_H
@@ -0,0 +1,493 @@
+// cipher.c - ChaCha20 (portable, SSE2, AVX2) and frame sealing/opening
+
+#include "cipher.h"
+#include "kdf.h"
+#include "lz.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CIPHER_X86 1
+#endif
+
+/* blocks whole 64-byte blocks of in into out, advancing st[12] */
+typedef void (*BlocksFn)(uint32_t st[16], const unsigned char *in,
+                         unsigned char *out, size_t blocks);
+
+/* ---------- helper: portable ChaCha20 ---------- */
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define QR(a, b, c, d)                                   \
+    a += b; d ^= a; d = ROTL(d, 16);                     \
+    c += d; b ^= c; b = ROTL(b, 12);                     \
+    a += b; d ^= a; d = ROTL(d, 8);                      \
+    c += d; b ^= c; b = ROTL(b, 7)
+
+static uint32_t load32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void store32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static void setup(uint32_t st[16], const unsigned char key[CIPHER_KEY_LEN],
+                  const unsigned char nonce[CIPHER_NONCE_LEN], uint32_t counter) {
+    st[0] = 0x61707865;   /* "expand 32-byte k" */
+    st[1] = 0x3320646e;
+    st[2] = 0x79622d32;
+    st[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) st[4 + i] = load32(key + 4 * i);
+    st[12] = counter;
+    for (int i = 0; i < 3; i++) st[13 + i] = load32(nonce + 4 * i);
+}
+
+/* one keystream block for st, then st[12]++ */
+static void keystream(uint32_t st[16], unsigned char out[CIPHER_BLOCK]) {
+    uint32_t x[16];
+    memcpy(x, st, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        QR(x[0], x[4], x[8],  x[12]);
+        QR(x[1], x[5], x[9],  x[13]);
+        QR(x[2], x[6], x[10], x[14]);
+        QR(x[3], x[7], x[11], x[15]);
+        QR(x[0], x[5], x[10], x[15]);
+        QR(x[1], x[6], x[11], x[12]);
+        QR(x[2], x[7], x[8],  x[13]);
+        QR(x[3], x[4], x[9],  x[14]);
+    }
+    for (int i = 0; i < 16; i++) store32(out + 4 * i, x[i] + st[i]);
+    st[12]++;
+}
+
+static void xorBytes(unsigned char *out, const unsigned char *in,
+                     const unsigned char *ks, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, in + i, 8);
+        memcpy(&b, ks + i, 8);
+        a ^= b;
+        memcpy(out + i, &a, 8);
+    }
+    for (; i < len; i++) out[i] = in[i] ^ ks[i];
+}
+
+static void blocksPortable(uint32_t st[16], const unsigned char *in,
+                           unsigned char *out, size_t blocks) {
+    unsigned char ks[CIPHER_BLOCK];
+    for (size_t b = 0; b < blocks; b++) {
+        keystream(st, ks);
+        xorBytes(out + b * CIPHER_BLOCK, in + b * CIPHER_BLOCK, ks, CIPHER_BLOCK);
+    }
+}
+
+/* ---------- helper: SSE2, 4 blocks per pass ---------- */
+
+#ifdef CIPHER_X86
+
+/* state words are held "vertically": lane j of x[i] is word i of block j.
+ * Loops over the vectors are unrolled so the arrays stay in registers. */
+#define UNROLL _Pragma("GCC unroll 16")
+#define ROT4(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+#define ROT4_16(x) _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xb1), 0xb1)
+#define QR4(a, b, c, d)                                                       \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROT4_16(d);         \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROT4(b, 12);        \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROT4(d, 8);         \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROT4(b, 7)
+
+__attribute__((target("sse2")))
+static void blocksSse2(uint32_t st[16], const unsigned char *in,
+                       unsigned char *out, size_t blocks) {
+    for (; blocks >= 4; blocks -= 4, in += 4 * CIPHER_BLOCK, out += 4 * CIPHER_BLOCK) {
+        __m128i s[16], x[16];
+        UNROLL for (int i = 0; i < 16; i++) s[i] = _mm_set1_epi32((int)st[i]);
+        s[12] = _mm_add_epi32(s[12], _mm_setr_epi32(0, 1, 2, 3));
+        memcpy(x, s, sizeof(x));
+
+        for (int i = 0; i < 10; i++) {
+            QR4(x[0], x[4], x[8],  x[12]);
+            QR4(x[1], x[5], x[9],  x[13]);
+            QR4(x[2], x[6], x[10], x[14]);
+            QR4(x[3], x[7], x[11], x[15]);
+            QR4(x[0], x[5], x[10], x[15]);
+            QR4(x[1], x[6], x[11], x[12]);
+            QR4(x[2], x[7], x[8],  x[13]);
+            QR4(x[3], x[4], x[9],  x[14]);
+        }
+        UNROLL for (int i = 0; i < 16; i++) x[i] = _mm_add_epi32(x[i], s[i]);
+
+        /* transpose each group of four words back into block order */
+        UNROLL for (int g = 0; g < 4; g++) {
+            __m128i t0 = _mm_unpacklo_epi32(x[4 * g],     x[4 * g + 1]);
+            __m128i t1 = _mm_unpackhi_epi32(x[4 * g],     x[4 * g + 1]);
+            __m128i t2 = _mm_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m128i t3 = _mm_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m128i y[4] = { _mm_unpacklo_epi64(t0, t2), _mm_unpackhi_epi64(t0, t2),
+                             _mm_unpacklo_epi64(t1, t3), _mm_unpackhi_epi64(t1, t3) };
+            UNROLL for (int b = 0; b < 4; b++) {
+                const unsigned char *src = in + b * CIPHER_BLOCK + 16 * g;
+                __m128i v = _mm_loadu_si128((const __m128i *)src);
+                _mm_storeu_si128((__m128i *)(out + b * CIPHER_BLOCK + 16 * g),
+                                 _mm_xor_si128(v, y[b]));
+            }
+        }
+        st[12] += 4;
+    }
+    blocksPortable(st, in, out, blocks);
+}
+
+/* ---------- helper: AVX2, 8 blocks per pass ---------- */
+
+#define ROT8(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define QR8(a, b, c, d)                                                          \
+    a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a);                      \
+    d = _mm256_shuffle_epi8(d, r16);                                             \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = ROT8(b, 12);     \
+    a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a);                      \
+    d = _mm256_shuffle_epi8(d, r8);                                              \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = ROT8(b, 7)
+
+__attribute__((target("avx2")))
+static void blocksAvx2(uint32_t st[16], const unsigned char *in,
+                       unsigned char *out, size_t blocks) {
+    const __m256i r16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9,
+                                         14, 15, 12, 13, 2, 3, 0, 1, 6, 7, 4, 5,
+                                         10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i r8  = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10,
+                                         15, 12, 13, 14, 3, 0, 1, 2, 7, 4, 5, 6,
+                                         11, 8, 9, 10, 15, 12, 13, 14);
+
+    for (; blocks >= 8; blocks -= 8, in += 8 * CIPHER_BLOCK, out += 8 * CIPHER_BLOCK) {
+        __m256i s[16], x[16];
+        UNROLL for (int i = 0; i < 16; i++) s[i] = _mm256_set1_epi32((int)st[i]);
+        s[12] = _mm256_add_epi32(s[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        memcpy(x, s, sizeof(x));
+
+        for (int i = 0; i < 10; i++) {
+            QR8(x[0], x[4], x[8],  x[12]);
+            QR8(x[1], x[5], x[9],  x[13]);
+            QR8(x[2], x[6], x[10], x[14]);
+            QR8(x[3], x[7], x[11], x[15]);
+            QR8(x[0], x[5], x[10], x[15]);
+            QR8(x[1], x[6], x[11], x[12]);
+            QR8(x[2], x[7], x[8],  x[13]);
+            QR8(x[3], x[4], x[9],  x[14]);
+        }
+        UNROLL for (int i = 0; i < 16; i++) x[i] = _mm256_add_epi32(x[i], s[i]);
+
+        /* per 128-bit lane as in SSE2: y[g][b] holds words 4g..4g+3 of
+         * block b (low lane) and of block b + 4 (high lane) */
+        __m256i y[4][4];
+        UNROLL for (int g = 0; g < 4; g++) {
+            __m256i t0 = _mm256_unpacklo_epi32(x[4 * g],     x[4 * g + 1]);
+            __m256i t1 = _mm256_unpackhi_epi32(x[4 * g],     x[4 * g + 1]);
+            __m256i t2 = _mm256_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m256i t3 = _mm256_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+            y[g][0] = _mm256_unpacklo_epi64(t0, t2);
+            y[g][1] = _mm256_unpackhi_epi64(t0, t2);
+            y[g][2] = _mm256_unpacklo_epi64(t1, t3);
+            y[g][3] = _mm256_unpackhi_epi64(t1, t3);
+        }
+        UNROLL for (int b = 0; b < 4; b++) {
+            __m256i k[4] = {
+                _mm256_permute2x128_si256(y[0][b], y[1][b], 0x20),   /* block b */
+                _mm256_permute2x128_si256(y[2][b], y[3][b], 0x20),
+                _mm256_permute2x128_si256(y[0][b], y[1][b], 0x31),   /* block b+4 */
+                _mm256_permute2x128_si256(y[2][b], y[3][b], 0x31),
+            };
+            UNROLL for (int h = 0; h < 4; h++) {
+                size_t off = (size_t)(h < 2 ? b : b + 4) * CIPHER_BLOCK + 32 * (size_t)(h & 1);
+                __m256i v = _mm256_loadu_si256((const __m256i *)(in + off));
+                _mm256_storeu_si256((__m256i *)(out + off), _mm256_xor_si256(v, k[h]));
+            }
+        }
+        st[12] += 8;
+    }
+    blocksSse2(st, in, out, blocks);
+}
+
+#endif /* CIPHER_X86 */
+
+/* ---------- helper: dispatch ---------- */
+
+static pthread_once_t implOnce = PTHREAD_ONCE_INIT;
+static BlocksFn       blocksFn = blocksPortable;
+static int            implId   = CIPHER_IMPL_PORTABLE;
+
+static int implSupported(int impl) {
+#ifdef CIPHER_X86
+    __builtin_cpu_init();
+    if (impl == CIPHER_IMPL_AVX2) return __builtin_cpu_supports("avx2");
+    if (impl == CIPHER_IMPL_SSE2) return __builtin_cpu_supports("sse2");
+#endif
+    return impl == CIPHER_IMPL_PORTABLE;
+}
+
+static void useImpl(int impl) {
+    implId = impl;
+#ifdef CIPHER_X86
+    blocksFn = impl == CIPHER_IMPL_AVX2 ? blocksAvx2 :
+               impl == CIPHER_IMPL_SSE2 ? blocksSse2 : blocksPortable;
+#else
+    blocksFn = blocksPortable;
+#endif
+}
+
+static void pickImpl(void) {
+    useImpl(implSupported(CIPHER_IMPL_AVX2) ? CIPHER_IMPL_AVX2 :
+            implSupported(CIPHER_IMPL_SSE2) ? CIPHER_IMPL_SSE2 :
+                                              CIPHER_IMPL_PORTABLE);
+}
+
+int chacha20_setImpl(int impl) {
+    pthread_once(&implOnce, pickImpl);
+    if (!implSupported(impl)) return -1;
+    useImpl(impl);
+    return 0;
+}
+
+const char *chacha20_implName(void) {
+    pthread_once(&implOnce, pickImpl);
+    return implId == CIPHER_IMPL_AVX2 ? "avx2" :
+           implId == CIPHER_IMPL_SSE2 ? "sse2" : "portable";
+}
+
+/* ---------- public: ChaCha20 ---------- */
+
+void chacha20_xor(const unsigned char key[CIPHER_KEY_LEN],
+                  const unsigned char nonce[CIPHER_NONCE_LEN],
+                  uint64_t offset, const void *in, void *out, size_t len) {
+    const unsigned char *src = (const unsigned char *)in;
+    unsigned char       *dst = (unsigned char *)out;
+    unsigned char        ks[CIPHER_BLOCK];
+    uint32_t             st[16];
+
+    pthread_once(&implOnce, pickImpl);
+    setup(st, key, nonce, (uint32_t)(offset / CIPHER_BLOCK));
+
+    size_t skip = (size_t)(offset % CIPHER_BLOCK);
+    if (skip > 0 && len > 0) {   /* finish the block offset falls in */
+        size_t n = CIPHER_BLOCK - skip < len ? CIPHER_BLOCK - skip : len;
+        keystream(st, ks);
+        xorBytes(dst, src, ks + skip, n);
+        src += n;
+        dst += n;
+        len -= n;
+    }
+
+    size_t blocks = len / CIPHER_BLOCK;
+    if (blocks > 0) {
+        blocksFn(st, src, dst, blocks);
+        src += blocks * CIPHER_BLOCK;
+        dst += blocks * CIPHER_BLOCK;
+        len -= blocks * CIPHER_BLOCK;
+    }
+
+    if (len > 0) {
+        keystream(st, ks);
+        xorBytes(dst, src, ks, len);
+    }
+}
+
+/* ---------- public: frames ---------- */
+
+enum { AT_HEADER, IN_BODY, IN_PACKED, PACKED_OUT, AT_TRAILER };
+
+#define PACKED_MIN  64                                /* smaller stays plain */
+#define PACKED_BODY (4 + FRAME_BLOCK_MAX)             /* longest packed body */
+
+static uint64_t load64(const unsigned char *p) {
+    return (uint64_t)load32(p) | (uint64_t)load32(p + 4) << 32;
+}
+
+uint64_t frame_plainEnd(const unsigned char trailer[FRAME_TRAILER]) {
+    return load64(trailer);
+}
+
+uint32_t frame_bodyLen(const unsigned char header[4]) {
+    return load32(header) & ~(FRAME_PACKED | FRAME_CHUNK);
+}
+
+size_t frame_seal(const unsigned char key[CIPHER_KEY_LEN], uint64_t plainEnd,
+                  const void *in, size_t len, void *out) {
+    unsigned char *p = (unsigned char *)out;
+    store32(p, (uint32_t)len);
+    if (kdf_random(p + 4, CIPHER_NONCE_LEN) != 0) return 0;
+
+    chacha20_xor(key, p + 4, 0, in, p + FRAME_HEADER, len);
+    store32(p + FRAME_HEADER + len, (uint32_t)plainEnd);
+    store32(p + FRAME_HEADER + len + 4, (uint32_t)(plainEnd >> 32));
+    return len + FRAME_OVERHEAD;
+}
+
+size_t frame_sealBlock(const unsigned char key[CIPHER_KEY_LEN], uint64_t plainEnd,
+                       const void *in, size_t len, void *out) {
+    unsigned char *p    = (unsigned char *)out;
+    unsigned char *body = p + FRAME_HEADER;
+
+    /* only a body that comes out smaller than len is worth decoding */
+    size_t packed = len >= PACKED_MIN && len <= FRAME_BLOCK_MAX ?
+                    lz_compress(in, len, body + 4, len - 5) : 0;
+    if (packed == 0) return frame_seal(key, plainEnd, in, len, out);
+
+    packed += 4;
+    store32(p, (uint32_t)packed | FRAME_PACKED);
+    if (kdf_random(p + 4, CIPHER_NONCE_LEN) != 0) return 0;
+    store32(body, (uint32_t)len);
+    chacha20_xor(key, p + 4, 0, body, body, packed);
+    store32(body + packed, (uint32_t)plainEnd);
+    store32(body + packed + 4, (uint32_t)(plainEnd >> 32));
+    return packed + FRAME_OVERHEAD;
+}
+
+size_t frame_sealChunk(const unsigned char key[CIPHER_KEY_LEN], uint64_t plainEnd,
+                       const unsigned char chunkKey[FRAME_REF_KEY], uint32_t len,
+                       void *out) {
+    unsigned char *p    = (unsigned char *)out;
+    unsigned char *body = p + FRAME_HEADER;
+    store32(p, FRAME_REF_BODY | FRAME_CHUNK);
+    if (kdf_random(p + 4, CIPHER_NONCE_LEN) != 0) return 0;
+    store32(body, len);
+    memcpy(body + 4, chunkKey, FRAME_REF_KEY);
+    chacha20_xor(key, p + 4, 0, body, body, FRAME_REF_BODY);
+    store32(body + FRAME_REF_BODY, (uint32_t)plainEnd);
+    store32(body + FRAME_REF_BODY + 4, (uint32_t)(plainEnd >> 32));
+    return FRAME_REF_BODY + FRAME_OVERHEAD;
+}
+
+void frame_readerInit(FrameReader *r, const unsigned char key[CIPHER_KEY_LEN]) {
+    memset(r, 0, sizeof(*r));
+    memcpy(r->key, key, CIPHER_KEY_LEN);
+    r->state = AT_HEADER;
+}
+
+void frame_readerSetChunks(FrameReader *r, FrameChunkFn fn, void *ctx) {
+    r->chunkFn  = fn;
+    r->chunkCtx = ctx;
+}
+
+void frame_readerFree(FrameReader *r) {
+    free(r->packed);
+    free(r->block);
+    memset(r, 0, sizeof(*r));
+}
+
+size_t frame_pending(const FrameReader *r) {
+    return r->state == PACKED_OUT ? r->blockLen - r->blockPos : 0;
+}
+
+/* decrypts a collected compressed or chunk body and decodes or fetches
+ * its plaintext into block. returns 0 or -1 */
+static int unpack(FrameReader *r) {
+    chacha20_xor(r->key, r->part + 4, 0, r->packed, r->packed, r->bodyLen);
+    r->blockLen = load32(r->packed);
+    r->blockPos = 0;
+    if (r->blockLen == 0 || r->blockLen > FRAME_BLOCK_MAX) return -1;
+    if (!r->block && !(r->block = (unsigned char *)malloc(FRAME_BLOCK_MAX)))
+        return -1;
+    if (r->ref)
+        return r->chunkFn(r->chunkCtx, r->packed + 4, r->block, r->blockLen);
+    return lz_decompress(r->packed + 4, r->bodyLen - 4, r->block, r->blockLen);
+}
+
+long frame_open(FrameReader *r, const void *in, size_t inLen, size_t *used,
+                void *out, size_t outCap) {
+    const unsigned char *src  = (const unsigned char *)in;
+    unsigned char       *dst  = (unsigned char *)out;
+    size_t               left = inLen;
+    size_t               made = 0;
+    long                 rc   = 0;
+
+    while (left > 0 || r->state == PACKED_OUT) {
+        if (r->state == IN_BODY || r->state == PACKED_OUT) {
+            if (made == outCap) break;
+            size_t n;
+            if (r->state == IN_BODY) {
+                n = r->bodyLen - r->bodyPos;
+                if (n > left) n = left;
+                if (n > outCap - made) n = outCap - made;
+                chacha20_xor(r->key, r->part + 4, r->bodyPos, src, dst + made, n);
+                r->bodyPos += (uint32_t)n;
+                src  += n;
+                left -= n;
+                if (r->bodyPos == r->bodyLen) r->state = AT_TRAILER;
+            } else {
+                n = r->blockLen - r->blockPos;
+                if (n > outCap - made) n = outCap - made;
+                memcpy(dst + made, r->block + r->blockPos, n);
+                r->blockPos += (uint32_t)n;
+                if (r->blockPos == r->blockLen) r->state = AT_TRAILER;
+            }
+            r->plainPos += n;
+            made += n;
+            continue;
+        }
+
+        if (r->state == IN_PACKED) {
+            size_t n = r->bodyLen - r->bodyPos;
+            if (n > left) n = left;
+            memcpy(r->packed + r->bodyPos, src, n);
+            r->bodyPos += (uint32_t)n;
+            src  += n;
+            left -= n;
+            if (r->bodyPos == r->bodyLen) {
+                if (unpack(r) != 0) {
+                    rc = -1;
+                    break;
+                }
+                r->state = PACKED_OUT;
+            }
+            continue;
+        }
+
+        /* header and trailer are collected in part; the nonce stays in
+         * part[4..] while the body is decrypted, then the trailer may
+         * overwrite it */
+        size_t want = r->state == AT_HEADER ? FRAME_HEADER : FRAME_TRAILER;
+        size_t n    = want - r->have < left ? want - r->have : left;
+        memcpy(r->part + r->have, src, n);
+        r->have += (uint32_t)n;
+        src  += n;
+        left -= n;
+        if (r->have < want) break;
+
+        r->have = 0;
+        if (r->state == AT_HEADER) {
+            uint32_t len = load32(r->part);
+            r->bodyLen = frame_bodyLen(r->part);
+            r->bodyPos = 0;
+            r->ref     = (len & FRAME_CHUNK) != 0;
+            if (r->bodyLen == 0 || (r->ref && (len & FRAME_PACKED)) ||
+                (r->ref && (r->bodyLen != FRAME_REF_BODY || !r->chunkFn))) {
+                rc = -1;
+                break;
+            }
+            r->state = IN_BODY;
+            if (len & (FRAME_PACKED | FRAME_CHUNK)) {
+                if (r->bodyLen <= 4 || r->bodyLen > PACKED_BODY ||
+                    (!r->packed && !(r->packed = (unsigned char *)malloc(PACKED_BODY)))) {
+                    rc = -1;
+                    break;
+                }
+                r->state = IN_PACKED;
+            }
+        } else {
+            if (load64(r->part) != r->plainPos) {
+                rc = -1;
+                break;
+            }
+            r->state = AT_HEADER;
+        }
+    }
+
+    *used = inLen - left;
+    return rc < 0 ? -1 : (long)made;
+}
@@ -0,0 +1,130 @@
+// cipher.h - ChaCha20 stream cipher and the framed layout of encrypted files
+
+#ifndef CIPHER_H
+#define CIPHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CIPHER_KEY_LEN   32
+#define CIPHER_NONCE_LEN 12
+#define CIPHER_BLOCK     64
+
+/* ChaCha20 (RFC 8439): out = in XOR keystream(key, nonce), starting at
+ * byte `offset` of the keystream. Seekable, so any span of a message can
+ * be processed on its own; in and out may be the same buffer. */
+void chacha20_xor(const unsigned char key[CIPHER_KEY_LEN],
+                  const unsigned char nonce[CIPHER_NONCE_LEN],
+                  uint64_t offset, const void *in, void *out, size_t len);
+
+/* Bulk implementations: 8 blocks per AVX2 pass, 4 per SSE2 pass, or one
+ * at a time. The best one the CPU supports is picked on first use. */
+#define CIPHER_IMPL_PORTABLE 0
+#define CIPHER_IMPL_SSE2     1
+#define CIPHER_IMPL_AVX2     2
+
+int  chacha20_setImpl(int impl);
+/* forces an implementation (benchmarks and tests).
+ * returns 0, or -1 if this CPU or build cannot run it */
+
+const char *chacha20_implName(void);
+
+/*
+ * An encrypted file is a sequence of frames, one per append (or per
+ * chunk of a long one):
+ *
+ *   u32 body length | nonce | body (ciphertext) | u64 plainEnd
+ *
+ * little-endian. Every frame has a fresh random nonce and its keystream
+ * starts at 0, so bytes written after an undo never reuse the keystream
+ * of the bytes that were undone. plainEnd is the plaintext size of the
+ * file up to and including this frame: the last 8 bytes of a file give
+ * its plaintext size, and readers check it as they go.
+ *
+ * A body length with FRAME_PACKED set is a compressed block: the body
+ * decrypts to u32 plaintext length | lz.h block, at most FRAME_BLOCK_MAX
+ * bytes of plaintext. Readers buffer such a frame whole, then hand out
+ * its plaintext as they would a plain body.
+ *
+ * A body length with FRAME_CHUNK set is a reference to a shared chunk
+ * (chunkstore.h): the body decrypts to u32 plaintext length | chunk key,
+ * and readers fetch the plaintext through their FrameChunkFn.
+ */
+#define FRAME_HEADER    (4 + CIPHER_NONCE_LEN)
+#define FRAME_TRAILER   8
+#define FRAME_OVERHEAD  (FRAME_HEADER + FRAME_TRAILER)
+#define FRAME_PACKED    0x80000000u
+#define FRAME_CHUNK     0x40000000u
+#define FRAME_BLOCK_MAX (64 * 1024)
+#define FRAME_REF_KEY   32
+#define FRAME_REF_BODY  (4 + FRAME_REF_KEY)
+
+size_t frame_seal(const unsigned char key[CIPHER_KEY_LEN], uint64_t plainEnd,
+                  const void *in, size_t len, void *out);
+/* encrypts len bytes (0 < len < 4 GiB) as one frame into out, which must
+ * hold len + FRAME_OVERHEAD bytes. plainEnd counts these len bytes.
+ * returns bytes written, or 0 if no randomness for the nonce */
+
+size_t frame_sealBlock(const unsigned char key[CIPHER_KEY_LEN], uint64_t plainEnd,
+                       const void *in, size_t len, void *out);
+/* as frame_seal, but compressed when that makes the frame smaller;
+ * len must not exceed FRAME_BLOCK_MAX. out must hold len + FRAME_OVERHEAD
+ * bytes either way */
+
+size_t frame_sealChunk(const unsigned char key[CIPHER_KEY_LEN], uint64_t plainEnd,
+                       const unsigned char chunkKey[FRAME_REF_KEY], uint32_t len,
+                       void *out);
+/* a frame referring to the shared chunk of len plaintext bytes (at most
+ * FRAME_BLOCK_MAX) under chunkKey; out must hold FRAME_REF_BODY +
+ * FRAME_OVERHEAD bytes. returns bytes written, or 0 as frame_seal */
+
+uint64_t frame_plainEnd(const unsigned char trailer[FRAME_TRAILER]);
+
+uint32_t frame_bodyLen(const unsigned char header[4]);
+/* body length from the first bytes of a frame, without the flags */
+
+/* fills out with the len plaintext bytes of the chunk under chunkKey.
+ * returns 0, or -1 if it cannot be had */
+typedef int (*FrameChunkFn)(void *ctx, const unsigned char chunkKey[FRAME_REF_KEY],
+                            void *out, uint32_t len);
+
+typedef struct {
+    unsigned char key[CIPHER_KEY_LEN];
+    unsigned char part[FRAME_HEADER];    /* header or trailer so far */
+    uint32_t      have;                  /* bytes of part collected */
+    int           state;                 /* header, body or trailer next */
+    uint32_t      bodyLen;
+    uint32_t      bodyPos;
+    uint64_t      plainPos;              /* plaintext bytes produced */
+    unsigned char *packed;               /* body of a compressed frame */
+    unsigned char *block;                /* ... and its plaintext */
+    uint32_t      blockLen;
+    uint32_t      blockPos;              /* bytes of block handed out */
+    int           ref;                   /* the body refers to a chunk */
+    FrameChunkFn  chunkFn;
+    void         *chunkCtx;
+} FrameReader;
+
+void frame_readerInit(FrameReader *r, const unsigned char key[CIPHER_KEY_LEN]);
+
+void frame_readerSetChunks(FrameReader *r, FrameChunkFn fn, void *ctx);
+/* where chunk references are resolved; without it they are malformed */
+
+void frame_readerFree(FrameReader *r);
+/* frees the buffers of compressed frames and wipes the key */
+
+size_t frame_pending(const FrameReader *r);
+/* plaintext decoded but not handed out yet, for lack of room in out;
+ * frame_open delivers it before consuming more input, even with none */
+
+long frame_open(FrameReader *r, const void *in, size_t inLen, size_t *used,
+                void *out, size_t outCap);
+/* decrypts the next bytes of a frame stream, in spans of any size.
+ * Consumes *used bytes of in and writes at most outCap plaintext bytes.
+ * returns:
+ *  >=0 = plaintext bytes written to out
+ *   -1 = malformed stream (bad length, block or plainEnd), out of
+ *        memory for a compressed frame, or a chunk that cannot be had
+ */
+
+#endif // CIPHER_H
@@ -0,0 +1,150 @@
+// crc32c.c - CRC-32C: SSE4.2 and table kernels, combine and trim
+
+#include "crc32c.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define HAVE_SSE42_KERNEL 1
+#endif
+
+#define POLY   0x82F63B78u         /* reflected, x^0 in the top bit */
+#define ONE    0x80000000u         /* the polynomial 1 */
+#define STRIPE (8 * 1024)          /* bytes per stream when interleaving */
+
+static uint32_t       table[8][256];
+static uint32_t       powers[64];      /* x^(8 * 2^k) */
+static uint32_t       inverses[64];    /* x^-(8 * 2^k) */
+static uint32_t       shift1, shift2;  /* x^(8 * STRIPE), x^(16 * STRIPE) */
+static int            hardware;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+/* ---------- helper: arithmetic modulo the polynomial ---------- */
+
+static uint32_t multModP(uint32_t a, uint32_t b) {
+    uint32_t p = 0;
+    for (uint32_t m = ONE; m; m >>= 1) {
+        if (a & m) p ^= b;
+        b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+    }
+    return p;
+}
+
+/* x^(8 * n), or x^-(8 * n) from the inverse table */
+static uint32_t bytePower(const uint32_t *pow, uint64_t n) {
+    uint32_t p = ONE;
+    for (int k = 0; n; k++, n >>= 1)
+        if (n & 1) p = multModP(pow[k], p);
+    return p;
+}
+
+static void init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ POLY : c >> 1;
+        table[0][i] = c;
+    }
+    for (int k = 1; k < 8; k++)
+        for (int i = 0; i < 256; i++)
+            table[k][i] = table[k - 1][i] >> 8 ^ table[0][table[k - 1][i] & 0xFF];
+
+    /* x^-1 = (P - 1) / x: the polynomial without its x^0 term, shifted
+     * down one degree, plus x^31 (the bottom bit here) */
+    uint32_t x = ONE >> 1, inv = POLY << 1 | 1;
+    for (int k = 0; k < 3; k++) {
+        x   = multModP(x, x);
+        inv = multModP(inv, inv);
+    }
+    powers[0]   = x;
+    inverses[0] = inv;
+    for (int k = 1; k < 64; k++) {
+        powers[k]   = multModP(powers[k - 1], powers[k - 1]);
+        inverses[k] = multModP(inverses[k - 1], inverses[k - 1]);
+    }
+    shift1 = bytePower(powers, STRIPE);
+    shift2 = bytePower(powers, 2 * STRIPE);
+
+#ifdef HAVE_SSE42_KERNEL
+    __builtin_cpu_init();
+    hardware = __builtin_cpu_supports("sse4.2") != 0;
+#endif
+}
+
+/* ---------- helper: kernels, on the raw register ---------- */
+
+static uint32_t softCrc(uint32_t c, const unsigned char *p, size_t len) {
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t lo = c ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        c = table[7][lo & 0xFF] ^ table[6][lo >> 8 & 0xFF] ^
+            table[5][lo >> 16 & 0xFF] ^ table[4][lo >> 24] ^
+            table[3][p[4]] ^ table[2][p[5]] ^ table[1][p[6]] ^ table[0][p[7]];
+    }
+    while (len--) c = table[0][(c ^ *p++) & 0xFF] ^ c >> 8;
+    return c;
+}
+
+#ifdef HAVE_SSE42_KERNEL
+__attribute__((target("sse4.2")))
+static uint32_t hardCrc(uint32_t c, const unsigned char *p, size_t len) {
+#ifdef __x86_64__
+    /* the instruction has a latency of three: three independent streams
+     * keep it busy, and are joined by shifting the first two along */
+    while (len >= 3 * STRIPE) {
+        uint64_t a = c, b = 0, d = 0, w;
+        for (size_t i = 0; i < STRIPE; i += 8) {
+            memcpy(&w, p + i, 8);
+            a = _mm_crc32_u64(a, w);
+            memcpy(&w, p + STRIPE + i, 8);
+            b = _mm_crc32_u64(b, w);
+            memcpy(&w, p + 2 * STRIPE + i, 8);
+            d = _mm_crc32_u64(d, w);
+        }
+        c = multModP(shift2, (uint32_t)a) ^ multModP(shift1, (uint32_t)b) ^ (uint32_t)d;
+        p   += 3 * STRIPE;
+        len -= 3 * STRIPE;
+    }
+    uint64_t c64 = c, w;
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&w, p, 8);
+        c64 = _mm_crc32_u64(c64, w);
+    }
+    c = (uint32_t)c64;
+#endif
+    for (; len >= 4; p += 4, len -= 4) {
+        uint32_t w;
+        memcpy(&w, p, 4);
+        c = _mm_crc32_u32(c, w);
+    }
+    while (len--) c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+#endif
+
+/* ---------- public ---------- */
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&once, init);
+    const unsigned char *p = (const unsigned char *)data;
+#ifdef HAVE_SSE42_KERNEL
+    if (hardware) return ~hardCrc(~crc, p, len);
+#endif
+    return ~softCrc(~crc, p, len);
+}
+
+uint32_t crc32c_combine(uint32_t crcA, uint32_t crcB, uint64_t lenB) {
+    pthread_once(&once, init);
+    return multModP(bytePower(powers, lenB), crcA) ^ crcB;
+}
+
+uint32_t crc32c_trim(uint32_t crcAB, uint32_t crcB, uint64_t lenB) {
+    pthread_once(&once, init);
+    return multModP(bytePower(inverses, lenB), crcAB ^ crcB);
+}
+
+int crc32c_hardware(void) {
+    pthread_once(&once, init);
+    return hardware;
+}
@@ -0,0 +1,34 @@
+// crc32c.h - CRC-32C (Castagnoli) with SSE4.2 and combine/trim
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The CRC the journals, vault.idx and vault.search already use, now with
+ * the SSE4.2 crc32 instruction where the CPU has it (three interleaved
+ * streams on long inputs) and slicing-by-8 tables elsewhere; both give
+ * the same values.
+ *
+ * CRCs are linear, so the CRC of a concatenation follows from the CRCs
+ * of its parts and the length of the second: crc32c_combine. Because x
+ * is invertible modulo the polynomial this also runs backwards, giving
+ * the CRC of what is left when a tail is cut off: crc32c_trim. Both take
+ * O(log len) steps, whatever the length.
+ */
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+/* continues crc (0 to start) over len bytes */
+
+uint32_t crc32c_combine(uint32_t crcA, uint32_t crcB, uint64_t lenB);
+/* the CRC of A then B */
+
+uint32_t crc32c_trim(uint32_t crcAB, uint32_t crcB, uint64_t lenB);
+/* the CRC of A, given that of A then B */
+
+int      crc32c_hardware(void);
+/* 1 if crc32c uses the CPU's instruction */
+
+#endif // CRC32C_H
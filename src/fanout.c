@@ -0,0 +1,73 @@
+// fanout.c - name -> a/b/<id> under the store root
+
+#include "fanout.h"
+#include "kdf.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ID_BYTES 16
+
+void fanout_path(const char *name, char out[FANOUT_PATH_LEN]) {
+    static const char hex[] = "0123456789abcdef";
+    unsigned char     digest[KDF_DIGEST_LEN];
+    Sha256            s;
+    sha256_init(&s);
+    sha256_update(&s, name, strlen(name));
+    sha256_final(&s, digest);
+
+    char *id = out + 4;
+    for (int i = 0; i < ID_BYTES; i++) {
+        id[2 * i]     = hex[digest[i] >> 4];
+        id[2 * i + 1] = hex[digest[i] & 15];
+    }
+    id[2 * ID_BYTES] = '\0';
+    out[0] = id[0];
+    out[1] = '/';
+    out[2] = id[1];
+    out[3] = '/';
+}
+
+int fanout_makeDirs(int rootFd, const char *path) {
+    char dir[FANOUT_PATH_LEN];
+    for (const char *slash = path; (slash = strchr(slash, '/')) != NULL; slash++) {
+        size_t len = (size_t)(slash - path);
+        if (len >= sizeof(dir)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+        if (mkdirat(rootFd, dir, 0700) != 0 && errno != EEXIST) return -1;
+    }
+    return 0;
+}
+
+int fanout_syncDir(int rootFd, const char *path) {
+    char        dir[FANOUT_PATH_LEN];
+    const char *slash = strrchr(path, '/');
+    size_t      len   = slash ? (size_t)(slash - path) : 0;
+    if (len >= sizeof(dir)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+
+    int fd = openat(rootFd, len ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+int fanout_open(int rootFd, const char *path, int flags, mode_t mode) {
+    int fd = openat(rootFd, path, flags, mode);
+    /* only the first file of a directory pays for making it */
+    if (fd < 0 && errno == ENOENT && (flags & O_CREAT) &&
+        fanout_makeDirs(rootFd, path) == 0)
+        fd = openat(rootFd, path, flags, mode);
+    return fd;
+}
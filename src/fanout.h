@@ -0,0 +1,39 @@
+// fanout.h - hashed two-level directory tree for the stored files
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <sys/types.h>
+
+/*
+ * A vault keeps its files under FANOUT_ROOT in its directory, never at a
+ * path the user named: file "name" lives at a/b/<id>, where id is the
+ * first 128 bits of SHA-256(name) in hex and a, b its first two digits.
+ * That spreads the files evenly over 256 directories, some 4000 each
+ * for a million files, and works for names holding any byte but NUL,
+ * '/' and ".." included. Each level is one digit rather than two: 65536
+ * leaves of a dozen entries cost more directory blocks to write and
+ * walk than they save below tens of millions of files. The mapping is
+ * a pure function of the name, so finding a file needs no lookup and no
+ * lock, and nothing is stored to go stale. Directories are made as
+ * files are first created in them.
+ */
+#define FANOUT_ROOT     "vault.store"
+#define FANOUT_PATH_LEN (1 + 1 + 1 + 1 + 32 + 1)   /* "a/b/<id>" and NUL */
+
+void fanout_path(const char *name, char out[FANOUT_PATH_LEN]);
+/* where name is kept, relative to the root */
+
+int  fanout_makeDirs(int rootFd, const char *path);
+/* makes the directories path goes through under rootFd, as needed.
+ * returns 0, or -1 (errno set) */
+
+int  fanout_syncDir(int rootFd, const char *path);
+/* fsyncs the directory holding path, so an entry made or renamed in it
+ * lasts. returns 0, or -1 (errno set) */
+
+int  fanout_open(int rootFd, const char *path, int flags, mode_t mode);
+/* openat under rootFd; with O_CREAT the directories are made first if
+ * missing. returns the fd, or -1 (errno set) */
+
+#endif // FANOUT_H
@@ -0,0 +1,127 @@
+// fdcache.c - store files kept open by name between operations
+
+#include "fdcache.h"
+#include "hashindex.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* capacity is small (tens), so lookups scan the entries */
+typedef struct {
+    char    *name;    /* NULL once dropped, until the last release */
+    uint32_t hash;
+    int      fd;      /* -1 = free */
+    int      refs;
+    uint64_t used;    /* clock of the last get or put */
+} Entry;
+
+struct FdCache {
+    Entry   *entries;
+    int      capacity;
+    uint64_t clock;
+};
+
+/* ---------- helper: entries ---------- */
+
+static Entry *byName(FdCache *c, const char *name, uint32_t hash) {
+    for (int i = 0; i < c->capacity; i++) {
+        Entry *e = &c->entries[i];
+        if (e->fd >= 0 && e->name && e->hash == hash && strcmp(e->name, name) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+static Entry *byFd(FdCache *c, int fd) {
+    for (int i = 0; i < c->capacity; i++)
+        if (c->entries[i].fd == fd) return &c->entries[i];
+    return NULL;
+}
+
+/* a free entry, or the least recently used one nobody holds, emptied */
+static Entry *vacancy(FdCache *c) {
+    Entry *oldest = NULL;
+    for (int i = 0; i < c->capacity; i++) {
+        Entry *e = &c->entries[i];
+        if (e->fd < 0) return e;
+        if (e->refs == 0 && (!oldest || e->used < oldest->used)) oldest = e;
+    }
+    if (oldest) {
+        close(oldest->fd);
+        free(oldest->name);
+        oldest->name = NULL;
+        oldest->fd   = -1;
+    }
+    return oldest;
+}
+
+/* ---------- public ---------- */
+
+FdCache *fdcache_open(int capacity) {
+    FdCache *c = (FdCache *)calloc(1, sizeof(FdCache));
+    if (!c) return NULL;
+    c->capacity = capacity > 0 ? capacity : 1;
+    c->entries  = (Entry *)calloc((size_t)c->capacity, sizeof(Entry));
+    if (!c->entries) {
+        free(c);
+        return NULL;
+    }
+    for (int i = 0; i < c->capacity; i++) c->entries[i].fd = -1;
+    return c;
+}
+
+void fdcache_close(FdCache *c) {
+    if (!c) return;
+    for (int i = 0; i < c->capacity; i++) {
+        if (c->entries[i].fd >= 0) close(c->entries[i].fd);
+        free(c->entries[i].name);
+    }
+    free(c->entries);
+    free(c);
+}
+
+int fdcache_get(FdCache *c, const char *name) {
+    Entry *e = c ? byName(c, name, hashindex_hash(name)) : NULL;
+    if (!e) return -1;
+    e->refs++;
+    e->used = ++c->clock;
+    return e->fd;
+}
+
+int fdcache_put(FdCache *c, const char *name, int fd) {
+    uint32_t hash = hashindex_hash(name);
+    if (!c || byName(c, name, hash)) return -1;   /* opened twice at once: keep the first */
+    Entry *e = vacancy(c);
+    char  *copy = e ? strdup(name) : NULL;
+    if (!copy) return -1;
+    e->name = copy;
+    e->hash = hash;
+    e->fd   = fd;
+    e->refs = 1;
+    e->used = ++c->clock;
+    return 0;
+}
+
+void fdcache_release(FdCache *c, int fd) {
+    Entry *e = c && fd >= 0 ? byFd(c, fd) : NULL;
+    if (!e) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    if (--e->refs == 0 && !e->name) {
+        close(e->fd);
+        e->fd = -1;
+    }
+}
+
+void fdcache_drop(FdCache *c, const char *name) {
+    Entry *e = c ? byName(c, name, hashindex_hash(name)) : NULL;
+    if (!e) return;
+    free(e->name);
+    e->name = NULL;
+    if (e->refs == 0) {
+        close(e->fd);
+        e->fd = -1;
+    }
+}
@@ -0,0 +1,42 @@
+// fdcache.h - store files kept open by name between operations
+
+#ifndef FDCACHE_H
+#define FDCACHE_H
+
+/*
+ * Up to capacity open descriptors, by name, so that reads, appends and
+ * undos of the same files do not pay a path lookup, an open and a close
+ * every time. Each descriptor handed out holds a reference; the least
+ * recently used unreferenced one is closed to make room. A name dropped
+ * while its descriptor is in use stays open until its last release.
+ *
+ * Descriptors are shared: whoever holds one uses pread/pwrite or
+ * O_APPEND writes, never the file offset.
+ *
+ * A NULL cache keeps nothing: get finds nothing and release closes.
+ * Not thread-safe: callers serialize every call.
+ */
+typedef struct FdCache FdCache;
+
+FdCache *fdcache_open(int capacity);
+/* returns the cache, or NULL when out of memory */
+
+void fdcache_close(FdCache *c);
+/* closes every descriptor; none may still be held */
+
+int  fdcache_get(FdCache *c, const char *name);
+/* name's descriptor with a reference for the caller, or -1 */
+
+int  fdcache_put(FdCache *c, const char *name, int fd);
+/* adds fd, just opened for name and referenced by the caller, unless
+ * every entry is in use. either way the caller ends with fdcache_release.
+ * returns 0 if kept, -1 if not */
+
+void fdcache_release(FdCache *c, int fd);
+/* returns a reference; closes fd if the cache does not (or no longer)
+ * keep it */
+
+void fdcache_drop(FdCache *c, const char *name);
+/* forgets name, whose file was replaced or removed */
+
+#endif // FDCACHE_H
@@ -0,0 +1,402 @@
+// filecache.c - hash index + intrusive LRU list of blobs, inotify checks
+
+#include "filecache.h"
+#include "hashindex.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define ENTRY_SHARE 4              /* one entry holds at most budget / 4 */
+#define BLOB_MIN    (64 * 1024)    /* first allocation when collecting */
+#define WATCH_MASK  (IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+                     IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+
+typedef struct {
+    char       *name;              /* NULL = on the free list */
+    char       *path;              /* under the root, as inotify names it */
+    CacheBlob  *blob;
+    size_t      len;               /* the file's bytes: a prefix of blob */
+    CacheStamp  stamp;
+    int         checked;
+    int         wd;                /* watch on the name's directory, or -1 */
+    int32_t     prev;              /* towards the head (newer), -1 at head */
+    int32_t     next;              /* towards the tail; the free list too */
+} CacheEntry;
+
+struct FileCache {
+    CacheEntry *entries;
+    int         slots, cap;        /* slots ever used, allocated */
+    int32_t     head, tail, free;
+    HashIndex   index;
+    HashIndex   byPath;
+    size_t      budget, used;      /* used: the len of every entry */
+    int         watchFd;           /* inotify, -1 without */
+    char       *root;
+    char      **dirs;              /* by watch descriptor; "" = the root */
+    int         dirCap;
+};
+
+/* ---------- helper: list ---------- */
+
+static const char *entryName(void *ctx, int id) {
+    return ((FileCache *)ctx)->entries[id].name;
+}
+
+static const char *entryPath(void *ctx, int id) {
+    return ((FileCache *)ctx)->entries[id].path;
+}
+
+static void detachEntry(FileCache *c, int32_t id) {
+    CacheEntry *e = &c->entries[id];
+    if (e->prev >= 0) c->entries[e->prev].next = e->next;
+    else              c->head = e->next;
+    if (e->next >= 0) c->entries[e->next].prev = e->prev;
+    else              c->tail = e->prev;
+}
+
+static void pushHead(FileCache *c, int32_t id) {
+    CacheEntry *e = &c->entries[id];
+    e->prev = -1;
+    e->next = c->head;
+    if (c->head >= 0) c->entries[c->head].prev = id;
+    c->head = id;
+    if (c->tail < 0) c->tail = id;
+}
+
+static int32_t findEntry(const FileCache *c, const char *name) {
+    return hashindex_find(&c->index, name, hashindex_hash(name));
+}
+
+static void removeEntry(FileCache *c, int32_t id) {
+    CacheEntry *e = &c->entries[id];
+    hashindex_remove(&c->index, e->name, hashindex_hash(e->name));
+    hashindex_remove(&c->byPath, e->path, hashindex_hash(e->path));
+    detachEntry(c, id);
+    filecache_release(e->blob);
+    c->used -= e->len;
+    free(e->name);
+    free(e->path);
+    e->name = NULL;
+    e->path = NULL;
+    e->blob = NULL;
+    e->next = c->free;
+    c->free = id;
+}
+
+static void evict(FileCache *c) {
+    while (c->used > c->budget && c->tail >= 0) removeEntry(c, c->tail);
+}
+
+/* ---------- helper: inotify ---------- */
+
+/* an entry can only stay checked while inotify reports on its name */
+static int watchable(const FileCache *c, const CacheEntry *e) {
+    return c->watchFd >= 0 && e->wd >= 0 && e->wd < c->dirCap && c->dirs[e->wd];
+}
+
+/* the watch on dir (under the root), added if need be; -1 without one */
+static int watchDir(FileCache *c, const char *dir, size_t len) {
+    if (c->watchFd < 0) return -1;
+    char path[4096];
+    if ((size_t)snprintf(path, sizeof(path), "%s/%.*s", c->root, (int)len, dir) >=
+        sizeof(path))
+        return -1;
+    int wd = inotify_add_watch(c->watchFd, path, WATCH_MASK);
+    if (wd < 0) return -1;
+
+    if (wd >= c->dirCap) {
+        int    cap  = c->dirCap ? c->dirCap : 64;
+        while (cap <= wd) cap *= 2;
+        char **dirs = (char **)realloc(c->dirs, sizeof(char *) * (size_t)cap);
+        if (!dirs) return -1;
+        memset(dirs + c->dirCap, 0, sizeof(char *) * (size_t)(cap - c->dirCap));
+        c->dirs   = dirs;
+        c->dirCap = cap;
+    }
+    if (!c->dirs[wd] && !(c->dirs[wd] = strndup(dir, len))) return -1;
+    return wd;
+}
+
+/* the watch covering path: its directory's */
+static int watchOf(FileCache *c, const char *path) {
+    const char *slash = strrchr(path, '/');
+    return watchDir(c, path, slash ? (size_t)(slash - path) : 0);
+}
+
+static void uncheckAll(FileCache *c) {
+    for (int32_t id = c->head; id >= 0; id = c->entries[id].next)
+        c->entries[id].checked = 0;
+}
+
+/* reads every queued event without blocking */
+static void takeEvents(FileCache *c) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (c->watchFd >= 0) {
+        ssize_t n = read(c->watchFd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;   /* EAGAIN: the queue is empty */
+
+        for (char *p = buf; p < buf + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            const char *dir = ev->wd >= 0 && ev->wd < c->dirCap ? c->dirs[ev->wd] : NULL;
+            if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED)) {
+                uncheckAll(c);
+            } else if (ev->len > 0 && dir) {
+                char    path[4096];
+                int32_t id = -1;
+                if ((size_t)snprintf(path, sizeof(path), "%s%s%s", dir, *dir ? "/" : "",
+                                     ev->name) < sizeof(path))
+                    id = hashindex_find(&c->byPath, path, hashindex_hash(path));
+                if (id >= 0) c->entries[id].checked = 0;
+            }
+            if ((ev->mask & IN_IGNORED) && dir) {   /* the directory is gone */
+                free(c->dirs[ev->wd]);
+                c->dirs[ev->wd] = NULL;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+/* ---------- public ---------- */
+
+void filecache_stamp(const struct stat *st, CacheStamp *out) {
+    out->dev  = (uint64_t)st->st_dev;
+    out->ino  = (uint64_t)st->st_ino;
+    out->size = (uint64_t)st->st_size;
+    out->sec  = (int64_t)st->st_mtim.tv_sec;
+    out->nsec = st->st_mtim.tv_nsec;
+}
+
+int filecache_sameStamp(const CacheStamp *a, const CacheStamp *b) {
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+           a->sec == b->sec && a->nsec == b->nsec;
+}
+
+FileCache *filecache_open(const char *dir, size_t budget) {
+    FileCache *c = (FileCache *)calloc(1, sizeof(FileCache));
+    if (!c) return NULL;
+    c->head   = c->tail = c->free = -1;
+    c->budget = budget;
+    c->root   = strdup(dir);
+    if (!c->root || hashindex_init(&c->index, 0, entryName, c) != 0) {
+        free(c->root);
+        free(c);
+        return NULL;
+    }
+    if (hashindex_init(&c->byPath, 0, entryPath, c) != 0) {
+        hashindex_free(&c->index);
+        free(c->root);
+        free(c);
+        return NULL;
+    }
+
+    c->watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (c->watchFd >= 0 && watchDir(c, "", 0) < 0) {
+        close(c->watchFd);
+        c->watchFd = -1;
+    }
+    return c;
+}
+
+void filecache_close(FileCache *c) {
+    if (!c) return;
+    while (c->head >= 0) removeEntry(c, c->head);
+    if (c->watchFd >= 0) close(c->watchFd);
+    for (int i = 0; i < c->dirCap; i++) free(c->dirs[i]);
+    free(c->dirs);
+    free(c->root);
+    hashindex_free(&c->index);
+    hashindex_free(&c->byPath);
+    free(c->entries);
+    free(c);
+}
+
+void filecache_setBudget(FileCache *c, size_t budget) {
+    if (!c) return;
+    c->budget = budget;
+    evict(c);
+    /* an entry may now be over the per-file limit; it goes when it grows */
+}
+
+size_t filecache_limit(const FileCache *c) {
+    return c ? c->budget / ENTRY_SHARE : 0;
+}
+
+CacheBlob *filecache_get(FileCache *c, const char *name, size_t *len,
+                         CacheStamp *stamp, int *checked) {
+    if (!c) return NULL;
+    takeEvents(c);
+    int32_t id = findEntry(c, name);
+    if (id < 0) return NULL;
+
+    CacheEntry *e = &c->entries[id];
+    if (id != c->head) {
+        detachEntry(c, id);
+        pushHead(c, id);
+    }
+    atomic_fetch_add(&e->blob->refs, 1);
+    *len     = e->len;
+    *stamp   = e->stamp;
+    *checked = e->checked;
+    return e->blob;
+}
+
+void filecache_confirm(FileCache *c, const char *name, const CacheBlob *b) {
+    int32_t id = c ? findEntry(c, name) : -1;
+    if (id >= 0 && c->entries[id].blob == b)
+        c->entries[id].checked = watchable(c, &c->entries[id]);
+}
+
+void filecache_drop(FileCache *c, const char *name, const CacheBlob *b) {
+    int32_t id = c ? findEntry(c, name) : -1;
+    if (id >= 0 && (!b || c->entries[id].blob == b)) removeEntry(c, id);
+}
+
+int filecache_holds(FileCache *c, const char *name, const CacheStamp *stamp) {
+    int32_t id = c ? findEntry(c, name) : -1;
+    return id >= 0 && filecache_sameStamp(&c->entries[id].stamp, stamp);
+}
+
+void filecache_put(FileCache *c, const char *name, const char *path,
+                   const CacheStamp *stamp, CacheBlob *b) {
+    if (!c || !b || b->len > filecache_limit(c)) {
+        filecache_release(b);
+        return;
+    }
+    filecache_drop(c, name, NULL);
+
+    if (c->free < 0 && c->slots == c->cap) {
+        int         cap     = c->cap ? c->cap * 2 : 64;
+        CacheEntry *entries = (CacheEntry *)realloc(c->entries,
+                                                    sizeof(CacheEntry) * (size_t)cap);
+        if (!entries) {
+            filecache_release(b);
+            return;
+        }
+        c->entries = entries;
+        c->cap     = cap;
+    }
+    char   *copy  = strdup(name);
+    char   *where = strdup(path);
+    int32_t id    = c->free >= 0 ? c->free : c->slots;
+    if (!copy || !where || hashindex_insert(&c->index, copy, hashindex_hash(copy), id) != 0) {
+        free(copy);
+        free(where);
+        filecache_release(b);
+        return;
+    }
+    if (hashindex_insert(&c->byPath, where, hashindex_hash(where), id) != 0) {
+        hashindex_remove(&c->index, copy, hashindex_hash(copy));
+        free(copy);
+        free(where);
+        filecache_release(b);
+        return;
+    }
+    if (id == c->free) c->free = c->entries[id].next;
+    else               c->slots++;
+
+    CacheEntry *e = &c->entries[id];
+    e->name    = copy;
+    e->path    = where;
+    e->blob    = b;
+    e->len     = b->len;
+    e->stamp   = *stamp;
+    e->checked = 0;
+    e->wd      = watchOf(c, path);
+    pushHead(c, id);
+    c->used += e->len;
+    evict(c);
+}
+
+void filecache_extend(FileCache *c, const char *name, const CacheStamp *was,
+                      const char *data, size_t len, const CacheStamp *now) {
+    int32_t id = c ? findEntry(c, name) : -1;
+    if (id < 0) return;
+    CacheEntry *e = &c->entries[id];
+    if (!filecache_sameStamp(&e->stamp, was) || len > filecache_limit(c) - e->len ||
+        e->len > filecache_limit(c)) {
+        removeEntry(c, id);
+        return;
+    }
+
+    /* readers hold the bytes they were handed: never write under them */
+    CacheBlob *b = e->blob;
+    if (atomic_load(&b->refs) > 1 || e->len + len > b->cap) {
+        size_t cap = b->cap * 2 > e->len + len ? b->cap * 2 : e->len + len;
+        if (cap > filecache_limit(c)) cap = filecache_limit(c);
+        CacheBlob *grown = filecache_blobNew(cap);
+        if (!grown) {
+            removeEntry(c, id);
+            return;
+        }
+        memcpy(grown->data, b->data, e->len);
+        filecache_release(b);
+        e->blob = b = grown;
+    }
+    memcpy(b->data + e->len, data, len);
+    e->len  += len;
+    b->len   = e->len;
+    e->stamp = *now;
+    c->used += len;
+    evict(c);
+}
+
+void filecache_trim(FileCache *c, const char *name, const CacheStamp *was,
+                    size_t len, const CacheStamp *now) {
+    int32_t id = c ? findEntry(c, name) : -1;
+    if (id < 0) return;
+    CacheEntry *e = &c->entries[id];
+    if (!filecache_sameStamp(&e->stamp, was) || len > e->len) {
+        removeEntry(c, id);
+        return;
+    }
+    c->used -= e->len - len;
+    e->len   = len;
+    e->stamp = *now;
+}
+
+CacheBlob *filecache_blobNew(size_t cap) {
+    CacheBlob *b = (CacheBlob *)malloc(sizeof(CacheBlob) + cap);
+    if (!b) return NULL;
+    atomic_init(&b->refs, 1);
+    b->len = 0;
+    b->cap = cap;
+    return b;
+}
+
+CacheBlob *filecache_blobAppend(CacheBlob *b, const char *data, size_t len,
+                                size_t limit) {
+    size_t have = b ? b->len : 0;
+    if (len > limit - have) {
+        filecache_release(b);
+        return NULL;
+    }
+    if (!b || have + len > b->cap) {
+        size_t cap = b ? b->cap * 2 : BLOB_MIN;
+        while (cap < have + len) cap *= 2;
+        if (cap > limit) cap = limit;
+        CacheBlob *grown = filecache_blobNew(cap);
+        if (!grown) {
+            filecache_release(b);
+            return NULL;
+        }
+        if (b) memcpy(grown->data, b->data, have);
+        grown->len = have;
+        filecache_release(b);
+        b = grown;
+    }
+    memcpy(b->data + have, data, len);
+    b->len = have + len;
+    return b;
+}
+
+void filecache_release(CacheBlob *b) {
+    if (b && atomic_fetch_sub(&b->refs, 1) == 1) {
+        memset(b->data, 0, b->cap);   /* plaintext does not outlive its use */
+        free(b);
+    }
+}
@@ -0,0 +1,98 @@
+// filecache.h - byte-budgeted LRU of decrypted file contents
+
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/*
+ * Whole plaintexts of recently read files, by name, up to budget bytes
+ * in all; the least recently used go first, and a file over a quarter
+ * of the budget is not kept. Contents are reference-counted blobs, so a
+ * reader keeps the bytes it was handed while appends (copy-on-write
+ * when shared), trims and evictions go on.
+ *
+ * Each entry also has the path of its file under one root directory,
+ * and the stamp of the file it was taken from: device, inode, size and
+ * modification time. The directory of every path put is watched with
+ * inotify, and any event for a path marks its entry unchecked (a queue
+ * overflow marks them all); so does every put. Whoever gets an
+ * unchecked entry compares its stamp with the file before using it and
+ * then confirms or drops it. Without inotify, or once the watches run
+ * out, entries are never checked.
+ *
+ * Not thread-safe: callers serialize every call but the blob ones.
+ */
+typedef struct {
+    uint64_t dev, ino, size;
+    int64_t  sec;
+    long     nsec;
+} CacheStamp;
+
+typedef struct {
+    atomic_int refs;
+    size_t     len, cap;
+    char       data[];
+} CacheBlob;
+
+typedef struct FileCache FileCache;
+
+void filecache_stamp(const struct stat *st, CacheStamp *out);
+int  filecache_sameStamp(const CacheStamp *a, const CacheStamp *b);
+
+FileCache *filecache_open(const char *dir, size_t budget);
+/* returns the cache of the files under dir, or NULL */
+
+void filecache_close(FileCache *c);
+/* wipes and frees every entry; no blob may still be held */
+
+void filecache_setBudget(FileCache *c, size_t budget);
+/* evicts down to the new budget; 0 keeps nothing */
+
+size_t filecache_limit(const FileCache *c);
+/* the largest plaintext worth collecting for a put */
+
+CacheBlob *filecache_get(FileCache *c, const char *name, size_t *len,
+                         CacheStamp *stamp, int *checked);
+/* name's contents, first len bytes, with a reference for the caller to
+ * release, or NULL. *checked is 0 when the file may have changed since
+ * *stamp. Takes any inotify events first. */
+
+void filecache_confirm(FileCache *c, const char *name, const CacheBlob *b);
+/* marks the entry checked, if it still holds b */
+
+void filecache_drop(FileCache *c, const char *name, const CacheBlob *b);
+/* forgets name's entry; only if it holds b, unless b is NULL */
+
+int  filecache_holds(FileCache *c, const char *name, const CacheStamp *stamp);
+/* 1 if name has an entry taken at stamp, worth extending */
+
+void filecache_put(FileCache *c, const char *name, const char *path,
+                   const CacheStamp *stamp, CacheBlob *b);
+/* keeps b (the caller's reference passes to the cache) as name's
+ * contents at stamp, unchecked, replacing any entry; path is the file
+ * under the root. b is released instead if it is too large */
+
+void filecache_extend(FileCache *c, const char *name, const CacheStamp *was,
+                      const char *data, size_t len, const CacheStamp *now);
+void filecache_trim(FileCache *c, const char *name, const CacheStamp *was,
+                    size_t len, const CacheStamp *now);
+/* the file grew by data, or was cut to len bytes, from stamp was to now:
+ * the entry follows if it was taken at was, and is dropped otherwise */
+
+CacheBlob *filecache_blobNew(size_t cap);
+/* an empty blob with room for cap bytes, or NULL */
+
+CacheBlob *filecache_blobAppend(CacheBlob *b, const char *data, size_t len,
+                                size_t limit);
+/* b (NULL to start one) with data added, possibly moved; NULL once it
+ * would pass limit bytes or memory runs out, b then released. Only for
+ * a blob nobody else holds. */
+
+void filecache_release(CacheBlob *b);
+/* drops a reference; the last one wipes and frees the blob */
+
+#endif // FILECACHE_H
@@ -0,0 +1,135 @@
+// hashindex.c - linear probing hash index with backward-shift deletion
+
+#include "hashindex.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_CAPACITY 16
+
+/* ---------- helper: sizing ---------- */
+
+static size_t roundUpPow2(size_t n) {
+    size_t cap = MIN_CAPACITY;
+    while (cap < n) cap <<= 1;
+    return cap;
+}
+
+/* keep the load factor at or below 7/10 */
+static int needsGrow(const HashIndex *hi, size_t count) {
+    return count * 10 > hi->capacity * 7;
+}
+
+static void placeSlot(HashSlot *slots, size_t mask, HashSlot s) {
+    size_t i = s.hash & mask;
+    while (slots[i].hash != 0)
+        i = (i + 1) & mask;
+    slots[i] = s;
+}
+
+static int grow(HashIndex *hi) {
+    size_t newCap = hi->capacity ? hi->capacity * 2 : MIN_CAPACITY;
+    HashSlot *slots = (HashSlot *)calloc(newCap, sizeof(HashSlot));
+    if (!slots) return -1;
+
+    for (size_t i = 0; i < hi->capacity; i++) {
+        if (hi->slots[i].hash != 0)
+            placeSlot(slots, newCap - 1, hi->slots[i]);
+    }
+    free(hi->slots);
+    hi->slots    = slots;
+    hi->capacity = newCap;
+    return 0;
+}
+
+/* returns the slot holding key, or -1 */
+static long findSlot(const HashIndex *hi, const char *key, uint32_t hash) {
+    if (hi->capacity == 0) return -1;
+
+    size_t mask = hi->capacity - 1;
+    size_t i    = hash & mask;
+
+    while (hi->slots[i].hash != 0) {
+        if (hi->slots[i].hash == hash &&
+            strcmp(hi->keyOf(hi->ctx, hi->slots[i].id), key) == 0)
+            return (long)i;
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+/* ---------- public ---------- */
+
+int hashindex_init(HashIndex *hi, size_t expected,
+                   HashIndexKeyFn keyOf, void *ctx) {
+    hi->capacity = roundUpPow2(expected + expected / 2);
+    hi->slots    = (HashSlot *)calloc(hi->capacity, sizeof(HashSlot));
+    hi->count    = 0;
+    hi->keyOf    = keyOf;
+    hi->ctx      = ctx;
+    if (!hi->slots) {
+        hi->capacity = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void hashindex_free(HashIndex *hi) {
+    free(hi->slots);
+    hi->slots    = NULL;
+    hi->capacity = 0;
+    hi->count    = 0;
+}
+
+uint32_t hashindex_hash(const char *key) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h ? h : 1;
+}
+
+int hashindex_find(const HashIndex *hi, const char *key, uint32_t hash) {
+    long slot = findSlot(hi, key, hash);
+    return slot < 0 ? -1 : hi->slots[slot].id;
+}
+
+int hashindex_insert(HashIndex *hi, const char *key, uint32_t hash, int id) {
+    long slot = findSlot(hi, key, hash);
+    if (slot >= 0) {
+        hi->slots[slot].id = id;
+        return 0;
+    }
+
+    if (needsGrow(hi, hi->count + 1) && grow(hi) != 0)
+        return -1;
+
+    HashSlot s = { hash, id };
+    placeSlot(hi->slots, hi->capacity - 1, s);
+    hi->count++;
+    return 0;
+}
+
+int hashindex_remove(HashIndex *hi, const char *key, uint32_t hash) {
+    long slot = findSlot(hi, key, hash);
+    if (slot < 0) return -1;
+
+    size_t mask = hi->capacity - 1;
+    size_t hole = (size_t)slot;
+    int    id   = hi->slots[hole].id;
+
+    /* shift later members of the probe run back so no tombstones remain */
+    size_t i = (hole + 1) & mask;
+    while (hi->slots[i].hash != 0) {
+        size_t home = hi->slots[i].hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            hi->slots[hole] = hi->slots[i];
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+    hi->slots[hole].hash = 0;
+    hi->slots[hole].id   = 0;
+    hi->count--;
+    return id;
+}
@@ -0,0 +1,51 @@
+// hashindex.h - open-addressing filename index used by the vault table
+
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The index stores only (hash, id) pairs; the key itself lives with the
+ * caller and is fetched through keyOf when two hashes collide. */
+typedef const char *(*HashIndexKeyFn)(void *ctx, int id);
+
+typedef struct {
+    uint32_t hash;   /* 0 = empty slot */
+    int32_t  id;
+} HashSlot;
+
+typedef struct {
+    HashSlot       *slots;
+    size_t          capacity;   /* always a power of two */
+    size_t          count;
+    HashIndexKeyFn  keyOf;
+    void           *ctx;
+} HashIndex;
+
+int  hashindex_init(HashIndex *hi, size_t expected,
+                    HashIndexKeyFn keyOf, void *ctx);
+/* returns:
+ *   0 = success
+ *  -1 = out of memory
+ */
+
+void hashindex_free(HashIndex *hi);
+
+/* FNV-1a, never returns 0 (0 marks an empty slot). */
+uint32_t hashindex_hash(const char *key);
+
+int  hashindex_find(const HashIndex *hi, const char *key, uint32_t hash);
+/* returns id, or -1 if not present */
+
+int  hashindex_insert(HashIndex *hi, const char *key, uint32_t hash, int id);
+/* inserts or re-points an existing key.
+ * returns:
+ *   0 = success
+ *  -1 = out of memory
+ */
+
+int  hashindex_remove(HashIndex *hi, const char *key, uint32_t hash);
+/* returns removed id, or -1 if not present */
+
+#endif // HASHINDEX_H
@@ -0,0 +1,130 @@
+// history.c - per-file version records: one fixed-size record per append
+
+#include "history.h"
+#include "crc32c.h"
+#include "kdf.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RECORD_BODY (HISTORY_RECORD - 4)   /* what the record's CRC covers */
+
+/* ---------- helper: encoding ---------- */
+
+static void putU32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t getU32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void putU64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t getU64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+static int readRecord(int fd, uint64_t n, unsigned char rec[HISTORY_RECORD]) {
+    ssize_t got;
+    do {
+        got = pread(fd, rec, HISTORY_RECORD, (off_t)(n * HISTORY_RECORD));
+    } while (got < 0 && errno == EINTR);
+    if (got != HISTORY_RECORD) return -1;
+    return getU32(rec + RECORD_BODY) == crc32c(0, rec, RECORD_BODY) ? 0 : -1;
+}
+
+/* ---------- public ---------- */
+
+uint32_t history_check(const unsigned char key[32], uint64_t offset,
+                       uint64_t length, uint32_t crc) {
+    static const char label[] = "fv history";
+    unsigned char     msg[sizeof(label) - 1 + 8 + 8 + 4];
+    unsigned char     digest[KDF_DIGEST_LEN];
+    memcpy(msg, label, sizeof(label) - 1);
+    putU64(msg + sizeof(label) - 1, offset);
+    putU64(msg + sizeof(label) - 1 + 8, length);
+    putU32(msg + sizeof(label) - 1 + 16, crc);
+    hmac_sha256(key, 32, msg, sizeof(msg), digest);
+    uint32_t check = getU32(digest);
+    memset(digest, 0, sizeof(digest));
+    return check;
+}
+
+uint64_t history_count(int fd) {
+    struct stat   st;
+    unsigned char rec[HISTORY_RECORD];
+    if (fstat(fd, &st) != 0) return 0;
+    uint64_t count = (uint64_t)st.st_size / HISTORY_RECORD;
+    /* only the last write can have been torn */
+    if (count > 0 && readRecord(fd, count - 1, rec) != 0) count--;
+    return count;
+}
+
+static void decode(const unsigned char *rec, Version *out) {
+    out->offset = getU64(rec);
+    out->length = getU64(rec + 8);
+    out->time   = getU64(rec + 16);
+    out->check  = getU32(rec + 24);
+}
+
+int history_get(int fd, uint64_t n, Version *out) {
+    unsigned char rec[HISTORY_RECORD];
+    if (readRecord(fd, n, rec) != 0) return -1;
+    decode(rec, out);
+    return 0;
+}
+
+long history_list(int fd, uint64_t first, long max, Version *out) {
+    if (max <= 0) return 0;
+    unsigned char *buf = (unsigned char *)malloc((size_t)max * HISTORY_RECORD);
+    if (!buf) return -1;
+    ssize_t got;
+    do {
+        got = pread(fd, buf, (size_t)max * HISTORY_RECORD, (off_t)(first * HISTORY_RECORD));
+    } while (got < 0 && errno == EINTR);
+
+    long n = 0;
+    for (; got >= 0 && n < got / HISTORY_RECORD; n++) {
+        const unsigned char *rec = buf + (size_t)n * HISTORY_RECORD;
+        if (getU32(rec + RECORD_BODY) != crc32c(0, rec, RECORD_BODY)) break;
+        decode(rec, &out[n]);
+    }
+    free(buf);
+    return got < 0 ? -1 : n;
+}
+
+int history_put(int fd, uint64_t n, uint64_t count, const Version *ver) {
+    unsigned char rec[HISTORY_RECORD];
+    putU64(rec, ver->offset);
+    putU64(rec + 8, ver->length);
+    putU64(rec + 16, ver->time);
+    putU32(rec + 24, ver->check);
+    putU32(rec + RECORD_BODY, crc32c(0, rec, RECORD_BODY));
+
+    off_t   at = (off_t)(n * HISTORY_RECORD);
+    ssize_t put;
+    do {
+        put = pwrite(fd, rec, HISTORY_RECORD, at);
+    } while (put < 0 && errno == EINTR);
+    if (put != HISTORY_RECORD) return -1;
+    return n + 1 < count ? ftruncate(fd, at + HISTORY_RECORD) : 0;
+}
+
+uint64_t history_find(int fd, uint64_t count, uint64_t time) {
+    uint64_t lo = 0, hi = count;   /* records [0, lo) are at or before time */
+    while (lo < hi) {
+        Version  ver;
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (history_get(fd, mid, &ver) != 0 || ver.time > time) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
@@ -0,0 +1,62 @@
+// history.h - per-file version records: one fixed-size record per append
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+/*
+ * A file's versions, one after another in a file of their own, each
+ * record HISTORY_RECORD bytes, little-endian:
+ *   u64 offset | u64 length | u64 time | u32 check | u32 CRC-32C of
+ *   the 28 bytes before it
+ * Record n (from 0) describes version n + 1: length bytes appended at
+ * plaintext offset, at time (milliseconds since the epoch). Version
+ * n + 1 of the file is then its first offset + length bytes, so no
+ * content is ever copied. check is history_check of the append: the
+ * CRC-32C of its bytes, keyed by the file's data key, so a reader
+ * holding the key can check them while the record alone tells nothing
+ * about the plaintext.
+ *
+ * Records are only ever added at the end or cut off the end, so finding
+ * version n is one read, and because times never go backwards (a record
+ * is stamped no earlier than the one before it) finding the version at a
+ * time is a binary search. A record torn by a crash fails its CRC and is
+ * not counted; the next one written takes its place.
+ *
+ * The functions work on an open descriptor and keep no state, so the
+ * caller decides how files are found, kept open and serialized.
+ */
+#define HISTORY_RECORD 32
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t time;      /* ms since the epoch */
+    uint32_t check;     /* history_check of the length bytes appended */
+} Version;
+
+uint32_t history_check(const unsigned char key[32], uint64_t offset,
+                       uint64_t length, uint32_t crc);
+/* HMAC-SHA256 under the data key key of offset, length and crc, the
+ * CRC-32C of the length bytes appended at offset, cut to 32 bits */
+
+uint64_t history_count(int fd);
+/* records in fd, not counting a torn one at the end; 0 on a read error */
+
+int  history_get(int fd, uint64_t n, Version *out);
+/* record n (from 0). returns 0, or -1 on a read error or a bad record */
+
+long history_list(int fd, uint64_t first, long max, Version *out);
+/* up to max records from first on, in one read, stopping before a bad
+ * one. returns how many, or -1 on a read error */
+
+int  history_put(int fd, uint64_t n, uint64_t count, const Version *ver);
+/* writes ver as record n of the count there are, n <= count, cutting
+ * off any after it. its time must not be earlier than record n - 1's.
+ * returns 0, or -1 on a write error */
+
+uint64_t history_find(int fd, uint64_t count, uint64_t time);
+/* how many of the first count records are stamped at or before time */
+
+#endif // HISTORY_H
@@ -0,0 +1,323 @@
+// ioq.c - batched reads, writes and fsyncs over io_uring, or blocking calls
+
+#include "ioq.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define HAVE_URING 1
+#else
+#define HAVE_URING 0
+#endif
+
+enum { OP_READ, OP_WRITE, OP_FSYNC };
+
+typedef struct {
+    int      op;
+    int      linked;   /* the next operation waits for this one */
+    int      fd;
+    void    *buf;
+    size_t   len;
+    uint64_t offset;
+    uint64_t tag;
+} Op;
+
+struct IoQueue {
+    unsigned depth;
+    unsigned queued;      /* waiting for submit */
+    unsigned inflight;    /* submitted, not reaped */
+    int      ringFd;      /* -1: blocking calls */
+
+    /* io_uring: the rings are shared with the kernel */
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    void     *sqes, *cqes;
+    void     *sqRing, *cqRing;
+    size_t    sqRingLen, cqRingLen, sqesLen;
+    unsigned  sqNext;     /* our tail, published at submit */
+    struct io_uring_sqe *last;   /* queued last, for ioq_link */
+
+    /* blocking: queued operations, then their completions */
+    Op      *ops;
+    IoqDone *done;
+    unsigned doneCount;
+};
+
+/* ---------- helper: io_uring ---------- */
+
+#if HAVE_URING
+
+static int ringEnter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static void ringUnmap(IoQueue *q) {
+    if (q->sqes) munmap(q->sqes, q->sqesLen);
+    if (q->cqRing && q->cqRing != q->sqRing) munmap(q->cqRing, q->cqRingLen);
+    if (q->sqRing) munmap(q->sqRing, q->sqRingLen);
+}
+
+/* returns 0 with the ring mapped, or -1 to fall back to blocking calls */
+static int ringOpen(IoQueue *q) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, q->depth, &p);
+    if (fd < 0) return -1;
+    /* reads and writes at the file offset (IOQ_APPEND) came with 5.6 */
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        close(fd);
+        return -1;
+    }
+
+    q->sqRingLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    q->cqRingLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    q->sqesLen   = p.sq_entries * sizeof(struct io_uring_sqe);
+    int single   = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && q->cqRingLen > q->sqRingLen) q->sqRingLen = q->cqRingLen;
+
+    q->sqRing = mmap(NULL, q->sqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_SQ_RING);
+    if (q->sqRing == MAP_FAILED) q->sqRing = NULL;
+    q->cqRing = single ? q->sqRing :
+                mmap(NULL, q->cqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_CQ_RING);
+    if (q->cqRing == MAP_FAILED) q->cqRing = NULL;
+    q->sqes = mmap(NULL, q->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQES);
+    if (q->sqes == MAP_FAILED) q->sqes = NULL;
+    if (!q->sqRing || !q->cqRing || !q->sqes) {
+        ringUnmap(q);
+        close(fd);
+        return -1;
+    }
+
+    char *sq = (char *)q->sqRing, *cq = (char *)q->cqRing;
+    q->sqHead  = (unsigned *)(sq + p.sq_off.head);
+    q->sqTail  = (unsigned *)(sq + p.sq_off.tail);
+    q->sqMask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    q->sqArray = (unsigned *)(sq + p.sq_off.array);
+    q->cqHead  = (unsigned *)(cq + p.cq_off.head);
+    q->cqTail  = (unsigned *)(cq + p.cq_off.tail);
+    q->cqMask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    q->cqes    = cq + p.cq_off.cqes;
+    q->sqNext  = *q->sqTail;
+    q->ringFd  = fd;
+    return 0;
+}
+
+static void ringQueue(IoQueue *q, const Op *op) {
+    unsigned             slot = q->sqNext & *q->sqMask;
+    struct io_uring_sqe *sqe  = (struct io_uring_sqe *)q->sqes + slot;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = op->op == OP_READ  ? IORING_OP_READ :
+                     op->op == OP_WRITE ? IORING_OP_WRITE : IORING_OP_FSYNC;
+    sqe->fd        = op->fd;
+    sqe->addr      = (uint64_t)(uintptr_t)op->buf;
+    sqe->len       = (uint32_t)op->len;
+    sqe->off       = op->offset;   /* IOQ_APPEND is the ring's -1 */
+    sqe->user_data = op->tag;
+    q->sqArray[slot] = slot;
+    q->last          = sqe;
+    q->sqNext++;
+}
+
+static int ringSubmit(IoQueue *q) {
+    /* the entries are written before the kernel may see the new tail */
+    __atomic_store_n(q->sqTail, q->sqNext, __ATOMIC_RELEASE);
+    int n;
+    do {
+        n = ringEnter(q->ringFd, q->queued, 0, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+    q->queued   -= (unsigned)n;
+    q->inflight += (unsigned)n;
+    return n;
+}
+
+static int ringReap(IoQueue *q, IoqDone *out, int max, unsigned wait) {
+    int got = 0;
+    for (;;) {
+        unsigned head = *q->cqHead;
+        unsigned tail = __atomic_load_n(q->cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail && got < max) {
+            const struct io_uring_cqe *cqe =
+                (const struct io_uring_cqe *)q->cqes + (head & *q->cqMask);
+            out[got].tag = cqe->user_data;
+            out[got].res = cqe->res;
+            got++;
+            head++;
+            q->inflight--;
+        }
+        __atomic_store_n(q->cqHead, head, __ATOMIC_RELEASE);
+        if ((unsigned)got >= wait || got == max) return got;
+
+        __atomic_store_n(q->sqTail, q->sqNext, __ATOMIC_RELEASE);
+        int n = ringEnter(q->ringFd, q->queued, wait - (unsigned)got,
+                          IORING_ENTER_GETEVENTS);
+        if (n < 0 && errno != EINTR) return got > 0 ? got : -1;
+        if (n > 0) {
+            q->queued   -= (unsigned)n;
+            q->inflight += (unsigned)n;
+        }
+    }
+}
+
+#endif
+
+/* ---------- helper: blocking calls ---------- */
+
+static long runOp(const Op *op) {
+    ssize_t n;
+    do {
+        n = op->op == OP_FSYNC ? fsync(op->fd) :
+            op->op == OP_READ  ? pread(op->fd, op->buf, op->len, (off_t)op->offset) :
+            op->offset == IOQ_APPEND ? write(op->fd, op->buf, op->len) :
+                                   pwrite(op->fd, op->buf, op->len, (off_t)op->offset);
+    } while (n < 0 && errno == EINTR);
+    return n < 0 ? -(long)errno : (long)n;
+}
+
+static int push(IoQueue *q, int op, int fd, void *buf, size_t len, uint64_t offset,
+                uint64_t tag) {
+    if (q->queued + q->inflight + q->doneCount >= q->depth) {
+        errno = EAGAIN;
+        return -1;
+    }
+    Op o = { op, 0, fd, buf, len, offset, tag };
+#if HAVE_URING
+    if (q->ringFd >= 0) {
+        ringQueue(q, &o);
+        q->queued++;
+        return 0;
+    }
+#endif
+    q->ops[q->queued++] = o;
+    return 0;
+}
+
+/* ---------- public ---------- */
+
+IoQueue *ioq_open(unsigned depth, int async) {
+    IoQueue *q = (IoQueue *)calloc(1, sizeof(IoQueue));
+    if (!q) return NULL;
+    q->depth  = depth > 0 ? depth : 1;
+    q->ringFd = -1;
+#if HAVE_URING
+    if (async && ringOpen(q) == 0) return q;
+#else
+    (void)async;
+#endif
+    q->ops  = (Op *)malloc(sizeof(Op) * q->depth);
+    q->done = (IoqDone *)malloc(sizeof(IoqDone) * q->depth);
+    if (!q->ops || !q->done) {
+        ioq_close(q);
+        return NULL;
+    }
+    return q;
+}
+
+void ioq_close(IoQueue *q) {
+    if (!q) return;
+#if HAVE_URING
+    if (q->ringFd >= 0) {
+        /* the kernel may still be using buffers the caller frees next */
+        ioq_drain(q);
+        ringUnmap(q);
+        close(q->ringFd);
+    }
+#endif
+    free(q->ops);
+    free(q->done);
+    free(q);
+}
+
+int ioq_async(const IoQueue *q) {
+    return q->ringFd >= 0;
+}
+
+unsigned ioq_free(const IoQueue *q) {
+    return q->depth - q->queued - q->inflight - q->doneCount;
+}
+
+int ioq_read(IoQueue *q, int fd, void *buf, size_t len, uint64_t offset, uint64_t tag) {
+    return push(q, OP_READ, fd, buf, len, offset, tag);
+}
+
+int ioq_write(IoQueue *q, int fd, const void *buf, size_t len, uint64_t offset,
+              uint64_t tag) {
+    return push(q, OP_WRITE, fd, (void *)buf, len, offset, tag);
+}
+
+int ioq_fsync(IoQueue *q, int fd, uint64_t tag) {
+    return push(q, OP_FSYNC, fd, NULL, 0, 0, tag);
+}
+
+int ioq_link(IoQueue *q) {
+    if (q->queued == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+#if HAVE_URING
+    if (q->ringFd >= 0) {
+        q->last->flags |= IOSQE_IO_LINK;
+        return 0;
+    }
+#endif
+    q->ops[q->queued - 1].linked = 1;
+    return 0;
+}
+
+int ioq_submit(IoQueue *q) {
+    if (q->queued == 0) return 0;
+#if HAVE_URING
+    if (q->ringFd >= 0) return ringSubmit(q);
+#endif
+    int n      = (int)q->queued;
+    int broken = 0;   /* a linked operation before failed or came up short */
+    for (unsigned i = 0; i < q->queued; i++) {
+        const Op *op  = &q->ops[i];
+        long      res = broken ? -ECANCELED : runOp(op);
+        broken = op->linked && (res < 0 || (op->op != OP_FSYNC && (size_t)res < op->len));
+        q->done[q->doneCount].tag = op->tag;
+        q->done[q->doneCount].res = res;
+        q->doneCount++;
+    }
+    q->queued = 0;
+    return n;
+}
+
+int ioq_reap(IoQueue *q, IoqDone *out, int max, int wait) {
+    unsigned outstanding = q->queued + q->inflight + q->doneCount;
+    unsigned want        = wait < 0 ? 0 : (unsigned)wait;
+    if (want > outstanding) want = outstanding;
+#if HAVE_URING
+    if (q->ringFd >= 0) return max > 0 ? ringReap(q, out, max, want) : 0;
+#endif
+    if (ioq_submit(q) < 0) return -1;
+    int got = 0;
+    while (got < max && (unsigned)got < q->doneCount) {
+        out[got] = q->done[got];
+        got++;
+    }
+    memmove(q->done, q->done + got, sizeof(IoqDone) * (q->doneCount - (unsigned)got));
+    q->doneCount -= (unsigned)got;
+    return got;
+}
+
+int ioq_drain(IoQueue *q) {
+    IoqDone done[16];
+    for (;;) {
+        unsigned left = q->queued + q->inflight + q->doneCount;
+        if (left == 0) return 0;
+        if (ioq_reap(q, done, 16, left < 16 ? (int)left : 16) >= 0) continue;
+        /* out of memory for a moment, or completions overflowing */
+        if (errno != EAGAIN && errno != EBUSY && errno != EINTR) return -1;
+    }
+}
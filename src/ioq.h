@@ -0,0 +1,81 @@
+// ioq.h - batched reads, writes and fsyncs over io_uring, or blocking calls
+
+#ifndef IOQ_H
+#define IOQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A queue of up to depth file operations in flight. Operations are
+ * queued, handed to the kernel together by one submit, and come back as
+ * completions in any order, each with the tag it was queued with and its
+ * result: bytes moved, or -errno. Nothing resubmits a short read or
+ * write; the caller sees the count and decides.
+ *
+ * On Linux the queue is an io_uring ring, driven through the raw system
+ * calls (no liburing). Where io_uring is missing or not allowed, or when
+ * opened blocking, every operation runs with pread/pwrite/fsync at
+ * submit and its completion waits to be reaped, so callers are written
+ * once for both.
+ *
+ * Operations in flight together run in any order unless linked.
+ * Writes at IOQ_APPEND go where the file's offset is, which for an
+ * O_APPEND descriptor is its end; two of them in flight at once may land
+ * in either order.
+ *
+ * Not thread-safe: one thread drives a queue at a time.
+ */
+#define IOQ_APPEND UINT64_MAX
+
+typedef struct {
+    uint64_t tag;
+    long     res;    /* bytes, or -errno */
+} IoqDone;
+
+typedef struct IoQueue IoQueue;
+
+IoQueue *ioq_open(unsigned depth, int async);
+/* a queue of depth (at least 1) operations; async 0 forces the blocking
+ * calls. returns the queue, or NULL when out of memory */
+
+void ioq_close(IoQueue *q);
+/* waits for whatever is still in flight (ioq_drain), then frees q */
+
+int  ioq_async(const IoQueue *q);
+/* returns 1 if q runs on io_uring, 0 if on blocking calls */
+
+unsigned ioq_free(const IoQueue *q);
+/* operations that can still be queued before some are reaped */
+
+int  ioq_read(IoQueue *q, int fd, void *buf, size_t len, uint64_t offset,
+              uint64_t tag);
+int  ioq_write(IoQueue *q, int fd, const void *buf, size_t len,
+               uint64_t offset, uint64_t tag);
+int  ioq_fsync(IoQueue *q, int fd, uint64_t tag);
+/* queue one operation; buf must stay put until it completes.
+ * returns 0, or -1 (errno EAGAIN) when depth operations are outstanding */
+
+int  ioq_link(IoQueue *q);
+/* makes the operation queued last run before the next one queued, which
+ * is cancelled (-ECANCELED) if the first fails or comes up short; a
+ * chain is only as long as the operations linked into it.
+ * returns 0, or -1 with nothing queued */
+
+int  ioq_submit(IoQueue *q);
+/* hands the kernel everything queued. returns how many, or -1 (errno
+ * set) */
+
+int  ioq_reap(IoQueue *q, IoqDone *out, int max, int wait);
+/* submits what is queued, waits until at least wait (capped at what is
+ * outstanding) completions are in, and moves up to max of them to out.
+ * returns how many, or -1 (errno set) */
+
+int  ioq_drain(IoQueue *q);
+/* submits what is queued and waits until every operation is back,
+ * dropping their completions, through errors that pass (EAGAIN, EBUSY,
+ * EINTR). returns 0, or -1 if the kernel cannot be waited on: the
+ * buffers of what is in flight may then still be written to and must
+ * never be freed or reused, nor q reused */
+
+#endif // IOQ_H
@@ -0,0 +1,198 @@
+// journal.c - append-only record log with group-commit fsync
+
+#include "journal.h"
+#include "crc32c.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* ---------- helper: checksum ---------- */
+
+uint32_t journal_crc(const void *data, size_t len) {
+    return crc32c(0, data, len);
+}
+
+/* ---------- helper: encoding ---------- */
+
+static void putU32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t getU32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int writeAll(int fd, const void *buf, size_t len) {
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static long elapsedMs(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 +
+           (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+/* ---------- public: replay ---------- */
+
+long journal_replay(const char *path, JournalReplayFn fn, void *ctx) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+
+    unsigned char  hdr[8];
+    unsigned char *buf = NULL;
+    size_t         cap = 0;
+    long           good = 0;
+
+    while (fread(hdr, 1, sizeof(hdr), fp) == sizeof(hdr)) {
+        uint32_t len = getU32(hdr);
+        uint32_t crc = getU32(hdr + 4);
+        if (len == 0 || len > JOURNAL_MAX_RECORD) break;
+
+        if (len > cap) {
+            unsigned char *nb = (unsigned char *)realloc(buf, len);
+            if (!nb) break;
+            buf = nb;
+            cap = len;
+        }
+        if (fread(buf, 1, len, fp) != len) break;
+        if (journal_crc(buf, len) != crc) break;
+
+        fn(ctx, buf, len);
+        good += (long)sizeof(hdr) + (long)len;
+    }
+
+    free(buf);
+    fclose(fp);
+    return good;
+}
+
+/* ---------- public: writing ---------- */
+
+int journal_open(Journal *j, const char *path, long validLen) {
+    memset(j, 0, sizeof(*j));
+    j->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (j->fd < 0) return -1;
+
+    if (validLen >= 0 && ftruncate(j->fd, (off_t)validLen) != 0) {
+        close(j->fd);
+        j->fd = -1;
+        return -1;
+    }
+    off_t end = lseek(j->fd, 0, SEEK_END);
+    j->bytes    = end > 0 ? (uint64_t)end : 0;
+    j->syncMode = JOURNAL_SYNC_GROUP;
+    j->groupSize = 32;
+    j->groupMs   = 50;
+    return 0;
+}
+
+void journal_setSync(Journal *j, int mode, int groupSize, int groupMs) {
+    j->syncMode  = mode;
+    j->groupSize = groupSize > 0 ? groupSize : 1;
+    j->groupMs   = groupMs >= 0 ? groupMs : 0;
+}
+
+int journal_sync(Journal *j) {
+    if (j->fd < 0) return -1;
+    if (j->pending == 0) return 0;
+
+    uint64_t t0 = stats_begin();
+    int      rc = fdatasync(j->fd);
+    stats_end(STAT_FSYNC, t0);
+    stats_count(STAT_FSYNCS, 1);
+    if (rc != 0) return -1;
+    j->pending = 0;
+    return 0;
+}
+
+int journal_append(Journal *j, const void *rec, size_t len) {
+    if (j->fd < 0 || len == 0 || len > JOURNAL_MAX_RECORD) return -1;
+
+    /* header and payload go out in one write so O_APPEND keeps them together */
+    unsigned char  stackBuf[512];
+    unsigned char *frame = stackBuf;
+    if (len + 8 > sizeof(stackBuf)) {
+        frame = (unsigned char *)malloc(len + 8);
+        if (!frame) return -1;
+    }
+    putU32(frame, (uint32_t)len);
+    putU32(frame + 4, journal_crc(rec, len));
+    memcpy(frame + 8, rec, len);
+
+    int rc = writeAll(j->fd, frame, len + 8);
+    if (frame != stackBuf) free(frame);
+    if (rc != 0) return -1;
+
+    stats_count(STAT_BYTES_WRITTEN, len + 8);
+    j->bytes += len + 8;
+    j->records++;
+    if (j->pending++ == 0)
+        clock_gettime(CLOCK_MONOTONIC, &j->firstPending);
+
+    switch (j->syncMode) {
+        case JOURNAL_SYNC_ALWAYS:
+            return journal_sync(j);
+        case JOURNAL_SYNC_GROUP:
+            if (j->pending >= j->groupSize ||
+                elapsedMs(&j->firstPending) >= j->groupMs)
+                return journal_sync(j);
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+int journal_truncate(Journal *j) {
+    if (j->fd < 0 || ftruncate(j->fd, 0) != 0) return -1;
+    j->bytes   = 0;
+    j->pending = 0;
+    return 0;
+}
+
+void journal_close(Journal *j) {
+    if (j->fd < 0) return;
+    journal_sync(j);
+    close(j->fd);
+    j->fd = -1;
+}
+
+int journal_syncDir(const char *path) {
+    char dir[4096];
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        strcpy(dir, ".");
+    } else if (slash == path) {
+        strcpy(dir, "/");
+    } else {
+        size_t n = (size_t)(slash - path);
+        if (n >= sizeof(dir)) return -1;
+        memcpy(dir, path, n);
+        dir[n] = '\0';
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    int rc = fsync(fd);
+    stats_count(STAT_FSYNCS, 1);
+    close(fd);
+    return rc;
+}
@@ -0,0 +1,73 @@
+// journal.h - append-only record log with group-commit fsync
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* fsync policies */
+#define JOURNAL_SYNC_NONE   0   /* leave flushing to the OS */
+#define JOURNAL_SYNC_ALWAYS 1   /* fsync after every record */
+#define JOURNAL_SYNC_GROUP  2   /* fsync once per groupSize records or groupMs */
+
+#define JOURNAL_MAX_RECORD  (1u << 20)
+
+typedef struct {
+    int             fd;
+    int             syncMode;
+    int             groupSize;
+    int             groupMs;
+    int             pending;      /* records written since the last fsync */
+    struct timespec firstPending;
+    uint64_t        bytes;        /* current length of the log */
+    uint32_t        records;      /* records appended since open */
+} Journal;
+
+/* On-disk framing of one record:
+ *   u32 payload length | u32 CRC-32C of payload | payload
+ * all little-endian. A record whose length or CRC does not check out
+ * ends the log (torn write from a crash). */
+
+typedef void (*JournalReplayFn)(void *ctx, const unsigned char *rec,
+                                size_t len);
+
+long journal_replay(const char *path, JournalReplayFn fn, void *ctx);
+/* calls fn for every intact record, in order.
+ * returns:
+ *  >=0 = byte length of the intact prefix
+ *   -1 = file missing or unreadable
+ */
+
+int  journal_open(Journal *j, const char *path, long validLen);
+/* opens (creating if needed) for appending; if validLen >= 0 the file
+ * is first cut back to that length to drop a torn tail.
+ * returns:
+ *   0 = success
+ *  -1 = open error
+ */
+
+void journal_setSync(Journal *j, int mode, int groupSize, int groupMs);
+
+int  journal_append(Journal *j, const void *rec, size_t len);
+/* returns:
+ *   0 = success
+ *  -1 = write or fsync error
+ */
+
+int  journal_sync(Journal *j);
+/* forces pending records to disk; returns 0 or -1 */
+
+int  journal_truncate(Journal *j);
+/* empties the log; records not synced yet are dropped, not synced.
+ * returns 0 or -1 */
+
+void journal_close(Journal *j);
+
+/* fsync the directory holding path, so a rename or create is durable */
+int  journal_syncDir(const char *path);
+
+uint32_t journal_crc(const void *data, size_t len);
+
+#endif // JOURNAL_H
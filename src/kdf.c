@@ -0,0 +1,347 @@
+// kdf.c - SHA-256 (FIPS 180-4), HMAC and PBKDF2-HMAC-SHA256
+
+#include "kdf.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+/* ---------- helper: SHA-256 ---------- */
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void compress(uint32_t st[8], const unsigned char *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+               (uint32_t)p[4 * i + 2] << 8 | (uint32_t)p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = st[0], b = st[1], c = st[2], d = st[3];
+    uint32_t e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) +
+                      ((e & f) ^ (~e & g)) + K[i] + w[i];
+        uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) +
+                      ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+    st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+}
+
+void sha256_init(Sha256 *s) {
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(s->state, iv, sizeof(iv));
+    s->length = 0;
+    s->fill   = 0;
+}
+
+void sha256_update(Sha256 *s, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    s->length += len;
+
+    if (s->fill > 0) {
+        size_t n = 64 - s->fill < len ? 64 - s->fill : len;
+        memcpy(s->block + s->fill, p, n);
+        s->fill += n;
+        p   += n;
+        len -= n;
+        if (s->fill < 64) return;
+        compress(s->state, s->block);
+        s->fill = 0;
+    }
+    for (; len >= 64; p += 64, len -= 64)
+        compress(s->state, p);
+    memcpy(s->block, p, len);
+    s->fill = len;
+}
+
+void sha256_final(Sha256 *s, unsigned char out[KDF_DIGEST_LEN]) {
+    uint64_t bits = s->length * 8;
+
+    s->block[s->fill++] = 0x80;
+    if (s->fill > 56) {
+        memset(s->block + s->fill, 0, 64 - s->fill);
+        compress(s->state, s->block);
+        s->fill = 0;
+    }
+    memset(s->block + s->fill, 0, 56 - s->fill);
+    for (int i = 0; i < 8; i++)
+        s->block[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+    compress(s->state, s->block);
+
+    for (int i = 0; i < 8; i++) {
+        out[4 * i]     = (unsigned char)(s->state[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(s->state[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(s->state[i] >> 8);
+        out[4 * i + 3] = (unsigned char)s->state[i];
+    }
+}
+
+/* ---------- helper: HMAC ---------- */
+
+/* the two keyed states, so each HMAC afterwards costs two compressions
+ * for a short message instead of four */
+typedef struct {
+    Sha256 inner;
+    Sha256 outer;
+} HmacKey;
+
+static void hmacInit(HmacKey *hk, const void *key, size_t keyLen) {
+    unsigned char k[64] = { 0 };
+    if (keyLen > 64) {
+        Sha256 s;
+        sha256_init(&s);
+        sha256_update(&s, key, keyLen);
+        sha256_final(&s, k);
+    } else {
+        memcpy(k, key, keyLen);
+    }
+
+    unsigned char pad[64];
+    for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x36;
+    sha256_init(&hk->inner);
+    sha256_update(&hk->inner, pad, 64);
+    for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x5c;
+    sha256_init(&hk->outer);
+    sha256_update(&hk->outer, pad, 64);
+}
+
+static void hmacRun(const HmacKey *hk, const void *msg, size_t len,
+                    unsigned char out[KDF_DIGEST_LEN]) {
+    Sha256 s = hk->inner;
+    sha256_update(&s, msg, len);
+    sha256_final(&s, out);
+    s = hk->outer;
+    sha256_update(&s, out, KDF_DIGEST_LEN);
+    sha256_final(&s, out);
+}
+
+void hmac_sha256(const void *key, size_t keyLen,
+                 const void *msg, size_t msgLen,
+                 unsigned char out[KDF_DIGEST_LEN]) {
+    HmacKey hk;
+    hmacInit(&hk, key, keyLen);
+    hmacRun(&hk, msg, msgLen, out);
+}
+
+/* ---------- public: PBKDF2 ---------- */
+
+void kdf_pbkdf2(const char *password, size_t pwLen,
+                const unsigned char *salt, size_t saltLen,
+                uint32_t iterations, unsigned char *out, size_t outLen) {
+    HmacKey hk;
+    hmacInit(&hk, password, pwLen);
+
+    for (uint32_t block = 1; outLen > 0; block++) {
+        unsigned char u[KDF_DIGEST_LEN], t[KDF_DIGEST_LEN];
+        unsigned char be[4] = { (unsigned char)(block >> 24),
+                                (unsigned char)(block >> 16),
+                                (unsigned char)(block >> 8),
+                                (unsigned char)block };
+
+        Sha256 s = hk.inner;            /* U1 = HMAC(P, salt || INT(i)) */
+        sha256_update(&s, salt, saltLen);
+        sha256_update(&s, be, 4);
+        sha256_final(&s, u);
+        s = hk.outer;
+        sha256_update(&s, u, KDF_DIGEST_LEN);
+        sha256_final(&s, u);
+        memcpy(t, u, KDF_DIGEST_LEN);
+
+        for (uint32_t i = 1; i < iterations; i++) {
+            hmacRun(&hk, u, KDF_DIGEST_LEN, u);
+            for (int j = 0; j < KDF_DIGEST_LEN; j++) t[j] ^= u[j];
+        }
+
+        size_t n = outLen < KDF_DIGEST_LEN ? outLen : KDF_DIGEST_LEN;
+        memcpy(out, t, n);
+        out    += n;
+        outLen -= n;
+    }
+}
+
+/* ---------- public: stored hashes ---------- */
+
+static void toHex(char *dst, const unsigned char *src, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        dst[2 * i]     = digits[src[i] >> 4];
+        dst[2 * i + 1] = digits[src[i] & 15];
+    }
+    dst[2 * len] = '\0';
+}
+
+static int fromHex(unsigned char *dst, const char *src, size_t len) {
+    for (size_t i = 0; i < 2 * len; i++) {
+        char c = src[i];
+        int  v = c >= '0' && c <= '9' ? c - '0' :
+                 c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (v < 0) return -1;
+        if (i % 2 == 0) dst[i / 2] = (unsigned char)(v << 4);
+        else            dst[i / 2] |= (unsigned char)v;
+    }
+    return 0;
+}
+
+int kdf_equal(const void *a, const void *b, size_t len) {
+    const unsigned char *x = (const unsigned char *)a;
+    const unsigned char *y = (const unsigned char *)b;
+    unsigned char diff = 0;
+    for (size_t i = 0; i < len; i++) diff |= x[i] ^ y[i];
+    return diff == 0;
+}
+
+int kdf_isHashed(const char *stored) {
+    return strncmp(stored, KDF_PREFIX, sizeof(KDF_PREFIX) - 1) == 0 ||
+           kdf_hasKey(stored);
+}
+
+int kdf_hasKey(const char *stored) {
+    return strncmp(stored, KDF_KEYED_PREFIX, sizeof(KDF_KEYED_PREFIX) - 1) == 0;
+}
+
+int kdf_random(void *buf, size_t len) {
+    unsigned char *p = (unsigned char *)buf;
+    while (len > 0) {
+        ssize_t n = getrandom(p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* "<iterations>$<salt hex>$" then nFields hex fields of KDF_DIGEST_LEN
+ * bytes separated by '$', as after a "$fvN$" prefix. returns 0 or -1 */
+static int parseStored(const char *p, uint32_t *iterations,
+                       unsigned char salt[KDF_SALT_LEN],
+                       unsigned char fields[][KDF_DIGEST_LEN], int nFields) {
+    char *end;
+    unsigned long iters = strtoul(p, &end, 10);
+    if (*end != '$' || iters == 0 || iters > UINT32_MAX) return -1;
+    *iterations = (uint32_t)iters;
+
+    p = end + 1;
+    if (strlen(p) != 2 * KDF_SALT_LEN + (size_t)nFields * (1 + 2 * KDF_DIGEST_LEN) ||
+        fromHex(salt, p, KDF_SALT_LEN) != 0)
+        return -1;
+    p += 2 * KDF_SALT_LEN;
+    for (int i = 0; i < nFields; i++, p += 1 + 2 * KDF_DIGEST_LEN) {
+        if (*p != '$' || fromHex(fields[i], p + 1, KDF_DIGEST_LEN) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* the check value and wrapping pad of the keyed form */
+static void keyedParts(const unsigned char master[KDF_DIGEST_LEN],
+                       unsigned char check[KDF_DIGEST_LEN],
+                       unsigned char pad[KDF_KEY_LEN]) {
+    hmac_sha256(master, KDF_DIGEST_LEN, "check", 5, check);
+    hmac_sha256(master, KDF_DIGEST_LEN, "wrap", 4, pad);
+}
+
+int kdf_hash(const char *password, uint32_t iterations,
+             char out[KDF_ENCODED_MAX]) {
+    unsigned char salt[KDF_SALT_LEN];
+    if (kdf_random(salt, sizeof(salt)) != 0) return -1;
+    if (iterations < KDF_MIN_COST) iterations = KDF_MIN_COST;
+
+    unsigned char hash[KDF_DIGEST_LEN];
+    kdf_pbkdf2(password, strlen(password), salt, sizeof(salt),
+               iterations, hash, sizeof(hash));
+
+    char saltHex[2 * KDF_SALT_LEN + 1], hashHex[2 * KDF_DIGEST_LEN + 1];
+    toHex(saltHex, salt, sizeof(salt));
+    toHex(hashHex, hash, sizeof(hash));
+    snprintf(out, KDF_ENCODED_MAX, KDF_PREFIX "%u$%s$%s",
+             (unsigned)iterations, saltHex, hashHex);
+    return 0;
+}
+
+int kdf_hashKey(const char *password, uint32_t iterations,
+                const unsigned char key[KDF_KEY_LEN], char out[KDF_ENCODED_MAX]) {
+    unsigned char salt[KDF_SALT_LEN];
+    if (kdf_random(salt, sizeof(salt)) != 0) return -1;
+    if (iterations < KDF_MIN_COST) iterations = KDF_MIN_COST;
+
+    unsigned char master[KDF_DIGEST_LEN], check[KDF_DIGEST_LEN], wrapped[KDF_KEY_LEN];
+    kdf_pbkdf2(password, strlen(password), salt, sizeof(salt),
+               iterations, master, sizeof(master));
+    keyedParts(master, check, wrapped);
+    for (int i = 0; i < KDF_KEY_LEN; i++) wrapped[i] ^= key[i];
+
+    char saltHex[2 * KDF_SALT_LEN + 1], checkHex[2 * KDF_DIGEST_LEN + 1];
+    char keyHex[2 * KDF_KEY_LEN + 1];
+    toHex(saltHex, salt, sizeof(salt));
+    toHex(checkHex, check, sizeof(check));
+    toHex(keyHex, wrapped, sizeof(wrapped));
+    snprintf(out, KDF_ENCODED_MAX, KDF_KEYED_PREFIX "%u$%s$%s$%s",
+             (unsigned)iterations, saltHex, checkHex, keyHex);
+    return 0;
+}
+
+int kdf_unlock(const char *password, const char *stored,
+               unsigned char key[KDF_KEY_LEN]) {
+    if (!kdf_hasKey(stored)) return 0;
+
+    uint32_t      iterations;
+    unsigned char salt[KDF_SALT_LEN], fields[2][KDF_DIGEST_LEN];
+    if (parseStored(stored + sizeof(KDF_KEYED_PREFIX) - 1, &iterations,
+                    salt, fields, 2) != 0)
+        return 0;
+
+    unsigned char master[KDF_DIGEST_LEN], check[KDF_DIGEST_LEN], pad[KDF_KEY_LEN];
+    kdf_pbkdf2(password, strlen(password), salt, sizeof(salt),
+               iterations, master, sizeof(master));
+    keyedParts(master, check, pad);
+    if (!kdf_equal(check, fields[0], sizeof(check))) return 0;
+
+    for (int i = 0; i < KDF_KEY_LEN; i++) key[i] = fields[1][i] ^ pad[i];
+    return 1;
+}
+
+int kdf_verify(const char *password, const char *stored) {
+    if (kdf_hasKey(stored)) {
+        unsigned char key[KDF_KEY_LEN];
+        return kdf_unlock(password, stored, key);
+    }
+    if (!kdf_isHashed(stored)) return 0;
+
+    uint32_t      iterations;
+    unsigned char salt[KDF_SALT_LEN], want[1][KDF_DIGEST_LEN], got[KDF_DIGEST_LEN];
+    if (parseStored(stored + sizeof(KDF_PREFIX) - 1, &iterations,
+                    salt, want, 1) != 0)
+        return 0;
+
+    kdf_pbkdf2(password, strlen(password), salt, sizeof(salt),
+               iterations, got, sizeof(got));
+    return kdf_equal(got, want[0], sizeof(got));
+}
@@ -0,0 +1,92 @@
+// kdf.h - SHA-256, HMAC-SHA256 and PBKDF2 for password and key storage
+
+#ifndef KDF_H
+#define KDF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KDF_DIGEST_LEN   32
+#define KDF_SALT_LEN     16
+#define KDF_DEFAULT_COST 100000   /* PBKDF2 iterations */
+#define KDF_MIN_COST     1000
+
+#define KDF_KEY_LEN      32       /* data key carried by a keyed hash */
+
+/* stored form: "$fv1$<iterations>$<salt hex>$<hash hex>", no whitespace,
+ * so it fits the "name secret" lines of vault.txt unchanged */
+#define KDF_PREFIX       "$fv1$"
+
+/* keyed form: "$fv2$<iterations>$<salt hex>$<check hex>$<wrapped key hex>".
+ * One PBKDF2 run gives a master secret M; check = HMAC(M, "check") proves
+ * the password and the data key is stored XORed with HMAC(M, "wrap").
+ * Every hash has a fresh salt, so the wrapping pad is never reused. */
+#define KDF_KEYED_PREFIX "$fv2$"
+
+#define KDF_ENCODED_MAX  (5 + 10 + 1 + 2 * KDF_SALT_LEN + 1 + 2 * KDF_DIGEST_LEN + \
+                          1 + 2 * KDF_KEY_LEN + 1)
+
+typedef struct {
+    uint32_t      state[8];
+    uint64_t      length;      /* bytes hashed so far */
+    unsigned char block[64];
+    size_t        fill;
+} Sha256;
+
+void sha256_init(Sha256 *s);
+void sha256_update(Sha256 *s, const void *data, size_t len);
+void sha256_final(Sha256 *s, unsigned char out[KDF_DIGEST_LEN]);
+
+void hmac_sha256(const void *key, size_t keyLen,
+                 const void *msg, size_t msgLen,
+                 unsigned char out[KDF_DIGEST_LEN]);
+
+/* PBKDF2-HMAC-SHA256 (RFC 8018); outLen may span several blocks */
+void kdf_pbkdf2(const char *password, size_t pwLen,
+                const unsigned char *salt, size_t saltLen,
+                uint32_t iterations, unsigned char *out, size_t outLen);
+
+int  kdf_hash(const char *password, uint32_t iterations,
+              char out[KDF_ENCODED_MAX]);
+/* derives a fresh salted hash in the stored form.
+ * returns:
+ *   0 = success
+ *  -1 = no randomness available for the salt
+ */
+
+int  kdf_hashKey(const char *password, uint32_t iterations,
+                 const unsigned char key[KDF_KEY_LEN], char out[KDF_ENCODED_MAX]);
+/* like kdf_hash, in the keyed form carrying key.
+ * returns:
+ *   0 = success
+ *  -1 = no randomness available for the salt
+ */
+
+int  kdf_verify(const char *password, const char *stored);
+/* either form.
+ * returns:
+ *   1 = password matches
+ *   0 = it does not, or stored is malformed
+ */
+
+int  kdf_unlock(const char *password, const char *stored,
+                unsigned char key[KDF_KEY_LEN]);
+/* keyed form only; same cost as kdf_verify.
+ * returns:
+ *   1 = password matches, key holds the data key
+ *   0 = it does not, or stored is malformed or not keyed
+ */
+
+/* nonzero if stored is in a KDF form rather than a legacy plaintext */
+int  kdf_isHashed(const char *stored);
+
+/* nonzero if stored is in the keyed form */
+int  kdf_hasKey(const char *stored);
+
+/* fills buf from the kernel CSPRNG. returns 0, or -1 on failure */
+int  kdf_random(void *buf, size_t len);
+
+/* comparison whose time does not depend on where the inputs differ */
+int  kdf_equal(const void *a, const void *b, size_t len);
+
+#endif // KDF_H
@@ -0,0 +1,131 @@
+// lru.c - hash index + intrusive doubly linked list
+
+#include "lru.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* ---------- helper: list ---------- */
+
+static const char *nodeName(void *ctx, int id) {
+    return ((Lru *)ctx)->nodes[id].name;
+}
+
+static void detachNode(Lru *l, int32_t id) {
+    LruNode *n = &l->nodes[id];
+    if (n->prev >= 0) l->nodes[n->prev].next = n->next;
+    else              l->head = n->next;
+    if (n->next >= 0) l->nodes[n->next].prev = n->prev;
+    else              l->tail = n->prev;
+}
+
+static void pushHead(Lru *l, int32_t id) {
+    LruNode *n = &l->nodes[id];
+    n->prev = -1;
+    n->next = l->head;
+    if (l->head >= 0) l->nodes[l->head].prev = id;
+    l->head = id;
+    if (l->tail < 0) l->tail = id;
+}
+
+static int growNodes(Lru *l) {
+    if (l->count < l->allocated) return 0;
+    int newCap = l->allocated ? l->allocated * 2 : 16;
+    if (newCap > l->capacity) newCap = l->capacity;
+    LruNode *nodes = (LruNode *)realloc(l->nodes, sizeof(LruNode) * (size_t)newCap);
+    if (!nodes) return -1;
+    l->nodes     = nodes;
+    l->allocated = newCap;
+    return 0;
+}
+
+/* ---------- public ---------- */
+
+int lru_init(Lru *l, int capacity) {
+    memset(l, 0, sizeof(*l));
+    l->capacity = capacity > 0 ? capacity : 1;
+    l->head     = -1;
+    l->tail     = -1;
+    return hashindex_init(&l->index, 0, nodeName, l);
+}
+
+void lru_free(Lru *l) {
+    for (int i = 0; i < l->count; i++)
+        free(l->nodes[i].name);
+    free(l->nodes);
+    hashindex_free(&l->index);
+    memset(l, 0, sizeof(*l));
+    l->head = l->tail = -1;
+}
+
+int lru_touch(Lru *l, const char *name) {
+    uint32_t hash = hashindex_hash(name);
+    int32_t  id   = hashindex_find(&l->index, name, hash);
+    if (id >= 0) {
+        if (id != l->head) {
+            detachNode(l, id);
+            pushHead(l, id);
+        }
+        return 0;
+    }
+
+    char *copy = strdup(name);
+    if (!copy) return -1;
+
+    if (l->count < l->capacity) {
+        /* the index insert is the only step that can fail; do it first */
+        if (growNodes(l) != 0 ||
+            hashindex_insert(&l->index, copy, hash, l->count) != 0) {
+            free(copy);
+            return -1;
+        }
+        id = l->count++;
+    } else {
+        /* full: recycle the oldest node; the index does not grow */
+        id = l->tail;
+        LruNode *old = &l->nodes[id];
+        hashindex_remove(&l->index, old->name, old->hash);
+        detachNode(l, id);
+        free(old->name);
+        hashindex_insert(&l->index, copy, hash, id);
+    }
+
+    l->nodes[id].name = copy;
+    l->nodes[id].hash = hash;
+    pushHead(l, id);
+    return 0;
+}
+
+int lru_setCapacity(Lru *l, int capacity) {
+    if (capacity <= 0) capacity = 1;
+
+    /* rebuild from oldest to newest so the survivors keep their order */
+    Lru fresh;
+    if (lru_init(&fresh, capacity) != 0) return -1;
+    int skip = l->count > capacity ? l->count - capacity : 0;
+    for (int32_t id = l->tail; id >= 0; id = l->nodes[id].prev) {
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        if (lru_touch(&fresh, l->nodes[id].name) != 0) {
+            lru_free(&fresh);
+            return -1;
+        }
+    }
+
+    lru_free(l);
+    *l = fresh;
+    l->index.ctx = l;   /* the index points back at its owner */
+    return 0;
+}
+
+int lru_list(const Lru *l, int offset, int maxCount, const char **out) {
+    int32_t id = l->head;
+    for (; id >= 0 && offset > 0; offset--)
+        id = l->nodes[id].next;
+
+    int n = 0;
+    for (; id >= 0 && n < maxCount; id = l->nodes[id].next)
+        out[n++] = l->nodes[id].name;
+    return n;
+}
@@ -0,0 +1,46 @@
+// lru.h - bounded most-recently-used list of names
+
+#ifndef LRU_H
+#define LRU_H
+
+#include "hashindex.h"
+#include <stdint.h>
+
+/* A hash index maps each name to its node; nodes form a doubly linked
+ * list by index, most recent at head. Touching a name and evicting the
+ * oldest are both O(1). Once full, the tail node is reused in place. */
+typedef struct {
+    char    *name;
+    uint32_t hash;
+    int32_t  prev;   /* towards the head (more recent), -1 at head */
+    int32_t  next;   /* towards the tail (older), -1 at tail */
+} LruNode;
+
+typedef struct {
+    LruNode  *nodes;
+    int       count;
+    int       allocated;   /* nodes[] length, grows up to capacity */
+    int       capacity;
+    int32_t   head;
+    int32_t   tail;
+    HashIndex index;
+} Lru;
+
+int  lru_init(Lru *l, int capacity);
+/* returns 0, or -1 when out of memory */
+
+void lru_free(Lru *l);
+
+int  lru_touch(Lru *l, const char *name);
+/* makes name the most recent, evicting the oldest if full.
+ * returns 0, or -1 when out of memory */
+
+int  lru_setCapacity(Lru *l, int capacity);
+/* keeps the newest min(count, capacity) names.
+ * returns 0, or -1 when out of memory (list unchanged) */
+
+int  lru_list(const Lru *l, int offset, int maxCount, const char **out);
+/* fills out[] from the offset-th most recent name onwards; the pointers
+ * stay valid until the next touch. returns the number filled */
+
+#endif // LRU_H
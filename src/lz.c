@@ -0,0 +1,191 @@
+// lz.c - greedy hash-chain-free LZ77 compressor and bounds-checked decoder
+
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_BITS     13
+#define MAX_OFFSET    65535
+#define LAST_LITERALS 5          /* a block always ends in literals */
+#define MATCH_LIMIT   12         /* no match starts this close to the end */
+#define SKIP_SHIFT    6          /* misses before the search steps faster */
+
+/* ---------- helper: unaligned access ---------- */
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hashOf(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* bytes p and q have in common, up to limit */
+static size_t commonLength(const unsigned char *p, const unsigned char *q,
+                           const unsigned char *limit) {
+    const unsigned char *start = p;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (p + 8 <= limit) {
+        uint64_t a, b;
+        memcpy(&a, p, 8);
+        memcpy(&b, q, 8);
+        if (a != b) return (size_t)(p - start) + (size_t)__builtin_ctzll(a ^ b) / 8;
+        p += 8;
+        q += 8;
+    }
+#endif
+    while (p < limit && *p == *q) {
+        p++;
+        q++;
+    }
+    return (size_t)(p - start);
+}
+
+/* ---------- helper: sequences ---------- */
+
+/* the bytes after a length nibble of 15 */
+static unsigned char *putLength(unsigned char *op, size_t n) {
+    for (n -= 15; n >= 255; n -= 255) *op++ = 255;
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+/* one sequence: lit literals at anchor, then a match of mlen at offset
+ * off (mlen 0 = the closing literals). returns the new end of out, or
+ * NULL if it does not fit before oend */
+static unsigned char *putSequence(unsigned char *op, unsigned char *oend,
+                                  const unsigned char *anchor, size_t lit,
+                                  size_t off, size_t mlen) {
+    size_t need = 1 + lit + lit / 255 + 1 + (mlen ? 2 + mlen / 255 + 1 : 0);
+    if (need > (size_t)(oend - op)) return NULL;
+
+    unsigned char *token = op++;
+    *token = (unsigned char)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15) op = putLength(op, lit);
+    memcpy(op, anchor, lit);
+    op += lit;
+    if (mlen == 0) return op;
+
+    *op++ = (unsigned char)off;
+    *op++ = (unsigned char)(off >> 8);
+    mlen -= LZ_MIN_MATCH;
+    *token |= (unsigned char)(mlen < 15 ? mlen : 15);
+    if (mlen >= 15) op = putLength(op, mlen);
+    return op;
+}
+
+static int getLength(const unsigned char **ip, const unsigned char *iend,
+                     size_t *n) {
+    unsigned b;
+    do {
+        if (*ip >= iend) return -1;
+        b   = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 0;
+}
+
+/* ---------- public ---------- */
+
+size_t lz_bound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+size_t lz_compress(const void *in, size_t len, void *out, size_t outCap) {
+    const unsigned char *base   = (const unsigned char *)in;
+    const unsigned char *end    = base + len;
+    const unsigned char *ip     = base;
+    const unsigned char *anchor = base;
+    unsigned char       *op     = (unsigned char *)out;
+    unsigned char       *oend   = op + outCap;
+    uint32_t             table[1 << HASH_BITS];
+
+    if (len > MATCH_LIMIT) {
+        const unsigned char *searchEnd = end - MATCH_LIMIT;
+        const unsigned char *matchEnd  = end - LAST_LITERALS;
+        memset(table, 0, sizeof(table));
+
+        for (ip++; ip < searchEnd; ) {
+            /* the next position whose 4 bytes were seen recently; the
+             * stride grows over incompressible stretches */
+            const unsigned char *ref;
+            unsigned             misses = 1u << SKIP_SHIFT;
+            for (;;) {
+                uint32_t h = hashOf(read32(ip));
+                ref        = base + table[h];
+                table[h]   = (uint32_t)(ip - base);
+                if (ip - ref <= MAX_OFFSET && read32(ref) == read32(ip)) break;
+                ip += misses++ >> SKIP_SHIFT;
+                if (ip >= searchEnd) goto done;
+            }
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            size_t mlen = LZ_MIN_MATCH +
+                          commonLength(ip + LZ_MIN_MATCH, ref + LZ_MIN_MATCH, matchEnd);
+            op = putSequence(op, oend, anchor, (size_t)(ip - anchor),
+                             (size_t)(ip - ref), mlen);
+            if (!op) return 0;
+            ip    += mlen;
+            anchor = ip;
+            if (ip < searchEnd)
+                table[hashOf(read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+        }
+    }
+
+done:
+    op = putSequence(op, oend, anchor, (size_t)(end - anchor), 0, 0);
+    return op ? (size_t)(op - (unsigned char *)out) : 0;
+}
+
+int lz_decompress(const void *in, size_t len, void *out, size_t outLen) {
+    const unsigned char *ip   = (const unsigned char *)in;
+    const unsigned char *iend = ip + len;
+    unsigned char       *op   = (unsigned char *)out;
+    unsigned char       *oend = op + outLen;
+
+    for (;;) {
+        if (ip >= iend) return -1;
+        unsigned token = *ip++;
+
+        size_t lit = token >> 4;
+        if (lit == 15 && getLength(&ip, iend, &lit) != 0) return -1;
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) return op == oend ? 0 : -1;   /* closing literals */
+
+        if (iend - ip < 2) return -1;
+        size_t off = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && getLength(&ip, iend, &mlen) != 0) return -1;
+        mlen += LZ_MIN_MATCH;
+        if (off == 0 || off > (size_t)(op - (unsigned char *)out) ||
+            mlen > (size_t)(oend - op))
+            return -1;
+
+        const unsigned char *m = op - off;
+        if (off >= 8 && (size_t)(oend - op) >= mlen + 7) {
+            /* whole words, overrunning by up to 7 bytes that the next
+             * sequence overwrites */
+            unsigned char *stop = op + mlen;
+            do {
+                memcpy(op, m, 8);
+                op += 8;
+                m  += 8;
+            } while (op < stop);
+            op = stop;
+        } else if (off >= mlen) {
+            memcpy(op, m, mlen);
+            op += mlen;
+        } else {
+            while (mlen-- > 0) *op++ = *m++;
+        }
+    }
+}
@@ -0,0 +1,35 @@
+// lz.h - small LZ77 block codec for stored file contents
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+
+/*
+ * A block is a run of sequences, each
+ *
+ *   token | [literal length bytes] | literals | u16 offset | [match length bytes]
+ *
+ * where the token's high nibble is the literal count and its low nibble
+ * the match length minus LZ_MIN_MATCH, 15 meaning "more follows" as
+ * bytes of 255 and a final byte below 255. Offsets are little-endian,
+ * 1..65535 back into the output. The last sequence is literals only and
+ * has no offset. Every block stands alone: nothing is shared with the
+ * blocks before it, so any one can be decoded by itself.
+ */
+#define LZ_MIN_MATCH 4
+
+size_t lz_bound(size_t len);
+/* the most lz_compress can write for len input bytes */
+
+size_t lz_compress(const void *in, size_t len, void *out, size_t outCap);
+/* compresses len bytes into out.
+ * returns the compressed size, or 0 if it would exceed outCap (so
+ * outCap = len - 1 asks "does this shrink at all?") */
+
+int lz_decompress(const void *in, size_t len, void *out, size_t outLen);
+/* decodes the block in into exactly outLen bytes.
+ * returns 0, or -1 if the block is malformed or does not decode to
+ * outLen bytes; out is garbage then */
+
+#endif // LZ_H
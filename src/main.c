@@ -1,14 +1,35 @@
 // main.c - Controller: connects View and Model
 #include <stdlib.h>
+#include "batch.h"
 #include "model.h"
+#include "server.h"
+#include "stats.h"
 #include "view.h"
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 static void controller_accessFile(const char *filename);
+static void controller_showPart(const char *filename, int choice);
+static void controller_showHistory(const char *filename, int choice);
+static int  controller_showHit(void *ctx, const char *filename, long long hits);
+static int  controller_showProblem(void *ctx, const char *filename, int status);
+static void controller_applyEnvironment(void);
+static int  controller_runBatch(const char *path);
+static int  controller_runServer(const char *path, const char *threads);
 
-int main(void) {
-    model_init();
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+        return controller_runBatch(argc > 2 ? argv[2] : NULL);
+    if (argc > 1 && strcmp(argv[1], "--serve") == 0)
+        return controller_runServer(argc > 2 ? argv[2] : NULL,
+                                    argc > 3 ? argv[3] : NULL);
+
+    controller_applyEnvironment();
+    if (model_init() != 0) {
+        perror("fv: cannot open the vault");
+        return 2;
+    }
 
     int choice;
     char filename[MAX_LEN];
@@ -17,7 +38,7 @@ int main(void) {
         view_showMainMenu();
         choice = view_getInt("Enter your choice: ");
 
-        if (choice == 6) {
+        if (choice == 10) {
             view_showMessage("Exiting...");
             break;
         }
@@ -32,7 +53,7 @@ int main(void) {
                 if (res == 0) {
                     view_showMessage("File added and protected successfully.");
                 } else if (res == -1) {
-                    view_showError("Vault is full!");
+                    view_showError("Out of memory!");
                 } else if (res == -2) {
                     view_showError("File already exists!");
                 } else {
@@ -60,21 +81,35 @@ int main(void) {
                     view_showError("File not found!");
                 } else if (res == -2) {
                     view_showError("Incorrect password!");
+                } else {
+                    view_showError("New password is too long.");
                 }
                 break;
             }
 
             case 4: {
-                char names[RECENT_MAX][MAX_LEN];
-                int count = model_getRecent(names, RECENT_MAX);
-                if (count == 0) {
-                    view_showMessage("No recent files.");
-                } else {
-                    view_showRecentFiles(names, count);
-                    int c = view_chooseRecentFile(count);
+                /* one page at a time; the extra slot tells us if there is more */
+                static char names[RECENT_MAX + 1][MAX_LEN];
+                int offset = 0;
+                for (;;) {
+                    int count = model_getRecentPage(names, offset, RECENT_MAX + 1);
+                    int more  = count > RECENT_MAX;
+                    if (more) count = RECENT_MAX;
+
+                    if (count == 0) {
+                        view_showMessage("No recent files.");
+                        break;
+                    }
+                    view_showRecentFiles(names, count, more);
+                    int c = view_chooseRecentFile(count, more);
+                    if (c == count + 1) {
+                        offset += RECENT_MAX;
+                        continue;
+                    }
                     if (c > 0) {
                         controller_accessFile(names[c - 1]);
                     }
+                    break;
                 }
                 break;
             }
@@ -83,34 +118,240 @@ int main(void) {
                 char undoneFile[MAX_LEN];
                 int res = model_undoLastAppend(undoneFile, sizeof(undoneFile));
                 if (res == 1) {
-                    char msg[200];
+                    char msg[MAX_LEN + 32];
                     snprintf(msg, sizeof(msg),
                              "Undo complete for file: %s", undoneFile);
                     view_showMessage(msg);
                 } else if (res == 0) {
                     view_showMessage("Nothing to undo.");
+                } else if (res == -2) {
+                    view_showError("File was changed outside the vault; undo entry discarded.");
+                } else if (res == -3) {
+                    view_showError("Unlock the file first: its last block must be recompressed.");
                 } else {
                     view_showError("Undo failed due to file or memory error.");
                 }
                 break;
             }
 
+            case 6: {
+                char redoneFile[MAX_LEN];
+                int res = model_redoLastUndo(redoneFile, sizeof(redoneFile));
+                if (res == 1) {
+                    char msg[MAX_LEN + 32];
+                    snprintf(msg, sizeof(msg),
+                             "Redo complete for file: %s", redoneFile);
+                    view_showMessage(msg);
+                } else if (res == 0) {
+                    view_showMessage("Nothing to redo.");
+                } else if (res == -2) {
+                    view_showError("File was changed outside the vault; redo entry discarded.");
+                } else if (res == -3) {
+                    view_showError("Unlock the file first: its last block must be recompressed.");
+                } else {
+                    view_showError("Redo failed due to file or memory error.");
+                }
+                break;
+            }
+
+            case 7: {
+                StatsSnapshot snap;
+                stats_snapshot(&snap);
+                view_showStats(&snap);
+                break;
+            }
+
+            case 8: {
+                char term[MAX_LEN];
+                view_getString("Search unlocked files for: ", term, MAX_LEN);
+
+                int res = model_search(term, controller_showHit, NULL);
+                if (res > 0) {
+                    char msg[64];
+                    snprintf(msg, sizeof(msg), "%d file%s found.", res, res == 1 ? "" : "s");
+                    view_showMessage(msg);
+                } else if (res == 0) {
+                    view_showMessage("No unlocked file contains that word.");
+                } else if (res == -2) {
+                    view_showError("Enter a single word.");
+                } else {
+                    view_showError("Search failed.");
+                }
+                break;
+            }
+
+            case 9: {
+                ModelScrub r;
+                if (model_scrub(0, controller_showProblem, NULL, &r) != 0) {
+                    view_showError("Verification failed: out of memory.");
+                    break;
+                }
+                if (r.indexDamaged)
+                    view_showVerifyProblem("vault.idx", "fails its own checksums");
+                char msg[160];
+                snprintf(msg, sizeof(msg),
+                         "%ld file%s verified (%.1f MiB): %ld ok, %ld newly tracked, "
+                         "%ld changed, %ld damaged, %ld unreadable.",
+                         r.files, r.files == 1 ? "" : "s", (double)r.bytes / (1 << 20),
+                         r.status[MODEL_SUM_OK], r.status[MODEL_SUM_NEW],
+                         r.status[MODEL_SUM_CHANGED], r.status[MODEL_SUM_DAMAGED],
+                         r.unreadable);
+                view_showMessage(msg);
+                break;
+            }
+
             default:
                 view_showError("Invalid choice!");
                 break;
         }
     }
 
+    model_shutdown();
     return 0;
 }
 
 /* ---------- controller helper ---------- */
 
+/* fv --batch [file]: commands from file (or stdin), results to stdout */
+static int controller_runBatch(const char *path) {
+    FILE *in = stdin;
+    if (path && strcmp(path, "-") != 0) {
+        in = fopen(path, "r");
+        if (!in) {
+            perror(path);
+            return 2;
+        }
+    }
+
+    /* bulk runs commit in larger groups unless told otherwise */
+    model_setSyncPolicy(MODEL_SYNC_GROUP, 1024, 100);
+    controller_applyEnvironment();
+    if (model_init() != 0) {
+        perror("fv: cannot open the vault");
+        if (in != stdin) fclose(in);
+        return 2;
+    }
+
+    int failed = batch_run(in, stdout);
+
+    model_shutdown();
+    if (in != stdin) fclose(in);
+    return failed ? 1 : 0;
+}
+
+/* fv --serve [socket] [threads]: own the vault and serve it locally */
+static int controller_runServer(const char *path, const char *threads) {
+    long cpus    = sysconf(_SC_NPROCESSORS_ONLN);
+    int  workers = threads ? atoi(threads) : (int)(cpus > 4 ? cpus : 4);
+    if (!path) path = SERVER_DEFAULT_SOCKET;
+
+    controller_applyEnvironment();
+    if (model_init() != 0) {
+        perror("fv: cannot open the vault");
+        return 2;
+    }
+
+    fprintf(stderr, "fv: serving %s with %d workers\n", path, workers);
+    int rc = server_run(path, workers);
+    if (rc != 0) perror(path);
+
+    model_shutdown();
+    return rc == 0 ? 0 : 2;
+}
+
+static const char *statsDumpPath;
+
+static void controller_dumpStats(void) {
+    FILE *out = strcmp(statsDumpPath, "-") == 0 ? stderr
+                                                : fopen(statsDumpPath, "w");
+    if (!out) {
+        perror(statsDumpPath);
+        return;
+    }
+    stats_writeJson(out, 1);
+    if (out != stderr) fclose(out);
+}
+
+/* FV_SYNC=none | always | group[:N[:MS]]  (default group:32:50)
+ * FV_KDF_COST=<PBKDF2 iterations>            (default 100000)
+ * FV_COMPRESS=1                              store new blocks compressed
+ * FV_DEDUP=1                                 store new appends as shared
+ *                                            chunks
+ * FV_RECENT=<recent-files capacity>          (default 256)
+ * FV_CACHE=<MiB of file contents kept>       (default 64, 0 = off)
+ * FV_AIO=0                                   blocking I/O instead of
+ *                                            io_uring queues
+ * FV_STATS=1 | <path> | -                    collect statistics; with a
+ *                                            path (- = stderr) dump them
+ *                                            as JSON at exit */
+static void controller_applyEnvironment(void) {
+    const char *stats = getenv("FV_STATS");
+    if (stats && *stats && !statsDumpPath) {
+        stats_enable();
+        if (strcmp(stats, "1") != 0) {
+            statsDumpPath = stats;
+            atexit(controller_dumpStats);
+        }
+    }
+
+    const char *cost = getenv("FV_KDF_COST");
+    if (cost && atol(cost) > 0)
+        model_setKdfCost((uint32_t)atol(cost));
+
+    const char *compress = getenv("FV_COMPRESS");
+    if (compress && atoi(compress) > 0)
+        model_setCompression(1);
+
+    const char *dedup = getenv("FV_DEDUP");
+    if (dedup && atoi(dedup) > 0)
+        model_setDedup(1);
+
+    const char *recent = getenv("FV_RECENT");
+    if (recent && atoi(recent) > 0)
+        model_setRecentCapacity(atoi(recent));
+
+    const char *cache = getenv("FV_CACHE");
+    if (cache && *cache && atol(cache) >= 0)
+        model_setCacheSize((size_t)atol(cache) << 20);
+
+    const char *aio = getenv("FV_AIO");
+    if (aio && *aio && atoi(aio) == 0)
+        model_setAsyncIo(0);
+
+    const char *spec = getenv("FV_SYNC");
+    if (!spec) return;
+
+    if (strcmp(spec, "none") == 0) {
+        model_setSyncPolicy(MODEL_SYNC_NONE, 0, 0);
+    } else if (strcmp(spec, "always") == 0) {
+        model_setSyncPolicy(MODEL_SYNC_ALWAYS, 1, 0);
+    } else if (strncmp(spec, "group", 5) == 0) {
+        int n = 32, ms = 50;
+        sscanf(spec + 5, ":%d:%d", &n, &ms);
+        model_setSyncPolicy(MODEL_SYNC_GROUP, n, ms);
+    }
+}
+
+static int controller_showHit(void *ctx, const char *filename, long long hits) {
+    (void)ctx;
+    view_showSearchHit(filename, hits);
+    return 0;
+}
+
+static int controller_showProblem(void *ctx, const char *filename, int status) {
+    (void)ctx;
+    if (status == MODEL_SUM_NEW) return 0;   /* not a problem: tracked from now on */
+    view_showVerifyProblem(filename,
+                           status == MODEL_SUM_CHANGED ? "changed outside the vault" :
+                           status == MODEL_SUM_DAMAGED ? "damaged (checksum mismatch)" :
+                                                         "unreadable");
+    return 0;
+}
+
 static void controller_accessFile(const char *filename) {
     char pwd[MAX_LEN];
 
-    int verifyPre = model_verifyPassword(filename, ""); // check existence only
-    if (verifyPre == -1) {
+    if (!model_fileExists(filename)) {
         view_showError("File not found!");
         return;
     }
@@ -124,32 +365,143 @@ static void controller_accessFile(const char *filename) {
 
     model_recordRecent(filename);
 
-    printf("1. View file\n2. Append to file\n");
+    printf("1. View file\n2. Append to file\n"
+           "3. Undo last append to this file\n4. Redo last undo on this file\n"
+           "5. View last lines\n6. View a range of lines\n7. View a range of bytes\n"
+           "8. List versions\n9. View an earlier version\n"
+           "10. View what changed between two versions\n");
     int choice = view_getInt("Enter your choice: ");
 
     if (choice == 1) {
-        char *content = model_getFileContents(filename);
-        view_showFileContent(filename, content);
-        free(content);
+        int lastChar = -1;
+        view_beginFileContent(filename);
+        int res = model_sendFile(filename, STDOUT_FILENO, &lastChar);
+        view_endFileContent(lastChar, res == 0);
     } else if (choice == 2) {
-        char *text = view_getMultilineText();
-        if (!text) {
-            view_showMessage("No content to append.");
+        ViewTextReader reader;
+        if (view_beginMultilineText(&reader) != 0) {
+            view_showError("Out of memory!");
             return;
         }
 
-        int appendedLen = 0;
-        int res = model_appendToFile(filename, text, &appendedLen);
-        free(text);
+        long long appendedLen = 0;
+        int res = model_appendStream(filename, view_readTextBlock, &reader,
+                                     &appendedLen);
+        view_endMultilineText(&reader);
 
         if (res == 0 && appendedLen > 0) {
             view_showMessage("Content appended successfully.");
-        } else if (res == -1) {
+        } else if (res == -2) {
+            view_showMessage("No content to append.");
+        } else {
             view_showError("Failed to open or write to file.");
+        }
+    } else if (choice == 3 || choice == 4) {
+        int res = choice == 3 ? model_undoFileAppend(filename)
+                              : model_redoFileAppend(filename);
+        if (res == 1) {
+            view_showMessage(choice == 3 ? "Undo complete." : "Redo complete.");
+        } else if (res == 0) {
+            view_showMessage(choice == 3 ? "Nothing to undo." : "Nothing to redo.");
+        } else if (res == -2) {
+            view_showError("File was changed outside the vault; entry discarded.");
         } else {
-            view_showMessage("Nothing was appended.");
+            view_showError("Failed to open or write to file.");
         }
+    } else if (choice >= 5 && choice <= 7) {
+        controller_showPart(filename, choice);
+    } else if (choice >= 8 && choice <= 10) {
+        controller_showHistory(filename, choice);
     } else {
         view_showError("Invalid choice.");
     }
 }
+
+static int controller_writeChunk(void *ctx, const char *data, size_t len) {
+    int *lastChar = (int *)ctx;
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n <= 0) return 1;
+        data += n;
+        len  -= (size_t)n;
+        *lastChar = (unsigned char)data[-1];
+    }
+    return 0;
+}
+
+/* tail (5), lines (6) or bytes (7) of an unlocked file */
+static void controller_showPart(const char *filename, int choice) {
+    long long offset = 0, length = 0;
+    int res = 0;
+    if (choice == 5) {
+        long long count = view_getCount("Number of lines: ");
+        res = model_findTail(filename, count, &offset, &length);
+    } else if (choice == 6) {
+        long long first = view_getCount("First line: ");
+        long long last  = view_getCount("Last line: ");
+        if (first < 1 || last < first) {
+            view_showError("Lines are counted from 1, the last one not before the first.");
+            return;
+        }
+        res = model_findLines(filename, first, last - first + 1, &offset, &length);
+    } else {
+        offset = view_getCount("Byte offset: ");
+        length = view_getCount("Number of bytes: ");
+    }
+    if (res != 0) {
+        view_showError("Failed to read the file.");
+        return;
+    }
+
+    int lastChar = -1;
+    view_beginFileContent(filename);
+    res = length > 0 ? model_readRange(filename, offset, length,
+                                       controller_writeChunk, &lastChar) : 0;
+    view_endFileContent(lastChar, res == 0 && lastChar >= 0);
+}
+
+#define HISTORY_PAGE 64   /* versions listed per model call */
+
+/* versions (8), one version (9) or the difference of two (10) */
+static void controller_showHistory(const char *filename, int choice) {
+    if (choice == 8) {
+        long long    count = model_countVersions(filename);
+        ModelVersion page[HISTORY_PAGE];
+        if (count < 0) {
+            view_showError("Failed to read the file's history.");
+        } else if (count == 0) {
+            view_showMessage("No versions recorded yet.");
+        }
+        for (long long at = 1; at <= count;) {
+            int n = model_getVersions(filename, at, page, HISTORY_PAGE);
+            if (n <= 0) {
+                view_showError("Failed to read the file's history.");
+                break;
+            }
+            for (int i = 0; i < n; i++) view_showVersion(at + i, &page[i]);
+            at += n;
+        }
+        return;
+    }
+
+    int       res, lastChar = -1;
+    long long offset = 0, length = 0;
+    if (choice == 9) {
+        long long version = view_getCount("Version (0 = empty): ");
+        view_beginFileContent(filename);
+        res = model_readVersion(filename, version, controller_writeChunk, &lastChar);
+        view_endFileContent(lastChar, res != -1 && lastChar >= 0);
+    } else {
+        long long from = view_getCount("Earlier version: ");
+        long long to   = view_getCount("Later version: ");
+        if (model_diffVersions(filename, from, to, &offset, &length) != 0) {
+            view_showError("No such version.");
+            return;
+        }
+        view_beginFileContent(filename);
+        res = length > 0 ? model_readRange(filename, offset, length,
+                                           controller_writeChunk, &lastChar) : 0;
+        view_endFileContent(lastChar, res == 0 && lastChar >= 0);
+    }
+    if (res == -2) view_showError("The file no longer matches this version's checksums.");
+}
@@ -1,306 +1,4910 @@
 // model.c - implements data, persistence, recent queue, and undo logic
 
+#define _GNU_SOURCE   /* syncfs */
 #include "model.h"
+#include "archive.h"
+#include "cdc.h"
+#include "chunkstore.h"
+#include "cipher.h"
+#include "crc32c.h"
+#include "fanout.h"
+#include "fdcache.h"
+#include "filecache.h"
+#include "history.h"
+#include "ioq.h"
+#include "journal.h"
+#include "kdf.h"
+#include "lru.h"
+#include "search.h"
+#include "stats.h"
+#include "sumtable.h"
+#include "undolog.h"
+#include "vindex.h"
+#include "vtable.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 /* ---------- internal data ---------- */
 
-static Vault vaults[MAX_FILES];
-static int   file_count = 0;
+/*
+ * Everything a vault owns lives in its VaultCtx, so independent vaults
+ * share no state and no locks. The model_* functions work on a default
+ * vault in the current directory.
+ *
+ * Locking within one vault, so the daemon's workers can share it:
+ *   vaultLock   the table and its journal; shared for lookups
+ *   fileLocks   appends/undo/redo of one file, striped by name hash,
+ *               and the stripe's block map; reads too while compression
+ *               is on, since appends then rewrite the file's tail
+ *   undoLock    the undo log
+ *   recentLock  the recent-files list
+ *   searchLock  the full-text index; taken last, under any of the above
+ *   chunkLock   the shared chunk store's table; likewise taken last
+ *   sumLock     the checksum table; likewise taken last
+ *   cacheLock   the content cache; likewise taken last
+ *   fdLock      the open store and history files; likewise taken last
+ *   ioqLock     the idle I/O queues; likewise taken last
+ * A thread holding a file lock may take undoLock, never the reverse.
+ */
+#define FILE_LOCK_STRIPES 256
 
-static Queue recentQ;
-static Queue tempQ;
+/*
+ * Store files are kept open between operations (fdcache.h), one
+ * descriptor per file for reading, appending and truncating alike, so a
+ * read or append of a recent file costs an fstat rather than a path
+ * lookup, an open and a close; the fstat also notices a file replaced
+ * from outside, which has no links left, and opens it again. Streaming
+ * reads, plain appends and bulk copies go through an I/O queue (ioq.h),
+ * io_uring where the kernel allows, taken from a small pool per vault.
+ */
+#define FD_CACHE_SIZE 64   /* store files kept open */
+#define IOQ_DEPTH     8    /* operations a queue keeps in flight */
+#define IOQ_IDLE      16   /* queues kept for reuse */
 
-static UndoOp undoStack[UNDO_MAX];
-static int    undoTop = -1;
+/*
+ * Passwords are stored as salted PBKDF2 hashes (kdf.h), which makes a
+ * verification deliberately slow. A file successfully unlocked once is
+ * remembered in a small 4-way set-associative session cache keyed by name,
+ * holding an HMAC of the password under a per-process random key; a
+ * repeat verification with the same password costs one HMAC. Changing
+ * the password drops the entry and bumps secretGen so a verification
+ * racing with the change cannot re-insert the old password.
+ */
+#define SESSION_SETS  1024
+#define SESSION_WAYS  4
+#define SESSION_SLOTS (SESSION_SETS * SESSION_WAYS)
 
-/* ---------- helper: queue ---------- */
+typedef struct {
+    uint32_t      nameHash;
+    char         *name;                  /* NULL = empty slot */
+    unsigned char tag[KDF_DIGEST_LEN];
+} SessionSlot;
 
-static void initQueue(Queue *q) {
-    q->front = 0;
-    q->rear  = -1;
-    q->count = 0;
+/* data key of an unlocked file, by table id */
+typedef struct {
+    unsigned char key[CIPHER_KEY_LEN];
+    unsigned char searchKey[SEARCH_KEY_LEN];
+    int           unlocked;
+} FileKey;
+
+/* where the frames of one file start and the plaintext each ends at:
+ * frame i holds the plaintext [end[i - 1], end[i]) in the bytes
+ * [start[i], start[i + 1]), the last one ending at mapped. Alongside,
+ * a sparse line index: line (i + 1) * LINE_STRIDE + 1 starts at the
+ * plaintext offset mark[i], for the lines counted so far */
+#define LINE_STRIDE 1024
+
+typedef struct {
+    char     *name;              /* NULL = unused */
+    uint64_t *start;
+    uint64_t *end;
+    int       count, cap;
+    uint64_t  mapped;
+    uint64_t *mark;
+    int       marks, markCap;
+    uint64_t  lines;             /* newlines in the plaintext [0, scanned) */
+    uint64_t  scanned;
+} BlockMap;
+
+/* a private copy of the table, taken when the journal is sealed; the
+ * base it lies over is only ever swapped by the compaction itself */
+typedef struct {
+    VaultCtx *v;
+    char     *strings;
+    uint32_t *nameOff;
+    uint32_t *secretOff;
+    int       count;
+} CompactJob;
+
+struct VaultCtx {
+    int        dirFd;            /* the vault directory */
+    int        storeFd;          /* vault.store: the files, fanout.h */
+    int        historyFd;        /* vault.history: their versions, history.h */
+    char      *indexPath;        /* vault.idx */
+    char      *indexTmpPath;     /* vault.idx.tmp */
+    char      *legacyPath;       /* vault.txt, imported once */
+    char      *legacyDonePath;   /* vault.txt.imported */
+    char      *journalPath;      /* vault.journal */
+    char      *journalOldPath;   /* vault.journal.old */
+    char      *undoPath;         /* vault.undo */
+    char      *redoPath;         /* vault.redo */
+    char      *recentPath;       /* vault.recent */
+    char      *recentTmpPath;    /* vault.recent.tmp */
+    char      *searchPath;       /* vault.search */
+    char      *searchLogPath;    /* vault.search.log */
+    char      *chunksPath;       /* vault.chunks */
+    char      *chunksLogPath;    /* vault.chunks.log */
+    char      *sumsPath;         /* vault.sums */
+    char      *sumsTmpPath;      /* vault.sums.tmp */
+
+    VaultIndex base;             /* vault.idx, mapped read-only */
+    VaultTable vaults;           /* filename -> password, over base */
+    Journal    journal;
+    int        syncMode;
+    int        syncGroupSize;
+    int        syncGroupMs;
+
+    pthread_t  compactThread;
+    int        compactActive;
+    atomic_int compactDone;
+    atomic_int compactFailed;    /* vault.journal.old must be kept */
+
+    Lru        recent;           /* most recently accessed files */
+    Journal    recentLog;        /* vault.recent, one record per touch */
+    uint32_t   recentRecords;    /* records currently in vault.recent */
+
+    UndoLog    undoLog;          /* per-file append history, vault.undo */
+
+    uint32_t      kdfCost;       /* PBKDF2 iterations for new hashes */
+    unsigned char sessionKey[KDF_DIGEST_LEN];
+    SessionSlot   sessions[SESSION_SLOTS];
+    uint64_t      secretGen;     /* bumped on every password change */
+    atomic_long   sessionHits;
+    atomic_long   sessionMisses;
+    FileKey      *keys;          /* under vaultLock, grown on demand */
+    int           keyCap;
+
+    SearchIndex  *search;        /* opened on first use */
+    atomic_int    compress;      /* seal appends as compressed blocks */
+    BlockMap      blockMaps[FILE_LOCK_STRIPES];   /* under the file lock */
+    ChunkStore   *chunks;        /* opened on first use */
+    atomic_int    dedup;         /* write appends as shared chunks */
+    SumTable     *sums;          /* opened on first use */
+    FileCache    *cache;         /* plaintexts of files read whole */
+    FdCache      *fds;           /* store files kept open */
+    FdCache      *histFds;       /* history files kept open */
+    atomic_int    asyncIo;       /* queues on io_uring, not blocking calls */
+    IoQueue      *idleQueues[IOQ_IDLE];   /* under ioqLock */
+    int           idleCount;
+
+    pthread_mutex_t  sessionLock;
+    pthread_rwlock_t vaultLock;
+    pthread_mutex_t  undoLock;
+    pthread_mutex_t  recentLock;
+    pthread_mutex_t  searchLock;
+    pthread_mutex_t  chunkLock;
+    pthread_mutex_t  sumLock;
+    pthread_mutex_t  cacheLock;
+    pthread_mutex_t  fdLock;
+    pthread_mutex_t  ioqLock;
+    pthread_mutex_t  fileLocks[FILE_LOCK_STRIPES];
+};
+
+static VaultCtx *defaultVault;
+
+/* policy handed to vaults as they are opened */
+static pthread_mutex_t defaultsLock      = PTHREAD_MUTEX_INITIALIZER;
+static int             defaultSyncMode   = JOURNAL_SYNC_GROUP;
+static int             defaultGroupSize  = 32;
+static int             defaultGroupMs    = 50;
+static uint32_t        defaultKdfCost    = KDF_DEFAULT_COST;
+static int             defaultRecentCap  = MODEL_RECENT_CAPACITY;
+static int             defaultCompress   = 0;
+static int             defaultDedup      = 0;
+static size_t          defaultCacheBytes = MODEL_CACHE_BYTES;
+static int             defaultAsyncIo    = 1;
+
+static pthread_mutex_t *fileLock(VaultCtx *v, const char *filename) {
+    return &v->fileLocks[hashindex_hash(filename) & (FILE_LOCK_STRIPES - 1)];
+}
+
+/* ---------- helper: raw I/O ---------- */
+
+/* open a user file where the store keeps it */
+static int openIn(const VaultCtx *v, const char *name, int flags) {
+    char path[FANOUT_PATH_LEN];
+    fanout_path(name, path);
+    stats_count(STAT_OPENS, 1);
+    return fanout_open(v->storeFd, path, flags, 0644);
+}
+
+/* the store file of name, open for reading, appending (O_APPEND) and
+ * truncating, from the fd cache or opened and added to it, with its
+ * fstat in st; create makes a missing file. A read-only store is opened
+ * read-only and not kept. release with fileClose. returns the fd, or -1 */
+static int fileOpen(VaultCtx *v, const char *name, int create, struct stat *st) {
+    pthread_mutex_lock(&v->fdLock);
+    int fd = fdcache_get(v->fds, name);
+    pthread_mutex_unlock(&v->fdLock);
+    if (fd >= 0) {
+        if (fstat(fd, st) == 0 && st->st_nlink > 0) return fd;
+        pthread_mutex_lock(&v->fdLock);   /* replaced or removed: open anew */
+        fdcache_drop(v->fds, name);
+        fdcache_release(v->fds, fd);
+        pthread_mutex_unlock(&v->fdLock);
+    }
+
+    fd = openIn(v, name, O_RDWR | O_APPEND | O_CLOEXEC | (create ? O_CREAT : 0));
+    int kept = fd >= 0;
+    if (fd < 0 && !create && (errno == EACCES || errno == EROFS)) {
+        fd = openIn(v, name, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) return -1;
+    if (fstat(fd, st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (kept) {
+        pthread_mutex_lock(&v->fdLock);
+        fdcache_put(v->fds, name, fd);
+        pthread_mutex_unlock(&v->fdLock);
+    }
+    return fd;
+}
+
+static void fileClose(VaultCtx *v, int fd) {
+    if (fd < 0) return;
+    pthread_mutex_lock(&v->fdLock);
+    fdcache_release(v->fds, fd);
+    pthread_mutex_unlock(&v->fdLock);
+}
+
+/* name's store file was just replaced */
+static void fileForget(VaultCtx *v, const char *name) {
+    pthread_mutex_lock(&v->fdLock);
+    fdcache_drop(v->fds, name);
+    pthread_mutex_unlock(&v->fdLock);
+}
+
+/* an I/O queue for this thread to drive, from the idle ones if it runs
+ * the way the vault is set to now. returns it, or NULL */
+static IoQueue *queueTake(VaultCtx *v) {
+    int      async = atomic_load(&v->asyncIo);
+    IoQueue *q     = NULL;
+    pthread_mutex_lock(&v->ioqLock);
+    if (v->idleCount > 0) q = v->idleQueues[--v->idleCount];
+    pthread_mutex_unlock(&v->ioqLock);
+    if (q && ioq_async(q) != async) {
+        ioq_close(q);
+        q = NULL;
+    }
+    return q ? q : ioq_open(IOQ_DEPTH, async);
+}
+
+static void queueGive(VaultCtx *v, IoQueue *q) {
+    if (!q) return;
+    pthread_mutex_lock(&v->ioqLock);
+    if (v->idleCount < IOQ_IDLE && ioq_free(q) == IOQ_DEPTH) {
+        v->idleQueues[v->idleCount++] = q;
+        q = NULL;
+    }
+    pthread_mutex_unlock(&v->ioqLock);
+    ioq_close(q);
+}
+
+static int writeAll(int fd, const void *buf, size_t len) {
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+#define READ_AHEAD 4   /* chunks a streaming read keeps in flight */
+
+/* hands fn the bytes of fd from `from` to its end, in order and in
+ * pieces of at most MODEL_CHUNK_SIZE, with up to READ_AHEAD reads in
+ * flight through q while they fit in size bytes, then one at a time
+ * until a short read marks the end; bufs holds READ_AHEAD chunks.
+ * returns 0, 1 if fn stopped, -1, or -2 if q broke with reads still in
+ * flight: bufs must then not be freed */
+static int streamIn(IoQueue *q, int fd, uint64_t from, uint64_t size, char *bufs,
+                    ModelChunkFn fn, void *ctx) {
+    long     res[READ_AHEAD];
+    int      ready[READ_AHEAD];
+    int      head = 0, queued = 0, inflight = 0, end = 0, rc = 0;
+    uint64_t next = from;
+    IoqDone  done[READ_AHEAD];
+    while (rc == 0 && !end) {
+        while (queued < READ_AHEAD && (queued == 0 || next < size)) {
+            int slot = (head + queued) % READ_AHEAD;
+            if (ioq_read(q, fd, bufs + (size_t)slot * MODEL_CHUNK_SIZE, MODEL_CHUNK_SIZE,
+                         next, (uint64_t)slot) != 0)
+                break;
+            ready[slot] = 0;
+            next       += MODEL_CHUNK_SIZE;
+            queued++;
+            inflight++;
+        }
+        if (queued == 0) {
+            rc = -1;
+            break;
+        }
+        while (rc == 0 && !ready[head]) {
+            int n = ioq_reap(q, done, READ_AHEAD, 1);
+            if (n < 0) rc = -1;
+            for (int i = 0; i < n; i++) {
+                res[done[i].tag]   = done[i].res;
+                ready[done[i].tag] = 1;
+                inflight--;
+            }
+        }
+        if (rc != 0) break;
+
+        long        n    = res[head];
+        const char *data = bufs + (size_t)head * MODEL_CHUNK_SIZE;
+        head = (head + 1) % READ_AHEAD;
+        queued--;
+        if (n < 0) {
+            rc = -1;
+            break;
+        }
+        end = n < MODEL_CHUNK_SIZE;   /* what is queued after it starts past the end */
+        if (n > 0) {
+            stats_count(STAT_BYTES_READ, (uint64_t)n);
+            if (fn(ctx, data, (size_t)n) != 0) rc = 1;
+        }
+    }
+    /* the buffers are the kernel's until every read is back */
+    if (inflight > 0 && ioq_drain(q) != 0) return -2;
+    return rc;
+}
+
+/* ---------- helper: full-text index ---------- */
+
+/*
+ * vault.search indexes the words of every append (search.h) under a
+ * per-file search key derived from the data key, so only files unlocked
+ * in this process can be searched. Appends add their words; undo reads
+ * the bytes it cuts off to take theirs back, redo adds them again. The
+ * first unlock of a file in a process indexes whatever the index does
+ * not hold yet: content from before the index existed, changes lost with
+ * its unsynced log, or a whole file whose index could not follow an undo.
+ */
+#define SEARCH_PATH     "vault.search"
+#define SEARCH_LOG_PATH "vault.search.log"
+
+/* caller holds searchLock. returns the index, opening it on first use,
+ * or NULL if it cannot be opened */
+static SearchIndex *searchIndex(VaultCtx *v) {
+    if (!v->search) v->search = search_open(v->searchPath, v->searchLogPath);
+    return v->search;
+}
+
+/* below, with the encrypted content helpers they read through */
+static void indexGap(VaultCtx *v, const char *filename, int fd);
+static void indexCut(VaultCtx *v, const char *filename, int fd, uint64_t end);
+
+/* adds the words fed to b as the bytes [pre, end) of filename, open as
+ * fd under its file lock; if the index does not end at pre, whatever it
+ * lacks is read from the file instead */
+static void indexAppend(VaultCtx *v, const char *filename, int fd,
+                        uint64_t pre, uint64_t end, SearchBuilder *b) {
+    search_builderFinish(b);
+    pthread_mutex_lock(&v->searchLock);
+    SearchIndex *s  = searchIndex(v);
+    int          rc = s ? search_add(s, filename, pre, end, b) : 0;
+    pthread_mutex_unlock(&v->searchLock);
+    if (rc != 0) indexGap(v, filename, fd);
+}
+
+/* ---------- helper: undo ---------- */
+
+#define UNDO_LOG_PATH  "vault.undo"
+#define UNDO_BLOB_PATH "vault.redo"
+
+/* below, with the compressed blocks and lines they work on */
+static void blockTrim(VaultCtx *v, const char *filename, uint64_t at);
+static void linesCut(VaultCtx *v, const char *filename, int fd);
+static int  undoRepacked(VaultCtx *v, const char *filename, int fd,
+                         const UndoEntry *e);
+static void indexRepacked(VaultCtx *v, const char *filename, int fd,
+                          const UndoEntry *e, int add);
+
+/* with the checksums */
+static int  regionCrc(int fd, uint64_t from, uint64_t len, uint32_t *crc);
+static int  sumTracks(VaultCtx *v, const char *filename, uint64_t size);
+static void sumChange(VaultCtx *v, const char *filename, int fd, uint64_t oldSize,
+                      uint64_t cut, uint32_t cutCrc, uint64_t newSize);
+
+/* and with the content cache */
+static void cacheCut(VaultCtx *v, const char *filename, int fd, const struct stat *was);
+static void cacheDrop(VaultCtx *v, const char *filename);
+
+static void copyName(char *out, size_t bufSize, const char *name) {
+    if (out && bufSize > 0) {
+        strncpy(out, name, bufSize - 1);
+        out[bufSize - 1] = '\0';
+    }
+}
+
+/* Takes the file lock of the file owning the newest undo (redo) entry,
+ * for filename or for any file when NULL, then undoLock, respecting the
+ * fileLocks -> undoLock order. Returns the owning name (caller frees and
+ * unlocks both) or NULL with no locks held when there is nothing to do. */
+static char *lockUndoTop(VaultCtx *v, const char *filename, int redo) {
+    for (;;) {
+        const char *name;
+        pthread_mutex_lock(&v->undoLock);
+        const UndoEntry *top = redo ? undolog_peekRedo(&v->undoLog, filename, &name)
+                                    : undolog_peekUndo(&v->undoLog, filename, &name);
+        char *owner = top ? strdup(name) : NULL;
+        pthread_mutex_unlock(&v->undoLock);
+        if (!owner) return NULL;
+
+        pthread_mutex_lock(fileLock(v, owner));
+        pthread_mutex_lock(&v->undoLock);
+        top = redo ? undolog_peekRedo(&v->undoLog, filename, &name)
+                   : undolog_peekUndo(&v->undoLog, filename, &name);
+        if (top && strcmp(name, owner) == 0) return owner;
+
+        /* another thread got there first; look again */
+        pthread_mutex_unlock(&v->undoLock);
+        pthread_mutex_unlock(fileLock(v, owner));
+        free(owner);
+    }
+}
+
+static void unlockUndoTop(VaultCtx *v, char *owner) {
+    pthread_mutex_unlock(&v->undoLock);
+    pthread_mutex_unlock(fileLock(v, owner));
+    free(owner);
+}
+
+/* undo the newest append to filename, or to any file when NULL */
+static int undoAppend(VaultCtx *v, const char *filename,
+                      char *outFilename, size_t bufSize) {
+    char *name = lockUndoTop(v, filename, 0);
+    if (!name) return 0; /* nothing to undo */
+
+    const char *owner;
+    UndoEntry   e = *undolog_peekUndo(&v->undoLog, filename, &owner);
+    copyName(outFilename, bufSize, name);
+
+    int         rc = -1;
+    struct stat st;
+    int         fd = fileOpen(v, name, 0, &st);
+    if (fd >= 0) {
+        uint32_t cutCrc = 0;
+        if ((uint64_t)st.st_size != e.preSize + e.length) {
+            undolog_drop(&v->undoLog, name, 0);
+            rc = -2; /* changed outside the vault */
+        } else if (sumTracks(v, name, (uint64_t)st.st_size) &&
+                   regionCrc(fd, e.preSize, e.length, &cutCrc) != 0) {
+            rc = -1;
+        } else if (e.keep > 0) {
+            rc = undoRepacked(v, name, fd, &e);
+        } else {
+            /* bytes kept for redo, then cut off: O(appended bytes). The
+             * index needs them to find their words, so it goes first and
+             * is filled back in from the file if the cut fails */
+            indexCut(v, name, fd, e.preSize);
+            if (undolog_commitUndo(&v->undoLog, name, fd) == 0 &&
+                ftruncate(fd, (off_t)e.preSize) == 0) {
+                blockTrim(v, name, e.preSize);
+                rc = 1;
+            } else {
+                indexGap(v, name, fd);
+            }
+        }
+        if (rc == 1)
+            sumChange(v, name, fd, (uint64_t)st.st_size, e.preSize, cutCrc,
+                      e.preSize + (e.keep > 0 ? e.keptLen : 0));
+        if (rc == 1) cacheCut(v, name, fd, &st);
+        else         cacheDrop(v, name);
+        linesCut(v, name, fd);
+    }
+    fileClose(v, fd);
+
+    unlockUndoTop(v, name);
+    return rc;
+}
+
+static int redoAppend(VaultCtx *v, const char *filename,
+                      char *outFilename, size_t bufSize) {
+    char *name = lockUndoTop(v, filename, 1);
+    if (!name) return 0; /* nothing to redo */
+
+    const char *owner;
+    UndoEntry   e = *undolog_peekRedo(&v->undoLog, filename, &owner);
+    copyName(outFilename, bufSize, name);
+
+    /* a re-packed tail that undo sealed on its own is cut off again,
+     * and kept here in case the saved blocks cannot be put back */
+    int            rc   = -1;
+    unsigned char *kept = NULL;
+    struct stat    st;
+    int            fd   = fileOpen(v, name, 0, &st);
+    if (fd >= 0) {
+        if ((uint64_t)st.st_size != e.preSize + e.keptLen) {
+            undolog_drop(&v->undoLog, name, 1);
+            rc = -2; /* changed outside the vault */
+        } else if (e.keptLen > 0 &&
+                   (!(kept = (unsigned char *)malloc(e.keptLen)) ||
+                    pread(fd, kept, e.keptLen, (off_t)e.preSize) != (ssize_t)e.keptLen)) {
+            rc = -1;
+        } else {
+            if (ftruncate(fd, (off_t)e.preSize) == 0 &&
+                undolog_copyPayload(&v->undoLog, &e, fd) == 0 &&
+                undolog_commitRedo(&v->undoLog, name) == 0) {
+                if (kept) indexRepacked(v, name, fd, &e, 1);
+                sumChange(v, name, fd, (uint64_t)st.st_size, e.preSize,
+                          kept ? crc32c(0, kept, e.keptLen) : 0, e.preSize + e.length);
+                rc = 1;
+            } else if (ftruncate(fd, (off_t)e.preSize) != 0 ||
+                       (kept && (lseek(fd, (off_t)e.preSize, SEEK_SET) < 0 ||
+                                 writeAll(fd, kept, e.keptLen) != 0))) {
+                rc = -1;   /* partially restored; nothing more we can do */
+            }
+            blockTrim(v, name, e.preSize);
+            linesCut(v, name, fd);
+            indexGap(v, name, fd);
+            cacheDrop(v, name);
+        }
+    }
+    fileClose(v, fd);
+    free(kept);
+
+    unlockUndoTop(v, name);
+    return rc;
+}
+
+/* ---------- helper: vault persistence ---------- */
+
+/*
+ * vault.idx is a binary snapshot (vindex.h) that is mapped, not parsed,
+ * so opening a vault costs the same at any size; every change since the
+ * snapshot was taken is an appended record in vault.journal, replayed
+ * into the in-memory table on top of it. Lookups try the table first,
+ * then the snapshot; an entry the vault needs an id for (to keep its
+ * data key, or to change it) is copied into the table on first use.
+ *
+ * Once the journal grows past a fraction of the snapshot it is sealed
+ * as vault.journal.old and a background thread merges table and
+ * snapshot into a fresh vault.idx (temp file + rename), maps it in place
+ * of the old one and drops the sealed journal. Records are idempotent upserts,
+ * so replaying a sealed journal over a snapshot that already contains
+ * it is harmless. A vault.txt from before the binary format is imported
+ * into vault.idx once and kept as vault.txt.imported.
+ */
+
+#define INDEX_PATH        "vault.idx"
+#define INDEX_TMP_PATH    "vault.idx.tmp"
+#define LEGACY_PATH       "vault.txt"
+#define LEGACY_DONE_PATH  "vault.txt.imported"
+#define JOURNAL_PATH      "vault.journal"
+#define JOURNAL_OLD_PATH  "vault.journal.old"
+
+/* the journal replayed at open stays under 1/COMPACT_RATIO of the
+ * snapshot (or COMPACT_MIN_BYTES), at the price of rewriting the
+ * snapshot once per that much journal */
+#define COMPACT_MIN_BYTES (64 * 1024)
+#define COMPACT_RATIO     8
+
+#define REC_PUT      'P'
+#define TAG_NAME     1
+#define TAG_PASSWORD 2
+
+static size_t putField(unsigned char *p, int tag, const char *value) {
+    size_t len = strlen(value);
+    p[0] = (unsigned char)tag;
+    p[1] = (unsigned char)len;
+    p[2] = (unsigned char)(len >> 8);
+    memcpy(p + 3, value, len);
+    return 3 + len;
+}
+
+static void applyRecord(void *ctx, const unsigned char *rec, size_t len) {
+    VaultCtx *v = (VaultCtx *)ctx;
+    char filename[MAX_LEN] = "";
+    char password[MAX_LEN] = "";
+
+    if (len < 1 || rec[0] != REC_PUT) return;
+
+    size_t pos = 1;
+    while (pos + 3 <= len) {
+        int    tag  = rec[pos];
+        size_t flen = (size_t)rec[pos + 1] | (size_t)rec[pos + 2] << 8;
+        pos += 3;
+        if (pos + flen > len) return;
+
+        char *dst = tag == TAG_NAME ? filename :
+                    tag == TAG_PASSWORD ? password : NULL;
+        if (dst && flen < MAX_LEN) {
+            memcpy(dst, rec + pos, flen);
+            dst[flen] = '\0';
+        }
+        pos += flen;
+    }
+    if (filename[0] != '\0')
+        vtable_put(&v->vaults, filename, password);
+}
+
+/* caller holds vaultLock */
+static const char *findSecret(const VaultCtx *v, const char *filename) {
+    int id = vtable_find(&v->vaults, filename);
+    return id >= 0 ? vtable_secret(&v->vaults, id)
+                   : vindex_find(&v->base, filename);
+}
+
+/* id of filename in the table, copying it in from the snapshot if it is
+ * only there. caller holds vaultLock exclusively. returns id or -1 */
+static int tableId(VaultCtx *v, const char *filename) {
+    int id = vtable_find(&v->vaults, filename);
+    if (id < 0) {
+        const char *secret = vindex_find(&v->base, filename);
+        if (secret) id = vtable_put(&v->vaults, filename, secret);
+    }
+    return id;
+}
+
+static int writeIndex(const VaultCtx *v, const char *const *names,
+                      const char *const *secrets, uint32_t count) {
+    if (vindex_write(v->indexTmpPath, names, secrets, count) != 0)
+        return -1;
+    struct stat st;
+    stats_count(STAT_OPENS, 1);
+    stats_count(STAT_FSYNCS, 1);
+    if (stat(v->indexTmpPath, &st) == 0)
+        stats_count(STAT_BYTES_WRITTEN, (uint64_t)st.st_size);
+
+    if (rename(v->indexTmpPath, v->indexPath) != 0) {
+        unlink(v->indexTmpPath);
+        return -1;
+    }
+    journal_syncDir(v->indexPath);
+    return 0;
+}
+
+/* maps a freshly written vault.idx in place of the old one */
+static void swapBase(VaultCtx *v) {
+    VaultIndex fresh, old;
+    if (vindex_open(&fresh, v->indexPath) != 0) return;   /* keep the old map */
+
+    pthread_rwlock_wrlock(&v->vaultLock);
+    old     = v->base;
+    v->base = fresh;
+    pthread_rwlock_unlock(&v->vaultLock);
+    vindex_close(&old);
+}
+
+static const char *jobKey(void *ctx, int id) {
+    const CompactJob *job = (const CompactJob *)ctx;
+    return job->strings + job->nameOff[id];
+}
+
+/* merge the table copy over the snapshot into a new vault.idx; safe to
+ * call from the compaction thread. Refuses (-1) if an entry of the old
+ * snapshot fails its checksum rather than carry the damage forward. */
+static int saveVault(CompactJob *snap) {
+    VaultCtx         *v    = snap->v;
+    const VaultIndex *base = &v->base;
+    uint64_t          t0   = stats_begin();
+    int               rc   = -1;
+
+    size_t       most    = (size_t)snap->count + base->count;
+    const char **names   = (const char **)malloc(sizeof(char *) * (most + 1));
+    const char **secrets = (const char **)malloc(sizeof(char *) * (most + 1));
+    HashIndex    seen;
+    if (names && secrets &&
+        hashindex_init(&seen, (size_t)snap->count, jobKey, snap) == 0) {
+        uint32_t n  = 0;
+        int      ok = 1;
+        for (int i = 0; ok && i < snap->count; i++) {
+            names[n]   = snap->strings + snap->nameOff[i];
+            secrets[n] = snap->strings + snap->secretOff[i];
+            ok = hashindex_insert(&seen, names[n], hashindex_hash(names[n]), i) == 0;
+            n++;
+        }
+
+        uint64_t    pos = 0;
+        const char *name, *secret;
+        int         more;
+        while (ok && (more = vindex_next(base, &pos, &name, &secret)) != 0) {
+            if (more < 0 || n == most) {
+                ok = 0;
+            } else if (hashindex_find(&seen, name, hashindex_hash(name)) < 0) {
+                names[n]   = name;
+                secrets[n] = secret;
+                n++;
+            }
+        }
+        if (ok) rc = writeIndex(v, names, secrets, n);
+        hashindex_free(&seen);
+    }
+    free(names);
+    free(secrets);
+    stats_end(STAT_SAVE_VAULT, t0);
+    return rc;
+}
+
+static void freeJob(CompactJob *job) {
+    free(job->strings);
+    free(job->nameOff);
+    free(job->secretOff);
+    free(job);
+}
+
+static CompactJob *copyTable(VaultCtx *v) {
+    CompactJob *job = (CompactJob *)calloc(1, sizeof(CompactJob));
+    if (!job) return NULL;
+
+    size_t offBytes = sizeof(uint32_t) * (size_t)v->vaults.count;
+    job->v         = v;
+    job->count     = v->vaults.count;
+    job->strings   = (char *)malloc(v->vaults.strings.used + 1);
+    job->nameOff   = (uint32_t *)malloc(offBytes + 1);
+    job->secretOff = (uint32_t *)malloc(offBytes + 1);
+    if (!job->strings || !job->nameOff || !job->secretOff) {
+        freeJob(job);
+        return NULL;
+    }
+    memcpy(job->strings, v->vaults.strings.base, v->vaults.strings.used);
+    memcpy(job->nameOff, v->vaults.nameOff, offBytes);
+    memcpy(job->secretOff, v->vaults.secretOff, offBytes);
+    return job;
+}
+
+static void *compactMain(void *arg) {
+    CompactJob *job = (CompactJob *)arg;
+    VaultCtx   *v   = job->v;
+    if (saveVault(job) == 0) {
+        swapBase(v);
+        unlink(v->journalOldPath);
+    } else {
+        atomic_store(&v->compactFailed, 1);
+    }
+    freeJob(job);
+    atomic_store(&v->compactDone, 1);
+    return NULL;
+}
+
+static void waitCompaction(VaultCtx *v) {
+    if (v->compactActive) {
+        pthread_join(v->compactThread, NULL);
+        v->compactActive = 0;
+    }
+}
+
+static int openJournal(VaultCtx *v, long validLen) {
+    if (journal_open(&v->journal, v->journalPath, validLen) != 0)
+        return -1;
+    journal_setSync(&v->journal, v->syncMode, v->syncGroupSize, v->syncGroupMs);
+    return 0;
+}
+
+/* seal the live journal and snapshot the table in the background */
+static void startCompaction(VaultCtx *v) {
+    /* sealing again would overwrite the journal a failed run still needs;
+     * the next open retries it */
+    if (atomic_load(&v->compactFailed)) return;
+    if (v->compactActive) {
+        if (!atomic_load(&v->compactDone)) return;
+        waitCompaction(v);
+    }
+
+    CompactJob *job = copyTable(v);
+    if (!job) return;
+
+    journal_close(&v->journal);
+    int sealed = rename(v->journalPath, v->journalOldPath) == 0;
+    if (openJournal(v, -1) != 0) {
+        /* no fresh journal: go on with the sealed one and compact later.
+         * If that cannot be had back either, stop compacting until the
+         * next open, which replays whichever of the two is there;
+         * journalPut tries to reopen meanwhile */
+        if (sealed && (rename(v->journalOldPath, v->journalPath) != 0 ||
+                       openJournal(v, -1) != 0))
+            atomic_store(&v->compactFailed, 1);
+        freeJob(job);
+        return;
+    }
+    if (!sealed) {
+        freeJob(job);
+        return;
+    }
+
+    atomic_store(&v->compactDone, 0);
+    if (pthread_create(&v->compactThread, NULL, compactMain, job) == 0) {
+        v->compactActive = 1;
+    } else {
+        compactMain(job);   /* no thread available: compact inline */
+    }
+}
+
+static void journalPut(VaultCtx *v, int id) {
+    unsigned char rec[1 + 2 * (3 + MAX_LEN)];
+    size_t len = 0;
+    rec[len++] = REC_PUT;
+    len += putField(rec + len, TAG_NAME, vtable_name(&v->vaults, id));
+    len += putField(rec + len, TAG_PASSWORD, vtable_secret(&v->vaults, id));
+    if (v->journal.fd < 0) openJournal(v, -1);   /* a compaction could not reopen it */
+    journal_append(&v->journal, rec, len);
+
+    if (v->journal.bytes >= COMPACT_MIN_BYTES &&
+        v->journal.bytes > v->base.heapLen / COMPACT_RATIO)
+        startCompaction(v);
+}
+
+/* one-shot conversion of a "name secret" text vault into vault.idx */
+static int importLegacy(VaultCtx *v) {
+    FILE *fp = fopen(v->legacyPath, "r");
+    if (!fp) return errno == ENOENT ? 0 : -1;
+    stats_count(STAT_OPENS, 1);
+
+    VaultTable t;
+    int        ok = vtable_init(&t, 0) == 0;
+    char      *line = NULL;
+    size_t     cap  = 0;
+    ssize_t    n;
+    while (ok && (n = getline(&line, &cap, fp)) != -1) {
+        stats_count(STAT_BYTES_READ, (uint64_t)n);
+        char *save = NULL;
+        char *name = strtok_r(line, " \t\r\n", &save);
+        char *pwd  = strtok_r(NULL, " \t\r\n", &save);
+        if (!pwd) pwd = "";
+        if (name && strlen(name) < MAX_LEN && strlen(pwd) < MAX_LEN)
+            ok = vtable_put(&t, name, pwd) >= 0;
+    }
+    free(line);
+    fclose(fp);
+
+    size_t       bytes   = sizeof(char *) * ((size_t)t.count + 1);
+    const char **names   = (const char **)malloc(bytes);
+    const char **secrets = (const char **)malloc(bytes);
+    ok = ok && names && secrets;
+    for (int i = 0; ok && i < t.count; i++) {
+        names[i]   = vtable_name(&t, i);
+        secrets[i] = vtable_secret(&t, i);
+    }
+    int rc = ok && writeIndex(v, names, secrets, (uint32_t)t.count) == 0 ? 0 : -1;
+    if (rc == 0 && rename(v->legacyPath, v->legacyDonePath) == 0)
+        journal_syncDir(v->legacyPath);
+
+    free(names);
+    free(secrets);
+    vtable_free(&t);
+    return rc;
+}
+
+/* returns 0, or -1 if the snapshot cannot be used (errno is EBADMSG
+ * when vault.idx is damaged) */
+static int loadVault(VaultCtx *v) {
+    uint64_t t0 = stats_begin();
+    vtable_init(&v->vaults, 0);
+
+    int rc = vindex_open(&v->base, v->indexPath);
+    if (rc == 0 && !v->base.map) {
+        rc = importLegacy(v);
+        if (rc == 0) rc = vindex_open(&v->base, v->indexPath);
+    }
+    if (rc != 0) {
+        if (rc == -2) errno = EBADMSG;
+        stats_end(STAT_LOAD_VAULT, t0);
+        return -1;
+    }
+
+    /* a sealed journal means the last compaction never finished */
+    int  interrupted = journal_replay(v->journalOldPath, applyRecord, v) >= 0;
+    long valid       = journal_replay(v->journalPath, applyRecord, v);
+    openJournal(v, valid);
+
+    if (interrupted) {
+        CompactJob *snap = copyTable(v);
+        if (snap && saveVault(snap) == 0) {
+            swapBase(v);
+            unlink(v->journalOldPath);
+        }
+        if (snap) freeJob(snap);
+    }
+    stats_end(STAT_LOAD_VAULT, t0);
+    return 0;
+}
+
+/* ---------- helper: recent files ---------- */
+
+/*
+ * vault.recent holds one record per touch, oldest first, so replaying it
+ * through the LRU rebuilds the list. Once it holds several times more
+ * records than the list has entries it is rewritten with just the list.
+ * Touches are not fsynced: losing the last few on a crash only reorders
+ * the list.
+ */
+
+#define RECENT_PATH      "vault.recent"
+#define RECENT_TMP_PATH  "vault.recent.tmp"
+
+#define REC_TOUCH 'T'
+
+static void replayTouch(void *ctx, const unsigned char *rec, size_t len) {
+    VaultCtx *v = (VaultCtx *)ctx;
+    char filename[MAX_LEN];
+
+    if (len < 2 || rec[0] != REC_TOUCH || len - 1 >= MAX_LEN) return;
+    memcpy(filename, rec + 1, len - 1);
+    filename[len - 1] = '\0';
+    lru_touch(&v->recent, filename);
+    v->recentRecords++;
+}
+
+static int appendTouch(Journal *j, const char *filename) {
+    unsigned char rec[1 + MAX_LEN];
+    size_t len = strlen(filename);
+    rec[0] = REC_TOUCH;
+    memcpy(rec + 1, filename, len);
+    return journal_append(j, rec, 1 + len);
+}
+
+static int openRecentLog(VaultCtx *v, long validLen) {
+    if (journal_open(&v->recentLog, v->recentPath, validLen) != 0)
+        return -1;
+    journal_setSync(&v->recentLog, JOURNAL_SYNC_NONE, 0, 0);
+    return 0;
+}
+
+/* replace vault.recent with the current list; caller holds recentLock */
+static void rewriteRecent(VaultCtx *v) {
+    Journal out;
+    if (journal_open(&out, v->recentTmpPath, 0) != 0) return;
+    journal_setSync(&out, JOURNAL_SYNC_NONE, 0, 0);
+
+    int ok = 1;
+    for (int32_t id = v->recent.tail; id >= 0 && ok; id = v->recent.nodes[id].prev)
+        ok = appendTouch(&out, v->recent.nodes[id].name) == 0;
+    ok = ok && journal_sync(&out) == 0;
+    journal_close(&out);
+
+    if (!ok || rename(v->recentTmpPath, v->recentPath) != 0) {
+        unlink(v->recentTmpPath);
+        return;
+    }
+    journal_close(&v->recentLog);
+    openRecentLog(v, -1);
+    v->recentRecords = (uint32_t)v->recent.count;
+}
+
+static void loadRecent(VaultCtx *v, int capacity) {
+    lru_init(&v->recent, capacity);
+    long valid = journal_replay(v->recentPath, replayTouch, v);
+    openRecentLog(v, valid);
+    if (v->recentRecords > 4u * (uint32_t)v->recent.capacity + 64)
+        rewriteRecent(v);
+}
+
+/* ---------- helper: shared chunks ---------- */
+
+/*
+ * With deduplication on, appends are cut into content-defined chunks
+ * (cdc.h), each stored once in the vault-wide chunk store (chunkstore.h)
+ * and written to the file as a small frame holding its key (cipher.h).
+ * The file becomes the manifest of its chunks: undo, the block and line
+ * maps and range reads work on its frames as before, and readers fetch
+ * each chunk through loadChunk. Chunks never span two appends.
+ */
+#define CHUNKS_PATH     "vault.chunks"
+#define CHUNKS_LOG_PATH "vault.chunks.log"
+#define CHUNK_BUF       (2 * CDC_MAX)   /* bytes gathered before cutting */
+
+/* caller holds chunkLock. returns the store, opening it on first use,
+ * or NULL if it cannot be opened */
+static ChunkStore *chunkStore(VaultCtx *v) {
+    if (!v->chunks) {
+        v->chunks = chunkstore_open(v->chunksPath, v->chunksLogPath);
+        if (v->chunks)
+            chunkstore_setSync(v->chunks, v->syncMode, v->syncGroupSize, v->syncGroupMs);
+    }
+    return v->chunks;
+}
+
+/* FrameChunkFn of every reader of v's files */
+static int loadChunk(void *ctx, const unsigned char key[FRAME_REF_KEY],
+                     void *out, uint32_t len) {
+    VaultCtx *v = (VaultCtx *)ctx;
+    ChunkLoc  loc;
+    pthread_mutex_lock(&v->chunkLock);
+    ChunkStore *s  = chunkStore(v);
+    int         rc = s ? chunkstore_find(s, key, &loc) : -1;
+    pthread_mutex_unlock(&v->chunkLock);
+    if (rc != 0 || loc.length != len) return -1;
+    return chunkstore_load(s, &loc, key, out);
+}
+
+/* stores the len bytes at data unless the store has them, and sets key
+ * to their key. returns 0 or -1 */
+static int storeChunk(VaultCtx *v, const char *data, size_t len,
+                      unsigned char key[CHUNK_KEY_LEN]) {
+    chunkstore_key(data, len, key);
+    pthread_mutex_lock(&v->chunkLock);
+    ChunkStore *s  = chunkStore(v);
+    int         rc = s ? chunkstore_put(s, key, data, len, atomic_load(&v->compress)) : -1;
+    pthread_mutex_unlock(&v->chunkLock);
+    if (rc >= 0) stats_count(rc > 0 ? STAT_CHUNKS_STORED : STAT_CHUNKS_SHARED, 1);
+    return rc < 0 ? -1 : 0;
+}
+
+/* ---------- helper: checksums ---------- */
+
+/*
+ * vault.sums holds every file's size and the CRC-32C of its bytes as
+ * stored (sumtable.h), so damage at rest shows without any password.
+ * Changes keep it current from the bytes they touch alone (crc32c.h):
+ * what an append writes is combined in, what undo or a re-packed tail
+ * cuts off is trimmed out first. A file no longer the size its sum says
+ * was changed behind the vault's back and keeps that sum, for verify to
+ * report. Files from before sums were kept get one when first verified.
+ */
+#define SUMS_PATH     "vault.sums"
+#define SUMS_TMP_PATH "vault.sums.tmp"
+#define SUM_READ      (1024 * 1024)   /* bytes per read when summing */
+
+/* caller holds sumLock. returns the table, opening it on first use, or
+ * NULL if it cannot be opened */
+static SumTable *sumTable(VaultCtx *v) {
+    if (!v->sums) {
+        v->sums = sumtable_open(v->sumsPath, v->sumsTmpPath);
+        if (v->sums)
+            sumtable_setSync(v->sums, v->syncMode, v->syncGroupSize, v->syncGroupMs);
+    }
+    return v->sums;
+}
+
+/* the CRC of the len bytes of fd at from. returns 0 or -1 */
+static int regionCrc(int fd, uint64_t from, uint64_t len, uint32_t *crc) {
+    char *buf = (char *)malloc(len < SUM_READ ? (size_t)len + 1 : SUM_READ);
+    if (!buf) return -1;
+    *crc = 0;
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len < SUM_READ ? (size_t)len : SUM_READ, (off_t)from);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        stats_count(STAT_BYTES_READ, (uint64_t)n);
+        *crc  = crc32c(*crc, buf, (size_t)n);
+        from += (uint64_t)n;
+        len  -= (uint64_t)n;
+    }
+    free(buf);
+    return len == 0 ? 0 : -1;
+}
+
+/* 1 if filename has a sum for exactly size bytes */
+static int sumTracks(VaultCtx *v, const char *filename, uint64_t size) {
+    FileSum sum;
+    pthread_mutex_lock(&v->sumLock);
+    SumTable *t  = sumTable(v);
+    int       ok = t && sumtable_get(t, filename, &sum) == 0 && sum.size == size;
+    pthread_mutex_unlock(&v->sumLock);
+    return ok;
+}
+
+static void sumSet(VaultCtx *v, const char *filename, uint64_t size, uint32_t crc) {
+    FileSum sum = { size, crc };
+    pthread_mutex_lock(&v->sumLock);
+    SumTable *t = sumTable(v);
+    if (t) sumtable_put(t, filename, &sum);
+    pthread_mutex_unlock(&v->sumLock);
+}
+
+/* the size and CRC of filename as it is now. returns 0 or -1 */
+static int fileSum(VaultCtx *v, const char *filename, FileSum *sum) {
+    struct stat st;
+    int         fd = fileOpen(v, filename, 0, &st);
+    if (fd < 0) return -1;
+    sum->size = (uint64_t)st.st_size;
+    int rc = regionCrc(fd, 0, sum->size, &sum->crc);
+    fileClose(v, fd);
+    return rc;
+}
+
+/* the file, oldSize bytes with the sum to match, was cut back to `cut`,
+ * the cut bytes having CRC cutCrc, and has since grown to newSize.
+ * caller holds the file lock */
+static void sumChange(VaultCtx *v, const char *filename, int fd, uint64_t oldSize,
+                      uint64_t cut, uint32_t cutCrc, uint64_t newSize) {
+    FileSum  sum;
+    uint32_t grown = 0;
+    pthread_mutex_lock(&v->sumLock);
+    SumTable *t  = sumTable(v);
+    int       ok = t && sumtable_get(t, filename, &sum) == 0 && sum.size == oldSize;
+    pthread_mutex_unlock(&v->sumLock);
+    if (!ok || regionCrc(fd, cut, newSize - cut, &grown) != 0) return;
+
+    uint32_t crc = crc32c_trim(sum.crc, cutCrc, oldSize - cut);
+    sumSet(v, filename, newSize, crc32c_combine(crc, grown, newSize - cut));
+}
+
+/* ---------- helper: version history ---------- */
+
+/*
+ * Every append is a version of its file: one record in the file's own
+ * history file under vault.history, laid out like vault.store, saying
+ * where the append started in the plaintext, how long it was, when it
+ * was made and a check of what it added, keyed by the file's data key
+ * like the search index so the history gives nothing of the plaintext
+ * away (history.h). A version's content is the file's plaintext up to
+ * its end, so reading one is a range read and history costs 32 bytes
+ * per append.
+ *
+ * Versions only count while they end within the file: undo hides the
+ * ones it cuts off and redo brings them back with the same bytes. The
+ * next append after an undo replaces the hidden ones, which also covers
+ * a crash between an undo's cut and anything else. An append that
+ * crashes before its record is written leaves bytes no version claims;
+ * the next append's version starts after them, and reads of later
+ * versions include them unchecked.
+ */
+#define HISTORY_ROOT  "vault.history"
+#define HISTORY_BATCH 256   /* records read at a time */
+
+static uint64_t wallMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* name's history file, from the fd cache or opened and added to it;
+ * create makes a missing one. release with historyClose. returns the fd,
+ * or -1 (errno ENOENT when the file has no history) */
+static int historyOpen(VaultCtx *v, const char *name, int create) {
+    if (v->historyFd < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    pthread_mutex_lock(&v->fdLock);
+    int fd = fdcache_get(v->histFds, name);
+    pthread_mutex_unlock(&v->fdLock);
+    if (fd >= 0) return fd;
+
+    char path[FANOUT_PATH_LEN];
+    fanout_path(name, path);
+    fd = fanout_open(v->historyFd, path, O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+    if (fd < 0 && !create && (errno == EACCES || errno == EROFS))
+        return fanout_open(v->historyFd, path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd >= 0) {
+        pthread_mutex_lock(&v->fdLock);
+        fdcache_put(v->histFds, name, fd);
+        pthread_mutex_unlock(&v->fdLock);
+    }
+    return fd;
+}
+
+static void historyClose(VaultCtx *v, int fd) {
+    if (fd < 0) return;
+    pthread_mutex_lock(&v->fdLock);
+    fdcache_release(v->histFds, fd);
+    pthread_mutex_unlock(&v->fdLock);
+}
+
+/* how many of the first count records of fd end within size bytes */
+static uint64_t historyWithin(int fd, uint64_t count, uint64_t size) {
+    Version ver;
+    while (count > 0 && (history_get(fd, count - 1, &ver) != 0 ||
+                         ver.offset + ver.length > size))
+        count--;
+    return count;
+}
+
+/* records the append of length bytes at plaintext offset, whose
+ * history_check is check. caller holds the file lock */
+static void historyAdd(VaultCtx *v, const char *filename, uint64_t offset,
+                       uint64_t length, uint32_t check) {
+    int fd = historyOpen(v, filename, 1);
+    if (fd < 0) return;
+    uint64_t count = history_count(fd);
+    uint64_t n     = historyWithin(fd, count, offset);
+    Version  prev, ver = { offset, length, wallMs(), check };
+    if (n > 0 && history_get(fd, n - 1, &prev) == 0 && prev.time > ver.time)
+        ver.time = prev.time;   /* the clock went back: keep times in order */
+    history_put(fd, n, count, &ver);
+    historyClose(v, fd);
+}
+
+/* below, with the encrypted content helpers */
+static long long plainSize(int fd, off_t fileSize);
+
+/* filename's history file, or -1 if it has none, and how many versions
+ * the file holds now in *count. takes the file lock. returns 0, or -1 if
+ * the file or its history cannot be read */
+static int historyLive(VaultCtx *v, const char *filename, int *hfd, uint64_t *count) {
+    pthread_mutex_t *lock = fileLock(v, filename);
+    pthread_mutex_lock(lock);
+    struct stat st;
+    int         fd   = fileOpen(v, filename, 0, &st);
+    long long   size = fd >= 0 ? plainSize(fd, st.st_size) : -1;
+    fileClose(v, fd);
+
+    *count = 0;
+    *hfd   = size >= 0 ? historyOpen(v, filename, 0) : -1;
+    int rc = size < 0 || (*hfd < 0 && errno != ENOENT) ? -1 : 0;
+    if (*hfd >= 0) *count = historyWithin(*hfd, history_count(*hfd), (uint64_t)size);
+    pthread_mutex_unlock(lock);
+    return rc;
+}
+
+/* ---------- helper: encrypted content ---------- */
+
+/*
+ * File contents are stored as frames (cipher.h) under a random per-file
+ * data key, which lives wrapped in the file's keyed hash (kdf.h). A
+ * successful password check keeps the unwrapped key in keys[] until the
+ * vault is closed; content operations on a file not unlocked since then
+ * fail. A password change only rewraps the key, so contents stay put.
+ */
+#define SEAL_CHUNK  MODEL_CHUNK_SIZE   /* longest frame body we write */
+
+/*
+ * A legacy file is sealed into a copy under SEAL_DIR in the store,
+ * named by the id of its file (fanout.h); no name maps there, so the
+ * copy never stands in for a vault file. While the copy is on its way
+ * in, the file's keyed hash is stored behind SEAL_PENDING: only that
+ * journaled mark lets an unlock move a copy over the file.
+ */
+#define SEAL_DIR      ".seal"
+#define SEAL_PATH_LEN (sizeof(SEAL_DIR) + 32 + 1)   /* ".seal/<id>" and NUL */
+#define SEAL_PENDING  "$seal$"
+#define SEAL_SUFFIX   ".fvseal"   /* where flat vaults kept the copy */
+
+/* caller holds vaultLock exclusively */
+static int setFileKey(VaultCtx *v, int id, const unsigned char key[CIPHER_KEY_LEN]) {
+    if (id >= v->keyCap) {
+        int cap = v->keyCap ? v->keyCap : 64;
+        while (cap <= id) cap *= 2;
+        FileKey *keys = (FileKey *)realloc(v->keys, sizeof(FileKey) * (size_t)cap);
+        if (!keys) return -1;
+        memset(keys + v->keyCap, 0, sizeof(FileKey) * (size_t)(cap - v->keyCap));
+        v->keys   = keys;
+        v->keyCap = cap;
+    }
+    memcpy(v->keys[id].key, key, CIPHER_KEY_LEN);
+    search_deriveKey(key, v->keys[id].searchKey);
+    v->keys[id].unlocked = 1;
+    return 0;
+}
+
+/* copies the data key of filename. returns 1, or 0 if the file is not
+ * in the vault or has not been unlocked */
+static int fileKey(VaultCtx *v, const char *filename,
+                   unsigned char key[CIPHER_KEY_LEN]) {
+    pthread_rwlock_rdlock(&v->vaultLock);
+    int id = vtable_find(&v->vaults, filename);
+    int ok = id >= 0 && id < v->keyCap && v->keys[id].unlocked;
+    if (ok) memcpy(key, v->keys[id].key, CIPHER_KEY_LEN);
+    pthread_rwlock_unlock(&v->vaultLock);
+    return ok;
+}
+
+/* the search key of an unlocked file, as fileKey */
+static int fileSearchKey(VaultCtx *v, const char *filename,
+                         unsigned char key[SEARCH_KEY_LEN]) {
+    pthread_rwlock_rdlock(&v->vaultLock);
+    int id = vtable_find(&v->vaults, filename);
+    int ok = id >= 0 && id < v->keyCap && v->keys[id].unlocked;
+    if (ok) memcpy(key, v->keys[id].searchKey, SEARCH_KEY_LEN);
+    pthread_rwlock_unlock(&v->vaultLock);
+    return ok;
+}
+
+/* plaintext size, from the trailer of the last frame; -1 if malformed */
+static long long plainSize(int fd, off_t fileSize) {
+    unsigned char trailer[FRAME_TRAILER];
+    if (fileSize == 0) return 0;
+    if (fileSize < FRAME_OVERHEAD ||
+        pread(fd, trailer, sizeof(trailer), fileSize - FRAME_TRAILER) != FRAME_TRAILER)
+        return -1;
+    return (long long)frame_plainEnd(trailer);
+}
+
+/* appends len bytes to fd as frames of at most SEAL_CHUNK bytes,
+ * compressed where that pays if packed; the file held plainEnd bytes of
+ * plaintext before. buf has room for one frame. returns bytes written,
+ * or -1 */
+static long long writeSealed(int fd, const unsigned char key[CIPHER_KEY_LEN],
+                             uint64_t plainEnd, const char *text, size_t len,
+                             unsigned char *buf, int packed) {
+    long long written = 0;
+    while (len > 0) {
+        size_t n = len < SEAL_CHUNK ? len : SEAL_CHUNK;
+        plainEnd += n;
+        size_t out = packed ? frame_sealBlock(key, plainEnd, text, n, buf)
+                            : frame_seal(key, plainEnd, text, n, buf);
+        if (out == 0 || writeAll(fd, buf, out) != 0) return -1;
+        written += (long long)out;
+        text    += n;
+        len     -= n;
+    }
+    return written;
+}
+
+/*
+ * Plain appends gather their frames into batches of up to SEAL_BATCH
+ * bytes, each written with one call. With a queue, one batch is written
+ * while the next is sealed; the descriptor is O_APPEND and only one
+ * batch is ever in flight, so frames land in order. The last batch is
+ * written in place, so a short append costs one write as before. Buffers
+ * grow with what is appended.
+ */
+#define SEAL_BATCH (8 * (SEAL_CHUNK + FRAME_OVERHEAD))
+
+typedef struct {
+    int            fd;
+    IoQueue       *q;         /* NULL: every batch is written in place */
+    unsigned char *buf[2];
+    size_t         cap[2];
+    size_t         len;       /* bytes gathered in buf[cur] */
+    int            cur;
+    size_t         flying;    /* bytes of buf[!cur] being written */
+} SealWriter;
+
+/* waits for the batch in flight. returns 0, or -1 if it did not land */
+static int writerLand(SealWriter *w) {
+    if (w->flying == 0) return 0;
+    IoqDone d;
+    if (ioq_reap(w->q, &d, 1, 1) != 1) {
+        /* the batch is the kernel's until it is back */
+        if (ioq_drain(w->q) != 0) w->buf[!w->cur] = NULL;   /* never freed */
+        w->flying = 0;
+        return -1;
+    }
+    size_t sent = d.res > 0 ? (size_t)d.res : 0;
+    size_t left = w->flying - (sent < w->flying ? sent : w->flying);
+    w->flying   = 0;
+    if (d.res < 0) return -1;
+    /* a short write is finished in place: nothing else is in flight */
+    return left > 0 ? writeAll(w->fd, w->buf[!w->cur] + sent, left) : 0;
+}
+
+/* sends the gathered batch; in place unless last is 0 and there is a
+ * queue. returns 0 or -1 */
+static int writerSend(SealWriter *w, int last) {
+    if (writerLand(w) != 0) return -1;
+    if (w->len == 0) return 0;
+    size_t len = w->len;
+    w->len = 0;
+    if (last || !w->q) return writeAll(w->fd, w->buf[w->cur], len);
+    if (ioq_write(w->q, w->fd, w->buf[w->cur], len, IOQ_APPEND, 0) != 0 ||
+        ioq_submit(w->q) != 1)
+        return -1;
+    w->flying = len;
+    w->cur   ^= 1;
+    return 0;
+}
+
+/* writeSealed through w: appends len bytes as frames after plainEnd
+ * bytes of plaintext. returns bytes of frames gathered, or -1 */
+static long long writerSeal(SealWriter *w, const unsigned char key[CIPHER_KEY_LEN],
+                            uint64_t plainEnd, const char *text, size_t len) {
+    long long written = 0;
+    while (len > 0) {
+        size_t n = len < SEAL_CHUNK ? len : SEAL_CHUNK;
+        if (w->len + n + FRAME_OVERHEAD > SEAL_BATCH && writerSend(w, 0) != 0) return -1;
+        size_t need = w->len + n + FRAME_OVERHEAD;
+        if (need > w->cap[w->cur]) {
+            size_t cap = w->cap[w->cur] * 2 > need ? w->cap[w->cur] * 2 : need;
+            if (cap > SEAL_BATCH) cap = SEAL_BATCH;
+            unsigned char *grown = (unsigned char *)realloc(w->buf[w->cur], cap);
+            if (!grown) return -1;
+            w->buf[w->cur] = grown;
+            w->cap[w->cur] = cap;
+        }
+        plainEnd += n;
+        size_t out = frame_seal(key, plainEnd, text, n, w->buf[w->cur] + w->len);
+        if (out == 0) return -1;
+        w->len  += out;
+        written += (long long)out;
+        text    += n;
+        len     -= n;
+    }
+    return written;
+}
+
+/* turns frames, fed in spans of any size, into plaintext blocks of
+ * MODEL_CHUNK_SIZE for fn */
+typedef struct {
+    FrameReader  frames;
+    char        *block;
+    size_t       filled;
+    ModelChunkFn fn;
+    void        *ctx;
+} Opener;
+
+static int openerInit(VaultCtx *v, const char *filename, Opener *o,
+                      ModelChunkFn fn, void *ctx) {
+    unsigned char key[CIPHER_KEY_LEN];
+    if (!fileKey(v, filename, key)) return -1;
+    o->block = (char *)malloc(MODEL_CHUNK_SIZE);
+    if (!o->block) return -1;
+    frame_readerInit(&o->frames, key);
+    frame_readerSetChunks(&o->frames, loadChunk, v);
+    o->filled = 0;
+    o->fn     = fn;
+    o->ctx    = ctx;
+    return 0;
+}
+
+static void openerFree(Opener *o) {
+    frame_readerFree(&o->frames);
+    free(o->block);
+}
+
+/* returns 0, 1 if stopped by fn, or -1 if the frames are malformed */
+static int openerFeed(Opener *o, const char *in, size_t len) {
+    while (len > 0 || frame_pending(&o->frames) > 0) {
+        size_t used;
+        long   n = frame_open(&o->frames, in, len, &used, o->block + o->filled,
+                              MODEL_CHUNK_SIZE - o->filled);
+        if (n < 0) return -1;
+        o->filled += (size_t)n;
+        in        += used;
+        len       -= used;
+        if (o->filled == MODEL_CHUNK_SIZE) {
+            o->filled = 0;
+            if (o->fn(o->ctx, o->block, MODEL_CHUNK_SIZE) != 0) return 1;
+        }
+    }
+    return 0;
+}
+
+/* hands out the last short block. A frame cut off at the end is an
+ * append still being written, not an error: readers see up to it. */
+static int openerFinish(Opener *o) {
+    if (o->filled > 0 && o->fn(o->ctx, o->block, o->filled) != 0) return 1;
+    return 0;
+}
+
+/* an opener fed by streamIn: fn's stop and malformed frames told apart */
+typedef struct {
+    Opener *o;
+    int     rc;
+} OpenerSink;
+
+static int openerChunk(void *ctx, const char *data, size_t len) {
+    OpenerSink *s = (OpenerSink *)ctx;
+    return s->rc = openerFeed(s->o, data, len);
+}
+
+/* where the sealed copy of filename is kept, relative to the store */
+static void sealPath(const char *filename, char out[SEAL_PATH_LEN]) {
+    char path[FANOUT_PATH_LEN];
+    fanout_path(filename, path);
+    sprintf(out, SEAL_DIR "/%s", path + 4);
+}
+
+/* 1 if the stored secret is a keyed hash whose sealed copy may not be
+ * in place yet */
+static int sealPending(const char *stored) {
+    return strncmp(stored, SEAL_PENDING, sizeof(SEAL_PENDING) - 1) == 0;
+}
+
+/* moves the sealed copy of filename over it, if there is one. caller
+ * holds the file lock. returns 0, or -1 if a copy is left */
+static int finishSeal(VaultCtx *v, const char *filename) {
+    char from[SEAL_PATH_LEN], to[FANOUT_PATH_LEN];
+    sealPath(filename, from);
+    fanout_path(filename, to);
+    if (fanout_makeDirs(v->storeFd, to) != 0 ||
+        renameat(v->storeFd, from, v->storeFd, to) != 0)
+        return errno == ENOENT ? 0 : -1;
+    fileForget(v, filename);
+    fanout_syncDir(v->storeFd, to);
+    fanout_syncDir(v->storeFd, from);
+    return 0;
+}
+
+/* finishes the seal its SEAL_PENDING secret says filename is in, then
+ * drops the mark. caller holds the file lock. returns 0 or -1 */
+static int settleSeal(VaultCtx *v, const char *filename) {
+    if (finishSeal(v, filename) != 0) return -1;
+
+    int rc = 0;
+    pthread_rwlock_wrlock(&v->vaultLock);
+    const char *now = findSecret(v, filename);
+    if (now && sealPending(now)) {
+        char *keyed = strdup(now + sizeof(SEAL_PENDING) - 1);
+        int   id    = keyed ? tableId(v, filename) : -1;
+        if (id < 0 || vtable_setSecret(&v->vaults, id, keyed) != 0) rc = -1;
+        else journalPut(v, id);   /* unsynced: a lost one is dropped again */
+        free(keyed);
+    }
+    pthread_rwlock_unlock(&v->vaultLock);
+    return rc;
+}
+
+/* writes the plaintext file filename as frames under key into its
+ * sealed copy and syncs it; a missing file counts as empty.
+ * returns 0 or -1 */
+static int sealFile(VaultCtx *v, const char *filename,
+                    const unsigned char key[CIPHER_KEY_LEN]) {
+    int src = openIn(v, filename, O_RDONLY | O_CLOEXEC);
+    if (src < 0) return errno == ENOENT ? 0 : -1;
+    char tmp[SEAL_PATH_LEN];
+    sealPath(filename, tmp);
+    stats_count(STAT_OPENS, 1);
+    int dst = fanout_open(v->storeFd, tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    char          *in  = (char *)malloc(SEAL_CHUNK);
+    unsigned char *out = (unsigned char *)malloc(SEAL_CHUNK + FRAME_OVERHEAD);
+
+    int      rc    = dst >= 0 && in && out ? 0 : -1;
+    uint64_t plain = 0;
+    while (rc == 0) {
+        ssize_t n = read(src, in, SEAL_CHUNK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            rc = n < 0 ? -1 : 0;
+            break;
+        }
+        stats_count(STAT_BYTES_READ, (uint64_t)n);
+        long long w = writeSealed(dst, key, plain, in, (size_t)n, out,
+                                  atomic_load(&v->compress));
+        if (w < 0) rc = -1;
+        else stats_count(STAT_BYTES_WRITTEN, (uint64_t)w);
+        plain += (uint64_t)n;
+    }
+    if (rc == 0) {
+        rc = fsync(dst) == 0 ? 0 : -1;
+        stats_count(STAT_FSYNCS, 1);
+    }
+
+    free(in);
+    free(out);
+    close(src);
+    if (dst >= 0) close(dst);
+    if (rc != 0) unlinkat(v->storeFd, tmp, 0);
+    return rc;
+}
+
+/*
+ * Entries from before encryption ($fv1$ or plaintext secrets) have
+ * plaintext files. Their first unlock encrypts the file under a fresh
+ * data key and replaces the secret with a keyed hash; the file's undo
+ * history is dropped since its byte offsets no longer apply. For
+ * crashes, the sealed copy is synced first, then the keyed hash is
+ * journaled and synced behind SEAL_PENDING, and only then is the copy
+ * renamed over the original and the mark dropped; keepKey finishes
+ * both if a crash came in between.
+ * returns 0 (sealed, here or by another thread) or -1
+ */
+static int sealLegacy(VaultCtx *v, const char *filename, const char *password,
+                      const char *stored) {
+    unsigned char key[CIPHER_KEY_LEN];
+    char          hashed[KDF_ENCODED_MAX];
+    char          marked[sizeof(SEAL_PENDING) - 1 + KDF_ENCODED_MAX];
+    if (kdf_random(key, sizeof(key)) != 0 ||
+        kdf_hashKey(password, v->kdfCost, key, hashed) != 0)
+        return -1;
+    sprintf(marked, SEAL_PENDING "%s", hashed);
+
+    pthread_mutex_t *lock = fileLock(v, filename);
+    pthread_mutex_lock(lock);
+
+    pthread_rwlock_rdlock(&v->vaultLock);
+    const char *now   = findSecret(v, filename);
+    int         still = now && strcmp(now, stored) == 0;
+    pthread_rwlock_unlock(&v->vaultLock);
+
+    int rc = still ? sealFile(v, filename, key) : 0;
+    if (still && rc == 0) {
+        pthread_rwlock_wrlock(&v->vaultLock);
+        int id     = tableId(v, filename);
+        int sealing = id >= 0 && vtable_setSecret(&v->vaults, id, marked) == 0;
+        if (!sealing) {
+            rc = -1;
+        } else {
+            journalPut(v, id);
+            journal_sync(&v->journal);
+            rc = setFileKey(v, id, key);
+        }
+        pthread_rwlock_unlock(&v->vaultLock);
+
+        if (sealing) {   /* the keyed hash is in; the copy must follow */
+            if (settleSeal(v, filename) != 0) rc = -1;
+            FileSum sum;
+            if (fileSum(v, filename, &sum) == 0) sumSet(v, filename, sum.size, sum.crc);
+            const char *owner;
+            pthread_mutex_lock(&v->undoLock);
+            while (undolog_peekUndo(&v->undoLog, filename, &owner))
+                undolog_drop(&v->undoLog, filename, 0);
+            while (undolog_peekRedo(&v->undoLog, filename, &owner))
+                undolog_drop(&v->undoLog, filename, 1);
+            pthread_mutex_unlock(&v->undoLock);
+        } else {
+            char tmp[SEAL_PATH_LEN];
+            sealPath(filename, tmp);
+            unlinkat(v->storeFd, tmp, 0);
+        }
+    }
+
+    pthread_mutex_unlock(lock);
+    return rc;
+}
+
+/* keeps the key a keyed secret unlocked, first finishing the seal a
+ * pending one was cut short in by a crash. returns 0 or -1 */
+static int keepKey(VaultCtx *v, const char *filename,
+                   const unsigned char key[CIPHER_KEY_LEN], int pending) {
+    if (pending) {
+        pthread_mutex_lock(fileLock(v, filename));
+        int settled = settleSeal(v, filename);
+        pthread_mutex_unlock(fileLock(v, filename));
+        if (settled != 0) return -1;
+    }
+
+    pthread_rwlock_wrlock(&v->vaultLock);
+    int id = tableId(v, filename);
+    int rc = id < 0 ? -1 : setFileKey(v, id, key);
+    pthread_rwlock_unlock(&v->vaultLock);
+    return rc;
+}
+
+static int feedWords(void *ctx, const char *data, size_t len) {
+    search_builderFeed((SearchBuilder *)ctx, data, len);
+    return 0;
+}
+
+/* decrypts the bytes [from, to) of filename, open as fd, for fn; from
+ * must be a frame boundary with plain bytes of plaintext before it.
+ * returns 0, 1 if stopped by fn, or -1 */
+static int readPlain(VaultCtx *v, const char *filename, int fd, uint64_t from,
+                     uint64_t to, uint64_t plain, ModelChunkFn fn, void *ctx) {
+    char  *buf = (char *)malloc(MODEL_CHUNK_SIZE);
+    Opener o;
+    int    rc = -1;
+    if (buf && openerInit(v, filename, &o, fn, ctx) == 0) {
+        o.frames.plainPos = plain;
+        rc = 0;
+        for (uint64_t pos = from; rc == 0 && pos < to; ) {
+            size_t  want = to - pos < MODEL_CHUNK_SIZE ? (size_t)(to - pos) : MODEL_CHUNK_SIZE;
+            ssize_t n    = pread(fd, buf, want, (off_t)pos);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                rc = -1;
+                break;
+            }
+            stats_count(STAT_BYTES_READ, (uint64_t)n);
+            rc   = openerFeed(&o, buf, (size_t)n);
+            pos += (uint64_t)n;
+        }
+        if (rc == 0) rc = openerFinish(&o);
+        openerFree(&o);
+    }
+    free(buf);
+    return rc;
+}
+
+/* decrypts the bytes [from, to) of filename, open as fd, into words;
+ * from must be a frame boundary. returns 0 or -1 */
+static int readWords(VaultCtx *v, const char *filename, int fd, uint64_t from,
+                     uint64_t to, SearchBuilder *words) {
+    /* the trailer before from gives the plaintext count the frames after
+     * it continue from */
+    long long plain = plainSize(fd, (off_t)from);
+    int       rc    = plain < 0 ? -1 :
+                      readPlain(v, filename, fd, from, to, (uint64_t)plain, feedWords, words);
+    search_builderFinish(words);
+    return rc;
+}
+
+/* brings the index of filename, open as fd under its file lock, up to
+ * the file's size on disk: if the file is unlocked, the bytes past what
+ * is indexed are read and added, and a file that shrank behind the
+ * index's back is indexed afresh */
+static void indexGap(VaultCtx *v, const char *filename, int fd) {
+    unsigned char sk[SEARCH_KEY_LEN];
+    int           unlocked = fileSearchKey(v, filename, sk);
+    struct stat   st;
+    if (fstat(fd, &st) != 0) return;
+
+    uint64_t size = (uint64_t)st.st_size, indexed = 0;
+    pthread_mutex_lock(&v->searchLock);
+    SearchIndex *s = unlocked ? searchIndex(v) : v->search;
+    if (s) {
+        indexed = search_indexed(s, filename);
+        if (indexed > size) {
+            search_reset(s, filename);
+            indexed = 0;
+        }
+    }
+    pthread_mutex_unlock(&v->searchLock);
+
+    if (unlocked && s && indexed < size) {
+        SearchBuilder words;
+        search_builderInit(&words, sk);
+        int rc = readWords(v, filename, fd, indexed, size, &words);
+        if (rc != 0 && indexed > 0) {
+            /* the index ends inside a block an append re-packed */
+            search_builderFree(&words);
+            search_builderInit(&words, sk);
+            pthread_mutex_lock(&v->searchLock);
+            search_reset(s, filename);
+            pthread_mutex_unlock(&v->searchLock);
+            indexed = 0;
+            rc      = readWords(v, filename, fd, 0, size, &words);
+        }
+        if (rc == 0) {
+            pthread_mutex_lock(&v->searchLock);
+            search_add(s, filename, indexed, size, &words);
+            pthread_mutex_unlock(&v->searchLock);
+        }
+        search_builderFree(&words);
+    }
+    memset(sk, 0, sizeof(sk));
+}
+
+/* takes the bytes of filename (open as fd under its file lock) past end,
+ * about to be cut off, out of the index. Without the file's key their
+ * words are unknown: the file is then reset, to be indexed afresh on its
+ * next unlock. */
+static void indexCut(VaultCtx *v, const char *filename, int fd, uint64_t end) {
+    unsigned char sk[SEARCH_KEY_LEN];
+    int           unlocked = fileSearchKey(v, filename, sk);
+    struct stat   st;
+    if (fstat(fd, &st) != 0) return;
+
+    uint64_t size = (uint64_t)st.st_size, indexed = 0;
+    pthread_mutex_lock(&v->searchLock);
+    SearchIndex *s = unlocked ? searchIndex(v) : v->search;
+    if (s) indexed = search_indexed(s, filename);
+    pthread_mutex_unlock(&v->searchLock);
+    if (!s || indexed <= end) {
+        memset(sk, 0, sizeof(sk));
+        return;   /* nothing indexed there; an unopened index is checked on unlock */
+    }
+
+    int rc = -1;
+    if (unlocked && indexed == size) {
+        SearchBuilder words;
+        search_builderInit(&words, sk);
+        if (readWords(v, filename, fd, end, size, &words) == 0) {
+            pthread_mutex_lock(&v->searchLock);
+            rc = search_remove(s, filename, end, size, &words);
+            pthread_mutex_unlock(&v->searchLock);
+        }
+        search_builderFree(&words);
+    }
+    if (rc != 0) {
+        pthread_mutex_lock(&v->searchLock);
+        search_reset(s, filename);
+        pthread_mutex_unlock(&v->searchLock);
+    }
+    memset(sk, 0, sizeof(sk));
+}
+
+/* below, with the frame boundaries it walks */
+static int tailRepair(VaultCtx *v, const char *filename, int fd, struct stat *st);
+
+/* filename was just unlocked: a frame a crash tore off its end is cut
+ * off, and whatever the index lacks of it is added */
+static void fileUnlocked(VaultCtx *v, const char *filename) {
+    pthread_mutex_t *lock = fileLock(v, filename);
+    pthread_mutex_lock(lock);
+    struct stat st;
+    int         fd = fileOpen(v, filename, 0, &st);
+    if (fd >= 0) {
+        tailRepair(v, filename, fd, &st);
+        indexGap(v, filename, fd);
+        fileClose(v, fd);
+    }
+    pthread_mutex_unlock(lock);
+}
+
+/* ---------- helper: compressed blocks ---------- */
+
+/*
+ * With compression on, appends are sealed as blocks of FRAME_BLOCK_MAX
+ * plaintext bytes, each compressed on its own (cipher.h, lz.h). A file's
+ * last block is usually short: an append decodes it, cuts it off and
+ * seals it again with the new bytes, so only the tail is ever
+ * recompressed. The undo entry remembers the cut (undolog.h): undo seals
+ * the old tail anew, which takes the file's key, and redo puts the saved
+ * blocks back.
+ *
+ * blockMaps[] holds the frame boundaries of the file last read or
+ * written in each file-lock stripe, so range reads go straight to the
+ * frames they need. It is extended by walking the frames past what it
+ * holds and trimmed wherever the file is cut.
+ */
+
+typedef struct {
+    char   *buf;
+    size_t  len;
+    size_t  cap;
+} Collector;
+
+static int collectChunk(void *ctx, const char *data, size_t len) {
+    Collector *c = (Collector *)ctx;
+    if (len > c->cap - c->len) len = c->cap - c->len;   /* file grew */
+    memcpy(c->buf + c->len, data, len);
+    c->len += len;
+    return c->len == c->cap;
+}
+
+/* slices the plaintext [from, to) out of the blocks handed to it */
+typedef struct {
+    uint64_t     pos;       /* plaintext offset of the next block */
+    uint64_t     from, to;
+    ModelChunkFn fn;
+    void        *ctx;
+    int          stopped;   /* by fn, not by reaching to */
+} RangeSink;
+
+static int rangeChunk(void *ctx, const char *data, size_t len) {
+    RangeSink *r  = (RangeSink *)ctx;
+    uint64_t   at = r->pos;
+    r->pos += len;
+    if (r->pos <= r->from) return 0;
+
+    size_t skip = at < r->from ? (size_t)(r->from - at) : 0;
+    size_t n    = r->pos > r->to ? (size_t)(r->to - at) - skip : len - skip;
+    if (n > 0 && r->fn(r->ctx, data + skip, n) != 0) {
+        r->stopped = 1;
+        return 1;
+    }
+    return r->pos >= r->to;
+}
+
+static BlockMap *mapSlot(VaultCtx *v, const char *filename) {
+    return &v->blockMaps[hashindex_hash(filename) & (FILE_LOCK_STRIPES - 1)];
+}
+
+static void linesReset(BlockMap *m) {
+    m->marks   = 0;
+    m->lines   = 0;
+    m->scanned = 0;
+}
+
+static void freeBlockMaps(VaultCtx *v) {
+    for (int i = 0; i < FILE_LOCK_STRIPES; i++) {
+        free(v->blockMaps[i].name);
+        free(v->blockMaps[i].start);
+        free(v->blockMaps[i].end);
+        free(v->blockMaps[i].mark);
+    }
+}
+
+/* forgets the frames of filename from the frame boundary at on; caller
+ * holds its file lock */
+static void blockTrim(VaultCtx *v, const char *filename, uint64_t at) {
+    BlockMap *m = mapSlot(v, filename);
+    if (!m->name || strcmp(m->name, filename) != 0 || at >= m->mapped) return;
+
+    uint64_t boundary = m->mapped;
+    while (m->count > 0 && m->start[m->count - 1] >= at)
+        boundary = m->start[--m->count];
+    if (boundary != at) m->count = 0;   /* not where a frame starts */
+    m->mapped = m->count > 0 ? at : 0;
+}
+
+static int pushBlock(BlockMap *m, uint64_t start, uint64_t end) {
+    if (m->count == m->cap) {
+        int       cap = m->cap ? m->cap * 2 : 64;
+        uint64_t *s   = (uint64_t *)realloc(m->start, sizeof(uint64_t) * (size_t)cap);
+        if (s) m->start = s;
+        uint64_t *e   = s ? (uint64_t *)realloc(m->end, sizeof(uint64_t) * (size_t)cap) : NULL;
+        if (!e) return -1;
+        m->end = e;
+        m->cap = cap;
+    }
+    m->start[m->count] = start;
+    m->end[m->count++] = end;
+    return 0;
+}
+
+/* the frames of filename, open as fd under its file lock, brought up to
+ * its size on disk by reading the trailer and next header of each frame
+ * not mapped yet. returns the map, or NULL if the frames are malformed
+ * or out of memory */
+static BlockMap *blockMap(VaultCtx *v, const char *filename, int fd) {
+    BlockMap *m = mapSlot(v, filename);
+    if (!m->name || strcmp(m->name, filename) != 0) {
+        char *name = strdup(filename);
+        if (!name) return NULL;
+        free(m->name);
+        m->name   = name;
+        m->count  = 0;
+        m->mapped = 0;
+        linesReset(m);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) return NULL;
+    uint64_t size = (uint64_t)st.st_size;
+    if (size < m->mapped) {   /* cut behind our back */
+        m->count  = 0;
+        m->mapped = 0;
+        linesReset(m);
+    }
+
+    /* buf holds a trailer and the length of the frame after it */
+    unsigned char buf[FRAME_TRAILER + 4];
+    uint64_t      pos   = m->mapped;
+    uint64_t      plain = m->count > 0 ? m->end[m->count - 1] : 0;
+    if (pos + FRAME_OVERHEAD > size) return m;
+    if (pread(fd, buf + FRAME_TRAILER, 4, (off_t)pos) != 4) return NULL;
+    for (;;) {
+        uint32_t body = frame_bodyLen(buf + FRAME_TRAILER);
+        uint64_t next = pos + FRAME_OVERHEAD + body;
+        if (body == 0) return NULL;
+        if (next > size) break;   /* an append still being written */
+
+        size_t want = next + 4 <= size ? sizeof(buf) : FRAME_TRAILER;
+        if (pread(fd, buf, want, (off_t)(next - FRAME_TRAILER)) != (ssize_t)want)
+            return NULL;
+        uint64_t end = frame_plainEnd(buf);
+        if (end <= plain || pushBlock(m, pos, end) != 0) return NULL;
+        m->mapped = pos = next;
+        plain     = end;
+        if (want < sizeof(buf)) break;
+    }
+    return m;
+}
+
+/* cuts a frame left incomplete by a crash in mid-append off the end of
+ * filename, open as fd under its file lock, so that its size on disk and
+ * the plaintext size in its last trailer are those of the whole frames;
+ * *st is brought up to date. A file whose checksum is for its size is as
+ * the vault left it; any other has its frames walked. Undo entries for
+ * appends past the cut go with it. returns 0, or -1 if the frames are
+ * malformed or the file cannot be cut */
+static int tailRepair(VaultCtx *v, const char *filename, int fd, struct stat *st) {
+    if (sumTracks(v, filename, (uint64_t)st->st_size)) return 0;
+    BlockMap *m = blockMap(v, filename, fd);
+    if (!m) return -1;
+    uint64_t end = m->mapped;
+    if (end == (uint64_t)st->st_size) return 0;
+
+    indexCut(v, filename, fd, end);
+    if (ftruncate(fd, (off_t)end) != 0 || fstat(fd, st) != 0) return -1;
+    cacheDrop(v, filename);
+    linesCut(v, filename, fd);
+
+    const char      *owner;
+    const UndoEntry *e;
+    pthread_mutex_lock(&v->undoLock);
+    while ((e = undolog_peekUndo(&v->undoLog, filename, &owner)) &&
+           e->preSize + e->length > end)
+        undolog_drop(&v->undoLog, filename, 0);
+    pthread_mutex_unlock(&v->undoLock);
+    return 0;
+}
+
+/* the first frame of a non-empty map holding plaintext past pos */
+static int blockAt(const BlockMap *m, uint64_t pos) {
+    int lo = 0, hi = m->count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (m->end[mid] > pos) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+/* the plaintext of an append on its way into blocks: a re-packed tail
+ * first, then the new bytes. With deduplication on, into chunks */
+typedef struct {
+    int                  fd;          /* O_APPEND */
+    const unsigned char *key;
+    char                *block;       /* FRAME_BLOCK_MAX bytes, or CHUNK_BUF */
+    size_t               filled;
+    uint64_t             plainEnd;    /* plaintext before block */
+    uint64_t             cut;         /* where the tail started */
+    int                  cutPending;  /* tail still on disk */
+    unsigned char       *frame;
+    size_t               start;       /* chunks: block is cut up to here */
+} Packer;
+
+/* the last block of filename, open as fd (size bytes) under its file
+ * lock, if it has room for more: its plaintext goes to p->block and its
+ * sealed bytes, which the append replaces, to *sealed (malloc'd, for
+ * putting back should the append fail). returns the plaintext length,
+ * 0 when the append starts a new block */
+static size_t loadTail(VaultCtx *v, const char *filename, uint64_t size,
+                       Packer *p, unsigned char **sealed, size_t *sealedLen) {
+    BlockMap *m = blockMap(v, filename, p->fd);
+    if (!m || m->count == 0 || m->mapped != size) return 0;
+
+    int      last = m->count - 1;
+    uint64_t from = last > 0 ? m->end[last - 1] : 0;
+    uint64_t keep = m->end[last] - from;
+    size_t   len  = (size_t)(size - m->start[last]);
+    if (keep >= FRAME_BLOCK_MAX || len > SEAL_CHUNK + FRAME_OVERHEAD) return 0;
+
+    unsigned char *buf = (unsigned char *)malloc(len);
+    if (!buf || pread(p->fd, buf, len, (off_t)m->start[last]) != (ssize_t)len) {
+        free(buf);
+        return 0;
+    }
+    stats_count(STAT_BYTES_READ, len);
+
+    /* the frame is whole, so consuming it all has checked its trailer */
+    FrameReader r;
+    size_t      used;
+    frame_readerInit(&r, p->key);
+    r.plainPos = from;
+    long n = frame_open(&r, buf, len, &used, p->block, FRAME_BLOCK_MAX);
+    frame_readerFree(&r);
+    if (n != (long)keep || used != len) {
+        free(buf);
+        return 0;
+    }
+
+    p->filled     = (size_t)keep;
+    p->plainEnd   = from;
+    p->cut        = m->start[last];
+    p->cutPending = 1;
+    *sealed       = buf;
+    *sealedLen    = len;
+    return (size_t)keep;
+}
+
+/* seals the gathered plaintext as the next frame, the first one taking
+ * the place of the re-packed tail. returns bytes written, or -1 */
+static long long packFlush(Packer *p) {
+    if (p->cutPending) {
+        if (ftruncate(p->fd, (off_t)p->cut) != 0) return -1;
+        p->cutPending = 0;
+    }
+    p->plainEnd += p->filled;
+    size_t out = frame_sealBlock(p->key, p->plainEnd, p->block, p->filled, p->frame);
+    p->filled  = 0;
+    if (out == 0 || writeAll(p->fd, p->frame, out) != 0) return -1;
+    return (long long)out;
+}
+
+/* adds len bytes, sealing every block filled. returns bytes written,
+ * or -1 */
+static long long packFeed(Packer *p, const char *data, size_t len) {
+    long long written = 0;
+    while (len > 0) {
+        size_t n = FRAME_BLOCK_MAX - p->filled < len ? FRAME_BLOCK_MAX - p->filled : len;
+        memcpy(p->block + p->filled, data, n);
+        p->filled += n;
+        data      += n;
+        len       -= n;
+        if (p->filled == FRAME_BLOCK_MAX) {
+            long long w = packFlush(p);
+            if (w < 0) return -1;
+            written += w;
+        }
+    }
+    return written;
+}
+
+/* stores the len bytes of block at start as a chunk and writes its
+ * frame. returns bytes written, or -1 */
+static long long chunkFlush(VaultCtx *v, Packer *p, size_t len) {
+    unsigned char key[CHUNK_KEY_LEN];
+    if (storeChunk(v, p->block + p->start, len, key) != 0) return -1;
+    p->start    += len;
+    p->plainEnd += len;
+    size_t out = frame_sealChunk(p->key, p->plainEnd, key, (uint32_t)len, p->frame);
+    if (out == 0 || writeAll(p->fd, p->frame, out) != 0) return -1;
+    return (long long)out;
+}
+
+/* adds len bytes, cutting chunks while a whole CDC_MAX is at hand, so
+ * every cut sees as far ahead as it may; final cuts the rest too.
+ * returns bytes written, or -1 */
+static long long chunkFeed(VaultCtx *v, Packer *p, const char *data, size_t len,
+                           int final) {
+    long long written = 0;
+    for (;;) {
+        size_t n = CHUNK_BUF - p->filled < len ? CHUNK_BUF - p->filled : len;
+        if (n > 0) memcpy(p->block + p->filled, data, n);
+        p->filled += n;
+        data      += n;
+        len       -= n;
+
+        while (p->filled - p->start >= CDC_MAX ||
+               (final && len == 0 && p->filled > p->start)) {
+            long long w = chunkFlush(v, p, cdc_cut(p->block + p->start,
+                                                   p->filled - p->start));
+            if (w < 0) return -1;
+            written += w;
+        }
+        if (len == 0) return written;
+
+        /* under CDC_MAX left uncut: move it down to make room */
+        memmove(p->block, p->block + p->start, p->filled - p->start);
+        p->filled -= p->start;
+        p->start   = 0;
+    }
+}
+
+/* the index change of the re-packing append e, whose blocks end
+ * filename (open as fd under its file lock): the words of its new bytes,
+ * past the kept ones, are taken out (undo) or counted again (redo) just
+ * as the append counted them. Where that cannot be done the file is
+ * reset, to be indexed afresh; its index must not end inside a block. */
+static void indexRepacked(VaultCtx *v, const char *filename, int fd,
+                          const UndoEntry *e, int add) {
+    unsigned char sk[SEARCH_KEY_LEN];
+    int           unlocked = fileSearchKey(v, filename, sk);
+    uint64_t      kept     = e->preSize + e->keptLen;
+    uint64_t      end      = e->preSize + e->length;
+
+    pthread_mutex_lock(&v->searchLock);
+    SearchIndex *s       = unlocked ? searchIndex(v) : v->search;
+    uint64_t     indexed = s ? search_indexed(s, filename) : 0;
+    pthread_mutex_unlock(&v->searchLock);
+
+    int rc = !s || (!add && indexed <= e->preSize) ? 0 : -1;
+    if (unlocked && s && indexed == (add ? kept : end)) {
+        SearchBuilder words;
+        search_builderInit(&words, sk);
+        long long plain = plainSize(fd, (off_t)e->preSize);
+        RangeSink sink  = { (uint64_t)plain, (uint64_t)plain + e->keep, UINT64_MAX,
+                            feedWords, &words, 0 };
+        if (plain >= 0 &&
+            readPlain(v, filename, fd, e->preSize, end, (uint64_t)plain,
+                      rangeChunk, &sink) == 0) {
+            search_builderFinish(&words);
+            pthread_mutex_lock(&v->searchLock);
+            rc = add ? search_add(s, filename, kept, end, &words)
+                     : search_remove(s, filename, kept, end, &words);
+            pthread_mutex_unlock(&v->searchLock);
+        }
+        search_builderFree(&words);
+    }
+    if (rc != 0) {
+        pthread_mutex_lock(&v->searchLock);
+        search_reset(s, filename);
+        pthread_mutex_unlock(&v->searchLock);
+    }
+    memset(sk, 0, sizeof(sk));
+}
+
+/* undoes the re-packing append e, whose bytes end filename (open as fd
+ * under its file lock): the plaintext it kept is read back out of its
+ * first block and sealed alone, and replaces the append's blocks once
+ * those are safe in the redo blob. The compressor is deterministic, so
+ * sealing the block the way it was comes to the same length and the
+ * entries below still match the file. returns 1, -1, or -3 if the file
+ * is not unlocked; caller holds undoLock */
+static int undoRepacked(VaultCtx *v, const char *filename, int fd,
+                        const UndoEntry *e) {
+    unsigned char key[CIPHER_KEY_LEN];
+    if (e->keep >= FRAME_BLOCK_MAX) return -1;
+    if (!fileKey(v, filename, key)) return -3;
+
+    long long      plain = plainSize(fd, (off_t)e->preSize);
+    Collector      kept  = { (char *)malloc((size_t)e->keep), 0, (size_t)e->keep };
+    unsigned char *frame = (unsigned char *)malloc(SEAL_CHUNK + FRAME_OVERHEAD);
+    size_t         out   = 0;
+    int            rc    = -1;
+    if (plain >= 0 && kept.buf && frame &&
+        readPlain(v, filename, fd, e->preSize, e->preSize + e->length,
+                  (uint64_t)plain, collectChunk, &kept) >= 0 &&
+        kept.len == kept.cap) {
+        uint64_t end = (uint64_t)plain + kept.len;
+        out = frame_sealBlock(key, end, kept.buf, kept.len, frame);
+        if (out != e->keptLen)   /* it was a plain frame */
+            out = frame_seal(key, end, kept.buf, kept.len, frame);
+    }
+
+    if (out > 0 && out == e->keptLen) {
+        indexRepacked(v, filename, fd, e, 0);
+        if (undolog_commitUndo(&v->undoLog, filename, fd) == 0 &&
+            ftruncate(fd, (off_t)e->preSize) == 0 &&
+            lseek(fd, (off_t)e->preSize, SEEK_SET) >= 0 &&
+            writeAll(fd, frame, out) == 0)
+            rc = 1;
+        blockTrim(v, filename, e->preSize);
+        indexGap(v, filename, fd);
+    }
+
+    free(kept.buf);
+    free(frame);
+    memset(key, 0, sizeof(key));
+    return rc;
+}
+
+/* ---------- helper: line index ---------- */
+
+/*
+ * Lines are found through the marks of the file's block map: every
+ * LINE_STRIDE-th newline is remembered, so reaching any line decrypts at
+ * most one stride of text past a mark, and the frames holding it are
+ * found through the map. Appends count the newlines of their new bytes
+ * as they write them when the marks reach the old end of the file;
+ * otherwise the marks are extended only as far as a lookup needs. Undo
+ * drops the marks past the new end. The last lines are found without the
+ * marks, by reading frames backwards from the end.
+ */
+
+/* the most plaintext one frame holds, packed or not */
+#define FRAME_PLAIN_MAX (FRAME_BLOCK_MAX > SEAL_CHUNK ? FRAME_BLOCK_MAX : SEAL_CHUNK)
+
+/* counts newlines in the plaintext handed to it from pos on; with m
+ * set, the count continues m's and records its marks */
+typedef struct {
+    BlockMap *m;
+    uint64_t  pos;      /* plaintext offset of the next byte */
+    uint64_t  lines;    /* newlines before pos */
+    uint64_t  want;     /* stop just past this many newlines */
+    int       failed;   /* out of memory for a mark */
+} LineScan;
+
+static int pushMark(BlockMap *m, uint64_t at) {
+    if (m->marks == m->markCap) {
+        int       cap  = m->markCap ? m->markCap * 2 : 64;
+        uint64_t *mark = (uint64_t *)realloc(m->mark, sizeof(uint64_t) * (size_t)cap);
+        if (!mark) return -1;
+        m->mark    = mark;
+        m->markCap = cap;
+    }
+    m->mark[m->marks++] = at;
+    return 0;
+}
+
+static int lineChunk(void *ctx, const char *data, size_t len) {
+    LineScan   *s   = (LineScan *)ctx;
+    const char *p   = data;
+    const char *end = data + len;
+    const char *nl;
+    while (s->lines < s->want &&
+           (nl = (const char *)memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        p = nl + 1;
+        s->lines++;
+        if (s->m && s->lines % LINE_STRIDE == 0 &&
+            pushMark(s->m, s->pos + (uint64_t)(p - data)) != 0) {
+            linesReset(s->m);
+            s->failed = 1;
+            return 1;
+        }
+    }
+    int done = s->lines == s->want;
+    s->pos += (uint64_t)((done ? p : end) - data);
+    if (s->m) {
+        s->m->scanned = s->pos;
+        s->m->lines   = s->lines;
+    }
+    return done;
+}
+
+/* the scan continuing the marks of filename from plaintext offset plain,
+ * for an append under its file lock; NULL when the marks stop short of
+ * plain (or belong to another file) and the new bytes can be left to the
+ * next lookup */
+static BlockMap *linesAt(VaultCtx *v, const char *filename, uint64_t plain) {
+    BlockMap *m = mapSlot(v, filename);
+    if (!m->name || strcmp(m->name, filename) != 0 || m->scanned != plain) return NULL;
+    return m;
+}
+
+/* drops the marks past the plaintext that filename, open as fd under its
+ * file lock, now holds */
+static void linesCut(VaultCtx *v, const char *filename, int fd) {
+    BlockMap *m = mapSlot(v, filename);
+    if (!m->name || strcmp(m->name, filename) != 0) return;
+
+    struct stat st;
+    long long   plain = fstat(fd, &st) == 0 ? plainSize(fd, st.st_size) : -1;
+    if (plain < 0) {
+        linesReset(m);
+        return;
+    }
+    if ((uint64_t)plain >= m->scanned) return;
+    while (m->marks > 0 && m->mark[m->marks - 1] > (uint64_t)plain) m->marks--;
+    m->scanned = m->marks > 0 ? m->mark[m->marks - 1] : 0;
+    m->lines   = (uint64_t)m->marks * LINE_STRIDE;
+}
+
+/* where line (counted from 1) of filename starts: just past its
+ * line - 1'th newline, or at the end of the plaintext if there are not
+ * that many. fd and the map m are held under the file lock. A line past
+ * the marks is reached by extending them. returns 0 or -1 */
+static int lineStart(VaultCtx *v, const char *filename, int fd, BlockMap *m,
+                     uint64_t line, uint64_t *at) {
+    uint64_t total = m->count > 0 ? m->end[m->count - 1] : 0;
+    LineScan s     = { NULL, 0, 0, line - 1, 0 };
+    if (s.want <= m->lines) {
+        uint64_t k = s.want / LINE_STRIDE;
+        s.pos   = k > 0 ? m->mark[k - 1] : 0;
+        s.lines = k * LINE_STRIDE;
+    } else {
+        s.m     = m;
+        s.pos   = m->scanned;
+        s.lines = m->lines;
+    }
+
+    if (s.lines < s.want && s.pos < total) {
+        int       f     = blockAt(m, s.pos);
+        uint64_t  plain = f > 0 ? m->end[f - 1] : 0;
+        RangeSink sink  = { plain, s.pos, total, lineChunk, &s, 0 };
+        if (readPlain(v, filename, fd, m->start[f], m->mapped, plain,
+                      rangeChunk, &sink) < 0 || s.failed) {
+            if (s.m) linesReset(m);
+            return -1;
+        }
+    }
+    *at = s.lines == s.want ? s.pos : total;
+    return 0;
+}
+
+/* where the last count lines of filename start, a final newline not
+ * ending a line of its own, found by reading its frames from the last
+ * one back. returns 0 or -1 */
+static int tailStart(VaultCtx *v, const char *filename, int fd,
+                     const BlockMap *m, uint64_t count, uint64_t *at) {
+    uint64_t total = m->count > 0 ? m->end[m->count - 1] : 0;
+    uint64_t seen  = 0;
+    char    *buf   = (char *)malloc(FRAME_PLAIN_MAX);
+    int      rc    = buf ? 0 : -1;
+
+    *at = 0;   /* fewer lines than asked for: all of them */
+    for (int f = m->count - 1; rc == 0 && f >= 0; f--) {
+        uint64_t  plain = f > 0 ? m->end[f - 1] : 0;
+        uint64_t  stop  = f + 1 < m->count ? m->start[f + 1] : m->mapped;
+        Collector c     = { buf, 0, (size_t)(m->end[f] - plain) };
+        if (c.cap > FRAME_PLAIN_MAX ||
+            readPlain(v, filename, fd, m->start[f], stop, plain, collectChunk, &c) < 0 ||
+            c.len != c.cap) {
+            rc = -1;
+            break;
+        }
+
+        for (size_t i = c.len; i-- > 0; ) {
+            if (buf[i] != '\n' || plain + i + 1 == total) continue;
+            if (++seen == count) {
+                *at = plain + i + 1;
+                break;
+            }
+        }
+        if (seen == count) break;
+    }
+    free(buf);
+    return rc;
+}
+
+/* ---------- helper: content cache ---------- */
+
+/*
+ * Whole plaintexts of files read through vault_readFile stay in
+ * v->cache (filecache.h), so viewing a file again reads and decrypts
+ * nothing. Appends extend the entry and undo trims it, under the file
+ * lock, comparing the file's stamp before the change with the entry's;
+ * redo drops it. Changes made outside fv come in as inotify events, and
+ * an entry they touched is only used again if the file's stamp still
+ * matches; the cache watches the store directories the files are in.
+ * Hits need the file unlocked, like any read.
+ */
+
+/* returns a blob of the file's first *len plaintext bytes, to release,
+ * or NULL */
+static CacheBlob *cacheGet(VaultCtx *v, const char *filename, size_t *len) {
+    CacheStamp stamp;
+    int        checked;
+    pthread_mutex_lock(&v->cacheLock);
+    CacheBlob *b = filecache_get(v->cache, filename, len, &stamp, &checked);
+    int        on = filecache_limit(v->cache) > 0;
+    pthread_mutex_unlock(&v->cacheLock);
+    if (!b) {
+        if (on) stats_count(STAT_CACHE_MISSES, 1);
+        return NULL;
+    }
+    if (!checked) {
+        char        where[FANOUT_PATH_LEN];
+        struct stat st;
+        CacheStamp  now;
+        fanout_path(filename, where);
+        int same = fstatat(v->storeFd, where, &st, 0) == 0;
+        if (same) {
+            filecache_stamp(&st, &now);
+            same = filecache_sameStamp(&now, &stamp);
+        }
+        pthread_mutex_lock(&v->cacheLock);
+        if (same) filecache_confirm(v->cache, filename, b);
+        else      filecache_drop(v->cache, filename, b);
+        pthread_mutex_unlock(&v->cacheLock);
+        if (!same) {
+            filecache_release(b);
+            stats_count(STAT_CACHE_MISSES, 1);
+            return NULL;
+        }
+    }
+    stats_count(STAT_CACHE_HITS, 1);
+    return b;
+}
+
+/* hands fn the bytes [from, to) of b. returns 0, or 1 if stopped by fn */
+static int cacheServe(const CacheBlob *b, size_t from, size_t to,
+                      ModelChunkFn fn, void *ctx) {
+    while (from < to) {
+        size_t n = to - from < MODEL_CHUNK_SIZE ? to - from : MODEL_CHUNK_SIZE;
+        if (fn(ctx, b->data + from, n) != 0) return 1;
+        from += n;
+    }
+    return 0;
+}
+
+static size_t cacheLimit(VaultCtx *v) {
+    pthread_mutex_lock(&v->cacheLock);
+    size_t limit = filecache_limit(v->cache);
+    pthread_mutex_unlock(&v->cacheLock);
+    return limit;
+}
+
+/* copies what a whole read hands out, as long as it fits */
+typedef struct {
+    ModelChunkFn fn;
+    void        *ctx;
+    CacheBlob   *copy;
+    size_t       limit;   /* 0 = not copying */
+} CacheTee;
+
+static int teeChunk(void *ctx, const char *data, size_t len) {
+    CacheTee *t = (CacheTee *)ctx;
+    if (t->limit > 0 && !(t->copy = filecache_blobAppend(t->copy, data, len, t->limit)))
+        t->limit = 0;
+    return t->fn(t->ctx, data, len);
+}
+
+/* keeps copy as the contents of filename as it was at st; the first
+ * hit checks the stamp, in case an append raced with the read */
+static void cachePut(VaultCtx *v, const char *filename, const struct stat *st,
+                     CacheBlob *copy) {
+    char       where[FANOUT_PATH_LEN];
+    CacheStamp stamp;
+    fanout_path(filename, where);
+    filecache_stamp(st, &stamp);
+    pthread_mutex_lock(&v->cacheLock);
+    filecache_put(v->cache, filename, where, &stamp, copy);
+    pthread_mutex_unlock(&v->cacheLock);
+}
+
+/* caller holds the file lock, and st was taken under it: returns how
+ * many bytes an append may collect to extend the entry, 0 if there is
+ * no entry for the file as it is */
+static size_t cacheFollows(VaultCtx *v, const char *filename, const struct stat *st) {
+    CacheStamp stamp;
+    filecache_stamp(st, &stamp);
+    pthread_mutex_lock(&v->cacheLock);
+    size_t limit = filecache_holds(v->cache, filename, &stamp) ?
+                   filecache_limit(v->cache) : 0;
+    pthread_mutex_unlock(&v->cacheLock);
+    return limit;
+}
+
+/* caller holds the file lock: fd grew from was by added (NULL if not
+ * collected), which goes onto the entry */
+static void cacheGrew(VaultCtx *v, const char *filename, int fd,
+                      const struct stat *was, CacheBlob *added) {
+    struct stat st;
+    CacheStamp  before, after;
+    filecache_stamp(was, &before);
+    int known = added && fstat(fd, &st) == 0;
+    if (known) filecache_stamp(&st, &after);
+
+    pthread_mutex_lock(&v->cacheLock);
+    if (known)
+        filecache_extend(v->cache, filename, &before, added->data, added->len, &after);
+    else
+        filecache_drop(v->cache, filename, NULL);
+    pthread_mutex_unlock(&v->cacheLock);
+    filecache_release(added);
+}
+
+/* caller holds the file lock: fd was cut back from was */
+static void cacheCut(VaultCtx *v, const char *filename, int fd, const struct stat *was) {
+    struct stat st;
+    CacheStamp  before, after;
+    long long   plain = fstat(fd, &st) == 0 ? plainSize(fd, st.st_size) : -1;
+    filecache_stamp(was, &before);
+    if (plain >= 0) filecache_stamp(&st, &after);
+
+    pthread_mutex_lock(&v->cacheLock);
+    if (plain >= 0)
+        filecache_trim(v->cache, filename, &before, (size_t)plain, &after);
+    else
+        filecache_drop(v->cache, filename, NULL);
+    pthread_mutex_unlock(&v->cacheLock);
+}
+
+static void cacheDrop(VaultCtx *v, const char *filename) {
+    pthread_mutex_lock(&v->cacheLock);
+    filecache_drop(v->cache, filename, NULL);
+    pthread_mutex_unlock(&v->cacheLock);
+}
+
+/* ---------- helper: password checks ---------- */
+
+static void sessionTag(const VaultCtx *v, const char *password,
+                       unsigned char tag[KDF_DIGEST_LEN]) {
+    hmac_sha256(v->sessionKey, sizeof(v->sessionKey),
+                password, strlen(password), tag);
+}
+
+/* the SESSION_WAYS slots name can live in, most recently stored first */
+static SessionSlot *sessionSet(VaultCtx *v, uint32_t hash) {
+    return &v->sessions[(hash & (SESSION_SETS - 1)) * SESSION_WAYS];
+}
+
+static int sessionWay(const SessionSlot *set, uint32_t hash,
+                      const char *filename) {
+    for (int w = 0; w < SESSION_WAYS; w++) {
+        if (set[w].name && set[w].nameHash == hash &&
+            strcmp(set[w].name, filename) == 0)
+            return w;
+    }
+    return -1;
+}
+
+static int sessionLookup(VaultCtx *v, const char *filename,
+                         const unsigned char tag[KDF_DIGEST_LEN]) {
+    uint32_t hash = hashindex_hash(filename);
+    pthread_mutex_lock(&v->sessionLock);
+    SessionSlot *set = sessionSet(v, hash);
+    int w   = sessionWay(set, hash, filename);
+    int hit = w >= 0 && kdf_equal(set[w].tag, tag, KDF_DIGEST_LEN);
+    pthread_mutex_unlock(&v->sessionLock);
+    return hit;
+}
+
+/* remember a successful unlock, unless the password changed since gen */
+static void sessionStore(VaultCtx *v, const char *filename,
+                         const unsigned char tag[KDF_DIGEST_LEN], uint64_t gen) {
+    uint32_t hash = hashindex_hash(filename);
+    char    *name = strdup(filename);
+    if (!name) return;
+
+    pthread_mutex_lock(&v->sessionLock);
+    if (gen == v->secretGen) {
+        SessionSlot *set = sessionSet(v, hash);
+        int w = sessionWay(set, hash, filename);
+        if (w < 0) w = SESSION_WAYS - 1;   /* evict the oldest */
+
+        free(set[w].name);
+        memmove(set + 1, set, sizeof(SessionSlot) * (size_t)w);
+        set[0].nameHash = hash;
+        set[0].name     = name;
+        memcpy(set[0].tag, tag, KDF_DIGEST_LEN);
+        name = NULL;
+    }
+    pthread_mutex_unlock(&v->sessionLock);
+    free(name);
+}
+
+/* caller holds vaultLock exclusively */
+static void sessionForget(VaultCtx *v, const char *filename) {
+    uint32_t hash = hashindex_hash(filename);
+    pthread_mutex_lock(&v->sessionLock);
+    v->secretGen++;
+    SessionSlot *set = sessionSet(v, hash);
+    int w = sessionWay(set, hash, filename);
+    if (w >= 0) {
+        free(set[w].name);
+        set[w].name = NULL;
+    }
+    pthread_mutex_unlock(&v->sessionLock);
+}
+
+/* copies the stored secret out from under vaultLock so the slow check
+ * runs unlocked. returns the copy (caller frees) or NULL if not found */
+static char *loadSecret(VaultCtx *v, const char *filename, uint64_t *gen) {
+    pthread_rwlock_rdlock(&v->vaultLock);
+    const char *found  = findSecret(v, filename);
+    char       *stored = found ? strdup(found) : NULL;
+    *gen = v->secretGen;
+    pthread_rwlock_unlock(&v->vaultLock);
+    return stored;
+}
+
+/* 1 = password matches stored (keyed, hashed, or legacy plaintext),
+ * else 0. On a match the file's data key is kept, sealing a legacy file
+ * first; only then is the session remembered. */
+static int checkSecret(VaultCtx *v, const char *filename, const char *password,
+                       const char *stored, uint64_t gen) {
+    unsigned char tag[KDF_DIGEST_LEN];
+    sessionTag(v, password, tag);
+    if (sessionLookup(v, filename, tag)) {
+        atomic_fetch_add(&v->sessionHits, 1);
+        stats_count(STAT_SESSION_HITS, 1);
+        return 1;
+    }
+    atomic_fetch_add(&v->sessionMisses, 1);
+    stats_count(STAT_SESSION_MISSES, 1);
+
+    unsigned char key[CIPHER_KEY_LEN];
+    int    ok, unlocked;
+    int    pending = sealPending(stored);
+    size_t mark    = pending ? sizeof(SEAL_PENDING) - 1 : 0;
+    if (kdf_hasKey(stored + mark)) {
+        ok       = kdf_unlock(password, stored + mark, key);
+        unlocked = ok && keepKey(v, filename, key, pending) == 0;
+    } else {
+        ok = kdf_isHashed(stored) ? kdf_verify(password, stored)
+                                  : strcmp(stored, password) == 0;
+        unlocked = ok && sealLegacy(v, filename, password, stored) == 0;
+    }
+    if (unlocked) {
+        fileUnlocked(v, filename);
+        sessionStore(v, filename, tag, gen);
+    }
+    memset(key, 0, sizeof(key));
+    return ok;
+}
+
+/* ---------- helper: storage layout ---------- */
+
+/*
+ * Files live in vault.store (fanout.h). Vaults from before it kept each
+ * file in the vault directory under its own name; the first open moves
+ * them in, by a hard link into the store and then an unlink, so a crash
+ * anywhere leaves every file reachable, and the next open carries on.
+ * STORE_READY, written and synced last, marks the move done. Names
+ * that are the vault's own files are left where they are: such a file
+ * never held the user's data.
+ */
+#define STORE_READY ".layout"
+
+/*
+ * Bulk moves write their files under BULK_DIR in the store, as
+ * "<pid>-<serial>-<index>", until they are committed; no name maps
+ * there. Those of a process no longer running are removed at open.
+ */
+#define BULK_DIR     ".bulk"
+#define BULK_TMP_LEN (sizeof(BULK_DIR) + 3 * 20 + 3)
+
+static const char *const ownFiles[] = {
+    INDEX_PATH, INDEX_TMP_PATH, LEGACY_PATH, LEGACY_DONE_PATH, JOURNAL_PATH,
+    JOURNAL_OLD_PATH, UNDO_LOG_PATH, UNDO_BLOB_PATH, RECENT_PATH, RECENT_TMP_PATH,
+    SEARCH_PATH, SEARCH_LOG_PATH, CHUNKS_PATH, CHUNKS_LOG_PATH, SUMS_PATH,
+    SUMS_TMP_PATH, FANOUT_ROOT, HISTORY_ROOT,
+};
+
+/* moves the flat file name into the store at path. returns 0 (also
+ * when there is none), or -1 */
+static int moveFlat(VaultCtx *v, const char *name, const char *path) {
+    for (size_t i = 0; i < sizeof(ownFiles) / sizeof(ownFiles[0]); i++)
+        if (strcmp(name, ownFiles[i]) == 0) return 0;
+
+    struct stat flat, kept;
+    if (fstatat(v->dirFd, name, &flat, AT_SYMLINK_NOFOLLOW) != 0)
+        return errno == ENOENT ? 0 : -1;   /* never created, or moved before */
+    if (fanout_makeDirs(v->storeFd, path) != 0) return -1;
+    if (linkat(v->dirFd, name, v->storeFd, path, 0) != 0) {
+        /* linked before a crash, not yet unlinked */
+        if (errno != EEXIST || fstatat(v->storeFd, path, &kept, AT_SYMLINK_NOFOLLOW) != 0 ||
+            flat.st_dev != kept.st_dev || flat.st_ino != kept.st_ino)
+            return -1;
+    }
+    fanout_syncDir(v->storeFd, path);
+    return unlinkat(v->dirFd, name, 0);
+}
+
+/* moves name into the store, and the sealed copy a seal cut short left
+ * next to it: only while its secret says a seal is pending, and never a
+ * file of the vault's own that merely has the copy's name */
+static int moveFlatNamed(VaultCtx *v, const char *name, const char *secret) {
+    char path[FANOUT_PATH_LEN], tmp[SEAL_PATH_LEN];
+    fanout_path(name, path);
+    if (moveFlat(v, name, path) != 0) return -1;
+    if (!sealPending(secret)) return 0;
+
+    char *flat = (char *)malloc(strlen(name) + sizeof(SEAL_SUFFIX));
+    if (!flat) return -1;
+    sprintf(flat, "%s" SEAL_SUFFIX, name);
+    sealPath(name, tmp);
+    int rc = findSecret(v, flat) ? 0 : moveFlat(v, flat, tmp);
+    free(flat);
+    return rc;
+}
+
+/* removes the files bulk moves cut short left in BULK_DIR */
+static void clearBulk(VaultCtx *v) {
+    int fd = openat(v->storeFd, BULK_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!d) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        long pid = strtol(e->d_name, NULL, 10);
+        if (pid > 0 && (pid == (long)getpid() || kill((pid_t)pid, 0) == 0 || errno == EPERM))
+            continue;   /* still being written */
+        unlinkat(dirfd(d), e->d_name, 0);
+    }
+    closedir(d);
+}
+
+/* opens vault.store, moving the files of a flat vault into it the first
+ * time. returns 0 or -1 */
+static int openStore(VaultCtx *v) {
+    if (mkdirat(v->dirFd, FANOUT_ROOT, 0700) != 0 && errno != EEXIST) return -1;
+    v->storeFd = openat(v->dirFd, FANOUT_ROOT, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (v->storeFd < 0) return -1;
+    clearBulk(v);
+    if (faccessat(v->storeFd, STORE_READY, F_OK, 0) == 0) return 0;
+
+    int ok = 1;
+    for (int i = 0; ok && i < v->vaults.count; i++)
+        ok = moveFlatNamed(v, vtable_name(&v->vaults, i), vtable_secret(&v->vaults, i)) == 0;
+    uint64_t    pos = 0;
+    const char *name, *secret;
+    int         more;
+    while (ok && (more = vindex_next(&v->base, &pos, &name, &secret)) != 0)
+        ok = more > 0 && moveFlatNamed(v, name, findSecret(v, name)) == 0;
+    if (!ok) return -1;
+
+    int fd = openat(v->storeFd, STORE_READY, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || fsync(fd) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    close(fd);
+    fsync(v->storeFd);
+    fsync(v->dirFd);
+    return 0;
+}
+
+/* "dir/name", or just "name" for the current directory */
+static char *joinPath(const char *dir, const char *name) {
+    if (strcmp(dir, ".") == 0) return strdup(name);
+
+    size_t dlen = strlen(dir);
+    while (dlen > 1 && dir[dlen - 1] == '/') dlen--;
+    char *out = (char *)malloc(dlen + 1 + strlen(name) + 1);
+    if (out) sprintf(out, "%.*s/%s", (int)dlen, dir, name);
+    return out;
+}
+
+static void destroyLocks(VaultCtx *v) {
+    pthread_rwlock_destroy(&v->vaultLock);
+    pthread_mutex_destroy(&v->sessionLock);
+    pthread_mutex_destroy(&v->undoLock);
+    pthread_mutex_destroy(&v->recentLock);
+    pthread_mutex_destroy(&v->searchLock);
+    pthread_mutex_destroy(&v->chunkLock);
+    pthread_mutex_destroy(&v->sumLock);
+    pthread_mutex_destroy(&v->cacheLock);
+    pthread_mutex_destroy(&v->fdLock);
+    pthread_mutex_destroy(&v->ioqLock);
+    for (int i = 0; i < FILE_LOCK_STRIPES; i++)
+        pthread_mutex_destroy(&v->fileLocks[i]);
+}
+
+static void freeCtx(VaultCtx *v) {
+    if (v->dirFd >= 0) close(v->dirFd);
+    if (v->storeFd >= 0) close(v->storeFd);
+    if (v->historyFd >= 0) close(v->historyFd);
+    free(v->indexPath);
+    free(v->indexTmpPath);
+    free(v->legacyPath);
+    free(v->legacyDonePath);
+    free(v->journalPath);
+    free(v->journalOldPath);
+    free(v->undoPath);
+    free(v->redoPath);
+    free(v->recentPath);
+    free(v->recentTmpPath);
+    free(v->searchPath);
+    free(v->searchLogPath);
+    free(v->chunksPath);
+    free(v->chunksLogPath);
+    free(v->sumsPath);
+    free(v->sumsTmpPath);
+    free(v);
+}
+
+/* ---------- public: vault handles ---------- */
+
+VaultCtx *model_open(const char *dir) {
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) return NULL;
+
+    VaultCtx *v = (VaultCtx *)calloc(1, sizeof(VaultCtx));
+    if (!v) return NULL;
+    v->dirFd          = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    v->storeFd        = -1;
+    v->historyFd      = -1;
+    v->indexPath      = joinPath(dir, INDEX_PATH);
+    v->indexTmpPath   = joinPath(dir, INDEX_TMP_PATH);
+    v->legacyPath     = joinPath(dir, LEGACY_PATH);
+    v->legacyDonePath = joinPath(dir, LEGACY_DONE_PATH);
+    v->journalPath    = joinPath(dir, JOURNAL_PATH);
+    v->journalOldPath = joinPath(dir, JOURNAL_OLD_PATH);
+    v->undoPath       = joinPath(dir, UNDO_LOG_PATH);
+    v->redoPath       = joinPath(dir, UNDO_BLOB_PATH);
+    v->recentPath     = joinPath(dir, RECENT_PATH);
+    v->recentTmpPath  = joinPath(dir, RECENT_TMP_PATH);
+    v->searchPath     = joinPath(dir, SEARCH_PATH);
+    v->searchLogPath  = joinPath(dir, SEARCH_LOG_PATH);
+    v->chunksPath     = joinPath(dir, CHUNKS_PATH);
+    v->chunksLogPath  = joinPath(dir, CHUNKS_LOG_PATH);
+    v->sumsPath       = joinPath(dir, SUMS_PATH);
+    v->sumsTmpPath    = joinPath(dir, SUMS_TMP_PATH);
+    if (v->dirFd < 0 || !v->indexPath || !v->indexTmpPath ||
+        !v->legacyPath || !v->legacyDonePath ||
+        !v->journalPath || !v->journalOldPath || !v->undoPath || !v->redoPath ||
+        !v->recentPath || !v->recentTmpPath || !v->searchPath || !v->searchLogPath ||
+        !v->chunksPath || !v->chunksLogPath || !v->sumsPath || !v->sumsTmpPath) {
+        freeCtx(v);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&defaultsLock);
+    v->syncMode      = defaultSyncMode;
+    v->syncGroupSize = defaultGroupSize;
+    v->syncGroupMs   = defaultGroupMs;
+    v->kdfCost       = defaultKdfCost;
+    v->compress      = defaultCompress;
+    v->dedup         = defaultDedup;
+    v->asyncIo       = defaultAsyncIo;
+    size_t cacheBytes = defaultCacheBytes;
+    int recentCap    = defaultRecentCap;
+    pthread_mutex_unlock(&defaultsLock);
+    kdf_random(v->sessionKey, sizeof(v->sessionKey));
+
+    pthread_rwlock_init(&v->vaultLock, NULL);
+    pthread_mutex_init(&v->undoLock, NULL);
+    pthread_mutex_init(&v->recentLock, NULL);
+    pthread_mutex_init(&v->sessionLock, NULL);
+    pthread_mutex_init(&v->searchLock, NULL);
+    pthread_mutex_init(&v->chunkLock, NULL);
+    pthread_mutex_init(&v->sumLock, NULL);
+    pthread_mutex_init(&v->cacheLock, NULL);
+    pthread_mutex_init(&v->fdLock, NULL);
+    pthread_mutex_init(&v->ioqLock, NULL);
+    for (int i = 0; i < FILE_LOCK_STRIPES; i++)
+        pthread_mutex_init(&v->fileLocks[i], NULL);
+
+    v->journal.fd = -1;
+    if (loadVault(v) != 0 || openStore(v) != 0) {
+        int err = errno;
+        waitCompaction(v);
+        journal_close(&v->journal);
+        vindex_close(&v->base);
+        vtable_free(&v->vaults);
+        destroyLocks(v);
+        freeCtx(v);
+        errno = err;
+        return NULL;
+    }
+    v->recentLog.fd = -1;
+    loadRecent(v, recentCap);
+    undolog_open(&v->undoLog, v->undoPath, v->redoPath);
+    undolog_setSync(&v->undoLog, v->syncMode, v->syncGroupSize, v->syncGroupMs);
+    char *store = joinPath(dir, FANOUT_ROOT);
+    v->cache = store ? filecache_open(store, cacheBytes) : NULL;   /* NULL: reads go to disk */
+    free(store);
+    v->fds     = fdcache_open(FD_CACHE_SIZE);                         /* NULL: opened every time */
+    v->histFds = fdcache_open(FD_CACHE_SIZE);
+    /* no history where it cannot be kept, as in a read-only vault */
+    if (mkdirat(v->dirFd, HISTORY_ROOT, 0700) == 0 || errno == EEXIST)
+        v->historyFd = openat(v->dirFd, HISTORY_ROOT, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return v;
+}
+
+void model_close(VaultCtx *v) {
+    if (!v) return;
+    waitCompaction(v);
+    journal_close(&v->journal);
+    undolog_close(&v->undoLog);
+    journal_close(&v->recentLog);
+    lru_free(&v->recent);
+    vtable_free(&v->vaults);
+    for (int i = 0; i < SESSION_SLOTS; i++)
+        free(v->sessions[i].name);
+    vindex_close(&v->base);
+    search_close(v->search);
+    chunkstore_close(v->chunks);
+    sumtable_close(v->sums);
+    filecache_close(v->cache);
+    fdcache_close(v->fds);
+    fdcache_close(v->histFds);
+    for (int i = 0; i < v->idleCount; i++)
+        ioq_close(v->idleQueues[i]);
+    freeBlockMaps(v);
+    if (v->keys) memset(v->keys, 0, sizeof(FileKey) * (size_t)v->keyCap);
+    free(v->keys);
+
+    destroyLocks(v);
+    freeCtx(v);
+}
+
+void vault_setSyncPolicy(VaultCtx *v, int mode, int groupSize, int groupMs) {
+    pthread_rwlock_wrlock(&v->vaultLock);
+    pthread_mutex_lock(&v->chunkLock);   /* chunkStore and sumTable read them */
+    pthread_mutex_lock(&v->sumLock);
+    v->syncMode      = mode;
+    v->syncGroupSize = groupSize;
+    v->syncGroupMs   = groupMs;
+    if (v->chunks)
+        chunkstore_setSync(v->chunks, mode, groupSize, groupMs);
+    if (v->sums)
+        sumtable_setSync(v->sums, mode, groupSize, groupMs);
+    pthread_mutex_unlock(&v->sumLock);
+    pthread_mutex_unlock(&v->chunkLock);
+    if (v->journal.fd >= 0)
+        journal_setSync(&v->journal, mode, groupSize, groupMs);
+    pthread_rwlock_unlock(&v->vaultLock);
+
+    pthread_mutex_lock(&v->undoLock);
+    if (v->undoLog.log.fd >= 0)
+        undolog_setSync(&v->undoLog, mode, groupSize, groupMs);
+    pthread_mutex_unlock(&v->undoLock);
+}
+
+void vault_setKdfCost(VaultCtx *v, uint32_t iterations) {
+    pthread_rwlock_wrlock(&v->vaultLock);
+    v->kdfCost = iterations;
+    pthread_rwlock_unlock(&v->vaultLock);
+}
+
+void vault_setCompression(VaultCtx *v, int on) {
+    atomic_store(&v->compress, on != 0);
+}
+
+void vault_setDedup(VaultCtx *v, int on) {
+    atomic_store(&v->dedup, on != 0);
+}
+
+void vault_setCacheSize(VaultCtx *v, size_t bytes) {
+    pthread_mutex_lock(&v->cacheLock);
+    filecache_setBudget(v->cache, bytes);
+    pthread_mutex_unlock(&v->cacheLock);
+}
+
+void vault_setAsyncIo(VaultCtx *v, int on) {
+    atomic_store(&v->asyncIo, on != 0);
+}
+
+void vault_getSessionStats(VaultCtx *v, long *hits, long *misses) {
+    *hits   = atomic_load(&v->sessionHits);
+    *misses = atomic_load(&v->sessionMisses);
+}
+
+/* ---------- public: vault operations ---------- */
+
+int vault_addFile(VaultCtx *v, const char *filename, const char *password) {
+    if (strlen(filename) >= MAX_LEN || strlen(password) >= MAX_LEN)
+        return -3; /* name or password too long */
+
+    /* derive before locking: the KDF is the slow part */
+    unsigned char key[CIPHER_KEY_LEN];
+    char          hashed[KDF_ENCODED_MAX];
+    if (kdf_random(key, sizeof(key)) != 0 ||
+        kdf_hashKey(password, v->kdfCost, key, hashed) != 0)
+        return -1;
+
+    pthread_rwlock_wrlock(&v->vaultLock);
+    int rc = 0;
+    if (findSecret(v, filename)) {
+        rc = -2; /* file already exists */
+    } else {
+        int fd = openIn(v, filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC);
+        if (fd < 0) {
+            rc = -3; /* file create error */
+        } else {
+            close(fd);
+            int idx = vtable_put(&v->vaults, filename, hashed);
+            if (idx < 0) {
+                rc = -1; /* out of memory */
+            } else {
+                journalPut(v, idx);
+                setFileKey(v, idx, key);   /* else unlocked on first verify */
+                sumSet(v, filename, 0, 0);
+            }
+        }
+    }
+    pthread_rwlock_unlock(&v->vaultLock);
+    memset(key, 0, sizeof(key));
+    return rc;
+}
+
+int vault_fileExists(VaultCtx *v, const char *filename) {
+    pthread_rwlock_rdlock(&v->vaultLock);
+    int found = findSecret(v, filename) != NULL;
+    pthread_rwlock_unlock(&v->vaultLock);
+    return found;
+}
+
+int vault_verifyPassword(VaultCtx *v, const char *filename, const char *password) {
+    uint64_t gen;
+    char    *stored = loadSecret(v, filename, &gen);
+    if (!stored) return -1; /* file not found */
+
+    int rc = checkSecret(v, filename, password, stored, gen);
+    free(stored);
+    return rc;
+}
+
+int vault_changePassword(VaultCtx *v,
+                         const char *filename,
+                         const char *oldPwd,
+                         const char *newPwd) {
+    if (strlen(newPwd) >= MAX_LEN)
+        return -3; /* new password rejected */
+
+    char hashed[KDF_ENCODED_MAX] = "";
+    for (;;) {
+        uint64_t gen;
+        char    *stored = loadSecret(v, filename, &gen);
+        if (!stored) return -1; /* file not found */
+        if (!checkSecret(v, filename, oldPwd, stored, gen)) {
+            free(stored);
+            return -2; /* wrong current password */
+        }
+
+        /* same data key, wrapped under the new password */
+        unsigned char key[CIPHER_KEY_LEN];
+        int wrapped = hashed[0] != '\0' ||
+                      (fileKey(v, filename, key) &&
+                       kdf_hashKey(newPwd, v->kdfCost, key, hashed) == 0);
+        memset(key, 0, sizeof(key));
+        if (!wrapped) {
+            free(stored);
+            return -3; /* key not available */
+        }
+
+        pthread_rwlock_wrlock(&v->vaultLock);
+        int rc  = 0;
+        const char *now = findSecret(v, filename);
+        int         idx = -1;
+        if (!now) {
+            rc = -1; /* file not found */
+        } else if (strcmp(now, stored) != 0) {
+            rc = 1; /* changed while we were checking; check again */
+        } else if ((idx = tableId(v, filename)) < 0 ||
+                   vtable_setSecret(&v->vaults, idx, hashed) != 0) {
+            rc = -3; /* new password rejected */
+        } else {
+            journalPut(v, idx);
+            sessionForget(v, filename);
+        }
+        pthread_rwlock_unlock(&v->vaultLock);
+        free(stored);
+        if (rc != 1) return rc;
+    }
+}
+
+/* ---------- public: file content ---------- */
+
+char *vault_getFileContents(VaultCtx *v, const char *filename) {
+    long long size = vault_getFileSize(v, filename);
+    if (size < 0) return NULL;
+
+    Collector c = { (char *)malloc((size_t)size + 1), 0, (size_t)size };
+    if (!c.buf) return NULL;
+    if (size > 0 && vault_readFile(v, filename, collectChunk, &c) < 0) {
+        free(c.buf);
+        return NULL;
+    }
+    c.buf[c.len] = '\0';
+    return c.buf;
+}
+
+long long vault_getFileSize(VaultCtx *v, const char *filename) {
+    unsigned char key[CIPHER_KEY_LEN];
+    if (!fileKey(v, filename, key)) return -1;
+    memset(key, 0, sizeof(key));
+
+    size_t     len;
+    CacheBlob *hit = cacheGet(v, filename, &len);
+    if (hit) {
+        filecache_release(hit);
+        return (long long)len;
+    }
+
+    struct stat st;
+    int         fd = fileOpen(v, filename, 0, &st);
+    if (fd < 0) return -1;
+    long long size = plainSize(fd, st.st_size);
+    fileClose(v, fd);
+    return size;
+}
+
+/* with compression on, appends rewrite a file's tail in place, so reads
+ * must not overlap them; returns the lock taken, or NULL */
+static pthread_mutex_t *lockForRead(VaultCtx *v, const char *filename) {
+    if (!atomic_load(&v->compress)) return NULL;
+    pthread_mutex_t *lock = fileLock(v, filename);
+    pthread_mutex_lock(lock);
+    return lock;
+}
+
+static void unlockRead(pthread_mutex_t *lock) {
+    if (lock) pthread_mutex_unlock(lock);
+}
+
+int vault_readFile(VaultCtx *v, const char *filename, ModelChunkFn fn, void *ctx) {
+    unsigned char key[CIPHER_KEY_LEN];
+    if (!fileKey(v, filename, key)) return -1;
+    memset(key, 0, sizeof(key));
+
+    size_t     len;
+    CacheBlob *hit = cacheGet(v, filename, &len);
+    if (hit) {
+        int rc = cacheServe(hit, 0, len, fn, ctx);
+        filecache_release(hit);
+        return rc;
+    }
+
+    /* a miss reads the file as before, keeping a copy if it fits */
+    CacheTee tee = { fn, ctx, NULL, cacheLimit(v) };
+    Opener   o;
+    if (openerInit(v, filename, &o, teeChunk, &tee) != 0) return -1;
+    pthread_mutex_t *lock = lockForRead(v, filename);
+    struct stat      st;
+    int              fd = fileOpen(v, filename, 0, &st);
+    char            *in = (char *)malloc((size_t)READ_AHEAD * MODEL_CHUNK_SIZE);
+    IoQueue         *q  = fd >= 0 && in ? queueTake(v) : NULL;
+    if (!q) {
+        fileClose(v, fd);
+        unlockRead(lock);
+        free(in);
+        openerFree(&o);
+        return -1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    /* the last frame says how much plaintext there is: collect into one
+     * allocation of that size, or not at all if it would not be kept */
+    long long plain = tee.limit > 0 ? plainSize(fd, st.st_size) : -1;
+    if (plain > 0 && (uint64_t)plain <= tee.limit)
+        tee.copy = filecache_blobNew((size_t)plain);
+    else
+        tee.limit = 0;
+
+    OpenerSink sink = { &o, 0 };
+    int        rc   = streamIn(q, fd, 0, (uint64_t)st.st_size, in, openerChunk, &sink);
+    if (rc == -2) {
+        in = NULL;   /* still the kernel's: never freed */
+        rc = -1;
+    }
+    if (rc == 1) rc = sink.rc;
+    if (rc == 0) rc = openerFinish(&o);
+
+    queueGive(v, q);
+    free(in);
+    openerFree(&o);
+    fileClose(v, fd);
+    unlockRead(lock);
+    /* complete even if fn stopped at the very end, as collectors do */
+    if (rc >= 0 && tee.copy && tee.copy->len == (uint64_t)plain)
+        cachePut(v, filename, &st, tee.copy);
+    else
+        filecache_release(tee.copy);
+    return rc;
+}
+
+int vault_mapFile(VaultCtx *v, const char *filename, ModelChunkFn fn, void *ctx) {
+    Opener o;
+    if (openerInit(v, filename, &o, fn, ctx) != 0) return -1;
+    pthread_mutex_t *lock = lockForRead(v, filename);
+    struct stat      st;
+    int              fd = fileOpen(v, filename, 0, &st);
+    if (fd < 0) {
+        unlockRead(lock);
+        openerFree(&o);
+        return -1;
+    }
+
+    /* map a bounded window at a time so address space stays constant;
+     * frames may straddle windows, the opener carries them over */
+    int   rc   = 0;
+    off_t size = st.st_size;
+    for (off_t base = 0; base < size && rc == 0; base += MODEL_MAP_WINDOW) {
+        size_t len = (size_t)(size - base < MODEL_MAP_WINDOW ?
+                              size - base : MODEL_MAP_WINDOW);
+        char *map = (char *)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, base);
+        if (map == MAP_FAILED) {
+            rc = -1;
+            break;
+        }
+        madvise(map, len, MADV_SEQUENTIAL);
+        stats_count(STAT_BYTES_READ, len);
+        rc = openerFeed(&o, map, len);
+        munmap(map, len);
+    }
+    if (rc == 0) rc = openerFinish(&o);
+
+    openerFree(&o);
+    fileClose(v, fd);
+    unlockRead(lock);
+    return rc;
+}
+
+int vault_readRange(VaultCtx *v, const char *filename, long long offset,
+                    long long length, ModelChunkFn fn, void *ctx) {
+    unsigned char key[CIPHER_KEY_LEN];
+    if (offset < 0 || length < 0 || !fileKey(v, filename, key)) return -1;
+    memset(key, 0, sizeof(key));
+
+    size_t     len;
+    CacheBlob *hit = cacheGet(v, filename, &len);
+    if (hit) {
+        size_t from = (uint64_t)offset < len ? (size_t)offset : len;
+        size_t to   = (uint64_t)length < len - from ? from + (size_t)length : len;
+        int    rc   = cacheServe(hit, from, to, fn, ctx);
+        filecache_release(hit);
+        return rc;
+    }
+
+    /* the map and the tail it describes only hold under the file lock */
+    pthread_mutex_t *lock = fileLock(v, filename);
+    pthread_mutex_lock(lock);
+    struct stat st;
+    int       fd = fileOpen(v, filename, 0, &st);
+    BlockMap *m  = fd >= 0 ? blockMap(v, filename, fd) : NULL;
+    int       rc = m ? 0 : -1;
+    uint64_t  total = m && m->count > 0 ? m->end[m->count - 1] : 0;
+    if (m && (uint64_t)offset < total && length > 0) {
+        uint64_t from  = (uint64_t)offset;
+        uint64_t to    = (uint64_t)length < total - from ? from + (uint64_t)length : total;
+        int      first = blockAt(m, from);
+        int      last  = blockAt(m, to - 1);
+        uint64_t plain = first > 0 ? m->end[first - 1] : 0;
+        uint64_t stop  = last + 1 < m->count ? m->start[last + 1] : m->mapped;
+
+        RangeSink sink = { plain, from, to, fn, ctx, 0 };
+        rc = readPlain(v, filename, fd, m->start[first], stop, plain, rangeChunk, &sink);
+        if (rc > 0) rc = sink.stopped;
+    }
+    fileClose(v, fd);
+    pthread_mutex_unlock(lock);
+    return rc;
+}
+
+/* lines from first (counted from 1), or the last count lines when first
+ * is 0, as a plaintext range for vault_readRange */
+static int findLines(VaultCtx *v, const char *filename, long long first,
+                     long long count, long long *offset, long long *length) {
+    unsigned char key[CIPHER_KEY_LEN];
+    *offset = *length = 0;
+    if (first < 0 || count < 0 || !fileKey(v, filename, key)) return -1;
+    memset(key, 0, sizeof(key));
+
+    pthread_mutex_t *lock = fileLock(v, filename);
+    pthread_mutex_lock(lock);
+    struct stat st;
+    int       fd = fileOpen(v, filename, 0, &st);
+    BlockMap *m  = fd >= 0 ? blockMap(v, filename, fd) : NULL;
+    int       rc = m ? 0 : -1;
+    uint64_t  total = m && m->count > 0 ? m->end[m->count - 1] : 0;
+    uint64_t  from  = total, to = total;
+    if (m && count > 0 && first == 0) {
+        rc = tailStart(v, filename, fd, m, (uint64_t)count, &from);
+    } else if (m && count > 0) {
+        uint64_t next = (uint64_t)first + (uint64_t)count;
+        rc = lineStart(v, filename, fd, m, (uint64_t)first, &from);
+        if (rc == 0 && from < total)
+            rc = lineStart(v, filename, fd, m, next, &to);
+    }
+    fileClose(v, fd);
+    pthread_mutex_unlock(lock);
+
+    if (rc == 0) {
+        *offset = (long long)from;
+        *length = (long long)(to - from);
+    }
+    return rc;
+}
+
+int vault_findLines(VaultCtx *v, const char *filename, long long first,
+                    long long count, long long *offset, long long *length) {
+    if (first < 1) {
+        *offset = *length = 0;
+        return -1;
+    }
+    return findLines(v, filename, first, count, offset, length);
+}
+
+int vault_findTail(VaultCtx *v, const char *filename, long long count,
+                   long long *offset, long long *length) {
+    return findLines(v, filename, 0, count, offset, length);
+}
+
+typedef struct {
+    int fd;
+    int last;     /* final byte written, or -1 */
+    int failed;
+} FdSink;
+
+static int fdChunk(void *ctx, const char *data, size_t len) {
+    FdSink *sink = (FdSink *)ctx;
+    if (writeAll(sink->fd, data, len) != 0) {
+        sink->failed = 1;
+        return 1;
+    }
+    sink->last = (unsigned char)data[len - 1];
+    return 0;
+}
+
+int vault_sendFile(VaultCtx *v, const char *filename, int outFd, int *lastChar) {
+    /* contents must pass through the cipher, so no sendfile() */
+    FdSink sink = { outFd, -1, 0 };
+    int    rc   = vault_readFile(v, filename, fdChunk, &sink);
+    *lastChar = sink.last;
+    return rc == 0 && !sink.failed ? 0 : -1;
+}
+
+/* appends everything fn produces, as frames, under the file lock, and
+ * records it as a single undo entry and one index change; on any failure
+ * the file is cut back to what it was. With compression on, the new bytes
+ * first fill up the file's last block, which is sealed again; with
+ * deduplication on they go to the chunk store instead. */
+static int appendFrom(VaultCtx *v, const char *filename, ModelSourceFn fn,
+                      void *ctx, long long *appendedLen) {
+    *appendedLen = 0;
+    unsigned char key[CIPHER_KEY_LEN], sk[SEARCH_KEY_LEN];
+    if (!fileKey(v, filename, key) || !fileSearchKey(v, filename, sk))
+        return -1; /* not unlocked */
+    int            dedup  = atomic_load(&v->dedup);
+    int            packed = !dedup && atomic_load(&v->compress);
+    unsigned char *frame  = (unsigned char *)malloc(SEAL_CHUNK + FRAME_OVERHEAD);
+    char          *block  = dedup  ? (char *)malloc(CHUNK_BUF) :
+                            packed ? (char *)malloc(FRAME_BLOCK_MAX) : NULL;
+    if (!frame || ((packed || dedup) && !block)) {
+        free(frame);
+        free(block);
+        return -1;
+    }
+
+    pthread_mutex_t *lock = fileLock(v, filename);
+    pthread_mutex_lock(lock);
+
+    /* an incomplete frame at the end would have the new ones after it */
+    struct stat st;
+    int         fd = fileOpen(v, filename, 1, &st);
+    if (fd < 0 || tailRepair(v, filename, fd, &st) != 0) {
+        fileClose(v, fd);
+        pthread_mutex_unlock(lock);
+        free(frame);
+        free(block);
+        return -1; /* open error */
+    }
+
+    /* only the new bytes are encrypted, continuing the plaintext count;
+     * a re-packed tail is encrypted again from where it started */
+    SearchBuilder words;
+    search_builderInit(&words, sk);
+    SealWriter sw = { fd, NULL, { NULL, NULL }, { 0, 0 }, 0, 0, 0 };
+    long long  plain   = plainSize(fd, st.st_size);
+    long long  written = plain < 0 ? -1 : 0;
+    long long total   = 0;
+    uint32_t   crc     = 0;   /* of the plaintext added, for its version */
+
+    Packer         pk      = { fd, key, block, 0, (uint64_t)plain,
+                               (uint64_t)st.st_size, 0, frame, 0 };
+    unsigned char *tail    = NULL;
+    size_t         tailLen = 0;
+    size_t         keep    = packed && plain >= 0 ?
+        loadTail(v, filename, (uint64_t)st.st_size, &pk, &tail, &tailLen) : 0;
+    LineScan lines = { plain >= 0 ? linesAt(v, filename, (uint64_t)plain) : NULL,
+                       (uint64_t)plain, 0, UINT64_MAX, 0 };
+    if (lines.m) lines.lines = lines.m->lines;
+    CacheBlob *added = NULL;
+    size_t     follow = plain >= 0 ? cacheFollows(v, filename, &st) : 0;
+    while (written >= 0) {
+        const char *data;
+        long n = fn(ctx, &data);
+        if (n <= 0) {
+            if (n < 0) written = -1;
+            break;
+        }
+        search_builderFeed(&words, data, (size_t)n);
+        crc = crc32c(crc, data, (size_t)n);
+        if (lines.m && lineChunk(&lines, data, (size_t)n) != 0) lines.m = NULL;
+        if (follow > 0 && !(added = filecache_blobAppend(added, data, (size_t)n, follow)))
+            follow = 0;
+        /* a second piece of plain frames: worth a queue to overlap them */
+        if (!dedup && !packed && total > 0 && !sw.q) sw.q = queueTake(v);
+        long long w = dedup  ? chunkFeed(v, &pk, data, (size_t)n, 0)
+                    : packed ? packFeed(&pk, data, (size_t)n)
+                             : writerSeal(&sw, key, (uint64_t)(plain + total), data,
+                                          (size_t)n);
+        if (w < 0) {
+            written = -1;
+            break;
+        }
+        written += w;
+        total   += n;
+    }
+    if (dedup && written >= 0 && total > 0) {
+        long long w = chunkFeed(v, &pk, NULL, 0, 1);
+        written = w < 0 ? -1 : written + w;
+    } else if (packed && written >= 0 && pk.filled > 0 && total > 0) {
+        long long w = packFlush(&pk);
+        written = w < 0 ? -1 : written + w;
+    }
+    /* on failure too: nothing may be in flight when the file is cut back */
+    if (written < 0) writerLand(&sw);
+    else if (writerSend(&sw, 1) != 0) written = -1;
+
+    int rc = 0;
+    if (written > 0) {
+        stats_count(STAT_BYTES_WRITTEN, (uint64_t)written);
+        pthread_mutex_lock(&v->undoLock);
+        if (keep > 0)
+            undolog_pushRepack(&v->undoLog, filename, pk.cut, (uint64_t)written,
+                               keep, tailLen);
+        else
+            undolog_pushAppend(&v->undoLog, filename, (uint64_t)st.st_size,
+                               (uint64_t)written);
+        pthread_mutex_unlock(&v->undoLock);
+        blockTrim(v, filename, pk.cut);
+        indexAppend(v, filename, fd, (uint64_t)st.st_size,
+                    pk.cut + (uint64_t)written, &words);
+        sumChange(v, filename, fd, (uint64_t)st.st_size, pk.cut,
+                  keep > 0 ? crc32c(0, tail, tailLen) : 0, pk.cut + (uint64_t)written);
+        cacheGrew(v, filename, fd, &st, added);
+        historyAdd(v, filename, (uint64_t)plain, (uint64_t)total,
+                   history_check(key, (uint64_t)plain, (uint64_t)total, crc));
+        added        = NULL;
+        *appendedLen = total;
+    } else if (written == 0) {
+        rc = -2;   /* the source was empty */
+    } else {
+        rc = -1;   /* read/write error, or not an encrypted file */
+        if (plain >= 0 && (ftruncate(fd, (off_t)pk.cut) != 0 ||
+                           (tail && writeAll(fd, tail, tailLen) != 0))) {
+            /* torn frames left behind; nothing more we can do */
+        }
+        blockTrim(v, filename, pk.cut);
+        linesCut(v, filename, fd);
+        cacheDrop(v, filename);
+    }
+    fileClose(v, fd);
+    pthread_mutex_unlock(lock);
+
+    queueGive(v, sw.q);
+    free(sw.buf[0]);
+    free(sw.buf[1]);
+    filecache_release(added);
+    search_builderFree(&words);
+    free(tail);
+    free(frame);
+    free(block);
+    memset(key, 0, sizeof(key));
+    memset(sk, 0, sizeof(sk));
+    return rc;
+}
+
+typedef struct {
+    const char *text;
+    size_t      len;
+} TextSource;
+
+static long textChunk(void *ctx, const char **data) {
+    TextSource *src = (TextSource *)ctx;
+    long        n   = (long)src->len;
+    *data    = src->text;
+    src->len = 0;
+    return n;
+}
+
+int vault_appendToFile(VaultCtx *v,
+                       const char *filename,
+                       const char *text,
+                       long long *appendedLen) {
+    *appendedLen = 0;
+    if (!text || text[0] == '\0')
+        return -2; /* nothing appended */
+
+    TextSource src = { text, strlen(text) };
+    return appendFrom(v, filename, textChunk, &src, appendedLen);
+}
+
+int vault_appendStream(VaultCtx *v, const char *filename, ModelSourceFn fn,
+                       void *ctx, long long *appendedLen) {
+    return appendFrom(v, filename, fn, ctx, appendedLen);
+}
+
+/* ---------- public: search ---------- */
+
+typedef struct {
+    char     *name;
+    uint64_t  token;
+    long long hits;
+} SearchHit;
+
+static int cmpHits(const void *a, const void *b) {
+    const SearchHit *x = (const SearchHit *)a, *y = (const SearchHit *)b;
+    if (x->hits != y->hits) return x->hits > y->hits ? -1 : 1;
+    return strcmp(x->name, y->name);
 }
 
-static int isEmpty(Queue *q) {
-    return q->count == 0;
+int vault_search(VaultCtx *v, const char *term, ModelSearchFn fn, void *ctx) {
+    char word[SEARCH_TERM_MAX + 1];
+    int  len = search_normalize(term, word);
+    if (len < 0) return -2;
+
+    /* the token differs per file; compute it for every unlocked one */
+    pthread_rwlock_rdlock(&v->vaultLock);
+    int        cap   = v->keyCap < v->vaults.count ? v->keyCap : v->vaults.count;
+    SearchHit *hits  = (SearchHit *)malloc(sizeof(SearchHit) * (size_t)(cap + 1));
+    int        count = 0, ok = hits != NULL;
+    for (int id = 0; ok && id < cap; id++) {
+        if (!v->keys[id].unlocked) continue;
+        hits[count].name  = strdup(vtable_name(&v->vaults, id));
+        hits[count].token = search_token(v->keys[id].searchKey, word, (size_t)len);
+        hits[count].hits  = 0;
+        if (hits[count].name) count++;
+        else ok = 0;
+    }
+    pthread_rwlock_unlock(&v->vaultLock);
+
+    pthread_mutex_lock(&v->searchLock);
+    SearchIndex *s = ok ? searchIndex(v) : NULL;
+    for (int i = 0; s && i < count; i++)
+        hits[i].hits = search_count(s, hits[i].name, hits[i].token);
+    pthread_mutex_unlock(&v->searchLock);
+
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        if (hits[i].hits > 0) hits[found++] = hits[i];
+        else free(hits[i].name);
+    }
+    qsort(hits, (size_t)found, sizeof(SearchHit), cmpHits);
+    for (int i = 0, stop = 0; i < found; i++) {
+        if (!stop && s) stop = fn(ctx, hits[i].name, hits[i].hits);
+        free(hits[i].name);
+    }
+    free(hits);
+    return s ? found : -1;
 }
 
-static int isFull(Queue *q) {
-    return q->count == RECENT_MAX;
+/* ---------- public: integrity ---------- */
+
+#define SCRUB_MAX_THREADS 16
+
+/* checks filename against its sum, recording one if it has none, and
+ * adds the bytes read to *bytes. returns a MODEL_SUM_* code or -1 */
+static int verifyFile(VaultCtx *v, const char *filename, uint64_t *bytes) {
+    if (!vault_fileExists(v, filename)) return -1;
+
+    /* held while reading, so the bytes and the sum belong together */
+    pthread_mutex_t *lock = fileLock(v, filename);
+    pthread_mutex_lock(lock);
+    FileSum now, kept;
+    int     rc = fileSum(v, filename, &now);
+    if (rc == 0) {
+        *bytes += now.size;
+        pthread_mutex_lock(&v->sumLock);
+        SumTable *t = sumTable(v);
+        if (!t)
+            rc = -1;
+        else if (sumtable_get(t, filename, &kept) != 0)
+            rc = sumtable_put(t, filename, &now) == 0 ? MODEL_SUM_NEW : -1;
+        else
+            rc = kept.size != now.size ? MODEL_SUM_CHANGED :
+                 kept.crc != now.crc   ? MODEL_SUM_DAMAGED : MODEL_SUM_OK;
+        pthread_mutex_unlock(&v->sumLock);
+    }
+    pthread_mutex_unlock(lock);
+    return rc;
 }
 
-static int enqueue(Queue *q, const char *filename) {
-    if (isFull(q)) return 0;
-    q->rear = (q->rear + 1) % RECENT_MAX;
-    strncpy(q->data[q->rear].filename, filename, MAX_LEN - 1);
-    q->data[q->rear].filename[MAX_LEN - 1] = '\0';
-    q->count++;
-    return 1;
+int vault_verifyFile(VaultCtx *v, const char *filename) {
+    uint64_t bytes = 0;
+    return verifyFile(v, filename, &bytes);
 }
 
-static int dequeue(Queue *q, char *outFilename) {
-    if (isEmpty(q)) return 0;
-    strncpy(outFilename, q->data[q->front].filename, MAX_LEN - 1);
-    outFilename[MAX_LEN - 1] = '\0';
-    q->front = (q->front + 1) % RECENT_MAX;
-    q->count--;
-    return 1;
+typedef struct {
+    VaultCtx    *v;
+    char       **names;
+    int         *status;
+    int          count;
+    atomic_int   next;
+    atomic_llong bytes;
+} ScrubJob;
+
+static void *scrubMain(void *arg) {
+    ScrubJob *job = (ScrubJob *)arg;
+    uint64_t  bytes = 0;
+    int       i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count)
+        job->status[i] = verifyFile(job->v, job->names[i], &bytes);
+    atomic_fetch_add(&job->bytes, (long long)bytes);
+    return NULL;
 }
 
-/* ---------- helper: undo stack ---------- */
+/* every file name, table and snapshot. returns the count (-1 if out of
+ * memory) and sets *damaged if the snapshot could not be walked */
+static int listFiles(VaultCtx *v, char ***out, int *damaged) {
+    pthread_rwlock_rdlock(&v->vaultLock);
+    size_t most  = (size_t)v->vaults.count + v->base.count;
+    char **names = (char **)malloc(sizeof(char *) * (most + 1));
+    int    n     = 0, ok = names != NULL;
+    for (int id = 0; ok && id < v->vaults.count; id++)
+        ok = (names[n++] = strdup(vtable_name(&v->vaults, id))) != NULL;
 
-static int pushUndo(const char *filename, int length) {
-    if (undoTop >= UNDO_MAX - 1) {
-        return 0;
+    uint64_t    pos = 0;
+    const char *name, *secret;
+    int         more;
+    *damaged = vindex_verify(&v->base) != 0;
+    while (ok && (more = vindex_next(&v->base, &pos, &name, &secret)) != 0) {
+        if (more < 0 || (size_t)n == most) {
+            *damaged = 1;
+            break;
+        }
+        if (vtable_find(&v->vaults, name) < 0)
+            ok = (names[n++] = strdup(name)) != NULL;
+    }
+    pthread_rwlock_unlock(&v->vaultLock);
+
+    if (!ok) {
+        while (names && n > 0) free(names[--n]);
+        free(names);
+        return -1;
     }
-    undoTop++;
-    strncpy(undoStack[undoTop].filename, filename, MAX_LEN - 1);
-    undoStack[undoTop].filename[MAX_LEN - 1] = '\0';
-    undoStack[undoTop].length = length;
-    return 1;
+    *out = names;
+    return n;
 }
 
-static int popUndo(UndoOp *op) {
-    if (undoTop < 0) return 0;
-    *op = undoStack[undoTop];
-    undoTop--;
-    return 1;
+int vault_scrub(VaultCtx *v, int threads, ModelScrubFn fn, void *ctx,
+                ModelScrub *out) {
+    memset(out, 0, sizeof(*out));
+    ScrubJob job;
+    job.v     = v;
+    job.count = listFiles(v, &job.names, &out->indexDamaged);
+    if (job.count < 0) return -1;
+    job.status = (int *)malloc(sizeof(int) * ((size_t)job.count + 1));
+    if (!job.status) {
+        for (int i = 0; i < job.count; i++) free(job.names[i]);
+        free(job.names);
+        return -1;
+    }
+    atomic_init(&job.next, 0);
+    atomic_init(&job.bytes, 0);
+
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > SCRUB_MAX_THREADS) threads = SCRUB_MAX_THREADS;
+    if (threads > job.count) threads = job.count;
+    pthread_t workers[SCRUB_MAX_THREADS];
+    int       started = 0;
+    while (started < threads - 1 &&
+           pthread_create(&workers[started], NULL, scrubMain, &job) == 0)
+        started++;
+    scrubMain(&job);   /* the calling thread is a worker too */
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+
+    out->files = job.count;
+    out->bytes = atomic_load(&job.bytes);
+    for (int i = 0; i < job.count; i++) {
+        if (job.status[i] < 0) out->unreadable++;
+        else                   out->status[job.status[i]]++;
+    }
+    int stop = 0;
+    for (int i = 0; i < job.count; i++) {
+        if (job.status[i] != MODEL_SUM_OK && fn && !stop)
+            stop = fn(ctx, job.names[i], job.status[i]);
+        free(job.names[i]);
+    }
+    free(job.names);
+    free(job.status);
+    return 0;
 }
 
-/* ---------- helper: vault persistence ---------- */
+/* ---------- public: bulk transfer ---------- */
+
+/*
+ * Bulk moves run on a pool like scrub's. Workers take files off a shared
+ * counter and do each one's costly part: the PBKDF2 run of a fresh
+ * secret, encryption, copying and checksumming. Each file is written
+ * into the store under a temporary name of its own in BULK_DIR. The
+ * calling thread then commits them together: one syncfs makes them all
+ * durable, the temporary names are renamed into place under the table
+ * lock with their journal records written unsynced, and one journal
+ * sync makes the lot part of the vault. A crash before that sync leaves
+ * files no record names, which a later add of the name truncates.
+ * Files brought in are not unlocked; their first verification unlocks
+ * them and indexes them for search.
+ */
+#define BULK_MAX_THREADS 16
+#define BULK_IO          (1024 * 1024)   /* bytes per read when copying */
+
+#define BULK_PENDING 0
+#define BULK_DONE    1
+#define BULK_SKIPPED 2
+#define BULK_FAILED  3
+
+typedef struct {
+    char       *name;
+    char       *secret;     /* the stored secret, once known */
+    const char *password;   /* tree: what the secret is made from */
+    uint64_t    from;       /* archive: where the file's bytes are */
+    uint64_t    size;       /* bytes as stored */
+    uint32_t    crc;        /* of those */
+    uint64_t    bytes;      /* plaintext read, or stored bytes copied */
+    uint32_t    check;      /* tree: history_check of its first version */
+    int         status;     /* BULK_* */
+} BulkItem;
+
+typedef struct {
+    BulkItem *items;
+    int       count, cap;
+    long      tooLong;      /* paths left out: longer than a name may be */
+} BulkList;
+
+typedef struct {
+    char          *io;      /* BULK_IO bytes */
+    unsigned char *frame;   /* one sealed frame */
+    char          *block;   /* a compressed block or CHUNK_BUF */
+    IoQueue       *q;       /* the worker's own */
+} BulkBufs;
+
+typedef struct BulkJob BulkJob;
+typedef int (*BulkFn)(BulkJob *job, BulkItem *it, BulkBufs *b);
+
+struct BulkJob {
+    VaultCtx     *v;
+    BulkItem     *items;
+    int           count;
+    int           fd;       /* the source tree, or the archive */
+    int           dedup, packed;
+    BulkFn        fn;
+    unsigned long serial;   /* of the move, in its temporary names */
+    atomic_int    next;
+    atomic_llong  end;      /* export: where the next file goes */
+};
+
+static atomic_ulong bulkSerial;
 
-static void loadVault(void) {
-    FILE *fp = fopen("vault.txt", "r");
-    file_count = 0;
-    if (fp) {
-        while (file_count < MAX_FILES &&
-            fscanf(fp, "%99s %99s",
-                   vaults[file_count].filename,
-                   vaults[file_count].password) == 2) {
-            file_count++;
-                   }
-                   fclose(fp);
+/* where job keeps item it until it is committed, relative to the store */
+static void bulkTmpPath(const BulkJob *job, const BulkItem *it, char out[BULK_TMP_LEN]) {
+    sprintf(out, BULK_DIR "/%ld-%lu-%ld", (long)getpid(), job->serial,
+            (long)(it - job->items));
+}
+
+static int bulkAdd(BulkList *l, const char *name) {
+    if (l->count == l->cap) {
+        int       cap   = l->cap ? l->cap * 2 : 1024;
+        BulkItem *items = (BulkItem *)realloc(l->items, sizeof(BulkItem) * (size_t)cap);
+        if (!items) return -1;
+        l->items = items;
+        l->cap   = cap;
+    }
+    BulkItem *it = &l->items[l->count];
+    memset(it, 0, sizeof(*it));
+    if (!(it->name = strdup(name))) return -1;
+    l->count++;
+    return 0;
+}
+
+static void bulkFree(BulkList *l) {
+    for (int i = 0; i < l->count; i++) {
+        free(l->items[i].name);
+        free(l->items[i].secret);
+    }
+    free(l->items);
+}
+
+/* adds every regular file under dirFd, which it closes, to l by its path
+ * from the top: rel, len bytes so far. Symbolic links are not followed.
+ * returns 0 or -1 */
+static int walkTree(int dirFd, char rel[MAX_LEN], size_t len, BulkList *l) {
+    DIR *d = fdopendir(dirFd);
+    if (!d) {
+        close(dirFd);
+        return -1;
+    }
+    struct dirent *e;
+    int            rc = 0;
+    while (rc == 0 && (e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        size_t n = strlen(e->d_name);
+        if (len + n + 2 > MAX_LEN) {
+            l->tooLong++;
+            continue;
+        }
+        memcpy(rel + len, e->d_name, n + 1);
+
+        int type = e->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+                type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN;
+        }
+        if (type == DT_REG) {
+            rc = bulkAdd(l, rel);
+        } else if (type == DT_DIR) {
+            int sub = openat(dirfd(d), e->d_name,
+                             O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            rel[len + n]     = '/';
+            rel[len + n + 1] = '\0';
+            if (sub >= 0) rc = walkTree(sub, rel, len + n + 1, l);
+        }
     }
+    closedir(d);
+    return rc;
 }
 
-static void saveVault(void) {
-    FILE *fp = fopen("vault.txt", "w");
-    if (!fp) return;
-    for (int i = 0; i < file_count; i++) {
-        fprintf(fp, "%s %s\n",
-                vaults[i].filename,
-                vaults[i].password);
+/* "<password> <name>" lines, the name running to the end of the line,
+ * into t; blank lines and lines starting with '#' are skipped.
+ * returns 0 or -1 */
+static int loadManifest(const char *path, VaultTable *t) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    int     ok   = vtable_init(t, 0) == 0;
+    char   *line = NULL;
+    size_t  cap  = 0;
+    ssize_t n;
+    while (ok && (n = getline(&line, &cap, fp)) != -1) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+        char *name = strpbrk(line, " \t");
+        if (!name || line[0] == '#') continue;
+        *name++ = '\0';
+        name += strspn(name, " \t");
+        if (line[0] != '\0' && name[0] != '\0' && strlen(line) < MAX_LEN && strlen(name) < MAX_LEN)
+            ok = vtable_put(t, name, line) >= 0;
     }
+    free(line);
     fclose(fp);
+    if (!ok) vtable_free(t);
+    return ok ? 0 : -1;
+}
+
+#define COPY_SLOTS 4                      /* pieces of a copy in flight */
+#define COPY_PIECE (BULK_IO / COPY_SLOTS)
+
+/* copies len bytes of in at from to out at to, adding them to *crc.
+ * Each piece of buf is a read linked to its write, so a small file
+ * costs one submission, and COPY_SLOTS of them are in flight through q
+ * at a time; the CRC follows them in order. returns 0, -1, or -2 if q
+ * broke with pieces in flight: buf must then not be freed */
+static int copyOut(IoQueue *q, int in, uint64_t from, int out, uint64_t to, uint64_t len,
+                   char *buf, uint32_t *crc) {
+    size_t   piece[COPY_SLOTS];
+    int      left[COPY_SLOTS];   /* of the slot's read and write, not back yet */
+    int      head = 0, queued = 0, inflight = 0, failed = 0;
+    uint64_t next = 0;
+    IoqDone  done[2 * COPY_SLOTS];
+    while (!failed && (next < len || queued > 0)) {
+        while (queued < COPY_SLOTS && next < len && ioq_free(q) >= 2) {
+            int    slot = (head + queued) % COPY_SLOTS;
+            size_t n    = len - next < COPY_PIECE ? (size_t)(len - next) : COPY_PIECE;
+            char  *p    = buf + (size_t)slot * COPY_PIECE;
+            ioq_read(q, in, p, n, from + next, (uint64_t)slot * 2);
+            ioq_link(q);
+            ioq_write(q, out, p, n, to + next, (uint64_t)slot * 2 + 1);
+            piece[slot] = n;
+            left[slot]  = 2;
+            next       += n;
+            queued++;
+            inflight += 2;
+        }
+        if (queued == 0) {
+            failed = 1;
+            break;
+        }
+        while (!failed && left[head] > 0) {
+            int n = ioq_reap(q, done, 2 * COPY_SLOTS, 1);
+            if (n < 0) failed = 1;
+            for (int i = 0; i < n; i++) {
+                int slot = (int)(done[i].tag / 2);
+                left[slot]--;
+                inflight--;
+                if (done[i].res != (long)piece[slot]) failed = 1;   /* short, or cancelled */
+            }
+        }
+        if (failed) break;
+
+        stats_count(STAT_BYTES_READ, piece[head]);
+        stats_count(STAT_BYTES_WRITTEN, piece[head]);
+        *crc = crc32c(*crc, buf + (size_t)head * COPY_PIECE, piece[head]);
+        head = (head + 1) % COPY_SLOTS;
+        queued--;
+    }
+    if (inflight > 0 && ioq_drain(q) != 0) return -2;
+    return failed ? -1 : 0;
 }
 
-static int findFileIndex(const char *filename) {
-    for (int i = 0; i < file_count; i++) {
-        if (strcmp(vaults[i].filename, filename) == 0)
-            return i;
+/* tree: encrypts the source file under a fresh data key, wrapped under
+ * its password, into the store under its temporary name */
+static int importOne(BulkJob *job, BulkItem *it, BulkBufs *b) {
+    VaultCtx     *v = job->v;
+    unsigned char key[CIPHER_KEY_LEN];
+    char          hashed[KDF_ENCODED_MAX];
+    char          tmp[BULK_TMP_LEN];
+    bulkTmpPath(job, it, tmp);
+    int src = openat(job->fd, it->name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    int dst = src >= 0 ? fanout_open(v->storeFd, tmp, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644)
+                       : -1;
+    int rc  = dst >= 0 && kdf_random(key, sizeof(key)) == 0 &&
+              kdf_hashKey(it->password, v->kdfCost, key, hashed) == 0 ? 0 : -1;
+
+    Packer    pk      = { dst, key, b->block, 0, 0, 0, 0, b->frame, 0 };
+    long long written = 0;
+    uint32_t  crc     = 0;   /* of the plaintext, its first version */
+    while (rc == 0) {
+        ssize_t n = read(src, b->io, BULK_IO);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            rc = n < 0 ? -1 : 0;
+            break;
+        }
+        long long w = job->dedup  ? chunkFeed(v, &pk, b->io, (size_t)n, 0)
+                    : job->packed ? packFeed(&pk, b->io, (size_t)n)
+                                  : writeSealed(dst, key, it->bytes, b->io, (size_t)n,
+                                                b->frame, 0);
+        if (w < 0) rc = -1;
+        written      += w;
+        it->bytes    += (uint64_t)n;
+        crc           = crc32c(crc, b->io, (size_t)n);
+    }
+    long long w = rc != 0 || it->bytes == 0 ? 0
+                : job->dedup  ? chunkFeed(v, &pk, NULL, 0, 1)
+                : job->packed && pk.filled > 0 ? packFlush(&pk) : 0;
+    stats_count(STAT_BYTES_READ, it->bytes);
+    if (w < 0) rc = -1;
+    else stats_count(STAT_BYTES_WRITTEN, (uint64_t)(written + w));
+
+    struct stat st;
+    if (rc == 0 && fstat(dst, &st) == 0) {
+        it->size = (uint64_t)st.st_size;
+        rc = regionCrc(dst, 0, it->size, &it->crc);
     }
-    return -1;
+    if (rc == 0 && !(it->secret = strdup(hashed))) rc = -1;
+    it->check = history_check(key, 0, it->bytes, crc);
+
+    if (src >= 0) close(src);
+    if (dst >= 0) close(dst);
+    if (rc != 0 && dst >= 0) unlinkat(v->storeFd, tmp, 0);
+    memset(key, 0, sizeof(key));
+    return rc == 0 ? BULK_DONE : BULK_FAILED;
 }
 
-/* ---------- public: init ---------- */
+/* archive: copies the file's bytes into the store under its temporary
+ * name, checking them against the archive's CRC */
+static int restoreOne(BulkJob *job, BulkItem *it, BulkBufs *b) {
+    VaultCtx *v = job->v;
+    char      tmp[BULK_TMP_LEN];
+    bulkTmpPath(job, it, tmp);
+    int       dst = fanout_open(v->storeFd, tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    uint32_t  crc = 0;
+    int       rc  = dst >= 0 ? copyOut(b->q, job->fd, it->from, dst, 0, it->size, b->io, &crc) : -1;
+    if (rc == -2) b->io = NULL;   /* still the kernel's: never freed */
+    if (rc == 0 && crc != it->crc) rc = -1;   /* damaged in the archive */
+    it->bytes = rc == 0 ? it->size : 0;
 
-void model_init(void) {
-    loadVault();
-    initQueue(&recentQ);
-    initQueue(&tempQ);
-    undoTop = -1;
+    if (dst >= 0) close(dst);
+    if (rc != 0 && dst >= 0) unlinkat(v->storeFd, tmp, 0);
+    return rc == 0 ? BULK_DONE : BULK_FAILED;
 }
 
-/* ---------- public: vault operations ---------- */
+/* export: copies the file as stored to the end of the archive, with
+ * appends to it held off; a file not matching its checksum is left out */
+static int exportOne(BulkJob *job, BulkItem *it, BulkBufs *b) {
+    VaultCtx *v = job->v;
+    uint64_t  gen;
+    if (!(it->secret = loadSecret(v, it->name, &gen))) return BULK_SKIPPED;
 
-int model_addFile(const char *filename, const char *password) {
-    if (file_count >= MAX_FILES)
-        return -1; /* vault full */
+    pthread_mutex_t *lock = fileLock(v, it->name);
+    pthread_mutex_lock(lock);
+    int         fd = openIn(v, it->name, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    int         rc = fd >= 0 ? fstat(fd, &st) : errno == ENOENT ? 0 : -1;
+    it->size = fd >= 0 && rc == 0 ? (uint64_t)st.st_size : 0;
+    it->from = (uint64_t)atomic_fetch_add(&job->end, (long long)it->size);
+    if (rc == 0 && it->size > 0)
+        rc = copyOut(b->q, fd, 0, job->fd, it->from, it->size, b->io, &it->crc);
+    if (rc == -2) b->io = NULL;   /* still the kernel's: never freed */
+    pthread_mutex_unlock(lock);
+    if (fd >= 0) close(fd);
+
+    FileSum sum;
+    if (rc == 0) {
+        pthread_mutex_lock(&v->sumLock);
+        SumTable *t = sumTable(v);
+        if (t && sumtable_get(t, it->name, &sum) == 0 && sum.size == it->size &&
+            sum.crc != it->crc)
+            rc = -1;   /* damaged at rest: not carried along */
+        pthread_mutex_unlock(&v->sumLock);
+    }
+    it->bytes = rc == 0 ? it->size : 0;
+    return rc == 0 ? BULK_DONE : BULK_FAILED;
+}
+
+static void *bulkMain(void *arg) {
+    BulkJob *job = (BulkJob *)arg;
+    BulkBufs b;
+    b.io    = (char *)malloc(BULK_IO);
+    b.frame = (unsigned char *)malloc(SEAL_CHUNK + FRAME_OVERHEAD);
+    b.block = (char *)malloc(CHUNK_BUF > FRAME_BLOCK_MAX ? CHUNK_BUF : FRAME_BLOCK_MAX);
+    b.q     = queueTake(job->v);
+    int i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+        BulkItem *it = &job->items[i];
+        if (it->status == BULK_PENDING)
+            it->status = b.io && b.frame && b.block && b.q ? job->fn(job, it, &b) : BULK_FAILED;
+    }
+    queueGive(job->v, b.q);
+    free(b.io);
+    free(b.frame);
+    free(b.block);
+    return NULL;
+}
+
+/* runs job->fn over every pending item, threads at a time */
+static void runBulk(BulkJob *job, int threads) {
+    atomic_init(&job->next, 0);
+    job->serial = atomic_fetch_add(&bulkSerial, 1);
+    job->dedup  = atomic_load(&job->v->dedup);
+    job->packed = !job->dedup && atomic_load(&job->v->compress);
+
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > BULK_MAX_THREADS) threads = BULK_MAX_THREADS;
+    if (threads > job->count) threads = job->count;
+    pthread_t workers[BULK_MAX_THREADS];
+    int       started = 0;
+    while (started < threads - 1 &&
+           pthread_create(&workers[started], NULL, bulkMain, job) == 0)
+        started++;
+    bulkMain(job);   /* the calling thread is a worker too */
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+}
+
+/* makes the files the workers wrote part of the vault, all at once; a
+ * name added meanwhile keeps its own file. With versions set, each
+ * file's content is its first version: the workers saw its plaintext */
+static void commitBulk(const BulkJob *job, int versions) {
+    VaultCtx *v     = job->v;
+    BulkItem *items = job->items;
+    int       count = job->count;
+    syncfs(v->storeFd);   /* every file is on disk before a record names it */
+    stats_count(STAT_FSYNCS, 1);
+
+    pthread_rwlock_wrlock(&v->vaultLock);
+    for (int i = 0; i < count; i++) {
+        BulkItem *it = &items[i];
+        if (it->status != BULK_DONE) continue;
+        char from[BULK_TMP_LEN], to[FANOUT_PATH_LEN];
+        int  id = -1;
+        bulkTmpPath(job, it, from);
+        fanout_path(it->name, to);
+        if (findSecret(v, it->name)) {
+            it->status = BULK_SKIPPED;
+        } else if (fanout_makeDirs(v->storeFd, to) == 0 &&
+                   renameat(v->storeFd, from, v->storeFd, to) == 0) {
+            fileForget(v, it->name);
+            id = vtable_put(&v->vaults, it->name, it->secret);
+            if (id < 0) unlinkat(v->storeFd, to, 0);
+        }
+        if (id < 0) {
+            if (it->status == BULK_DONE) it->status = BULK_FAILED;
+            unlinkat(v->storeFd, from, 0);
+        } else {
+            /* a compaction may reopen the journal midway */
+            journal_setSync(&v->journal, JOURNAL_SYNC_NONE, 0, 0);
+            journalPut(v, id);
+        }
+    }
+    journal_setSync(&v->journal, v->syncMode, v->syncGroupSize, v->syncGroupMs);
+    journal_sync(&v->journal);
+    pthread_rwlock_unlock(&v->vaultLock);
+    syncfs(v->storeFd);   /* and the renames */
+    stats_count(STAT_FSYNCS, 1);
+
+    pthread_mutex_lock(&v->sumLock);
+    SumTable *t = sumTable(v);
+    if (t) {
+        sumtable_setSync(t, JOURNAL_SYNC_NONE, 0, 0);
+        for (int i = 0; i < count; i++) {
+            FileSum sum = { items[i].size, items[i].crc };
+            if (items[i].status == BULK_DONE) sumtable_put(t, items[i].name, &sum);
+        }
+        sumtable_setSync(t, v->syncMode, v->syncGroupSize, v->syncGroupMs);
+    }
+    pthread_mutex_unlock(&v->sumLock);
+
+    for (int i = 0; versions && i < count; i++) {
+        if (items[i].status != BULK_DONE || items[i].bytes == 0) continue;
+        pthread_mutex_t *lock = fileLock(v, items[i].name);
+        pthread_mutex_lock(lock);
+        historyAdd(v, items[i].name, 0, items[i].bytes, items[i].check);
+        pthread_mutex_unlock(lock);
+    }
+}
+
+static void bulkCount(const BulkItem *items, int count, ModelBulk *out) {
+    for (int i = 0; i < count; i++) {
+        if (items[i].status == BULK_DONE) {
+            out->files++;
+            out->bytes += (long long)items[i].bytes;
+        } else if (items[i].status == BULK_SKIPPED) {
+            out->skipped++;
+        } else {
+            out->failed++;
+        }
+    }
+}
+
+int vault_importTree(VaultCtx *v, const char *dir, const char *password,
+                     const char *manifest, int threads, ModelBulk *out) {
+    memset(out, 0, sizeof(*out));
+    VaultTable listed;
+    if (manifest && loadManifest(manifest, &listed) != 0) return -1;
+
+    char     rel[MAX_LEN] = "";
+    BulkList l   = { NULL, 0, 0, 0 };
+    int      src = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int      top = src >= 0 ? dup(src) : -1;
+    int      rc  = top >= 0 ? walkTree(top, rel, 0, &l) : -1;
+    if (top < 0 && src >= 0) close(src);
+    out->failed = l.tooLong;
+
+    for (int i = 0; rc == 0 && i < l.count; i++) {
+        BulkItem *it = &l.items[i];
+        int       id = manifest ? vtable_find(&listed, it->name) : -1;
+        it->password = id >= 0 ? vtable_secret(&listed, id) : password;
+        if (!it->password || strlen(it->password) >= MAX_LEN || vault_fileExists(v, it->name))
+            it->status = BULK_SKIPPED;
+    }
+    if (rc == 0) {
+        BulkJob job;
+        job.v     = v;
+        job.items = l.items;
+        job.count = l.count;
+        job.fd    = src;
+        job.fn    = importOne;
+        runBulk(&job, threads);
+        commitBulk(&job, 1);
+        bulkCount(l.items, l.count, out);
+    }
+    if (src >= 0) close(src);
+    if (manifest) vtable_free(&listed);
+    bulkFree(&l);
+    return rc;
+}
+
+/* appends the stored body of every chunk in the vault to the archive
+ * at *end, as its pack. returns 0 or -1 */
+static int exportChunks(VaultCtx *v, int fd, uint64_t *end, char *buf, Archive *a) {
+    struct stat st;
+    pthread_mutex_lock(&v->chunkLock);
+    ChunkStore *s = v->chunks || (stat(v->chunksPath, &st) == 0 && st.st_size > 0)
+                    ? chunkStore(v) : NULL;
+    int n = s ? chunkstore_count(s) : 0;
+    a->chunks = (ArchiveChunk *)malloc(sizeof(ArchiveChunk) * ((size_t)n + 1));
+    for (int i = 0; a->chunks && i < n; i++)
+        chunkstore_entry(s, i, a->chunks[i].id, &a->chunks[i].loc);
+    pthread_mutex_unlock(&v->chunkLock);
+    if (!a->chunks) return -1;
+
+    /* bodies are only ever appended, so they can be read unlocked */
+    a->packOff = *end;
+    a->packCrc = 0;
+    int rc = 0;
+    for (int i = 0; rc == 0 && i < n; i++) {
+        ChunkLoc *loc = &a->chunks[i].loc;
+        rc = chunkstore_readStored(s, loc, buf) == 0 &&
+             writeAll(fd, buf, loc->stored) == 0 ? 0 : -1;
+        a->packCrc  = crc32c(a->packCrc, buf, loc->stored);
+        loc->offset = *end - a->packOff;
+        *end       += loc->stored;
+    }
+    a->packLen    = *end - a->packOff;
+    a->chunkCount = (uint32_t)n;
+    return rc;
+}
+
+int vault_exportArchive(VaultCtx *v, const char *path, int threads, ModelBulk *out) {
+    memset(out, 0, sizeof(*out));
+    char   **names;
+    int      damaged;
+    int      count = listFiles(v, &names, &damaged);
+    if (count < 0) return -1;
+
+    BulkList l   = { (BulkItem *)calloc((size_t)count + 1, sizeof(BulkItem)), count, count, 0 };
+    char    *buf = (char *)malloc(BULK_IO);
+    int      fd  = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    for (int i = 0; i < count; i++) {
+        if (l.items) l.items[i].name = names[i];
+        else free(names[i]);
+    }
+    free(names);
+    if (!l.items) l.count = 0;
+    int rc = l.items && buf && fd >= 0 ? 0 : -1;
+
+    Archive a;
+    memset(&a, 0, sizeof(a));
+    if (rc == 0) {
+        BulkJob job;
+        job.v     = v;
+        job.items = l.items;
+        job.count = l.count;
+        job.fd    = fd;
+        job.fn    = exportOne;
+        atomic_init(&job.end, ARCHIVE_DATA_START);
+        runBulk(&job, threads);
+        bulkCount(l.items, l.count, out);
+
+        /* after the files: every chunk they hold was stored before its frame */
+        uint64_t end = (uint64_t)atomic_load(&job.end);
+        rc = lseek(fd, (off_t)end, SEEK_SET) < 0 ? -1 : exportChunks(v, fd, &end, buf, &a);
+        a.files = (ArchiveFile *)malloc(sizeof(ArchiveFile) * ((size_t)out->files + 1));
+        for (int i = 0; rc == 0 && a.files && i < l.count; i++) {
+            const BulkItem *it = &l.items[i];
+            if (it->status != BULK_DONE) continue;
+            ArchiveFile f = { it->name, it->secret, it->from, it->size, it->crc };
+            a.files[a.fileCount++] = f;
+        }
+        if (rc == 0) rc = a.files && archive_write(fd, end, &a) == 0 ? 0 : -1;
+    }
+    if (fd >= 0) close(fd);
+    if (rc != 0 && fd >= 0) unlink(path);
+    free(a.files);
+    free(a.chunks);
+    free(buf);
+    bulkFree(&l);
+    return rc;
+}
+
+/* stores the archive's chunks the vault lacks, once its pack checks out.
+ * returns 0, -1 on a read or write error, or -2 if the pack is damaged */
+static int restoreChunks(VaultCtx *v, int fd, const Archive *a, char *buf) {
+    uint32_t crc = 0;
+    for (uint64_t at = 0; at < a->packLen;) {
+        uint64_t want = a->packLen - at < BULK_IO ? a->packLen - at : BULK_IO;
+        ssize_t  n    = pread(fd, buf, (size_t)want, (off_t)(a->packOff + at));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -2;
+        crc = crc32c(crc, buf, (size_t)n);
+        at += (uint64_t)n;
+    }
+    if (crc != a->packCrc) return -2;
+    if (a->chunkCount == 0) return 0;
+
+    /* made durable with the files, by commitBulk's first syncfs */
+    pthread_mutex_lock(&v->chunkLock);
+    ChunkStore *s  = chunkStore(v);
+    int         rc = s ? 0 : -1;
+    if (s) chunkstore_setSync(s, JOURNAL_SYNC_NONE, 0, 0);
+    for (uint32_t i = 0; rc == 0 && i < a->chunkCount; i++) {
+        const ChunkLoc *loc = &a->chunks[i].loc;
+        if (loc->stored > CHUNK_MAX || loc->offset + loc->stored > a->packLen ||
+            pread(fd, buf, loc->stored, (off_t)(a->packOff + loc->offset)) != (ssize_t)loc->stored)
+            rc = -2;
+        else if (chunkstore_putStored(s, a->chunks[i].id, loc, buf) < 0)
+            rc = -1;
+        else
+            stats_count(STAT_BYTES_WRITTEN, loc->stored);
+    }
+    if (s) chunkstore_setSync(s, v->syncMode, v->syncGroupSize, v->syncGroupMs);
+    pthread_mutex_unlock(&v->chunkLock);
+    return rc;
+}
+
+int vault_importArchive(VaultCtx *v, const char *path, int threads, ModelBulk *out) {
+    memset(out, 0, sizeof(*out));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    Archive a;
+    int     rc = archive_read(fd, &a);
+    if (rc != 0) {
+        close(fd);
+        return rc;
+    }
+
+    char    *buf = (char *)malloc(BULK_IO);
+    BulkList l   = { NULL, 0, 0, 0 };
+    rc = buf ? restoreChunks(v, fd, &a, buf) : -1;
+    for (uint32_t i = 0; rc == 0 && i < a.fileCount; i++) {
+        const ArchiveFile *f = &a.files[i];
+        if (bulkAdd(&l, f->name) != 0) {
+            rc = -1;
+            break;
+        }
+        BulkItem *it = &l.items[l.count - 1];
+        it->from   = f->offset;
+        it->size   = f->length;
+        it->crc    = f->crc;
+        it->secret = strdup(f->secret);
+        if (!it->secret) rc = -1;
+        else if (strlen(f->name) >= MAX_LEN || strlen(f->secret) >= MAX_LEN)
+            it->status = BULK_FAILED;
+        else if (vault_fileExists(v, f->name))
+            it->status = BULK_SKIPPED;
+    }
+    if (rc == 0) {
+        BulkJob job;
+        job.v     = v;
+        job.items = l.items;
+        job.count = l.count;
+        job.fd    = fd;
+        job.fn    = restoreOne;
+        runBulk(&job, threads);
+        commitBulk(&job, 0);
+        bulkCount(l.items, l.count, out);
+    }
+    close(fd);
+    free(buf);
+    archive_free(&a);
+    bulkFree(&l);
+    return rc;
+}
+
+/* ---------- public: recent files ---------- */
+
+void vault_setRecentCapacity(VaultCtx *v, int capacity) {
+    pthread_mutex_lock(&v->recentLock);
+    if (capacity != v->recent.capacity &&
+        lru_setCapacity(&v->recent, capacity) == 0)
+        rewriteRecent(v);
+    pthread_mutex_unlock(&v->recentLock);
+}
+
+void vault_recordRecent(VaultCtx *v, const char *filename) {
+    pthread_mutex_lock(&v->recentLock);
+    int32_t head = v->recent.head;
+    if (head >= 0 && strcmp(v->recent.nodes[head].name, filename) == 0) {
+        pthread_mutex_unlock(&v->recentLock);
+        return; /* already the most recent */
+    }
+
+    if (lru_touch(&v->recent, filename) == 0 &&
+        appendTouch(&v->recentLog, filename) == 0 &&
+        ++v->recentRecords > 4u * (uint32_t)v->recent.capacity + 64)
+        rewriteRecent(v);
+    pthread_mutex_unlock(&v->recentLock);
+}
+
+int vault_getRecent(VaultCtx *v, char names[][MAX_LEN], int offset, int maxCount) {
+    if (offset < 0 || maxCount <= 0) return 0;
+    const char **page = (const char **)malloc(sizeof(char *) * (size_t)maxCount);
+    if (!page) return 0;
+
+    pthread_mutex_lock(&v->recentLock);
+    int count = lru_list(&v->recent, offset, maxCount, page);
+    for (int i = 0; i < count; i++) {
+        strncpy(names[i], page[i], MAX_LEN - 1);
+        names[i][MAX_LEN - 1] = '\0';
+    }
+    pthread_mutex_unlock(&v->recentLock);
+
+    free(page);
+    return count;
+}
 
-        if (findFileIndex(filename) != -1)
-            return -2; /* file already exists */
+/* ---------- public: undo ---------- */
 
-            FILE *fp = fopen(filename, "w");
-        if (!fp) {
-            return -3; /* file create error */
+int vault_undoLastAppend(VaultCtx *v, char *outFilename, size_t bufSize) {
+    return undoAppend(v, NULL, outFilename, bufSize);
+}
+
+int vault_redoLastUndo(VaultCtx *v, char *outFilename, size_t bufSize) {
+    return redoAppend(v, NULL, outFilename, bufSize);
+}
+
+int vault_undoFileAppend(VaultCtx *v, const char *filename) {
+    return undoAppend(v, filename, NULL, 0);
+}
+
+int vault_redoFileAppend(VaultCtx *v, const char *filename) {
+    return redoAppend(v, filename, NULL, 0);
+}
+
+/* ---------- public: version history ---------- */
+
+/* where version ends in the plaintext: 0 for version 0, otherwise the
+ * end of its append. returns 0, or -1 if the file holds no such version */
+static int versionEnd(int hfd, uint64_t count, long long version, uint64_t *end) {
+    Version ver;
+    if (version < 0 || (uint64_t)version > count) return -1;
+    *end = 0;
+    if (version == 0) return 0;
+    if (history_get(hfd, (uint64_t)version - 1, &ver) != 0) return -1;
+    *end = ver.offset + ver.length;
+    return 0;
+}
+
+static void toModelVersion(const Version *ver, ModelVersion *out) {
+    out->offset = (long long)ver->offset;
+    out->length = (long long)ver->length;
+    out->time   = (long long)ver->time;
+    out->check  = ver->check;
+}
+
+/* checks the bytes of each version against its record on their way to
+ * fn; bytes that belong to no version pass unchecked */
+typedef struct {
+    ModelChunkFn  fn;
+    void         *ctx;
+    unsigned char key[CIPHER_KEY_LEN];   /* the file's data key */
+    int           fd;
+    uint64_t      next, count;        /* records [next, count) still to load */
+    Version       batch[HISTORY_BATCH];
+    long          have, at;           /* loaded, and the one being checked */
+    uint64_t      pos;                /* plaintext offset of the next byte */
+    uint32_t      crc;                /* of the current version so far */
+    int           inside;             /* some of the current version was seen */
+    int           bad;
+} VersionSink;
+
+static int versionChunk(void *ctx, const char *data, size_t len) {
+    VersionSink *s    = (VersionSink *)ctx;
+    const char  *p    = data;
+    size_t       left = len;
+    while (left > 0 && !s->bad) {
+        if (s->at == s->have) {
+            if (s->next == s->count) break;
+            uint64_t want = s->count - s->next < HISTORY_BATCH ? s->count - s->next
+                                                                 : HISTORY_BATCH;
+            s->have = history_list(s->fd, s->next, (long)want, s->batch);
+            s->at   = 0;
+            if (s->have <= 0) {
+                s->bad = 1;
+                break;
+            }
+            s->next += (uint64_t)s->have;
+        }
+        const Version *ver = &s->batch[s->at];
+        uint64_t       end = ver->offset + ver->length;
+        if (s->pos < ver->offset) {
+            size_t skip = ver->offset - s->pos < left ? (size_t)(ver->offset - s->pos) : left;
+            p      += skip;
+            left   -= skip;
+            s->pos += skip;
+        } else if (s->pos > ver->offset && !s->inside) {
+            s->bad = 1;   /* versions overlap: not a history of this file */
+        } else {
+            /* a version may go on over any number of chunks */
+            size_t take = end - s->pos < left ? (size_t)(end - s->pos) : left;
+            s->crc    = crc32c(s->crc, p, take);
+            s->inside = 1;
+            p        += take;
+            left     -= take;
+            s->pos   += take;
+            if (s->pos == end) {
+                if (history_check(s->key, ver->offset, ver->length, s->crc) != ver->check)
+                    s->bad = 1;
+                s->crc    = 0;
+                s->inside = 0;
+                s->at++;
+            }
         }
-        fclose(fp);
+    }
+    return s->fn(s->ctx, data, len);
+}
+
+long long vault_countVersions(VaultCtx *v, const char *filename) {
+    unsigned char key[CIPHER_KEY_LEN];
+    if (!fileKey(v, filename, key)) return -1;
+    memset(key, 0, sizeof(key));
+
+    int      hfd;
+    uint64_t count;
+    if (historyLive(v, filename, &hfd, &count) != 0) return -1;
+    historyClose(v, hfd);
+    return (long long)count;
+}
+
+int vault_getVersions(VaultCtx *v, const char *filename, long long first,
+                      ModelVersion *out, int maxCount) {
+    unsigned char key[CIPHER_KEY_LEN];
+    if (first < 1 || maxCount < 0 || !fileKey(v, filename, key)) return -1;
+    memset(key, 0, sizeof(key));
+
+    int      hfd;
+    uint64_t count;
+    if (historyLive(v, filename, &hfd, &count) != 0) return -1;
+    Version  batch[HISTORY_BATCH];
+    uint64_t at  = (uint64_t)first - 1;
+    int      got = 0;
+    while (got < maxCount && at < count) {
+        uint64_t want = count - at;
+        if (want > HISTORY_BATCH) want = HISTORY_BATCH;
+        if (want > (uint64_t)(maxCount - got)) want = (uint64_t)(maxCount - got);
+        long n = history_list(hfd, at, (long)want, batch);
+        if (n <= 0) {
+            got = -1;
+            break;
+        }
+        for (long i = 0; i < n; i++) toModelVersion(&batch[i], &out[got++]);
+        at += (uint64_t)n;
+    }
+    historyClose(v, hfd);
+    return got;
+}
+
+long long vault_findVersion(VaultCtx *v, const char *filename, long long time) {
+    unsigned char key[CIPHER_KEY_LEN];
+    if (!fileKey(v, filename, key)) return -1;
+    memset(key, 0, sizeof(key));
+
+    int      hfd;
+    uint64_t count;
+    if (historyLive(v, filename, &hfd, &count) != 0) return -1;
+    uint64_t n = count > 0 && time >= 0 ? history_find(hfd, count, (uint64_t)time) : 0;
+    historyClose(v, hfd);
+    return (long long)n;
+}
+
+int vault_readVersion(VaultCtx *v, const char *filename, long long version,
+                      ModelChunkFn fn, void *ctx) {
+    unsigned char key[CIPHER_KEY_LEN];
+    if (!fileKey(v, filename, key)) return -1;
+
+    int      hfd;
+    uint64_t count, end;
+    if (historyLive(v, filename, &hfd, &count) != 0 ||
+        versionEnd(hfd, count, version, &end) != 0) {
+        historyClose(v, hfd);
+        memset(key, 0, sizeof(key));
+        return -1;
+    }
 
-    strncpy(vaults[file_count].filename, filename, MAX_LEN - 1);
-    vaults[file_count].filename[MAX_LEN - 1] = '\0';
-    strncpy(vaults[file_count].password, password, MAX_LEN - 1);
-    vaults[file_count].password[MAX_LEN - 1] = '\0';
-    file_count++;
+    /* the records checked stay put: only appends past them rewrite any */
+    VersionSink *sink = (VersionSink *)calloc(1, sizeof(VersionSink));
+    int          rc   = -1;
+    if (sink) {
+        sink->fn    = fn;
+        sink->ctx   = ctx;
+        sink->fd    = hfd;
+        memcpy(sink->key, key, sizeof(key));
+        sink->count = (uint64_t)version;
+        rc = end > 0 ? vault_readRange(v, filename, 0, (long long)end, versionChunk, sink) : 0;
+        if (rc == 0 && (sink->bad || sink->at < sink->have || sink->next < sink->count))
+            rc = -2;
+        memset(sink->key, 0, sizeof(sink->key));
+        free(sink);
+    }
+    historyClose(v, hfd);
+    memset(key, 0, sizeof(key));
+    return rc;
+}
 
-    saveVault();
+int vault_diffVersions(VaultCtx *v, const char *filename, long long from,
+                       long long to, long long *offset, long long *length) {
+    unsigned char key[CIPHER_KEY_LEN];
+    if (!fileKey(v, filename, key)) return -1;
+    memset(key, 0, sizeof(key));
+
+    int      hfd;
+    uint64_t count, a, b;
+    if (historyLive(v, filename, &hfd, &count) != 0) return -1;
+    int rc = versionEnd(hfd, count, from < to ? from : to, &a) == 0 &&
+             versionEnd(hfd, count, from < to ? to : from, &b) == 0 ? 0 : -1;
+    historyClose(v, hfd);
+    if (rc != 0) return -1;
+    *offset = (long long)a;
+    *length = (long long)(b - a);
     return 0;
 }
 
+/* ---------- public: default vault ---------- */
+
+/* The model_* entry points are where latencies are recorded (stats.h);
+ * the vault_* calls underneath only bump the I/O counters. */
+
+int model_init(void) {
+    if (!defaultVault)
+        defaultVault = model_open(".");
+    return defaultVault ? 0 : -1;
+}
+
+void model_setSyncPolicy(int mode, int groupSize, int groupMs) {
+    pthread_mutex_lock(&defaultsLock);
+    defaultSyncMode  = mode;
+    defaultGroupSize = groupSize;
+    defaultGroupMs   = groupMs;
+    pthread_mutex_unlock(&defaultsLock);
+
+    if (defaultVault)
+        vault_setSyncPolicy(defaultVault, mode, groupSize, groupMs);
+}
+
+void model_setKdfCost(uint32_t iterations) {
+    pthread_mutex_lock(&defaultsLock);
+    defaultKdfCost = iterations;
+    pthread_mutex_unlock(&defaultsLock);
+
+    if (defaultVault)
+        vault_setKdfCost(defaultVault, iterations);
+}
+
+void model_setCompression(int on) {
+    pthread_mutex_lock(&defaultsLock);
+    defaultCompress = on != 0;
+    pthread_mutex_unlock(&defaultsLock);
+
+    if (defaultVault)
+        vault_setCompression(defaultVault, on);
+}
+
+void model_setDedup(int on) {
+    pthread_mutex_lock(&defaultsLock);
+    defaultDedup = on != 0;
+    pthread_mutex_unlock(&defaultsLock);
+
+    if (defaultVault)
+        vault_setDedup(defaultVault, on);
+}
+
+void model_setCacheSize(size_t bytes) {
+    pthread_mutex_lock(&defaultsLock);
+    defaultCacheBytes = bytes;
+    pthread_mutex_unlock(&defaultsLock);
+
+    if (defaultVault)
+        vault_setCacheSize(defaultVault, bytes);
+}
+
+void model_setAsyncIo(int on) {
+    pthread_mutex_lock(&defaultsLock);
+    defaultAsyncIo = on != 0;
+    pthread_mutex_unlock(&defaultsLock);
+
+    if (defaultVault)
+        vault_setAsyncIo(defaultVault, on);
+}
+
+void model_setRecentCapacity(int capacity) {
+    pthread_mutex_lock(&defaultsLock);
+    defaultRecentCap = capacity;
+    pthread_mutex_unlock(&defaultsLock);
+
+    if (defaultVault)
+        vault_setRecentCapacity(defaultVault, capacity);
+}
+
+void model_shutdown(void) {
+    model_close(defaultVault);
+    defaultVault = NULL;
+}
+
+VaultCtx *model_default(void) {
+    return defaultVault;
+}
+
+int model_addFile(const char *filename, const char *password) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_addFile(defaultVault, filename, password);
+    stats_end(STAT_ADD_FILE, t0);
+    return rc;
+}
+
+int model_fileExists(const char *filename) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_fileExists(defaultVault, filename);
+    stats_end(STAT_FILE_EXISTS, t0);
+    return rc;
+}
+
 int model_verifyPassword(const char *filename, const char *password) {
-    int idx = findFileIndex(filename);
-    if (idx < 0)
-        return -1; /* file not found */
-        if (strcmp(vaults[idx].password, password) == 0)
-            return 1;
-    return 0;
+    uint64_t t0 = stats_begin();
+    int rc = vault_verifyPassword(defaultVault, filename, password);
+    stats_end(STAT_VERIFY, t0);
+    return rc;
 }
 
 int model_changePassword(const char *filename,
                          const char *oldPwd,
                          const char *newPwd) {
-    int idx = findFileIndex(filename);
-    if (idx < 0)
-        return -1; /* file not found */
+    uint64_t t0 = stats_begin();
+    int rc = vault_changePassword(defaultVault, filename, oldPwd, newPwd);
+    stats_end(STAT_CHANGE_PASSWORD, t0);
+    return rc;
+}
 
-        if (strcmp(vaults[idx].password, oldPwd) != 0)
-            return -2; /* wrong current password */
+char *model_getFileContents(const char *filename) {
+    uint64_t t0 = stats_begin();
+    char *buf = vault_getFileContents(defaultVault, filename);
+    stats_end(STAT_GET_CONTENTS, t0);
+    return buf;
+}
 
-            strncpy(vaults[idx].password, newPwd, MAX_LEN - 1);
-        vaults[idx].password[MAX_LEN - 1] = '\0';
-    saveVault();
-    return 0;
-                         }
-
-                         /* ---------- public: file content ---------- */
-
-                         char *model_getFileContents(const char *filename) {
-                             FILE *fp = fopen(filename, "rb");
-                             if (!fp) return NULL;
-
-                             /* get file size */
-                             if (fseek(fp, 0, SEEK_END) != 0) {
-                                 fclose(fp);
-                                 return NULL;
-                             }
-                             long size = ftell(fp);
-                             if (size < 0) size = 0;
-                             rewind(fp);
-
-                             char *buffer = (char *)malloc((size_t)size + 1);
-                             if (!buffer) {
-                                 fclose(fp);
-                                 return NULL;
-                             }
-
-                             size_t readBytes = fread(buffer, 1, (size_t)size, fp);
-                             buffer[readBytes] = '\0';
-                             fclose(fp);
-
-                             return buffer;
-                         }
-
-                         int model_appendToFile(const char *filename,
-                                                const char *text,
-                                                int *appendedLen) {
-                             *appendedLen = 0;
-                             if (!text || text[0] == '\0')
-                                 return -2; /* nothing appended */
-
-                                 FILE *fp = fopen(filename, "a");
-                             if (!fp) {
-                                 return -1; /* open error */
-                             }
-
-                             int len = (int)strlen(text);
-                             size_t written = fwrite(text, 1, (size_t)len, fp);
-                             fclose(fp);
-
-                             if ((int)written != len) {
-                                 return -1; /* write error */
-                             }
-
-                             *appendedLen = len;
-                             pushUndo(filename, len);
-                             return 0;
-                                                }
-
-                                                /* ---------- public: recent files ---------- */
-
-                                                void model_recordRecent(const char *filename) {
-                                                    initQueue(&tempQ);
-                                                    char current[MAX_LEN];
-
-                                                    while (!isEmpty(&recentQ)) {
-                                                        dequeue(&recentQ, current);
-                                                        if (strcmp(current, filename) != 0) {
-                                                            enqueue(&tempQ, current);
-                                                        }
-                                                    }
-
-                                                    if (isFull(&tempQ)) {
-                                                        dequeue(&tempQ, current);
-                                                    }
-
-                                                    enqueue(&tempQ, filename);
-                                                    recentQ = tempQ;
-                                                }
-
-                                                int model_getRecent(char names[][MAX_LEN], int maxCount) {
-                                                    if (maxCount > RECENT_MAX)
-                                                        maxCount = RECENT_MAX;
-
-                                                    int count = recentQ.count;
-                                                    if (count > maxCount) count = maxCount;
-
-                                                    int idx = recentQ.rear;
-                                                    for (int i = 0; i < count; i++) {
-                                                        strncpy(names[i], recentQ.data[idx].filename, MAX_LEN - 1);
-                                                        names[i][MAX_LEN - 1] = '\0';
-                                                        idx = (idx - 1 + RECENT_MAX) % RECENT_MAX;
-                                                    }
-                                                    return count;
-                                                }
-
-                                                /* ---------- public: undo ---------- */
-
-                                                int model_undoLastAppend(char *outFilename, size_t bufSize) {
-                                                    UndoOp op;
-                                                    if (!popUndo(&op)) {
-                                                        return 0; /* nothing to undo */
-                                                    }
-
-                                                    FILE *fp = fopen(op.filename, "rb");
-                                                    if (!fp) {
-                                                        return -1;
-                                                    }
-
-                                                    if (fseek(fp, 0, SEEK_END) != 0) {
-                                                        fclose(fp);
-                                                        return -1;
-                                                    }
-                                                    long size = ftell(fp);
-                                                    if (size < 0) size = 0;
-                                                    long newSize = size - op.length;
-                                                    if (newSize < 0) newSize = 0;
-                                                    rewind(fp);
-
-                                                    char *buffer = (char *)malloc((size_t)newSize + 1);
-                                                    if (!buffer) {
-                                                        fclose(fp);
-                                                        return -1;
-                                                    }
-
-                                                    size_t readBytes = fread(buffer, 1, (size_t)newSize, fp);
-                                                    buffer[readBytes] = '\0';
-                                                    fclose(fp);
-
-                                                    fp = fopen(op.filename, "wb");
-                                                    if (!fp) {
-                                                        free(buffer);
-                                                        return -1;
-                                                    }
-
-                                                    fwrite(buffer, 1, (size_t)newSize, fp);
-                                                    fclose(fp);
-                                                    free(buffer);
-
-                                                    if (outFilename && bufSize > 0) {
-                                                        strncpy(outFilename, op.filename, bufSize - 1);
-                                                        outFilename[bufSize - 1] = '\0';
-                                                    }
-
-                                                    return 1; /* undo complete */
-                                                }
+long long model_getFileSize(const char *filename) {
+    uint64_t t0 = stats_begin();
+    long long rc = vault_getFileSize(defaultVault, filename);
+    stats_end(STAT_GET_SIZE, t0);
+    return rc;
+}
+
+int model_readFile(const char *filename, ModelChunkFn fn, void *ctx) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_readFile(defaultVault, filename, fn, ctx);
+    stats_end(STAT_READ_FILE, t0);
+    return rc;
+}
+
+int model_readRange(const char *filename, long long offset, long long length,
+                    ModelChunkFn fn, void *ctx) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_readRange(defaultVault, filename, offset, length, fn, ctx);
+    stats_end(STAT_READ_RANGE, t0);
+    return rc;
+}
+
+int model_findLines(const char *filename, long long first, long long count,
+                    long long *offset, long long *length) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_findLines(defaultVault, filename, first, count, offset, length);
+    stats_end(STAT_FIND_LINES, t0);
+    return rc;
+}
+
+int model_findTail(const char *filename, long long count,
+                   long long *offset, long long *length) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_findTail(defaultVault, filename, count, offset, length);
+    stats_end(STAT_FIND_LINES, t0);
+    return rc;
+}
+
+int model_mapFile(const char *filename, ModelChunkFn fn, void *ctx) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_mapFile(defaultVault, filename, fn, ctx);
+    stats_end(STAT_MAP_FILE, t0);
+    return rc;
+}
+
+int model_sendFile(const char *filename, int outFd, int *lastChar) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_sendFile(defaultVault, filename, outFd, lastChar);
+    stats_end(STAT_SEND_FILE, t0);
+    return rc;
+}
+
+int model_appendToFile(const char *filename,
+                       const char *text,
+                       long long *appendedLen) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_appendToFile(defaultVault, filename, text, appendedLen);
+    stats_end(STAT_APPEND, t0);
+    return rc;
+}
+
+int model_appendStream(const char *filename, ModelSourceFn fn, void *ctx,
+                       long long *appendedLen) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_appendStream(defaultVault, filename, fn, ctx, appendedLen);
+    stats_end(STAT_APPEND_STREAM, t0);
+    return rc;
+}
+
+int model_search(const char *term, ModelSearchFn fn, void *ctx) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_search(defaultVault, term, fn, ctx);
+    stats_end(STAT_SEARCH, t0);
+    return rc;
+}
+
+int model_verifyFile(const char *filename) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_verifyFile(defaultVault, filename);
+    stats_end(STAT_VERIFY_FILE, t0);
+    return rc;
+}
+
+int model_scrub(int threads, ModelScrubFn fn, void *ctx, ModelScrub *out) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_scrub(defaultVault, threads, fn, ctx, out);
+    stats_end(STAT_SCRUB, t0);
+    return rc;
+}
+
+int model_importTree(const char *dir, const char *password,
+                     const char *manifest, int threads, ModelBulk *out) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_importTree(defaultVault, dir, password, manifest, threads, out);
+    stats_end(STAT_IMPORT, t0);
+    return rc;
+}
+
+int model_exportArchive(const char *path, int threads, ModelBulk *out) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_exportArchive(defaultVault, path, threads, out);
+    stats_end(STAT_EXPORT, t0);
+    return rc;
+}
+
+int model_importArchive(const char *path, int threads, ModelBulk *out) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_importArchive(defaultVault, path, threads, out);
+    stats_end(STAT_IMPORT, t0);
+    return rc;
+}
+
+void model_recordRecent(const char *filename) {
+    uint64_t t0 = stats_begin();
+    vault_recordRecent(defaultVault, filename);
+    stats_end(STAT_RECORD_RECENT, t0);
+}
+
+int model_getRecent(char names[][MAX_LEN], int maxCount) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_getRecent(defaultVault, names, 0, maxCount);
+    stats_end(STAT_GET_RECENT, t0);
+    return rc;
+}
+
+int model_getRecentPage(char names[][MAX_LEN], int offset, int maxCount) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_getRecent(defaultVault, names, offset, maxCount);
+    stats_end(STAT_GET_RECENT, t0);
+    return rc;
+}
+
+int model_undoLastAppend(char *outFilename, size_t bufSize) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_undoLastAppend(defaultVault, outFilename, bufSize);
+    stats_end(STAT_UNDO_LAST, t0);
+    return rc;
+}
+
+int model_redoLastUndo(char *outFilename, size_t bufSize) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_redoLastUndo(defaultVault, outFilename, bufSize);
+    stats_end(STAT_REDO_LAST, t0);
+    return rc;
+}
+
+int model_undoFileAppend(const char *filename) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_undoFileAppend(defaultVault, filename);
+    stats_end(STAT_UNDO_FILE, t0);
+    return rc;
+}
+
+int model_redoFileAppend(const char *filename) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_redoFileAppend(defaultVault, filename);
+    stats_end(STAT_REDO_FILE, t0);
+    return rc;
+}
+
+long long model_countVersions(const char *filename) {
+    uint64_t t0 = stats_begin();
+    long long n = vault_countVersions(defaultVault, filename);
+    stats_end(STAT_VERSIONS, t0);
+    return n;
+}
+
+int model_getVersions(const char *filename, long long first, ModelVersion *out,
+                      int maxCount) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_getVersions(defaultVault, filename, first, out, maxCount);
+    stats_end(STAT_VERSIONS, t0);
+    return rc;
+}
+
+long long model_findVersion(const char *filename, long long time) {
+    uint64_t t0 = stats_begin();
+    long long n = vault_findVersion(defaultVault, filename, time);
+    stats_end(STAT_VERSIONS, t0);
+    return n;
+}
+
+int model_readVersion(const char *filename, long long version, ModelChunkFn fn,
+                      void *ctx) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_readVersion(defaultVault, filename, version, fn, ctx);
+    stats_end(STAT_READ_VERSION, t0);
+    return rc;
+}
+
+int model_diffVersions(const char *filename, long long from, long long to,
+                       long long *offset, long long *length) {
+    uint64_t t0 = stats_begin();
+    int rc = vault_diffVersions(defaultVault, filename, from, to, offset, length);
+    stats_end(STAT_VERSIONS, t0);
+    return rc;
+}
@@ -4,43 +4,62 @@
 #define MODEL_H
 
 #include <stddef.h>
+#include <stdint.h>
 
-#define MAX_FILES   100
-#define MAX_LEN     100
-#define RECENT_MAX  5
-#define UNDO_MAX    50
+#define MAX_LEN     4096   /* longest filename or password, plus NUL */
+#define RECENT_MAX  5      /* recent files shown per page in the menu */
 
-typedef struct {
-    char filename[MAX_LEN];
-    char password[MAX_LEN];
-} Vault;
+/* Initialization: opens the default vault in the current directory,
+ * which every model_* function below operates on.
+ * returns 0, or -1 (errno set) if it cannot be opened */
+int  model_init(void);
 
-typedef struct {
-    char filename[MAX_LEN];
-} RecentFile;
+/* Flushes the metadata journal and waits for any background compaction.
+ * Call once before exiting. */
+void model_shutdown(void);
 
-typedef struct {
-    RecentFile data[RECENT_MAX];
-    int front;
-    int rear;
-    int count;
-} Queue;
+/* Durability of vault metadata changes (see journal.h) */
+#define MODEL_SYNC_NONE   0   /* leave flushing to the OS */
+#define MODEL_SYNC_ALWAYS 1   /* fsync after every change */
+#define MODEL_SYNC_GROUP  2   /* fsync once per groupSize changes or groupMs */
 
-typedef struct {
-    char filename[MAX_LEN];
-    int length;
-} UndoOp;
+/* applies to the default vault and to vaults opened afterwards */
+void model_setSyncPolicy(int mode, int groupSize, int groupMs);
+
+/* Passwords are stored as salted PBKDF2-HMAC-SHA256 hashes; iterations
+ * is the cost of every new hash (and so of every uncached verification).
+ * Applies to the default vault and to vaults opened afterwards. Entries
+ * still in plaintext are rehashed on their next successful verification. */
+void model_setKdfCost(uint32_t iterations);
 
-/* Initialization */
-void model_init(void);
+/* Compression: with it on, appends store files as blocks of 64 KiB of
+ * plaintext, each compressed on its own before it is encrypted. An
+ * append recompresses only the file's last block, and range reads decode
+ * only the blocks they touch. Files keep the blocks they were written
+ * with, so it can be switched at any time; while it is on, reads of a
+ * file wait for appends to it. Undoing an append that recompressed a
+ * block needs the file unlocked. Off by default; applies to the default
+ * vault and to vaults opened afterwards. */
+void model_setCompression(int on);
+
+/* Deduplication: with it on, appends are cut into content-defined chunks
+ * of 2-64 KiB (8 KiB on average) and each distinct chunk is stored once
+ * for the whole vault, in vault.chunks; the file keeps only a reference
+ * per chunk. Chunks are encrypted under a key derived from their content
+ * (see chunkstore.h), so files with different passwords share them. A
+ * chunk never spans two appends, and chunks are never removed. Takes
+ * precedence over compression, which then compresses the stored chunks.
+ * Off by default; applies to the default vault and to vaults opened
+ * afterwards. */
+void model_setDedup(int on);
 
 /* Vault operations */
 int  model_addFile(const char *filename, const char *password);
 /* returns:
  *   0 = success
- *  -1 = vault full
+ *  -1 = out of memory (or no randomness for the salt)
  *  -2 = file already exists
- *  -3 = file create error
+ *  -3 = file create error (or name/password too long)
  */
 
 int  model_changePassword(const char *filename,
@@ -50,6 +69,8 @@ int  model_changePassword(const char *filename,
  *   0 = success
  *  -1 = file not found
  *  -2 = wrong old password
+ *  -3 = new password too long (or the file could not be unlocked)
+ * The contents are not re-encrypted; only the wrapped key changes.
  */
 
 int  model_verifyPassword(const char *filename, const char *password);
@@ -57,34 +78,381 @@ int  model_verifyPassword(const char *filename, const char *password);
  *   1 = ok
  *   0 = wrong password
  *  -1 = file not found
+ * Full cost only the first time per file and password; repeats are
+ * answered from the session cache.
  */
 
-/* File content operations */
+int  model_fileExists(const char *filename);
+/* cheap existence probe (no password check). returns 1 or 0 */
+
+/* File content operations. Contents are encrypted at rest with ChaCha20
+ * under a random per-file key, which only a correct password unwraps
+ * (cipher.h, kdf.h). A file is unlocked by model_addFile or a successful
+ * model_verifyPassword and stays so until shutdown; on a file that is
+ * not unlocked every function below fails. Files from before encryption
+ * are encrypted in place on their first unlock. */
 char *model_getFileContents(const char *filename);
-/* returns malloc'd string or NULL (caller must free) */
+/* returns malloc'd string or NULL (caller must free).
+ * Holds the whole file in memory; prefer the streaming readers below. */
+
+/* Streaming reads: fn is handed the file in blocks of MODEL_CHUNK_SIZE
+ * bytes (the last one may be shorter) and returns nonzero to stop early.
+ * Memory use is one block regardless of file size. */
+#define MODEL_CHUNK_SIZE  (64 * 1024)
+#define MODEL_MAP_WINDOW  (64L * 1024 * 1024)
+
+typedef int (*ModelChunkFn)(void *ctx, const char *data, size_t len);
+
+int  model_readFile(const char *filename, ModelChunkFn fn, void *ctx);
+/* read()-based.
+ * returns:
+ *   0 = whole file delivered
+ *   1 = stopped by fn
+ *  -1 = open/read error
+ */
+
+int  model_mapFile(const char *filename, ModelChunkFn fn, void *ctx);
+/* same contract, served from an mmap window of MODEL_MAP_WINDOW bytes */
+
+int  model_readRange(const char *filename, long long offset, long long length,
+                     ModelChunkFn fn, void *ctx);
+/* hands fn the plaintext bytes [offset, offset + length), cut short at
+ * the end of the file, reading and decrypting only the frames holding
+ * them; fn sees at most MODEL_CHUNK_SIZE bytes at a time.
+ * returns:
+ *   0 = range delivered (nothing if offset is past the end)
+ *   1 = stopped by fn
+ *  -1 = open/read error, or a negative offset or length
+ */
+
+int  model_findLines(const char *filename, long long first, long long count,
+                     long long *offset, long long *length);
+int  model_findTail(const char *filename, long long count,
+                    long long *offset, long long *length);
+/* the plaintext range holding count lines from line first (counted from
+ * 1), or the last count lines, to hand to model_readRange. A line ends
+ * just past its '\n'; a final newline does not start another line, and
+ * lines past the end make the range shorter or empty. The line index
+ * kept for this is sparse and in memory: appends extend it, undo cuts
+ * it, and a lookup past it reads only from the last entry on. The last
+ * lines are found reading back from the end.
+ * returns:
+ *   0 = *offset and *length set
+ *  -1 = open/read error, or first < 1 or count < 0
+ */
+
+int  model_sendFile(const char *filename, int outFd, int *lastChar);
+/* decrypts the file to outFd. *lastChar is the final byte, or -1 if
+ * empty.
+ * returns:
+ *   0 = success
+ *  -1 = open/read/write error
+ */
+
+long long model_getFileSize(const char *filename);
+/* returns the plaintext size in bytes, or -1 if the file cannot be read */
 
 int  model_appendToFile(const char *filename,
                         const char *text,
-                        int *appendedLen);
-/* returns:
+                        long long *appendedLen);
+/* encrypts only the new bytes; *appendedLen is the plaintext length
+ * appended.
+ * returns:
  *   0 = success
- *  -1 = file open error
+ *  -1 = file open/write error (or the file is not unlocked)
  *  -2 = nothing appended
  */
 
-/* Recent files */
+/* Streaming appends: fn sets *data to the next bytes and returns their
+ * count, 0 at the end of the input, or -1 to abort. Data of any size is
+ * written through as it arrives and recorded as one undo entry. fn runs
+ * with the file locked; an abort or error leaves the file as it was. */
+typedef long (*ModelSourceFn)(void *ctx, const char **data);
+
+int  model_appendStream(const char *filename, ModelSourceFn fn, void *ctx,
+                        long long *appendedLen);
+/* returns the model_appendToFile codes; *appendedLen is the plaintext
+ * length appended */
+
+/* Content cache: the plaintext of files read whole (model_readFile and
+ * what is built on it) is kept in memory, least recently used first
+ * out, up to a budget of bytes; a file over a quarter of the budget is
+ * not kept. Later reads, sizes and ranges of it come from memory.
+ * Appends extend the copy and undo trims it; changes made outside fv
+ * are noticed through inotify and the file's size and modification
+ * time. 0 turns it off. */
+#define MODEL_CACHE_BYTES (64UL * 1024 * 1024)
+
+/* applies to the default vault and to vaults opened afterwards */
+void model_setCacheSize(size_t bytes);
+
+/* Asynchronous I/O: streaming reads, appends and bulk copies keep their
+ * reads and writes queued on io_uring, several in flight at a time, and
+ * store files stay open between operations. Off, or where the kernel
+ * has no io_uring, the same queues run on blocking calls. On by default;
+ * applies to the default vault and to vaults opened afterwards. */
+void model_setAsyncIo(int on);
+
+/* Full-text search over the files unlocked so far. A word is a run of
+ * letters, digits, '_' and non-ASCII bytes, matched regardless of ASCII
+ * case. Appends are indexed as they are written and undo/redo apply at
+ * once; files from before the index are indexed on their first unlock.
+ * fn is handed every matching file with its number of occurrences, most
+ * first, and returns nonzero to stop. */
+typedef int (*ModelSearchFn)(void *ctx, const char *filename, long long hits);
+
+int  model_search(const char *term, ModelSearchFn fn, void *ctx);
+/* returns:
+ *  >=0 = number of matching files
+ *   -1 = the index cannot be opened (or out of memory)
+ *   -2 = term is not a single word
+ */
+
+/* Integrity: vault.sums keeps each file's size and the CRC-32C of its
+ * bytes as stored, encrypted, so checking needs no password. Appends,
+ * undo and redo update it from the bytes they touch, never by reading
+ * the whole file. Files from before it was kept get a checksum the first
+ * time they are verified. */
+#define MODEL_SUM_OK      0   /* matches */
+#define MODEL_SUM_NEW     1   /* had none; the current one is recorded */
+#define MODEL_SUM_CHANGED 2   /* size differs: changed outside the vault */
+#define MODEL_SUM_DAMAGED 3   /* same size, different bytes */
+#define MODEL_SUM_KINDS   4
+
+int  model_verifyFile(const char *filename);
+/* returns a MODEL_SUM_* code, or -1 if the file is not in the vault or
+ * cannot be read */
+
+typedef struct {
+    long      files;                     /* files checked */
+    long      status[MODEL_SUM_KINDS];   /* of those, by MODEL_SUM_* */
+    long      unreadable;
+    long long bytes;                     /* read and summed */
+    int       indexDamaged;              /* vault.idx fails its own checks */
+} ModelScrub;
+
+/* handed every file whose status is not MODEL_SUM_OK (-1 = unreadable),
+ * from the calling thread once all are checked and out is filled in;
+ * nonzero stops */
+typedef int (*ModelScrubFn)(void *ctx, const char *filename, int status);
+
+int  model_scrub(int threads, ModelScrubFn fn, void *ctx, ModelScrub *out);
+/* verifies every file in the vault, threads at a time (0 = one per
+ * CPU), and vault.idx. Appends to a file wait while it is read.
+ * returns 0, or -1 if out of memory */
+
+/* Bulk transfer: whole trees in and whole vaults out, on a pool of
+ * threads at a time (0 = one per CPU) that encrypts, copies and
+ * checksums files in parallel, then commits them to the vault at once:
+ * one sync of the files, one of the metadata. Names already in the
+ * vault are skipped and keep their contents. Files brought in are
+ * locked until their first verification, which also indexes them for
+ * search. */
+typedef struct {
+    long      files;     /* brought in or written out */
+    long      skipped;   /* already in the vault, or without a password */
+    long      failed;    /* unreadable, too long a name, or damaged */
+    long long bytes;     /* plaintext imported, or stored bytes copied */
+} ModelBulk;
+
+int  model_importTree(const char *dir, const char *password,
+                      const char *manifest, int threads, ModelBulk *out);
+/* adds every regular file under dir as a new vault file named by its
+ * path from dir ("a/b.txt"); symbolic links are not followed. A file
+ * gets the password the manifest gives it, if any, else password; with
+ * neither it is skipped. Manifest lines are "<password> <name>", the
+ * name running to the end of the line; blank and '#' lines are ignored.
+ * Each file costs one KDF run, as model_addFile does.
+ * returns 0, or -1 if dir or the manifest cannot be read (or out of
+ * memory) */
+
+int  model_exportArchive(const char *path, int threads, ModelBulk *out);
+/* writes every file of the vault as stored, encrypted, with its stored
+ * secret and the shared chunks (archive.h) to the archive at path.
+ * Appends to a file wait while it is copied. Files not matching their
+ * checksum are left out and counted as failed.
+ * returns 0, or -1 if the archive cannot be written (it is removed) */
+
+int  model_importArchive(const char *path, int threads, ModelBulk *out);
+/* brings in the files of an archive, their passwords unchanged; no KDF
+ * runs. Files whose bytes fail the archive's checksum are counted as
+ * failed.
+ * returns:
+ *   0 = success
+ *  -1 = the archive cannot be read (or out of memory)
+ *  -2 = not an archive, or its index or chunks are damaged
+ */
+
+/* Recent files: an LRU of the last `capacity` files accessed, kept in
+ * vault.recent across restarts. Recording and eviction are O(1). */
+#define MODEL_RECENT_CAPACITY 256
+
+/* applies to the default vault and to vaults opened afterwards */
+void model_setRecentCapacity(int capacity);
+
 void model_recordRecent(const char *filename);
 
 /* fill from most recent to oldest (up to maxCount).
  *   returns actual count. */
 int  model_getRecent(char names[][MAX_LEN], int maxCount);
 
-/* Undo */
+/* the same, starting at the offset-th most recent (0 = newest) */
+int  model_getRecentPage(char names[][MAX_LEN], int offset, int maxCount);
+
+/* Undo / redo. Every append is remembered per file, on disk, with the
+ * file's exact size before it; undo truncates back to that size and
+ * redo re-appends the same bytes (for a recompressed last block, undo
+ * cuts at the block's start and seals its old contents again). The
+ * *Last* variants act on the most recent append (undo) or undo (redo)
+ * across all files. */
 int  model_undoLastAppend(char *outFilename, size_t bufSize);
+int  model_redoLastUndo(char *outFilename, size_t bufSize);
+int  model_undoFileAppend(const char *filename);
+int  model_redoFileAppend(const char *filename);
 /* returns:
- *   1 = undo done
- *   0 = nothing to undo
- *  -1 = error (file open/memory/etc)
+ *   1 = done
+ *   0 = nothing to undo / redo
+ *  -1 = error (file open/write/etc)
+ *  -2 = file was changed outside the vault; the entry was discarded
+ *  -3 = the append recompressed a block and the file is not unlocked
  */
 
+/* Version history: every append is a version of its file, recorded in
+ * vault.history with where it starts in the plaintext, how many bytes it
+ * added, when, and a check of those bytes keyed by the file's data key,
+ * so the history file alone gives no plaintext away; 32 bytes per
+ * append, never a copy of the content. Version n is the file as it was right after its nth
+ * append, its first offset + length bytes, so reading it is a range read
+ * and a later version differs from an earlier one only by the bytes
+ * appended in between. Versions count from 1; version 0 is the empty
+ * file. Undo hides the versions it cuts off and redo brings them back;
+ * the next append after an undo replaces them. Content older than the
+ * history, or restored from an archive, belongs to no version but is
+ * part of every later one. All of these need the file unlocked. */
+typedef struct {
+    long long offset;   /* plaintext offset the append started at */
+    long long length;   /* bytes it added */
+    long long time;     /* when, in ms since the epoch */
+    uint32_t  check;    /* keyed check of those bytes (history.h) */
+} ModelVersion;
+
+long long model_countVersions(const char *filename);
+/* returns the number of versions, or -1 if the file cannot be read */
+
+int  model_getVersions(const char *filename, long long first, ModelVersion *out,
+                       int maxCount);
+/* fills out with versions first, first + 1, ..., at most maxCount.
+ * returns how many, or -1 on a read error or first < 1 */
+
+long long model_findVersion(const char *filename, long long time);
+/* returns the last version made at or before time (ms since the epoch),
+ * 0 if none was, or -1 if the file cannot be read */
+
+int  model_readVersion(const char *filename, long long version,
+                       ModelChunkFn fn, void *ctx);
+/* hands fn the file as of version, as model_readRange does, checking the
+ * bytes of every version up to it against their checks on the way.
+ * returns:
+ *   0 = version delivered
+ *   1 = stopped by fn
+ *  -1 = no such version, or an open/read error
+ *  -2 = delivered, but the bytes do not match their versions: the file
+ *       was changed outside the vault, or is damaged
+ */
+
+int  model_diffVersions(const char *filename, long long from, long long to,
+                        long long *offset, long long *length);
+/* the plaintext range the later of two versions adds to the earlier,
+ * to hand to model_readRange; appends only add, so that range is all
+ * that differs. returns 0, or -1 if either version does not exist */
+
+/* ---------- vault handles ----------
+ *
+ * The same operations on an explicit vault. Each VaultCtx owns its
+ * metadata files, undo history, recent list and locks, so vaults opened
+ * from different directories never contend with each other; one vault
+ * may be shared between threads. Filenames are names, not paths: the
+ * files are kept in the hashed tree under dir/vault.store (fanout.h),
+ * where a vault from before it has them moved on its first open. Return
+ * codes match the model_* functions above.
+ */
+typedef struct VaultCtx VaultCtx;
+
+VaultCtx *model_open(const char *dir);
+/* opens (creating the directory if needed) the vault stored in dir.
+ * returns the handle, or NULL if dir cannot be used or its vault.idx
+ * is damaged (errno EBADMSG) */
+
+void model_close(VaultCtx *v);
+/* flushes and frees v; no other thread may be using it */
+
+VaultCtx *model_default(void);
+/* the vault behind the model_* functions, or NULL before model_init */
+
+void vault_setSyncPolicy(VaultCtx *v, int mode, int groupSize, int groupMs);
+void vault_setKdfCost(VaultCtx *v, uint32_t iterations);
+void vault_setCompression(VaultCtx *v, int on);
+void vault_setDedup(VaultCtx *v, int on);
+void vault_setCacheSize(VaultCtx *v, size_t bytes);
+void vault_setAsyncIo(VaultCtx *v, int on);
+
+/* verifications answered from / missing the session cache so far */
+void vault_getSessionStats(VaultCtx *v, long *hits, long *misses);
+
+int  vault_addFile(VaultCtx *v, const char *filename, const char *password);
+int  vault_changePassword(VaultCtx *v, const char *filename,
+                          const char *oldPwd, const char *newPwd);
+int  vault_verifyPassword(VaultCtx *v, const char *filename,
+                          const char *password);
+int  vault_fileExists(VaultCtx *v, const char *filename);
+
+char *vault_getFileContents(VaultCtx *v, const char *filename);
+int  vault_readFile(VaultCtx *v, const char *filename,
+                    ModelChunkFn fn, void *ctx);
+int  vault_mapFile(VaultCtx *v, const char *filename,
+                   ModelChunkFn fn, void *ctx);
+int  vault_readRange(VaultCtx *v, const char *filename, long long offset,
+                     long long length, ModelChunkFn fn, void *ctx);
+int  vault_findLines(VaultCtx *v, const char *filename, long long first,
+                     long long count, long long *offset, long long *length);
+int  vault_findTail(VaultCtx *v, const char *filename, long long count,
+                    long long *offset, long long *length);
+int  vault_sendFile(VaultCtx *v, const char *filename,
+                    int outFd, int *lastChar);
+long long vault_getFileSize(VaultCtx *v, const char *filename);
+int  vault_appendToFile(VaultCtx *v, const char *filename,
+                        const char *text, long long *appendedLen);
+int  vault_appendStream(VaultCtx *v, const char *filename,
+                        ModelSourceFn fn, void *ctx, long long *appendedLen);
+int  vault_search(VaultCtx *v, const char *term, ModelSearchFn fn, void *ctx);
+int  vault_verifyFile(VaultCtx *v, const char *filename);
+int  vault_scrub(VaultCtx *v, int threads, ModelScrubFn fn, void *ctx,
+                 ModelScrub *out);
+
+int  vault_importTree(VaultCtx *v, const char *dir, const char *password,
+                      const char *manifest, int threads, ModelBulk *out);
+int  vault_exportArchive(VaultCtx *v, const char *path, int threads,
+                         ModelBulk *out);
+int  vault_importArchive(VaultCtx *v, const char *path, int threads,
+                         ModelBulk *out);
+
+void vault_setRecentCapacity(VaultCtx *v, int capacity);
+void vault_recordRecent(VaultCtx *v, const char *filename);
+int  vault_getRecent(VaultCtx *v, char names[][MAX_LEN],
+                     int offset, int maxCount);
+
+int  vault_undoLastAppend(VaultCtx *v, char *outFilename, size_t bufSize);
+int  vault_redoLastUndo(VaultCtx *v, char *outFilename, size_t bufSize);
+int  vault_undoFileAppend(VaultCtx *v, const char *filename);
+int  vault_redoFileAppend(VaultCtx *v, const char *filename);
+
+long long vault_countVersions(VaultCtx *v, const char *filename);
+int  vault_getVersions(VaultCtx *v, const char *filename, long long first,
+                       ModelVersion *out, int maxCount);
+long long vault_findVersion(VaultCtx *v, const char *filename, long long time);
+int  vault_readVersion(VaultCtx *v, const char *filename, long long version,
+                       ModelChunkFn fn, void *ctx);
+int  vault_diffVersions(VaultCtx *v, const char *filename, long long from,
+                        long long to, long long *offset, long long *length);
+
 #endif // MODEL_H
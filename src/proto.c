@@ -0,0 +1,172 @@
+// proto.c - wire format between the vault daemon and its clients
+
+#include "proto.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* ---------- helper: encoding ---------- */
+
+static void putU32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t getU32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void putU64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t getU64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+/* ---------- public: raw I/O ---------- */
+
+int proto_readFull(int fd, void *buf, size_t len) {
+    char *p = (char *)buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int proto_writeFull(int fd, const void *buf, size_t len) {
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* ---------- public: requests ---------- */
+
+int proto_recvRequest(int fd, ProtoRequest *req) {
+    unsigned char hdr[PROTO_REQ_HEADER];
+    memset(req, 0, sizeof(*req));
+    if (proto_readFull(fd, hdr, sizeof(hdr)) != 0) return -1;
+
+    uint32_t bodyLen = getU32(hdr + 4);
+    req->op         = hdr[0];
+    req->fieldCount = hdr[1];
+    if (req->fieldCount > PROTO_MAX_FIELDS || bodyLen > PROTO_MAX_BODY)
+        return PROTO_ERR_BADREQ;
+
+    /* one spare byte per field so every field can be NUL-terminated */
+    req->body = (unsigned char *)malloc(bodyLen + PROTO_MAX_FIELDS + 1);
+    if (!req->body) return -1;
+    if (proto_readFull(fd, req->body, bodyLen) != 0) {
+        proto_freeRequest(req);
+        return -1;
+    }
+
+    /* shift each field right by one per preceding field to make room */
+    unsigned char *src = req->body;
+    unsigned char *end = req->body + bodyLen;
+    uint32_t       lens[PROTO_MAX_FIELDS];
+    size_t         offs[PROTO_MAX_FIELDS];
+    int parsed = 0;
+    for (int i = 0; i < req->fieldCount; i++, parsed++) {
+        if (end - src < 4) break;
+        lens[i] = getU32(src);
+        src += 4;
+        if ((uint32_t)(end - src) < lens[i]) break;
+        offs[i] = (size_t)(src - req->body);
+        src += lens[i];
+    }
+    if (parsed != req->fieldCount || src != end) {
+        proto_freeRequest(req);
+        return PROTO_ERR_BADREQ;
+    }
+
+    for (int i = req->fieldCount - 1; i >= 0; i--) {
+        unsigned char *dst = req->body + offs[i] + (size_t)i;
+        memmove(dst, req->body + offs[i], lens[i]);
+        dst[lens[i]]     = '\0';
+        req->field[i]    = (const char *)dst;
+        req->fieldLen[i] = lens[i];
+    }
+    return 0;
+}
+
+void proto_freeRequest(ProtoRequest *req) {
+    free(req->body);
+    req->body = NULL;
+}
+
+int proto_sendRequest(int fd, int op, int fieldCount,
+                      const char *const *field, const uint32_t *fieldLen) {
+    unsigned char hdr[PROTO_REQ_HEADER];
+    unsigned char lens[PROTO_MAX_FIELDS][4];
+    struct iovec  iov[1 + 2 * PROTO_MAX_FIELDS];
+    uint32_t      bodyLen = 0;
+
+    if (fieldCount > PROTO_MAX_FIELDS) return -1;
+    for (int i = 0; i < fieldCount; i++) {
+        putU32(lens[i], fieldLen[i]);
+        iov[1 + 2 * i].iov_base = lens[i];
+        iov[1 + 2 * i].iov_len  = 4;
+        iov[2 + 2 * i].iov_base = (void *)field[i];
+        iov[2 + 2 * i].iov_len  = fieldLen[i];
+        bodyLen += 4 + fieldLen[i];
+    }
+    hdr[0] = (unsigned char)op;
+    hdr[1] = (unsigned char)fieldCount;
+    hdr[2] = hdr[3] = 0;
+    putU32(hdr + 4, bodyLen);
+    iov[0].iov_base = hdr;
+    iov[0].iov_len  = sizeof(hdr);
+
+    /* one syscall for the common case; finish by hand on a short write */
+    int     cnt = 1 + 2 * fieldCount;
+    ssize_t n;
+    do {
+        n = writev(fd, iov, cnt);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+
+    size_t done = (size_t)n;
+    for (int i = 0; i < cnt; i++) {
+        if (done >= iov[i].iov_len) {
+            done -= iov[i].iov_len;
+            continue;
+        }
+        const char *rest = (const char *)iov[i].iov_base + done;
+        if (proto_writeFull(fd, rest, iov[i].iov_len - done) != 0) return -1;
+        done = 0;
+    }
+    return 0;
+}
+
+/* ---------- public: responses ---------- */
+
+int proto_sendResponseHeader(int fd, int32_t status, uint64_t payloadLen) {
+    unsigned char hdr[PROTO_RESP_HEADER];
+    putU32(hdr, (uint32_t)status);
+    putU32(hdr + 4, 0);
+    putU64(hdr + 8, payloadLen);
+    return proto_writeFull(fd, hdr, sizeof(hdr));
+}
+
+int proto_recvResponseHeader(int fd, int32_t *status, uint64_t *payloadLen) {
+    unsigned char hdr[PROTO_RESP_HEADER];
+    if (proto_readFull(fd, hdr, sizeof(hdr)) != 0) return -1;
+    *status     = (int32_t)getU32(hdr);
+    *payloadLen = getU64(hdr + 8);
+    return 0;
+}
@@ -0,0 +1,60 @@
+// proto.h - wire format between the vault daemon and its clients
+
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Request:   u8 op | u8 fieldCount | u16 reserved | u32 bodyLength | body
+ *            body = fieldCount x (u32 length | bytes)
+ * Response:  i32 status | u32 reserved | u64 payloadLength | payload
+ * All integers little-endian. status carries the model_* return code of
+ * the operation; READ returns the file contents as payload. A READ
+ * whose file cannot be read once its header is sent closes the
+ * connection before the payload is complete.
+ */
+
+#define PROTO_OP_ADD     1   /* name, password */
+#define PROTO_OP_VERIFY  2   /* name, password */
+#define PROTO_OP_READ    3   /* name, password */
+#define PROTO_OP_APPEND  4   /* name, password, data (any bytes, NULs too) */
+#define PROTO_OP_UNDO    5   /* name, password */
+
+#define PROTO_MAX_FIELDS 4
+#define PROTO_MAX_BODY   (64u * 1024 * 1024)
+
+#define PROTO_REQ_HEADER  8
+#define PROTO_RESP_HEADER 16
+
+/* status values that do not come from the model */
+#define PROTO_ERR_BADREQ  -100
+#define PROTO_ERR_DENIED  -101
+
+typedef struct {
+    int            op;
+    int            fieldCount;
+    const char    *field[PROTO_MAX_FIELDS];   /* NUL-terminated views */
+    uint32_t       fieldLen[PROTO_MAX_FIELDS];
+    unsigned char *body;                      /* owns the field bytes */
+} ProtoRequest;
+
+int  proto_readFull(int fd, void *buf, size_t len);
+int  proto_writeFull(int fd, const void *buf, size_t len);
+/* return 0, or -1 on error / EOF */
+
+int  proto_recvRequest(int fd, ProtoRequest *req);
+/* returns 0, -1 on EOF or I/O error, PROTO_ERR_BADREQ on a malformed
+ * request. On success the caller frees with proto_freeRequest. */
+
+void proto_freeRequest(ProtoRequest *req);
+
+int  proto_sendRequest(int fd, int op, int fieldCount,
+                       const char *const *field, const uint32_t *fieldLen);
+
+int  proto_sendResponseHeader(int fd, int32_t status, uint64_t payloadLen);
+
+int  proto_recvResponseHeader(int fd, int32_t *status, uint64_t *payloadLen);
+
+#endif // PROTO_H
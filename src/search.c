@@ -0,0 +1,1067 @@
+// search.c - full-text index: tokenizer, per-file term dictionaries and log
+
+#include "search.h"
+#include "hashindex.h"
+#include "journal.h"
+#include "kdf.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIC         "FVSEARCH"
+#define HEADER_SIZE   64
+#define HEADER_CRC    60          /* the CRC covers bytes before this */
+#define FILE_SIZE     24
+#define BLOCK_SIZE    16          /* first token, data offset */
+#define BLOCK_ENTRIES 32
+#define NAME_MAX_LEN  0xffff
+
+#define MIN_MAP       16
+#define BUILDER_MAP   1024        /* distinct words of a typical append, x2 */
+#define MERGE_MIN     (16u << 20) /* log bytes that always wait for a merge */
+#define MERGE_MAX     (64u << 20) /* ... and that never do */
+
+/* log records; a change is written as REC_TOKENS batches and a closing
+ * REC_ADD or REC_REMOVE, and one torn off before its closing record is
+ * dropped */
+#define REC_TOKENS    'T'         /* seq, n, n x (u64 token, count) */
+#define REC_ADD       'A'         /* seq, indexed, name, n, n x (...) */
+#define REC_REMOVE    'D'         /* the same, counts taken back */
+#define REC_RESET     'R'         /* seq, name */
+#define BATCH_TOKENS  32768       /* keeps a record far below 1 MiB */
+
+typedef struct {
+    char                *name;
+    uint64_t             indexed;
+    uint64_t             firstBlock; /* its run in the merged index */
+    uint32_t             entryCount;
+    SearchMap            delta;      /* token -> change since, as int32_t */
+} IndexedFile;
+
+struct SearchIndex {
+    char        *indexPath;
+    char        *tmpPath;
+    char        *logPath;
+
+    unsigned char       *map;     /* merged index, NULL = none */
+    size_t               mapSize;
+    const unsigned char *blocks;
+    uint64_t             blockCount;
+    const unsigned char *data;
+    uint64_t             dataLen;
+    uint64_t             maxSeq;  /* log records up to here are merged */
+    uint64_t             seq;     /* last record written or replayed */
+
+    IndexedFile *files;
+    uint32_t     fileCount, fileCap;
+    HashIndex    byName;
+    Journal      log;
+
+    /* replay: REC_TOKENS batches waiting for their closing record */
+    uint64_t     pendSeq;
+    uint64_t    *pendTokens;
+    uint32_t    *pendCounts;
+    size_t       pendLen, pendCap;
+};
+
+/* ---------- helper: little-endian fields and varints ---------- */
+
+static uint32_t get16(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+static uint32_t get32(const unsigned char *p) {
+    return get16(p) | get16(p + 2) << 16;
+}
+
+static uint64_t get64(const unsigned char *p) {
+    return (uint64_t)get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+static void put16(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static void put64(unsigned char *p, uint64_t v) {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static size_t putVarint(unsigned char *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+/* bounded reads; a read past end clears ok and yields zeros */
+typedef struct {
+    const unsigned char *p, *end;
+    int                  ok;
+} Reader;
+
+static uint64_t readVarint(Reader *r) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->p >= r->end) break;
+        unsigned char c = *r->p++;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return v;
+    }
+    r->ok = 0;
+    return 0;
+}
+
+static const unsigned char *readBytes(Reader *r, size_t n) {
+    if (!r->ok || (size_t)(r->end - r->p) < n) {
+        r->ok = 0;
+        return NULL;
+    }
+    const unsigned char *p = r->p;
+    r->p += n;
+    return p;
+}
+
+/* ---------- helper: SipHash-2-4 ---------- */
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                        \
+    do {                                                                \
+        v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32);       \
+        v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2;                          \
+        v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0;                          \
+        v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32);       \
+    } while (0)
+
+static uint64_t siphash(uint64_t k0, uint64_t k1, const unsigned char *in,
+                        size_t len) {
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ull;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dull;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ull;
+    uint64_t v3 = k1 ^ 0x7465646279746573ull;
+    uint64_t b  = (uint64_t)len << 56;
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t m = get64(in + i);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+    for (size_t k = 0; i + k < len; k++)
+        b |= (uint64_t)in[i + k] << (8 * k);
+
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static uint64_t tokenOf(uint64_t k0, uint64_t k1, const char *word, size_t len) {
+    uint64_t t = siphash(k0, k1, (const unsigned char *)word, len);
+    return t ? t : 1;
+}
+
+/* ---------- helper: token maps ---------- */
+
+static int mapInit(SearchMap *m, size_t cap) {
+    m->keys = (uint64_t *)calloc(cap, sizeof(uint64_t));
+    m->vals = (uint32_t *)malloc(cap * sizeof(uint32_t));
+    m->cap  = cap;
+    m->used = 0;
+    return m->keys && m->vals ? 0 : -1;
+}
+
+static void mapFree(SearchMap *m) {
+    free(m->keys);
+    free(m->vals);
+    memset(m, 0, sizeof(*m));
+}
+
+/* the value slot of token, or NULL */
+static uint32_t *mapFind(const SearchMap *m, uint64_t token) {
+    if (m->cap == 0) return NULL;
+    size_t mask = m->cap - 1;
+    for (size_t i = token & mask; m->keys[i] != 0; i = (i + 1) & mask) {
+        if (m->keys[i] == token) return &m->vals[i];
+    }
+    return NULL;
+}
+
+/* the value slot of token, inserted as 0 if new; NULL if out of memory.
+ * Kept at most half full. */
+static uint32_t *mapSlot(SearchMap *m, uint64_t token) {
+    if (2 * (m->used + 1) > m->cap) {
+        SearchMap bigger;
+        if (mapInit(&bigger, m->cap ? 2 * m->cap : MIN_MAP) != 0) {
+            mapFree(&bigger);
+            return NULL;
+        }
+        for (size_t i = 0; i < m->cap; i++) {
+            if (m->keys[i] != 0) *mapSlot(&bigger, m->keys[i]) = m->vals[i];
+        }
+        mapFree(m);
+        *m = bigger;
+    }
+
+    size_t mask = m->cap - 1;
+    size_t i    = token & mask;
+    for (; m->keys[i] != 0; i = (i + 1) & mask) {
+        if (m->keys[i] == token) return &m->vals[i];
+    }
+    m->keys[i] = token;
+    m->vals[i] = 0;
+    m->used++;
+    return &m->vals[i];
+}
+
+/* ---------- helper: tokenizer ---------- */
+
+static int isWordByte(unsigned char c) {
+    return (unsigned)((c | 0x20) - 'a') < 26u || (unsigned)(c - '0') < 10u ||
+           c == '_' || c >= 0x80;
+}
+
+static char lower(unsigned char c) {
+    return (char)((unsigned)(c - 'A') < 26u ? c + 32 : c);
+}
+
+static void endWord(SearchBuilder *b) {
+    if (b->wordLen > 0 && !b->failed) {
+        uint32_t *count = mapSlot(&b->counts, tokenOf(b->k0, b->k1, b->word, b->wordLen));
+        if (count) (*count)++;
+        else b->failed = 1;
+    }
+    b->wordLen = 0;
+    b->inWord  = 0;
+}
+
+/* ---------- helper: files ---------- */
+
+static const char *fileName(void *ctx, int id) {
+    return ((const SearchIndex *)ctx)->files[id].name;
+}
+
+static int findFile(const SearchIndex *s, const char *name) {
+    return hashindex_find(&s->byName, name, hashindex_hash(name));
+}
+
+/* id of name, added with nothing indexed if new; -1 if out of memory */
+static int fileId(SearchIndex *s, const char *name, size_t len) {
+    char *copy = strndup(name, len);
+    if (!copy) return -1;
+    int id = findFile(s, copy);
+    if (id >= 0) {
+        free(copy);
+        return id;
+    }
+
+    if (s->fileCount == s->fileCap) {
+        uint32_t     cap   = s->fileCap ? 2 * s->fileCap : 64;
+        IndexedFile *files = (IndexedFile *)realloc(s->files, sizeof(IndexedFile) * cap);
+        if (!files) {
+            free(copy);
+            return -1;
+        }
+        s->files   = files;
+        s->fileCap = cap;
+    }
+    id = (int)s->fileCount;
+    IndexedFile *f = &s->files[id];
+    memset(f, 0, sizeof(*f));
+    f->name = copy;
+    s->fileCount++;
+    if (hashindex_insert(&s->byName, copy, hashindex_hash(copy), id) != 0) {
+        s->fileCount--;
+        free(copy);
+        return -1;
+    }
+    return id;
+}
+
+static void resetFile(IndexedFile *f) {
+    mapFree(&f->delta);
+    f->indexed    = 0;
+    f->firstBlock = 0;
+    f->entryCount = 0;
+}
+
+/* adds (sign 1) or takes back (sign -1) n (token, count) pairs, zero
+ * tokens skipped, and sets what is indexed. A file whose counts could
+ * not all change is reset. returns 0 or -1 */
+static int applyChange(SearchIndex *s, const char *name, size_t nameLen,
+                       uint64_t indexed, const uint64_t *tokens,
+                       const uint32_t *counts, size_t n, int sign) {
+    int f = fileId(s, name, nameLen);
+    if (f < 0) return -1;
+    IndexedFile *file = &s->files[f];
+
+    for (size_t i = 0; i < n; i++) {
+        if (tokens[i] == 0) continue;
+        uint32_t *d = mapSlot(&file->delta, tokens[i]);
+        if (!d) {
+            resetFile(file);
+            return -1;
+        }
+        *d = (uint32_t)((int32_t)*d + sign * (int32_t)counts[i]);
+    }
+    file->indexed = indexed;
+    return 0;
+}
+
+/* ---------- helper: merged runs ---------- */
+
+static uint64_t getN(const unsigned char *p, unsigned width) {
+    uint64_t v = 0;
+    for (unsigned i = width; i > 0; i--) v = v << 8 | p[i - 1];
+    return v;
+}
+
+/* reads the run of one file in token order */
+typedef struct {
+    const SearchIndex *s;
+    uint64_t           block;     /* next block to open */
+    uint32_t           left;      /* entries of the run not read yet */
+    uint32_t           inBlock;   /* of them, in the open block */
+    unsigned           width;     /* bytes per token gap in the open block */
+    uint64_t           token;     /* the last one read */
+    Reader             r;
+} Cursor;
+
+/* starts c at block k of the run of f */
+static void cursorAt(Cursor *c, const SearchIndex *s, const IndexedFile *f,
+                     uint32_t k) {
+    uint64_t skip = (uint64_t)k * BLOCK_ENTRIES;
+    c->s       = s;
+    c->block   = f->firstBlock + k;
+    c->left    = f->entryCount > skip ? (uint32_t)(f->entryCount - skip) : 0;
+    c->inBlock = 0;
+}
+
+/* the next entry. returns 1, or 0 at the end of the run or of the
+ * readable part of a damaged one */
+static int cursorNext(Cursor *c, uint64_t *token, uint32_t *count) {
+    if (c->left == 0) return 0;
+    if (c->inBlock == 0) {
+        const SearchIndex   *s = c->s;
+        const unsigned char *w = NULL;
+        if (c->block < s->blockCount) {
+            const unsigned char *b   = s->blocks + c->block++ * BLOCK_SIZE;
+            uint64_t             off = get64(b + 8);
+            c->token = get64(b);
+            c->r     = (Reader){ s->data + off, s->data + s->dataLen, off < s->dataLen };
+            w        = readBytes(&c->r, 1);
+        }
+        if (!w || *w == 0 || *w > 8) {
+            c->left = 0;
+            return 0;
+        }
+        c->width   = *w;
+        c->inBlock = c->left < BLOCK_ENTRIES ? c->left : BLOCK_ENTRIES;
+    } else {
+        const unsigned char *gap = readBytes(&c->r, c->width);
+        if (gap) c->token += getN(gap, c->width);
+    }
+    uint32_t n = (uint32_t)readVarint(&c->r);
+    if (!c->r.ok) {
+        c->left = 0;
+        return 0;
+    }
+    c->inBlock--;
+    c->left--;
+    *token = c->token;
+    *count = n;
+    return 1;
+}
+
+/* count of token in the merged run of f */
+static uint32_t mergedCount(const SearchIndex *s, const IndexedFile *f,
+                            uint64_t token) {
+    /* the last block starting at or before token */
+    uint32_t lo = 0, hi = (f->entryCount + BLOCK_ENTRIES - 1) / BLOCK_ENTRIES;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (get64(s->blocks + (f->firstBlock + mid) * BLOCK_SIZE) <= token) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return 0;
+
+    Cursor   c;
+    uint64_t t;
+    uint32_t n;
+    cursorAt(&c, s, f, lo - 1);
+    while (cursorNext(&c, &t, &n) && t <= token) {
+        if (t == token) return n;
+    }
+    return 0;
+}
+
+/* ---------- helper: merged index ---------- */
+
+/* maps indexPath and loads its file table.
+ * returns 0 (also when there is none), -1 on I/O error, -2 if damaged */
+static int loadMerged(SearchIndex *s) {
+    int fd = open(s->indexPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT ? 0 : -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size < HEADER_SIZE) {
+        close(fd);
+        return -2;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    s->map     = (unsigned char *)map;
+    s->mapSize = (size_t)st.st_size;
+
+    const unsigned char *h        = s->map;
+    uint64_t             size     = (uint64_t)st.st_size;
+    uint32_t             files    = get32(h + 12);
+    uint64_t             blocks   = get64(h + 24);
+    uint64_t             dataLen  = get64(h + 32);
+    uint32_t             namesLen = get32(h + 40);
+    uint64_t             tableLen = (uint64_t)files * FILE_SIZE;
+    if (memcmp(h, MAGIC, 8) != 0 || get32(h + 8) != SEARCH_VERSION ||
+        journal_crc(h, HEADER_CRC) != get32(h + HEADER_CRC) ||
+        blocks > size / BLOCK_SIZE || dataLen > size ||
+        HEADER_SIZE + tableLen + namesLen + blocks * BLOCK_SIZE + dataLen != size)
+        return -2;
+
+    /* the data is read with bounds checks, and checked in full by a
+     * verify; everything else is checked here */
+    const unsigned char *table = h + HEADER_SIZE;
+    const unsigned char *names = table + tableLen;
+    s->blocks     = names + namesLen;
+    s->blockCount = blocks;
+    s->data       = s->blocks + blocks * BLOCK_SIZE;
+    s->dataLen    = dataLen;
+    if (journal_crc(table, (size_t)tableLen) != get32(h + 44) ||
+        journal_crc(names, namesLen) != get32(h + 48) ||
+        journal_crc(s->blocks, (size_t)(blocks * BLOCK_SIZE)) != get32(h + 52))
+        return -2;
+    s->maxSeq = s->seq = get64(h + 16);
+
+    Reader r = { names, names + namesLen, 1 };
+    for (uint32_t i = 0; i < files; i++) {
+        const unsigned char *e     = table + (size_t)i * FILE_SIZE;
+        uint64_t             first = get64(e + 8);
+        uint32_t             count = get32(e + 16);
+        size_t               nl    = get16(e + 20);
+        const unsigned char *name  = readBytes(&r, nl);
+        uint64_t             runs  = (count + (uint64_t)BLOCK_ENTRIES - 1) / BLOCK_ENTRIES;
+        if (!name || nl == 0 || memchr(name, '\0', nl) ||
+            first > blocks || runs > blocks - first)
+            return -2;
+        int f = fileId(s, (const char *)name, nl);
+        if (f != (int)i) return -2;   /* out of memory or a repeated name */
+        s->files[f].indexed    = get64(e);
+        s->files[f].firstBlock = first;
+        s->files[f].entryCount = count;
+    }
+    return 0;
+}
+
+/* drops everything held in memory, keeping the paths and the log */
+static void unload(SearchIndex *s) {
+    if (s->map) munmap(s->map, s->mapSize);
+    for (uint32_t i = 0; i < s->fileCount; i++) {
+        free(s->files[i].name);
+        mapFree(&s->files[i].delta);
+    }
+    free(s->files);
+    hashindex_free(&s->byName);
+
+    s->map = NULL;
+    s->mapSize = 0;
+    s->blocks = s->data = NULL;
+    s->blockCount = s->dataLen = 0;
+    s->maxSeq = 0;
+    s->files = NULL;
+    s->fileCount = s->fileCap = 0;
+    hashindex_init(&s->byName, 0, fileName, s);
+}
+
+/* growable output buffer for a merge */
+typedef struct {
+    unsigned char *data;
+    size_t         len, cap;
+    int            failed;
+} Buf;
+
+static unsigned char *bufReserve(Buf *b, size_t n) {
+    if (b->failed) return NULL;
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n) cap *= 2;
+        unsigned char *data = (unsigned char *)realloc(b->data, cap);
+        if (!data) {
+            b->failed = 1;
+            return NULL;
+        }
+        b->data = data;
+        b->cap  = cap;
+    }
+    return b->data + b->len;
+}
+
+/* the runs of a merge, written a block at a time */
+typedef struct {
+    Buf       blocks, data;
+    uint64_t  tokens[BLOCK_ENTRIES];
+    uint32_t  counts[BLOCK_ENTRIES];
+    unsigned  n;
+    uint64_t *merged;             /* one run being rewritten */
+    uint32_t *mergedCounts;
+    uint64_t *added;
+    size_t    cap;
+} MergeOut;
+
+static void flushBlock(MergeOut *m) {
+    if (m->n == 0) return;
+    uint64_t widest = 0;
+    for (unsigned i = 1; i < m->n; i++) {
+        if (m->tokens[i] - m->tokens[i - 1] > widest) widest = m->tokens[i] - m->tokens[i - 1];
+    }
+    unsigned width = 1;
+    while (width < 8 && widest >> (8 * width) != 0) width++;
+
+    unsigned char *b = bufReserve(&m->blocks, BLOCK_SIZE);
+    unsigned char *p = bufReserve(&m->data, 1 + (size_t)m->n * (8 + 5));
+    if (b && p) {
+        put64(b, m->tokens[0]);
+        put64(b + 8, m->data.len);
+        m->blocks.len += BLOCK_SIZE;
+
+        size_t len = 0;
+        p[len++] = (unsigned char)width;
+        for (unsigned i = 0; i < m->n; i++) {
+            if (i > 0) {
+                uint64_t gap = m->tokens[i] - m->tokens[i - 1];
+                for (unsigned k = 0; k < width; k++) p[len++] = (unsigned char)(gap >> (8 * k));
+            }
+            len += putVarint(p + len, m->counts[i]);
+        }
+        m->data.len += len;
+    }
+    m->n = 0;
+}
+
+static void emitEntry(MergeOut *m, uint64_t token, long long count) {
+    if (count <= 0) return;
+    m->tokens[m->n] = token;
+    m->counts[m->n] = count > UINT32_MAX ? UINT32_MAX : (uint32_t)count;
+    if (++m->n == BLOCK_ENTRIES) flushBlock(m);
+}
+
+static int cmpToken(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* room for one run of up to n entries; returns 0 or -1 */
+static int reserveRun(MergeOut *m, size_t n) {
+    if (n <= m->cap) return 0;
+    uint64_t *merged = (uint64_t *)realloc(m->merged, sizeof(uint64_t) * n);
+    if (merged) m->merged = merged;
+    uint32_t *counts = (uint32_t *)realloc(m->mergedCounts, sizeof(uint32_t) * n);
+    if (counts) m->mergedCounts = counts;
+    uint64_t *added = (uint64_t *)realloc(m->added, sizeof(uint64_t) * n);
+    if (added) m->added = added;
+    if (!merged || !counts || !added) return -1;
+    m->cap = n;
+    return 0;
+}
+
+/* the run of f when the log did not change it: its blocks copied as
+ * they are. returns the entries written, -1 if out of memory, or -2 if
+ * the run's blocks do not lie in order in the data */
+static long long copyRun(MergeOut *m, const SearchIndex *s, const IndexedFile *f) {
+    uint64_t runs = (f->entryCount + (uint64_t)BLOCK_ENTRIES - 1) / BLOCK_ENTRIES;
+    if (runs == 0) return 0;
+    const unsigned char *b    = s->blocks + f->firstBlock * BLOCK_SIZE;
+    uint64_t             from = get64(b + 8);
+    uint64_t             to   = f->firstBlock + runs < s->blockCount
+                                ? get64(b + runs * BLOCK_SIZE + 8) : s->dataLen;
+    if (from > to || to > s->dataLen) return -2;
+
+    unsigned char *nb = bufReserve(&m->blocks, (size_t)(runs * BLOCK_SIZE));
+    unsigned char *nd = bufReserve(&m->data, (size_t)(to - from));
+    if (!nb || !nd) return -1;
+    for (uint64_t k = 0; k < runs; k++) {
+        put64(nb + k * BLOCK_SIZE, get64(b + k * BLOCK_SIZE));
+        put64(nb + k * BLOCK_SIZE + 8, get64(b + k * BLOCK_SIZE + 8) - from + m->data.len);
+    }
+    memcpy(nd, s->data + from, (size_t)(to - from));
+    m->blocks.len += (size_t)(runs * BLOCK_SIZE);
+    m->data.len   += (size_t)(to - from);
+    return f->entryCount;
+}
+
+/* writes the run of f: its merged entries changed by the log, and the
+ * tokens the log added, in token order with zero counts dropped. Only
+ * the added tokens need sorting. The delta map is used up.
+ * returns the entries written, or -1 if out of memory */
+static long long emitRun(MergeOut *m, const SearchIndex *s, IndexedFile *f) {
+    if (f->delta.used == 0) {
+        long long copied = copyRun(m, s, f);
+        if (copied != -2) return copied;
+    }
+    if (reserveRun(m, (size_t)f->entryCount + f->delta.used) != 0) return -1;
+
+    /* the merged entries with their changes; a change used is zeroed */
+    Cursor   c;
+    size_t   merged = 0, added = 0;
+    uint64_t t;
+    uint32_t n;
+    cursorAt(&c, s, f, 0);
+    while (cursorNext(&c, &t, &n)) {
+        uint32_t *d = mapFind(&f->delta, t);
+        long long count = (long long)n + (d ? (int32_t)*d : 0);
+        if (d) *d = 0;
+        m->merged[merged]         = t;
+        m->mergedCounts[merged++] = count > UINT32_MAX ? UINT32_MAX
+                                    : count > 0 ? (uint32_t)count : 0;
+    }
+    for (size_t i = 0; i < f->delta.cap; i++) {
+        if (f->delta.keys[i] != 0 && (int32_t)f->delta.vals[i] > 0)
+            m->added[added++] = f->delta.keys[i];
+    }
+    qsort(m->added, added, sizeof(uint64_t), cmpToken);
+
+    uint64_t before = m->blocks.len / BLOCK_SIZE * BLOCK_ENTRIES + m->n;
+    size_t   i = 0, j = 0;
+    while (i < merged || j < added) {
+        if (i < merged && (j == added || m->merged[i] < m->added[j])) {
+            emitEntry(m, m->merged[i], m->mergedCounts[i]);
+            i++;
+        } else {
+            emitEntry(m, m->added[j], (int32_t)*mapFind(&f->delta, m->added[j]));
+            j++;
+        }
+    }
+    uint64_t after = m->blocks.len / BLOCK_SIZE * BLOCK_ENTRIES + m->n;
+    flushBlock(m);   /* a block never spans two runs */
+    return (long long)(after - before);
+}
+
+static int writeFile(const char *path, const Buf *parts, int count) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    int rc = 0;
+    for (int i = 0; rc == 0 && i < count; i++) {
+        const unsigned char *p   = parts[i].data;
+        size_t               len = parts[i].len;
+        while (len > 0) {
+            ssize_t n = write(fd, p, len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                rc = -1;
+                break;
+            }
+            p   += n;
+            len -= (size_t)n;
+        }
+    }
+    if (rc == 0 && fsync(fd) != 0) rc = -1;
+    if (close(fd) != 0) rc = -1;
+    if (rc != 0) unlink(path);
+    return rc;
+}
+
+/* the log size at which a merge is due: the size of the merged index,
+ * so a merge rewrites no more than the log has added, but bounded, as
+ * the changes in the log are also held in memory */
+static uint64_t mergeAt(const SearchIndex *s) {
+    uint64_t at = s->mapSize;
+    return at < MERGE_MIN ? MERGE_MIN : at > MERGE_MAX ? MERGE_MAX : at;
+}
+
+/* folds the log into a fresh merged index, dropping files with nothing
+ * indexed, and starts an empty log. returns 0 or -1 (the old index and
+ * log stay, less the changes used up: they are then dropped too) */
+static int merge(SearchIndex *s) {
+    Buf      table, names;
+    MergeOut m;
+    memset(&table, 0, sizeof(table));
+    memset(&names, 0, sizeof(names));
+    memset(&m, 0, sizeof(m));
+
+    int      ok   = 1;
+    uint32_t kept = 0;
+    for (uint32_t i = 0; ok && i < s->fileCount; i++) {
+        IndexedFile *f  = &s->files[i];
+        size_t       nl = strlen(f->name);
+        if (f->indexed == 0) continue;
+
+        uint64_t       first = m.blocks.len / BLOCK_SIZE;
+        long long      count = emitRun(&m, s, f);
+        unsigned char *e     = bufReserve(&table, FILE_SIZE);
+        unsigned char *n     = nl <= NAME_MAX_LEN ? bufReserve(&names, nl) : NULL;
+        if (!e || !n || count < 0 || count > UINT32_MAX) {
+            ok = 0;
+            break;
+        }
+        put64(e, f->indexed);
+        put64(e + 8, first);
+        put32(e + 16, (uint32_t)count);
+        put16(e + 20, (uint32_t)nl);
+        put16(e + 22, 0);
+        table.len += FILE_SIZE;
+        memcpy(n, f->name, nl);
+        names.len += nl;
+        kept++;
+    }
+    ok = ok && !m.blocks.failed && !m.data.failed && names.len <= UINT32_MAX;
+
+    int rc = -1;
+    if (ok) {
+        unsigned char header[HEADER_SIZE];
+        memset(header, 0, sizeof(header));
+        memcpy(header, MAGIC, 8);
+        put32(header + 8, SEARCH_VERSION);
+        put32(header + 12, kept);
+        put64(header + 16, s->seq);
+        put64(header + 24, m.blocks.len / BLOCK_SIZE);
+        put64(header + 32, m.data.len);
+        put32(header + 40, (uint32_t)names.len);
+        put32(header + 44, journal_crc(table.data, table.len));
+        put32(header + 48, journal_crc(names.data, names.len));
+        put32(header + 52, journal_crc(m.blocks.data, m.blocks.len));
+        put32(header + 56, journal_crc(m.data.data, m.data.len));
+        put32(header + HEADER_CRC, journal_crc(header, HEADER_CRC));
+
+        Buf parts[5] = { { header, sizeof(header), sizeof(header), 0 },
+                         table, names, m.blocks, m.data };
+        if (writeFile(s->tmpPath, parts, 5) == 0) {
+            if (rename(s->tmpPath, s->indexPath) == 0) {
+                journal_syncDir(s->indexPath);
+                rc = 0;
+            } else {
+                unlink(s->tmpPath);
+            }
+        }
+    }
+
+    free(table.data);
+    free(names.data);
+    free(m.blocks.data);
+    free(m.data.data);
+    free(m.merged);
+    free(m.mergedCounts);
+    free(m.added);
+
+    /* on success the new index holds every record so far, and a crash
+     * before the log is emptied only makes the next open skip them by
+     * seq. On failure some changes are used up: both are dropped, and
+     * the files indexed again on their next unlock */
+    uint64_t seq = s->seq;
+    journal_truncate(&s->log);
+    if (rc != 0) unlink(s->indexPath);
+    unload(s);
+    if (rc == 0 && loadMerged(s) != 0) unload(s);
+    s->seq = seq;
+    return rc;
+}
+
+/* ---------- helper: log ---------- */
+
+static void pendPush(SearchIndex *s, uint64_t token, uint32_t count) {
+    if (s->pendLen == s->pendCap) {
+        size_t    cap    = s->pendCap ? 2 * s->pendCap : 1024;
+        uint64_t *tokens = (uint64_t *)realloc(s->pendTokens, sizeof(uint64_t) * cap);
+        if (tokens) s->pendTokens = tokens;
+        uint32_t *counts = (uint32_t *)realloc(s->pendCounts, sizeof(uint32_t) * cap);
+        if (counts) s->pendCounts = counts;
+        if (!tokens || !counts) return;
+        s->pendCap = cap;
+    }
+    s->pendTokens[s->pendLen]   = token;
+    s->pendCounts[s->pendLen++] = count;
+}
+
+static void readCounts(SearchIndex *s, Reader *r) {
+    uint64_t n = readVarint(r);
+    for (uint64_t i = 0; r->ok && i < n; i++) {
+        const unsigned char *t = readBytes(r, 8);
+        uint32_t             c = (uint32_t)readVarint(r);
+        if (t && r->ok) pendPush(s, get64(t), c);
+    }
+}
+
+static const char *readName(Reader *r, size_t *nl) {
+    *nl = (size_t)readVarint(r);
+    const unsigned char *name = readBytes(r, *nl);
+    if (!name || *nl == 0 || memchr(name, '\0', *nl)) {
+        r->ok = 0;
+        return NULL;
+    }
+    return (const char *)name;
+}
+
+static void replayRecord(void *ctx, const unsigned char *rec, size_t len) {
+    SearchIndex *s = (SearchIndex *)ctx;
+    Reader       r = { rec + 1, rec + len, len > 0 };
+    if (len == 0) return;
+
+    uint64_t seq = readVarint(&r);
+    if (!r.ok) return;
+    if (seq > s->seq) s->seq = seq;
+    if (seq != s->pendSeq) s->pendLen = 0;
+    s->pendSeq = seq;
+
+    size_t nl;
+    if (rec[0] == REC_TOKENS) {
+        readCounts(s, &r);
+    } else if (rec[0] == REC_ADD || rec[0] == REC_REMOVE) {
+        uint64_t    indexed = readVarint(&r);
+        const char *name    = readName(&r, &nl);
+        readCounts(s, &r);
+        if (r.ok && seq > s->maxSeq)
+            applyChange(s, name, nl, indexed, s->pendTokens, s->pendCounts,
+                        s->pendLen, rec[0] == REC_ADD ? 1 : -1);
+        s->pendLen = 0;
+    } else if (rec[0] == REC_RESET) {
+        const char *name = readName(&r, &nl);
+        int         f    = r.ok && seq > s->maxSeq ? fileId(s, name, nl) : -1;
+        if (f >= 0) resetFile(&s->files[f]);
+    }
+}
+
+/* writes the counts of b as REC_TOKENS batches and a closing record of
+ * type kind carrying the rest. returns 0 or -1 */
+static int logChange(SearchIndex *s, int kind, const char *file,
+                     uint64_t indexed, const SearchMap *counts) {
+    size_t         nl  = strlen(file);
+    uint64_t       seq = ++s->seq;
+    size_t         max = counts->used < BATCH_TOKENS ? counts->used : BATCH_TOKENS;
+    unsigned char *rec = (unsigned char *)malloc(64 + nl + max * 13);
+    unsigned char *ent = (unsigned char *)malloc(max * 13 + 1);
+    int            rc  = rec && ent && nl <= NAME_MAX_LEN ? 0 : -1;
+
+    size_t i = 0;
+    while (rc == 0) {
+        size_t n = 0, entLen = 0;
+        for (; i < counts->cap && n < BATCH_TOKENS; i++) {
+            if (counts->keys[i] == 0) continue;
+            put64(ent + entLen, counts->keys[i]);
+            entLen += 8;
+            entLen += putVarint(ent + entLen, counts->vals[i]);
+            n++;
+        }
+        int last = i == counts->cap;
+
+        size_t pos = 0;
+        rec[pos++] = (unsigned char)(last ? kind : REC_TOKENS);
+        pos += putVarint(rec + pos, seq);
+        if (last) {
+            pos += putVarint(rec + pos, indexed);
+            pos += putVarint(rec + pos, nl);
+            memcpy(rec + pos, file, nl);
+            pos += nl;
+        }
+        pos += putVarint(rec + pos, n);
+        memcpy(rec + pos, ent, entLen);
+        pos += entLen;
+        if (journal_append(&s->log, rec, pos) != 0) rc = -1;
+        if (last) break;
+    }
+    free(rec);
+    free(ent);
+    return rc;
+}
+
+/* logs and applies one change of file. returns 0 or -1 */
+static int change(SearchIndex *s, int kind, const char *file, uint64_t indexed,
+                  const SearchBuilder *b) {
+    if (b->failed) return -1;
+
+    /* the log only adds durability; the change counts from now on */
+    logChange(s, kind, file, indexed, &b->counts);
+    if (applyChange(s, file, strlen(file), indexed, b->counts.keys,
+                    b->counts.vals, b->counts.cap, kind == REC_ADD ? 1 : -1) != 0)
+        return -1;
+
+    if (s->log.bytes > mergeAt(s)) merge(s);
+    return 0;
+}
+
+/* ---------- public ---------- */
+
+void search_deriveKey(const unsigned char dataKey[32],
+                      unsigned char out[SEARCH_KEY_LEN]) {
+    unsigned char digest[KDF_DIGEST_LEN];
+    hmac_sha256(dataKey, 32, "fv search", 9, digest);
+    memcpy(out, digest, SEARCH_KEY_LEN);
+    memset(digest, 0, sizeof(digest));
+}
+
+int search_normalize(const char *term, char out[SEARCH_TERM_MAX + 1]) {
+    while (*term == ' ' || *term == '\t') term++;
+    size_t len = strlen(term);
+    while (len > 0 && (term[len - 1] == ' ' || term[len - 1] == '\t')) len--;
+    if (len == 0) return -1;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)term[i];
+        if (!isWordByte(c)) return -1;
+        if (i < SEARCH_TERM_MAX) out[i] = lower(c);
+    }
+    if (len > SEARCH_TERM_MAX) len = SEARCH_TERM_MAX;
+    out[len] = '\0';
+    return (int)len;
+}
+
+uint64_t search_token(const unsigned char key[SEARCH_KEY_LEN],
+                      const char *word, size_t len) {
+    return tokenOf(get64(key), get64(key + 8), word, len);
+}
+
+void search_builderInit(SearchBuilder *b, const unsigned char key[SEARCH_KEY_LEN]) {
+    memset(b, 0, sizeof(*b));
+    b->k0 = get64(key);
+    b->k1 = get64(key + 8);
+    if (mapInit(&b->counts, BUILDER_MAP) != 0) b->failed = 1;
+}
+
+void search_builderFeed(SearchBuilder *b, const char *text, size_t len) {
+    const unsigned char *p   = (const unsigned char *)text;
+    const unsigned char *end = p + len;
+    while (p < end && !b->failed) {
+        if (!isWordByte(*p)) {
+            if (b->inWord) endWord(b);
+            p++;
+            continue;
+        }
+        b->inWord = 1;
+        for (; p < end && isWordByte(*p); p++) {
+            if (b->wordLen < SEARCH_TERM_MAX) b->word[b->wordLen++] = lower(*p);
+        }
+    }
+}
+
+void search_builderFinish(SearchBuilder *b) {
+    if (b->inWord) endWord(b);
+}
+
+void search_builderFree(SearchBuilder *b) {
+    mapFree(&b->counts);
+    memset(b, 0, sizeof(*b));
+}
+
+SearchIndex *search_open(const char *indexPath, const char *logPath) {
+    SearchIndex *s = (SearchIndex *)calloc(1, sizeof(SearchIndex));
+    if (!s) return NULL;
+    s->indexPath = strdup(indexPath);
+    s->logPath   = strdup(logPath);
+    s->tmpPath   = (char *)malloc(strlen(indexPath) + 5);
+    s->log.fd    = -1;
+    if (!s->indexPath || !s->logPath || !s->tmpPath ||
+        hashindex_init(&s->byName, 0, fileName, s) != 0) {
+        search_close(s);
+        return NULL;
+    }
+    sprintf(s->tmpPath, "%s.tmp", indexPath);
+
+    int  rc    = loadMerged(s);
+    long valid = 0;   /* a log over a lost index is lost with it */
+    if (rc != 0) {
+        unload(s);
+        if (rc == -2) unlink(indexPath);
+    } else {
+        valid = journal_replay(logPath, replayRecord, s);
+    }
+    if (journal_open(&s->log, logPath, valid) != 0) {
+        search_close(s);
+        return NULL;
+    }
+    journal_setSync(&s->log, JOURNAL_SYNC_NONE, 0, 0);
+    return s;
+}
+
+void search_close(SearchIndex *s) {
+    if (!s) return;
+    journal_close(&s->log);
+    unload(s);
+    hashindex_free(&s->byName);
+    free(s->pendTokens);
+    free(s->pendCounts);
+    free(s->indexPath);
+    free(s->tmpPath);
+    free(s->logPath);
+    free(s);
+}
+
+uint64_t search_indexed(const SearchIndex *s, const char *file) {
+    int f = findFile(s, file);
+    return f < 0 ? 0 : s->files[f].indexed;
+}
+
+int search_add(SearchIndex *s, const char *file, uint64_t pre, uint64_t end,
+               const SearchBuilder *b) {
+    if (search_indexed(s, file) != pre) return -1;
+    return change(s, REC_ADD, file, end, b);
+}
+
+int search_remove(SearchIndex *s, const char *file, uint64_t pre, uint64_t end,
+                  const SearchBuilder *b) {
+    if (search_indexed(s, file) != end) return -1;
+    return change(s, REC_REMOVE, file, pre, b);
+}
+
+int search_reset(SearchIndex *s, const char *file) {
+    int f = findFile(s, file);
+    if (f < 0) return 0;
+
+    size_t         nl  = strlen(file);
+    unsigned char *rec = (unsigned char *)malloc(32 + nl);
+    if (!rec) return -1;
+    size_t pos = 0;
+    rec[pos++] = REC_RESET;
+    pos += putVarint(rec + pos, ++s->seq);
+    pos += putVarint(rec + pos, nl);
+    memcpy(rec + pos, file, nl);
+    pos += nl;
+    journal_append(&s->log, rec, pos);
+    free(rec);
+
+    resetFile(&s->files[f]);
+    return 0;
+}
+
+long long search_count(const SearchIndex *s, const char *file, uint64_t token) {
+    int f = findFile(s, file);
+    if (f < 0) return 0;
+
+    const IndexedFile *fl    = &s->files[f];
+    long long          total = mergedCount(s, fl, token);
+    const uint32_t    *d     = mapFind(&fl->delta, token);
+    if (d) total += (int32_t)*d;
+    return total > 0 ? total : 0;
+}
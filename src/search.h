@@ -0,0 +1,121 @@
+// search.h - full-text index over vault files: blinded per-file term dictionaries
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SEARCH_KEY_LEN   16
+#define SEARCH_TERM_MAX  64       /* longer words are cut to this */
+
+/*
+ * A word is a maximal run of ASCII letters, digits and '_' and of bytes
+ * >= 0x80 (so UTF-8 text stays whole), lowercased in ASCII and cut to
+ * SEARCH_TERM_MAX bytes.
+ *
+ * Words are never stored. Each file has its own search key, derived from
+ * its data key, and the index maps token = SipHash-2-4(search key, word)
+ * to postings: without the file's key the index reveals neither the
+ * words nor which files share one. A query computes its token once per
+ * unlocked file.
+ *
+ * As a token belongs to one file, its posting list is a single entry,
+ * and the index is a term dictionary per file: token -> occurrences in
+ * the first `indexed` bytes of the file on disk. An append adds the
+ * counts of its words; undo takes back those of the bytes it cuts off
+ * (read again before they go), redo adds them once more. A file whose
+ * index cannot follow a change is reset and indexed afresh on its next
+ * unlock. Words are not joined across appends.
+ *
+ * Storage: the merged index, immutable and mapped, plus a log of the
+ * count changes since (journal framing), folded into a fresh merged
+ * index once it outgrows it. A file's run of (token, count) entries is
+ * cut into blocks of 32, each storing its first token in a block table
+ * and the rest as gaps from the previous token in the fewest bytes that
+ * fit all its gaps, counts as varints. All little-endian:
+ *
+ *   header    64 bytes: magic "FVSEARCH", u32 version, u32 fileCount,
+ *             u64 maxSeq (last log record merged), u64 blockCount,
+ *             u64 dataLen, u32 namesLen, u32 CRC-32C each of files,
+ *             names, blocks and data, u32 CRC-32C of bytes 0..59
+ *   files     fileCount x { u64 indexed, u64 firstBlock,
+ *             u32 entryCount, u16 nameLen, u16 zero }
+ *   names     the file names, in file order, unterminated
+ *   blocks    blockCount x { u64 first token, u64 offset into data }
+ *   data      per block: u8 gap width, varint count, then for each
+ *             further entry the gap in width bytes and a varint count
+ *
+ * The index is derived data: its log is not synced, and a damaged merged
+ * file is dropped. Whatever is missing is read again from the file on
+ * its next unlock (search_indexed).
+ */
+#define SEARCH_VERSION 1
+
+/* open-addressing map from token to a u32 */
+typedef struct {
+    uint64_t *keys;            /* 0 = empty slot */
+    uint32_t *vals;
+    size_t    cap;             /* power of two */
+    size_t    used;
+} SearchMap;
+
+/* the words of one change, counted as they are read */
+typedef struct {
+    SearchMap counts;          /* token -> occurrences */
+    uint64_t  k0, k1;          /* the file's search key */
+    char      word[SEARCH_TERM_MAX];
+    size_t    wordLen;
+    int       inWord;
+    int       failed;          /* out of memory: the change is dropped */
+} SearchBuilder;
+
+typedef struct SearchIndex SearchIndex;
+
+void search_deriveKey(const unsigned char dataKey[32],
+                      unsigned char out[SEARCH_KEY_LEN]);
+
+int  search_normalize(const char *term, char out[SEARCH_TERM_MAX + 1]);
+/* a query as the tokenizer sees it.
+ * returns its length, or -1 if term is not exactly one word */
+
+uint64_t search_token(const unsigned char key[SEARCH_KEY_LEN],
+                      const char *word, size_t len);
+/* token of a normalized word; never 0 */
+
+void search_builderInit(SearchBuilder *b, const unsigned char key[SEARCH_KEY_LEN]);
+void search_builderFeed(SearchBuilder *b, const char *text, size_t len);
+/* text of any size; a word may continue into the next call */
+void search_builderFinish(SearchBuilder *b);
+/* ends the last word */
+void search_builderFree(SearchBuilder *b);
+
+SearchIndex *search_open(const char *indexPath, const char *logPath);
+/* maps the merged index and replays the log. returns NULL if out of
+ * memory or the log cannot be opened */
+
+void search_close(SearchIndex *s);
+
+uint64_t search_indexed(const SearchIndex *s, const char *file);
+/* on-disk bytes of file, from its start, whose words are counted */
+
+int  search_add(SearchIndex *s, const char *file, uint64_t pre, uint64_t end,
+                const SearchBuilder *b);
+/* counts the words b read from the bytes [pre, end) of file, where pre
+ * is search_indexed(); end becomes it. An append that re-packed the
+ * file's last block may end below pre. returns 0, or -1 (nothing
+ * changed) */
+
+int  search_remove(SearchIndex *s, const char *file, uint64_t pre, uint64_t end,
+                   const SearchBuilder *b);
+/* takes back the words b read from the bytes [pre, end), where end is
+ * search_indexed(); pre becomes it, and may lie past end as for
+ * search_add. returns 0, or -1 (nothing changed) */
+
+int  search_reset(SearchIndex *s, const char *file);
+/* forgets everything counted for file. returns 0 or -1 */
+
+long long search_count(const SearchIndex *s, const char *file, uint64_t token);
+/* occurrences of token in the indexed bytes of file */
+
+#endif // SEARCH_H
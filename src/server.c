@@ -0,0 +1,318 @@
+// server.c - vault daemon: serves the model over a Unix domain socket
+
+#define _GNU_SOURCE
+#include "server.h"
+#include "model.h"
+#include "proto.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * The accept thread watches the listening socket and every client with
+ * one-shot epoll. A readable client is handed to the worker pool; the
+ * worker reads one request, answers it and re-arms the client, so a
+ * handful of workers can serve many mostly-idle connections. A client
+ * that stops sending part way through a request, or stops reading a
+ * reply, would hold its worker for good; its socket times out instead
+ * and the connection is dropped.
+ */
+
+#define MAX_EVENTS   64
+#define QUEUE_SIZE   1024
+#define IO_TIMEOUT   10   /* seconds a worker waits on one client read or write */
+
+typedef struct {
+    int             fds[QUEUE_SIZE];
+    int             head, count;
+    int             stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t  notEmpty;
+    pthread_cond_t  notFull;
+} WorkQueue;
+
+static WorkQueue             queue;
+static int                   epfd = -1;
+static volatile sig_atomic_t stopRequested = 0;
+
+/* ---------- helper: work queue ---------- */
+
+static void queuePush(int fd) {
+    pthread_mutex_lock(&queue.lock);
+    while (queue.count == QUEUE_SIZE && !queue.stopping)
+        pthread_cond_wait(&queue.notFull, &queue.lock);
+    if (!queue.stopping) {
+        queue.fds[(queue.head + queue.count) % QUEUE_SIZE] = fd;
+        queue.count++;
+        pthread_cond_signal(&queue.notEmpty);
+    }
+    pthread_mutex_unlock(&queue.lock);
+}
+
+/* returns -1 once the server is stopping */
+static int queuePop(void) {
+    pthread_mutex_lock(&queue.lock);
+    while (queue.count == 0 && !queue.stopping)
+        pthread_cond_wait(&queue.notEmpty, &queue.lock);
+    int fd = -1;
+    if (queue.count > 0) {
+        fd = queue.fds[queue.head];
+        queue.head = (queue.head + 1) % QUEUE_SIZE;
+        queue.count--;
+        pthread_cond_signal(&queue.notFull);
+    }
+    pthread_mutex_unlock(&queue.lock);
+    return fd;
+}
+
+/* ---------- helper: request handling ---------- */
+
+typedef struct {
+    int      fd;
+    uint64_t left;
+    int      failed;
+} SocketSink;
+
+static int sendChunk(void *ctx, const char *data, size_t len) {
+    SocketSink *sink = (SocketSink *)ctx;
+    if (len > sink->left) len = (size_t)sink->left;
+    if (proto_writeFull(sink->fd, data, len) != 0) {
+        sink->failed = 1;
+        return 1;
+    }
+    sink->left -= len;
+    return sink->left == 0;
+}
+
+static int replyRead(int fd, const char *name) {
+    long long size = model_getFileSize(name);
+    if (size < 0) return proto_sendResponseHeader(fd, -1, 0);
+    if (proto_sendResponseHeader(fd, 0, (uint64_t)size) != 0) return -1;
+
+    /* the header promised size bytes: a read that fails part way can
+     * only be reported by cutting the connection short */
+    SocketSink sink = { fd, (uint64_t)size, 0 };
+    int        res  = size > 0 ? model_readFile(name, sendChunk, &sink) : 0;
+    if (sink.failed || res < 0) return -1;
+
+    /* the file shrank after the header went out: keep the framing */
+    static const char zeros[4096];
+    while (sink.left > 0) {
+        size_t n = sink.left < sizeof(zeros) ? (size_t)sink.left : sizeof(zeros);
+        if (proto_writeFull(fd, zeros, n) != 0) return -1;
+        sink.left -= n;
+    }
+    return 0;
+}
+
+/* the data field of an APPEND, handed over whole: its length, not a
+ * NUL, says where it ends */
+typedef struct {
+    const char *data;
+    size_t      len;
+} FieldSource;
+
+static long fieldChunk(void *ctx, const char **data) {
+    FieldSource *src = (FieldSource *)ctx;
+    long         n   = (long)src->len;
+    *data    = src->data;
+    src->len = 0;
+    return n;
+}
+
+/* returns 0 to keep the connection, -1 to drop it */
+static int handleRequest(int fd) {
+    ProtoRequest req;
+    int rc = proto_recvRequest(fd, &req);
+    if (rc == -1) return -1;
+    if (rc == PROTO_ERR_BADREQ) {
+        proto_sendResponseHeader(fd, PROTO_ERR_BADREQ, 0);
+        return -1;
+    }
+
+    int status = PROTO_ERR_BADREQ;
+    if (req.fieldCount < 2) {
+        rc = proto_sendResponseHeader(fd, status, 0);
+        proto_freeRequest(&req);
+        return rc;
+    }
+
+    const char *name = req.field[0];
+    const char *pwd  = req.field[1];
+
+    switch (req.op) {
+        case PROTO_OP_ADD:
+            status = model_addFile(name, pwd);
+            break;
+
+        case PROTO_OP_VERIFY:
+            status = model_verifyPassword(name, pwd);
+            break;
+
+        case PROTO_OP_READ:
+            if (model_verifyPassword(name, pwd) != 1) {
+                status = PROTO_ERR_DENIED;
+                break;
+            }
+            rc = replyRead(fd, name);
+            proto_freeRequest(&req);
+            return rc;
+
+        case PROTO_OP_APPEND: {
+            if (req.fieldCount < 3) break;
+            if (model_verifyPassword(name, pwd) != 1) {
+                status = PROTO_ERR_DENIED;
+                break;
+            }
+            long long   appended = 0;
+            FieldSource src      = { req.field[2], req.fieldLen[2] };
+            status = src.len == 0 ? -2   /* nothing appended */
+                                  : model_appendStream(name, fieldChunk, &src, &appended);
+            break;
+        }
+
+        case PROTO_OP_UNDO:
+            if (model_verifyPassword(name, pwd) != 1) {
+                status = PROTO_ERR_DENIED;
+                break;
+            }
+            status = model_undoFileAppend(name);
+            break;
+
+        default:
+            break;
+    }
+
+    rc = proto_sendResponseHeader(fd, status, 0);
+    proto_freeRequest(&req);
+    return rc;
+}
+
+static void *workerMain(void *arg) {
+    (void)arg;
+    int fd;
+    while ((fd = queuePop()) >= 0) {
+        if (handleRequest(fd) != 0) {
+            close(fd);   /* also drops it from the epoll set */
+            continue;
+        }
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT,
+                                  .data.fd = fd };
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) != 0)
+            close(fd);
+    }
+    return NULL;
+}
+
+/* ---------- helper: setup ---------- */
+
+static void onSignal(int sig) {
+    (void)sig;
+    stopRequested = 1;
+}
+
+static int listenOn(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path);   /* stale socket from a previous run */
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* reads and writes on fd give up after IO_TIMEOUT with EAGAIN, which
+ * proto_readFull and proto_writeFull report as an error */
+static int setTimeouts(int fd) {
+    struct timeval tv = { .tv_sec = IO_TIMEOUT, .tv_usec = 0 };
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0)
+        return -1;
+    return 0;
+}
+
+/* ---------- public ---------- */
+
+int server_run(const char *socketPath, int threads) {
+    int lfd = listenOn(socketPath);
+    if (lfd < 0) return -1;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = lfd };
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev) != 0) {
+        close(lfd);
+        unlink(socketPath);
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&queue, 0, sizeof(queue));
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.notEmpty, NULL);
+    pthread_cond_init(&queue.notFull, NULL);
+
+    if (threads < 1) threads = 1;
+    pthread_t *workers = (pthread_t *)calloc((size_t)threads, sizeof(pthread_t));
+    int started = 0;
+    while (workers && started < threads &&
+           pthread_create(&workers[started], NULL, workerMain, NULL) == 0)
+        started++;
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!stopRequested && started > 0) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd != lfd) {
+                queuePush(fd);
+                continue;
+            }
+            int cfd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+            if (cfd < 0) continue;
+            struct epoll_event cev = { .events = EPOLLIN | EPOLLONESHOT,
+                                       .data.fd = cfd };
+            if (setTimeouts(cfd) != 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &cev) != 0)
+                close(cfd);
+        }
+    }
+
+    pthread_mutex_lock(&queue.lock);
+    queue.stopping = 1;
+    pthread_cond_broadcast(&queue.notEmpty);
+    pthread_cond_broadcast(&queue.notFull);
+    pthread_mutex_unlock(&queue.lock);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+
+    close(epfd);
+    close(lfd);
+    unlink(socketPath);
+    return started > 0 ? 0 : -1;
+}
@@ -0,0 +1,12 @@
+// server.h - vault daemon: serves the model over a Unix domain socket
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#define SERVER_DEFAULT_SOCKET "vault.sock"
+
+int server_run(const char *socketPath, int threads);
+/* serves requests (see proto.h) until SIGINT or SIGTERM.
+ * returns 0 on clean shutdown, -1 if the socket could not be set up */
+
+#endif // SERVER_H
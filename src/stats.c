@@ -0,0 +1,143 @@
+// stats.c - histogram recording, percentiles and JSON output
+
+#include "stats.h"
+#include <string.h>
+
+int stats_enabled = 0;
+
+StatsHistogram       stats_ops[STAT_OP_COUNT];
+atomic_uint_fast64_t stats_counters[STAT_COUNTER_COUNT];
+
+static const char *opNames[STAT_OP_COUNT] = {
+    "addFile", "verifyPassword", "changePassword", "fileExists",
+    "getFileContents", "readFile", "readRange", "findLines", "mapFile",
+    "sendFile", "getFileSize",
+    "appendToFile", "appendStream", "undoLastAppend", "redoLastUndo",
+    "undoFileAppend", "redoFileAppend", "recordRecent", "getRecent",
+    "search", "verifyFile", "scrub", "import", "export", "versions", "readVersion",
+    "loadVault", "saveVault", "fsync"
+};
+
+static const char *counterNames[STAT_COUNTER_COUNT] = {
+    "bytesRead", "bytesWritten", "opens", "fsyncs",
+    "sessionHits", "sessionMisses", "chunksStored", "chunksShared",
+    "cacheHits", "cacheMisses"
+};
+
+/* ---------- helper: buckets ---------- */
+
+static int bucketOf(uint64_t v) {
+    if (v < (1u << STATS_SUB_BITS)) return (int)v;
+    int exp = 63 - __builtin_clzll(v);            /* >= STATS_SUB_BITS */
+    int sub = (int)(v >> (exp - STATS_SUB_BITS)) & ((1 << STATS_SUB_BITS) - 1);
+    return ((exp - STATS_SUB_BITS + 1) << STATS_SUB_BITS) + sub;
+}
+
+/* midpoint of the values that land in bucket b */
+static double bucketValue(int b) {
+    if (b < (1 << STATS_SUB_BITS)) return b;
+    int    exp   = (b >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+    int    sub   = b & ((1 << STATS_SUB_BITS) - 1);
+    double width = (double)(1ull << (exp - STATS_SUB_BITS));
+    return ((1 << STATS_SUB_BITS) + sub) * width + width / 2;
+}
+
+static double percentile(const uint64_t *counts, uint64_t total, double p) {
+    uint64_t rank = (uint64_t)(p * (double)total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        seen += counts[b];
+        if (seen > rank) return bucketValue(b);
+    }
+    return 0;
+}
+
+static double clampAt(double max, double v) {
+    return v > max ? max : v;
+}
+
+/* ---------- public ---------- */
+
+void stats_enable(void) {
+    stats_enabled = 1;
+}
+
+void stats_record(int op, uint64_t ns) {
+    StatsHistogram *h = &stats_ops[op];
+    atomic_fetch_add_explicit(&h->buckets[bucketOf(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sumNs, ns, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&h->maxNs, memory_order_relaxed);
+    while (ns > max &&
+           !atomic_compare_exchange_weak_explicit(&h->maxNs, &max, ns,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {}
+}
+
+void stats_snapshot(StatsSnapshot *s) {
+    uint64_t counts[STATS_BUCKETS];
+
+    memset(s, 0, sizeof(*s));
+    s->enabled = stats_enabled;
+    for (int op = 0; op < STAT_OP_COUNT; op++) {
+        StatsHistogram *h = &stats_ops[op];
+        StatsOpSummary *o = &s->ops[op];
+        uint64_t total = 0;
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            counts[b] = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+            total    += counts[b];
+        }
+
+        o->name  = opNames[op];
+        o->count = total;
+        if (total == 0) continue;
+        /* bucket midpoints can overshoot the largest sample; clamp to it */
+        double max = (double)atomic_load(&h->maxNs);
+        o->meanUs = (double)atomic_load(&h->sumNs) / (double)total / 1e3;
+        o->p50Us  = clampAt(max, percentile(counts, total, 0.50)) / 1e3;
+        o->p90Us  = clampAt(max, percentile(counts, total, 0.90)) / 1e3;
+        o->p99Us  = clampAt(max, percentile(counts, total, 0.99)) / 1e3;
+        o->p999Us = clampAt(max, percentile(counts, total, 0.999)) / 1e3;
+        o->maxUs  = max / 1e3;
+    }
+    for (int c = 0; c < STAT_COUNTER_COUNT; c++) {
+        s->counters[c]     = atomic_load(&stats_counters[c]);
+        s->counterNames[c] = counterNames[c];
+    }
+}
+
+void stats_writeJson(FILE *out, int pretty) {
+    StatsSnapshot s;
+    stats_snapshot(&s);
+    const char *nl  = pretty ? "\n" : "";
+    const char *ind = pretty ? "    " : "";
+
+    fprintf(out, "{%s%s\"enabled\": %s,%s%s\"ops\": {", nl, pretty ? "  " : "",
+            s.enabled ? "true" : "false", nl, pretty ? "  " : "");
+    int first = 1;
+    for (int op = 0; op < STAT_OP_COUNT; op++) {
+        const StatsOpSummary *o = &s.ops[op];
+        if (o->count == 0) continue;
+        fprintf(out, "%s%s%s\"%s\": {\"count\": %llu, \"mean_us\": %.3f, "
+                "\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, "
+                "\"p999_us\": %.3f, \"max_us\": %.3f}",
+                first ? "" : ",", nl, ind, o->name,
+                (unsigned long long)o->count, o->meanUs, o->p50Us, o->p90Us,
+                o->p99Us, o->p999Us, o->maxUs);
+        first = 0;
+    }
+    fprintf(out, "%s%s},%s%s\"counters\": {", nl, pretty ? "  " : "",
+            nl, pretty ? "  " : "");
+    for (int c = 0; c < STAT_COUNTER_COUNT; c++) {
+        fprintf(out, "%s%s%s\"%s\": %llu", c ? "," : "", nl, ind,
+                s.counterNames[c], (unsigned long long)s.counters[c]);
+    }
+
+    uint64_t lookups = s.counters[STAT_SESSION_HITS] + s.counters[STAT_SESSION_MISSES];
+    fprintf(out, "%s%s},%s%s\"sessionHitRate\": %.4f%s}%s",
+            nl, pretty ? "  " : "", nl, pretty ? "  " : "",
+            lookups ? (double)s.counters[STAT_SESSION_HITS] / (double)lookups : 0.0,
+            nl, nl);
+}
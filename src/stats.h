@@ -0,0 +1,130 @@
+// stats.h - opt-in latency histograms and I/O counters
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Timed operations: the public model functions plus the persistence
+ * paths underneath them. */
+enum {
+    STAT_ADD_FILE,
+    STAT_VERIFY,
+    STAT_CHANGE_PASSWORD,
+    STAT_FILE_EXISTS,
+    STAT_GET_CONTENTS,
+    STAT_READ_FILE,
+    STAT_READ_RANGE,
+    STAT_FIND_LINES,
+    STAT_MAP_FILE,
+    STAT_SEND_FILE,
+    STAT_GET_SIZE,
+    STAT_APPEND,
+    STAT_APPEND_STREAM,
+    STAT_UNDO_LAST,
+    STAT_REDO_LAST,
+    STAT_UNDO_FILE,
+    STAT_REDO_FILE,
+    STAT_RECORD_RECENT,
+    STAT_GET_RECENT,
+    STAT_SEARCH,
+    STAT_VERIFY_FILE,
+    STAT_SCRUB,
+    STAT_IMPORT,
+    STAT_EXPORT,
+    STAT_VERSIONS,
+    STAT_READ_VERSION,
+    STAT_LOAD_VAULT,
+    STAT_SAVE_VAULT,
+    STAT_FSYNC,
+    STAT_OP_COUNT
+};
+
+/* Plain event counters */
+enum {
+    STAT_BYTES_READ,
+    STAT_BYTES_WRITTEN,
+    STAT_OPENS,
+    STAT_FSYNCS,
+    STAT_SESSION_HITS,
+    STAT_SESSION_MISSES,
+    STAT_CHUNKS_STORED,
+    STAT_CHUNKS_SHARED,
+    STAT_CACHE_HITS,
+    STAT_CACHE_MISSES,
+    STAT_COUNTER_COUNT
+};
+
+/*
+ * Log-linear buckets in the style of HdrHistogram: 16 linear sub-buckets
+ * per power of two of nanoseconds, so any recorded value is reported
+ * within 1/16 (6.25%) of its true value. Recording is one relaxed atomic
+ * add, safe from any thread.
+ */
+#define STATS_SUB_BITS  4
+#define STATS_BUCKETS   ((64 - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+
+typedef struct {
+    atomic_uint_fast64_t buckets[STATS_BUCKETS];
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sumNs;
+    atomic_uint_fast64_t maxNs;
+} StatsHistogram;
+
+/* Collection is off unless stats_enable() is called; while off, every
+ * hook below is a single predictable branch on this flag. */
+extern int stats_enabled;
+
+extern StatsHistogram       stats_ops[STAT_OP_COUNT];
+extern atomic_uint_fast64_t stats_counters[STAT_COUNTER_COUNT];
+
+void stats_enable(void);
+void stats_record(int op, uint64_t ns);
+
+static inline uint64_t stats_begin(void) {
+    if (!stats_enabled) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* t0 is stats_begin()'s result; 0 means collection was off at the start */
+static inline void stats_end(int op, uint64_t t0) {
+    if (t0 == 0) return;
+    stats_record(op, stats_begin() - t0);
+}
+
+static inline void stats_count(int counter, uint64_t n) {
+    if (stats_enabled)
+        atomic_fetch_add_explicit(&stats_counters[counter], n,
+                                  memory_order_relaxed);
+}
+
+/* A point-in-time summary, for display */
+typedef struct {
+    const char *name;
+    uint64_t    count;
+    double      meanUs;
+    double      p50Us;
+    double      p90Us;
+    double      p99Us;
+    double      p999Us;
+    double      maxUs;
+} StatsOpSummary;
+
+typedef struct {
+    int            enabled;
+    StatsOpSummary ops[STAT_OP_COUNT];
+    uint64_t       counters[STAT_COUNTER_COUNT];
+    const char    *counterNames[STAT_COUNTER_COUNT];
+} StatsSnapshot;
+
+void stats_snapshot(StatsSnapshot *s);
+
+/* the snapshot as one JSON object; newline-free unless pretty */
+void stats_writeJson(FILE *out, int pretty);
+
+#endif // STATS_H
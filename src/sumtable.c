@@ -0,0 +1,206 @@
+// sumtable.c - per-file checksums of the stored bytes, journaled
+
+#include "sumtable.h"
+#include "hashindex.h"
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECORD_FIXED (2 + 8 + 4)
+#define REWRITE_MIN  1024          /* records before a rewrite is worth it */
+
+typedef struct {
+    char    *name;
+    FileSum  sum;
+} SumEntry;
+
+struct SumTable {
+    SumEntry  *entries;
+    int        count, cap;
+    HashIndex  index;
+    Journal    log;
+    uint32_t   records;            /* records currently in the log */
+    int        syncMode, groupSize, groupMs;
+    char      *path;
+    char      *tmpPath;
+};
+
+/* ---------- helper: encoding ---------- */
+
+static void putU32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t getU32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void putU64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t getU64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+static int writeRecord(Journal *j, const char *name, const FileSum *sum) {
+    size_t nameLen = strlen(name);
+    if (nameLen > 0xFFFF) return -1;
+
+    unsigned char  stackBuf[256];
+    unsigned char *rec = stackBuf;
+    size_t         len = RECORD_FIXED + nameLen;
+    if (len > sizeof(stackBuf)) {
+        rec = (unsigned char *)malloc(len);
+        if (!rec) return -1;
+    }
+    rec[0] = (unsigned char)nameLen;
+    rec[1] = (unsigned char)(nameLen >> 8);
+    memcpy(rec + 2, name, nameLen);
+    putU64(rec + 2 + nameLen, sum->size);
+    putU32(rec + 10 + nameLen, sum->crc);
+
+    int rc = journal_append(j, rec, len);
+    if (rec != stackBuf) free(rec);
+    return rc;
+}
+
+/* ---------- helper: table ---------- */
+
+static const char *entryName(void *ctx, int id) {
+    return ((SumTable *)ctx)->entries[id].name;
+}
+
+static int store(SumTable *t, const char *name, size_t nameLen, const FileSum *sum) {
+    char *key = (char *)malloc(nameLen + 1);
+    if (!key) return -1;
+    memcpy(key, name, nameLen);
+    key[nameLen] = '\0';
+
+    uint32_t hash = hashindex_hash(key);
+    int      id   = hashindex_find(&t->index, key, hash);
+    if (id >= 0) {
+        t->entries[id].sum = *sum;
+        free(key);
+        return 0;
+    }
+    if (t->count == t->cap) {
+        int       cap     = t->cap ? t->cap * 2 : 64;
+        SumEntry *entries = (SumEntry *)realloc(t->entries, sizeof(SumEntry) * (size_t)cap);
+        if (!entries) {
+            free(key);
+            return -1;
+        }
+        t->entries = entries;
+        t->cap     = cap;
+    }
+    t->entries[t->count].name = key;
+    t->entries[t->count].sum  = *sum;
+    if (hashindex_insert(&t->index, key, hash, t->count) != 0) {
+        free(key);
+        return -1;
+    }
+    t->count++;
+    return 0;
+}
+
+static void replayRecord(void *ctx, const unsigned char *rec, size_t len) {
+    SumTable *t = (SumTable *)ctx;
+    if (len < RECORD_FIXED) return;
+    size_t nameLen = (size_t)rec[0] | (size_t)rec[1] << 8;
+    if (len != RECORD_FIXED + nameLen || memchr(rec + 2, '\0', nameLen)) return;
+
+    FileSum sum = { getU64(rec + 2 + nameLen), getU32(rec + 10 + nameLen) };
+    store(t, (const char *)rec + 2, nameLen, &sum);
+    t->records++;
+}
+
+static int openLog(SumTable *t, long validLen) {
+    if (journal_open(&t->log, t->path, validLen) != 0) return -1;
+    journal_setSync(&t->log, t->syncMode, t->groupSize, t->groupMs);
+    return 0;
+}
+
+/* replaces the log with one record per name */
+static void rewrite(SumTable *t) {
+    Journal out;
+    if (journal_open(&out, t->tmpPath, 0) != 0) return;
+    journal_setSync(&out, JOURNAL_SYNC_NONE, 0, 0);
+
+    int ok = 1;
+    for (int i = 0; ok && i < t->count; i++)
+        ok = writeRecord(&out, t->entries[i].name, &t->entries[i].sum) == 0;
+    ok = ok && journal_sync(&out) == 0;
+    journal_close(&out);
+
+    if (!ok || rename(t->tmpPath, t->path) != 0) {
+        remove(t->tmpPath);
+        return;
+    }
+    journal_syncDir(t->path);
+    journal_close(&t->log);
+    openLog(t, -1);
+    t->records = (uint32_t)t->count;
+}
+
+/* ---------- public ---------- */
+
+SumTable *sumtable_open(const char *path, const char *tmpPath) {
+    SumTable *t = (SumTable *)calloc(1, sizeof(SumTable));
+    if (!t) return NULL;
+    t->log.fd   = -1;
+    t->syncMode = JOURNAL_SYNC_NONE;
+    t->path     = strdup(path);
+    t->tmpPath  = strdup(tmpPath);
+    if (!t->path || !t->tmpPath || hashindex_init(&t->index, 0, entryName, t) != 0) {
+        free(t->path);
+        free(t->tmpPath);
+        free(t);
+        return NULL;
+    }
+
+    long valid = journal_replay(path, replayRecord, t);
+    if (openLog(t, valid) != 0) {
+        sumtable_close(t);
+        return NULL;
+    }
+    if (t->records > 4u * (uint32_t)t->count + REWRITE_MIN) rewrite(t);
+    return t;
+}
+
+void sumtable_close(SumTable *t) {
+    if (!t) return;
+    journal_close(&t->log);
+    for (int i = 0; i < t->count; i++) free(t->entries[i].name);
+    free(t->entries);
+    hashindex_free(&t->index);
+    free(t->path);
+    free(t->tmpPath);
+    free(t);
+}
+
+void sumtable_setSync(SumTable *t, int mode, int groupSize, int groupMs) {
+    t->syncMode  = mode;
+    t->groupSize = groupSize;
+    t->groupMs   = groupMs;
+    journal_setSync(&t->log, mode, groupSize, groupMs);
+}
+
+int sumtable_get(const SumTable *t, const char *name, FileSum *out) {
+    int id = hashindex_find(&t->index, name, hashindex_hash(name));
+    if (id < 0) return -1;
+    *out = t->entries[id].sum;
+    return 0;
+}
+
+int sumtable_put(SumTable *t, const char *name, const FileSum *sum) {
+    if (writeRecord(&t->log, name, sum) != 0 ||
+        store(t, name, strlen(name), sum) != 0)
+        return -1;
+    if (++t->records > 4u * (uint32_t)t->count + REWRITE_MIN) rewrite(t);
+    return 0;
+}
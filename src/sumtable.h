@@ -0,0 +1,40 @@
+// sumtable.h - per-file checksums of the stored bytes, journaled
+
+#ifndef SUMTABLE_H
+#define SUMTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * For each name, the size of the file and the CRC-32C (crc32c.h) of its
+ * size bytes as stored. Every change is one record in the log:
+ *   u16 name length | name | u64 size | u32 crc
+ * little-endian, replayed in order at open so the last record of a name
+ * wins. Once the log holds several records per name it is rewritten
+ * with one each (temp file + rename).
+ *
+ * Not thread-safe: callers serialize every call.
+ */
+typedef struct {
+    uint64_t size;
+    uint32_t crc;
+} FileSum;
+
+typedef struct SumTable SumTable;
+
+SumTable *sumtable_open(const char *path, const char *tmpPath);
+/* returns the table, its log created if needed, or NULL */
+
+void sumtable_close(SumTable *t);
+
+void sumtable_setSync(SumTable *t, int mode, int groupSize, int groupMs);
+/* journal.h policies */
+
+int  sumtable_get(const SumTable *t, const char *name, FileSum *out);
+/* returns 0, or -1 if name has no sum */
+
+int  sumtable_put(SumTable *t, const char *name, const FileSum *sum);
+/* returns 0, or -1 on a write error or out of memory */
+
+#endif // SUMTABLE_H
@@ -0,0 +1,535 @@
+// undolog.c - persistent per-file undo/redo stacks for appends
+
+#define _GNU_SOURCE
+#include "undolog.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Every stack change is one record in the log:
+ *   'A' name preSize length     append pushed (clears the file's redo)
+ *   'P' name preSize length keep keptLen
+ *                               re-packing append pushed, likewise
+ *   'U' name payloadOff         undo top moved to redo, bytes in blob
+ *   'R' name                    redo top moved back to undo
+ *   'X' name / 'Y' name         undo / redo top discarded
+ * encoded as  op | u16 name length | name | u64 | u64 [| u64 | u64].
+ * Once the log is mostly history it is rewritten with only the live
+ * entries; the blob is emptied whenever no redo entry references it.
+ */
+
+#define REC_APPEND   'A'
+#define REC_REPACK   'P'
+#define REC_UNDO     'U'
+#define REC_REDO     'R'
+#define REC_DROPUNDO 'X'
+#define REC_DROPREDO 'Y'
+
+#define REC_FIXED    (1 + 2 + 8 + 8)
+#define COMPACT_MIN_BYTES (1024 * 1024)
+
+/* ---------- helper: encoding ---------- */
+
+static void putU64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t getU64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+static int writeFields(Journal *j, int op, const char *name,
+                       uint64_t a, uint64_t b, const uint64_t *more, int moreCount) {
+    size_t nameLen = strlen(name);
+    if (nameLen > 0xFFFF) return -1;
+
+    unsigned char  stackBuf[256];
+    unsigned char *rec = stackBuf;
+    size_t         len = REC_FIXED + nameLen + 8 * (size_t)moreCount;
+    if (len > sizeof(stackBuf)) {
+        rec = (unsigned char *)malloc(len);
+        if (!rec) return -1;
+    }
+    rec[0] = (unsigned char)op;
+    rec[1] = (unsigned char)nameLen;
+    rec[2] = (unsigned char)(nameLen >> 8);
+    memcpy(rec + 3, name, nameLen);
+    putU64(rec + 3 + nameLen, a);
+    putU64(rec + 11 + nameLen, b);
+    for (int i = 0; i < moreCount; i++)
+        putU64(rec + 19 + nameLen + 8 * (size_t)i, more[i]);
+
+    int rc = journal_append(j, rec, len);
+    if (rec != stackBuf) free(rec);
+    return rc;
+}
+
+static int writeRecord(Journal *j, int op, const char *name,
+                       uint64_t a, uint64_t b) {
+    return writeFields(j, op, name, a, b, NULL, 0);
+}
+
+/* the record that pushes e again */
+static int writePush(Journal *j, const char *name, const UndoEntry *e) {
+    uint64_t kept[2] = { e->keep, e->keptLen };
+    return e->keep ? writeFields(j, REC_REPACK, name, e->preSize, e->length, kept, 2)
+                   : writeRecord(j, REC_APPEND, name, e->preSize, e->length);
+}
+
+/* ---------- helper: byte copies ---------- */
+
+#define COPY_BLOCK (64 * 1024)
+
+/* in-kernel where possible, constant memory otherwise */
+static int copyRange(int in, uint64_t inOff, int out, uint64_t outOff,
+                     uint64_t len) {
+    while (len > 0) {
+        loff_t  src = (loff_t)inOff, dst = (loff_t)outOff;
+        ssize_t n   = copy_file_range(in, &src, out, &dst, (size_t)len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        inOff  += (uint64_t)n;
+        outOff += (uint64_t)n;
+        len    -= (uint64_t)n;
+    }
+    if (len == 0) return 0;
+
+    char *buf = (char *)malloc(COPY_BLOCK);
+    if (!buf) return -1;
+    while (len > 0) {
+        size_t  want = len < COPY_BLOCK ? (size_t)len : COPY_BLOCK;
+        ssize_t n    = pread(in, buf, want, (off_t)inOff);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        ssize_t done = 0;
+        while (done < n) {
+            ssize_t w = pwrite(out, buf + done, (size_t)(n - done),
+                               (off_t)(outOff + (uint64_t)done));
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) {
+                free(buf);
+                return -1;
+            }
+            done += w;
+        }
+        inOff  += (uint64_t)n;
+        outOff += (uint64_t)n;
+        len    -= (uint64_t)n;
+    }
+    free(buf);
+    return len == 0 ? 0 : -1;
+}
+
+/* ---------- helper: stacks ---------- */
+
+static const char *fileKey(void *ctx, int id) {
+    return ((UndoLog *)ctx)->files[id].name;
+}
+
+static int growArray(void **arr, int *cap, int need, size_t elem) {
+    if (need <= *cap) return 0;
+    int newCap = *cap ? *cap * 2 : 8;
+    while (newCap < need) newCap *= 2;
+    void *p = realloc(*arr, elem * (size_t)newCap);
+    if (!p) return -1;
+    *arr = p;
+    *cap = newCap;
+    return 0;
+}
+
+static int findFile(UndoLog *u, const char *name) {
+    return hashindex_find(&u->byName, name, hashindex_hash(name));
+}
+
+static int fileFor(UndoLog *u, const char *name) {
+    int id = findFile(u, name);
+    if (id >= 0) return id;
+
+    if (growArray((void **)&u->files, &u->fileCap, u->fileCount + 1,
+                  sizeof(UndoFile)) != 0)
+        return -1;
+    UndoFile *f = &u->files[u->fileCount];
+    memset(f, 0, sizeof(*f));
+    f->name = strdup(name);
+    if (!f->name) return -1;
+    if (hashindex_insert(&u->byName, f->name, hashindex_hash(f->name),
+                         u->fileCount) != 0) {
+        free(f->name);
+        return -1;
+    }
+    return u->fileCount++;
+}
+
+static int pushRef(UndoRef **order, int *count, int *cap,
+                   int file, uint64_t seq) {
+    if (growArray((void **)order, cap, *count + 1, sizeof(UndoRef)) != 0)
+        return -1;
+    (*order)[*count].file = file;
+    (*order)[*count].seq  = seq;
+    (*count)++;
+    return 0;
+}
+
+static int pushEntry(UndoEntry **stack, int *count, int *cap, UndoEntry e) {
+    if (growArray((void **)stack, cap, *count + 1, sizeof(UndoEntry)) != 0)
+        return -1;
+    (*stack)[(*count)++] = e;
+    return 0;
+}
+
+/* ---------- helper: state transitions (shared by replay and live) ---------- */
+
+static int applyAppend(UndoLog *u, const char *name, uint64_t preSize,
+                       uint64_t length, uint64_t keep, uint64_t keptLen) {
+    int id = fileFor(u, name);
+    if (id < 0) return -1;
+    UndoFile *f = &u->files[id];
+
+    UndoEntry e = { u->nextSeq++, preSize, length, 0, keep, keptLen };
+    if (pushEntry(&f->undo, &f->undoCount, &f->undoCap, e) != 0 ||
+        pushRef(&u->undoOrder, &u->undoOrderCount, &u->undoOrderCap,
+                id, e.seq) != 0)
+        return -1;
+
+    u->liveRecords += 1 - 2 * (uint64_t)f->redoCount;
+    f->redoCount = 0;
+    return 0;
+}
+
+static int applyUndo(UndoLog *u, const char *name, uint64_t payloadOff) {
+    int id = findFile(u, name);
+    if (id < 0 || u->files[id].undoCount == 0) return -1;
+    UndoFile *f = &u->files[id];
+
+    UndoEntry e  = f->undo[f->undoCount - 1];
+    e.seq        = u->nextSeq++;
+    e.payloadOff = payloadOff;
+    if (pushEntry(&f->redo, &f->redoCount, &f->redoCap, e) != 0 ||
+        pushRef(&u->redoOrder, &u->redoOrderCount, &u->redoOrderCap,
+                id, e.seq) != 0)
+        return -1;
+    f->undoCount--;
+    u->liveRecords++;
+    return 0;
+}
+
+static int applyRedo(UndoLog *u, const char *name) {
+    int id = findFile(u, name);
+    if (id < 0 || u->files[id].redoCount == 0) return -1;
+    UndoFile *f = &u->files[id];
+
+    UndoEntry e = f->redo[f->redoCount - 1];
+    e.seq        = u->nextSeq++;
+    e.payloadOff = 0;
+    if (pushEntry(&f->undo, &f->undoCount, &f->undoCap, e) != 0 ||
+        pushRef(&u->undoOrder, &u->undoOrderCount, &u->undoOrderCap,
+                id, e.seq) != 0)
+        return -1;
+    f->redoCount--;
+    u->liveRecords--;
+    return 0;
+}
+
+static void applyDrop(UndoLog *u, const char *name, int redo) {
+    int id = findFile(u, name);
+    if (id < 0) return;
+    UndoFile *f = &u->files[id];
+    if (redo && f->redoCount > 0) {
+        f->redoCount--;
+        u->liveRecords -= 2;
+    } else if (!redo && f->undoCount > 0) {
+        f->undoCount--;
+        u->liveRecords--;
+    }
+}
+
+static void replayRecord(void *ctx, const unsigned char *rec, size_t len) {
+    UndoLog *u = (UndoLog *)ctx;
+    if (len < REC_FIXED) return;
+    size_t nameLen = (size_t)rec[1] | (size_t)rec[2] << 8;
+    size_t extra   = rec[0] == REC_REPACK ? 16 : 0;
+    if (len != REC_FIXED + nameLen + extra) return;
+
+    char *name = (char *)malloc(nameLen + 1);
+    if (!name) return;
+    memcpy(name, rec + 3, nameLen);
+    name[nameLen] = '\0';
+    uint64_t a = getU64(rec + 3 + nameLen);
+    uint64_t b = getU64(rec + 11 + nameLen);
+    uint64_t c = extra ? getU64(rec + 19 + nameLen) : 0;
+    uint64_t d = extra ? getU64(rec + 27 + nameLen) : 0;
+
+    switch (rec[0]) {
+        case REC_APPEND:   applyAppend(u, name, a, b, 0, 0); break;
+        case REC_REPACK:   applyAppend(u, name, a, b, c, d); break;
+        case REC_UNDO:     applyUndo(u, name, a);            break;
+        case REC_REDO:     applyRedo(u, name);         break;
+        case REC_DROPUNDO: applyDrop(u, name, 0);      break;
+        case REC_DROPREDO: applyDrop(u, name, 1);      break;
+        default: break;
+    }
+    free(name);
+}
+
+/* ---------- helper: log compaction ---------- */
+
+static int isLiveUndo(const UndoLog *u, UndoRef r) {
+    const UndoFile *f = &u->files[r.file];
+    for (int i = f->undoCount - 1; i >= 0; i--) {
+        if (f->undo[i].seq == r.seq) return 1;
+        if (f->undo[i].seq < r.seq) break;
+    }
+    return 0;
+}
+
+static int isLiveRedo(const UndoLog *u, UndoRef r) {
+    const UndoFile *f = &u->files[r.file];
+    for (int i = f->redoCount - 1; i >= 0; i--) {
+        if (f->redo[i].seq == r.seq) return 1;
+    }
+    return 0;
+}
+
+/* Rewrites the log as the shortest record sequence that rebuilds the
+ * current stacks: the live undo entries in global order, then each
+ * redo entry re-appended and undone again (oldest undo first). */
+static void compactLog(UndoLog *u) {
+    size_t tmpLen  = strlen(u->logPath) + 5;
+    char  *tmpPath = (char *)malloc(tmpLen);
+    if (!tmpPath) return;
+    snprintf(tmpPath, tmpLen, "%s.tmp", u->logPath);
+    unlink(tmpPath);
+
+    Journal out;
+    if (journal_open(&out, tmpPath, 0) != 0) {
+        free(tmpPath);
+        return;
+    }
+    journal_setSync(&out, JOURNAL_SYNC_NONE, 1, 0);
+
+    int ok = 1, anyRedo = 0, kept = 0;
+    for (int i = 0; ok && i < u->undoOrderCount; i++) {
+        UndoRef r = u->undoOrder[i];
+        if (!isLiveUndo(u, r)) continue;
+        const UndoFile *f = &u->files[r.file];
+        for (int k = 0; k < f->undoCount; k++) {
+            if (f->undo[k].seq == r.seq) {
+                ok = writePush(&out, f->name, &f->undo[k]) == 0;
+                break;
+            }
+        }
+        u->undoOrder[kept++] = r;
+    }
+    u->undoOrderCount = kept;
+
+    for (int id = 0; ok && id < u->fileCount; id++) {
+        const UndoFile *f = &u->files[id];
+        for (int k = f->redoCount - 1; ok && k >= 0; k--) {
+            ok = writePush(&out, f->name, &f->redo[k]) == 0;
+            anyRedo = 1;
+        }
+    }
+
+    kept = 0;
+    for (int i = 0; ok && i < u->redoOrderCount; i++) {
+        UndoRef r = u->redoOrder[i];
+        if (!isLiveRedo(u, r)) continue;
+        const UndoFile *f = &u->files[r.file];
+        for (int k = 0; k < f->redoCount; k++) {
+            if (f->redo[k].seq == r.seq) {
+                ok = writeRecord(&out, REC_UNDO, f->name,
+                                 f->redo[k].payloadOff, 0) == 0;
+                break;
+            }
+        }
+        u->redoOrder[kept++] = r;
+    }
+    u->redoOrderCount = kept;
+
+    if (ok && fdatasync(out.fd) != 0) ok = 0;
+    stats_count(STAT_FSYNCS, 1);
+    journal_close(&out);
+
+    if (ok && rename(tmpPath, u->logPath) == 0) {
+        journal_syncDir(u->logPath);
+        int mode = u->log.syncMode, group = u->log.groupSize, ms = u->log.groupMs;
+        journal_close(&u->log);
+        if (journal_open(&u->log, u->logPath, -1) == 0)
+            journal_setSync(&u->log, mode, group, ms);
+        if (!anyRedo && ftruncate(u->blobFd, 0) != 0) {
+            /* stale payloads are harmless, only wasted space */
+        }
+    } else {
+        unlink(tmpPath);
+    }
+    free(tmpPath);
+}
+
+static void maybeCompact(UndoLog *u) {
+    if (u->log.bytes >= COMPACT_MIN_BYTES &&
+        u->log.bytes > 4 * 64 * (u->liveRecords + 1))
+        compactLog(u);
+}
+
+/* ---------- public ---------- */
+
+int undolog_open(UndoLog *u, const char *logPath, const char *blobPath) {
+    memset(u, 0, sizeof(*u));
+    u->log.fd  = -1;
+    u->blobFd  = -1;
+    u->nextSeq = 1;
+    u->logPath  = strdup(logPath);
+    u->blobPath = strdup(blobPath);
+    if (!u->logPath || !u->blobPath ||
+        hashindex_init(&u->byName, 0, fileKey, u) != 0) {
+        undolog_close(u);
+        return -1;
+    }
+
+    long valid = journal_replay(logPath, replayRecord, u);
+    if (journal_open(&u->log, logPath, valid) != 0) {
+        undolog_close(u);
+        return -1;
+    }
+    u->blobFd = open(blobPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (u->blobFd < 0) {
+        undolog_close(u);
+        return -1;
+    }
+    maybeCompact(u);
+    return 0;
+}
+
+void undolog_close(UndoLog *u) {
+    journal_close(&u->log);
+    if (u->blobFd >= 0) close(u->blobFd);
+    for (int i = 0; i < u->fileCount; i++) {
+        free(u->files[i].name);
+        free(u->files[i].undo);
+        free(u->files[i].redo);
+    }
+    free(u->files);
+    free(u->undoOrder);
+    free(u->redoOrder);
+    free(u->logPath);
+    free(u->blobPath);
+    hashindex_free(&u->byName);
+    memset(u, 0, sizeof(*u));
+    u->log.fd = -1;
+    u->blobFd = -1;
+}
+
+void undolog_setSync(UndoLog *u, int mode, int groupSize, int groupMs) {
+    journal_setSync(&u->log, mode, groupSize, groupMs);
+}
+
+int undolog_pushAppend(UndoLog *u, const char *name,
+                       uint64_t preSize, uint64_t length) {
+    if (writeRecord(&u->log, REC_APPEND, name, preSize, length) != 0)
+        return -1;
+    int rc = applyAppend(u, name, preSize, length, 0, 0);
+    maybeCompact(u);
+    return rc;
+}
+
+int undolog_pushRepack(UndoLog *u, const char *name, uint64_t preSize,
+                       uint64_t length, uint64_t keep, uint64_t keptLen) {
+    uint64_t kept[2] = { keep, keptLen };
+    if (writeFields(&u->log, REC_REPACK, name, preSize, length, kept, 2) != 0)
+        return -1;
+    int rc = applyAppend(u, name, preSize, length, keep, keptLen);
+    maybeCompact(u);
+    return rc;
+}
+
+const UndoEntry *undolog_peekUndo(UndoLog *u, const char *name,
+                                  const char **nameOut) {
+    if (name) {
+        int id = findFile(u, name);
+        if (id < 0 || u->files[id].undoCount == 0) return NULL;
+        *nameOut = u->files[id].name;
+        return &u->files[id].undo[u->files[id].undoCount - 1];
+    }
+
+    while (u->undoOrderCount > 0) {   /* skip entries undone per file */
+        UndoRef   r = u->undoOrder[u->undoOrderCount - 1];
+        UndoFile *f = &u->files[r.file];
+        if (f->undoCount > 0 && f->undo[f->undoCount - 1].seq == r.seq) {
+            *nameOut = f->name;
+            return &f->undo[f->undoCount - 1];
+        }
+        u->undoOrderCount--;
+    }
+    return NULL;
+}
+
+const UndoEntry *undolog_peekRedo(UndoLog *u, const char *name,
+                                  const char **nameOut) {
+    if (name) {
+        int id = findFile(u, name);
+        if (id < 0 || u->files[id].redoCount == 0) return NULL;
+        *nameOut = u->files[id].name;
+        return &u->files[id].redo[u->files[id].redoCount - 1];
+    }
+
+    while (u->redoOrderCount > 0) {
+        UndoRef   r = u->redoOrder[u->redoOrderCount - 1];
+        UndoFile *f = &u->files[r.file];
+        if (f->redoCount > 0 && f->redo[f->redoCount - 1].seq == r.seq) {
+            *nameOut = f->name;
+            return &f->redo[f->redoCount - 1];
+        }
+        u->redoOrderCount--;
+    }
+    return NULL;
+}
+
+int undolog_commitUndo(UndoLog *u, const char *name, int srcFd) {
+    int id = findFile(u, name);
+    if (id < 0 || u->files[id].undoCount == 0) return -1;
+    const UndoEntry *e = &u->files[id].undo[u->files[id].undoCount - 1];
+
+    /* the bytes must be safe in the blob before the record points at them */
+    struct stat st;
+    if (fstat(u->blobFd, &st) != 0) return -1;
+    uint64_t off = (uint64_t)st.st_size;
+    if (copyRange(srcFd, e->preSize, u->blobFd, off, e->length) != 0)
+        return -1;
+    stats_count(STAT_BYTES_WRITTEN, e->length);
+    if (u->log.syncMode != JOURNAL_SYNC_NONE) {
+        stats_count(STAT_FSYNCS, 1);
+        if (fdatasync(u->blobFd) != 0) return -1;
+    }
+
+    if (writeRecord(&u->log, REC_UNDO, name, off, 0) != 0) return -1;
+    int rc = applyUndo(u, name, off);
+    maybeCompact(u);
+    return rc;
+}
+
+int undolog_commitRedo(UndoLog *u, const char *name) {
+    if (writeRecord(&u->log, REC_REDO, name, 0, 0) != 0) return -1;
+    int rc = applyRedo(u, name);
+    maybeCompact(u);
+    return rc;
+}
+
+int undolog_copyPayload(UndoLog *u, const UndoEntry *e, int dstFd) {
+    if (copyRange(u->blobFd, e->payloadOff, dstFd, e->preSize, e->length) != 0)
+        return -1;
+    stats_count(STAT_BYTES_WRITTEN, e->length);
+    return 0;
+}
+
+void undolog_drop(UndoLog *u, const char *name, int redo) {
+    writeRecord(&u->log, redo ? REC_DROPREDO : REC_DROPUNDO, name, 0, 0);
+    applyDrop(u, name, redo);
+}
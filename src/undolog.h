@@ -0,0 +1,101 @@
+// undolog.h - persistent per-file undo/redo stacks for appends
+
+#ifndef UNDOLOG_H
+#define UNDOLOG_H
+
+#include "hashindex.h"
+#include "journal.h"
+#include <stdint.h>
+
+/* One append. preSize is the exact file size before it, so undo is a
+ * truncate to preSize, and is refused if the file is no longer
+ * preSize + length bytes long. For redo entries the undone bytes are
+ * kept in the blob file at payloadOff.
+ *
+ * An append to a compressed file may re-pack the file's last block with
+ * the new bytes: preSize is then where that block started, keep its
+ * plaintext length and keptLen the length it was sealed to. Undo seals
+ * those keep bytes again, to exactly keptLen bytes, after the cut. */
+typedef struct {
+    uint64_t seq;
+    uint64_t preSize;
+    uint64_t length;
+    uint64_t payloadOff;
+    uint64_t keep;
+    uint64_t keptLen;
+} UndoEntry;
+
+typedef struct {
+    char      *name;
+    UndoEntry *undo;
+    int        undoCount, undoCap;
+    UndoEntry *redo;
+    int        redoCount, redoCap;
+} UndoFile;
+
+/* (file, seq) in the order entries were pushed, across all files; an
+ * element is stale once that entry left the top of its file's stack. */
+typedef struct {
+    int      file;
+    uint64_t seq;
+} UndoRef;
+
+typedef struct {
+    UndoFile  *files;
+    int        fileCount, fileCap;
+    HashIndex  byName;
+    UndoRef   *undoOrder;
+    int        undoOrderCount, undoOrderCap;
+    UndoRef   *redoOrder;
+    int        redoOrderCount, redoOrderCap;
+    uint64_t   nextSeq;
+    uint64_t   liveRecords;   /* records a compacted log would hold */
+    Journal    log;
+    int        blobFd;
+    char      *logPath;
+    char      *blobPath;
+} UndoLog;
+
+int  undolog_open(UndoLog *u, const char *logPath, const char *blobPath);
+/* replays logPath. returns 0, or -1 on open error */
+
+void undolog_close(UndoLog *u);
+
+void undolog_setSync(UndoLog *u, int mode, int groupSize, int groupMs);
+
+int  undolog_pushAppend(UndoLog *u, const char *name,
+                        uint64_t preSize, uint64_t length);
+/* records an append and clears that file's redo stack.
+ * returns 0, or -1 on error */
+
+int  undolog_pushRepack(UndoLog *u, const char *name, uint64_t preSize,
+                        uint64_t length, uint64_t keep, uint64_t keptLen);
+/* as undolog_pushAppend, for an append that rewrote the keptLen-byte
+ * last block at preSize, keeping its `keep` plaintext bytes */
+
+/* Top of the undo (redo) stack of name, or of the most recent entry
+ * across all files when name is NULL. *nameOut receives the owning
+ * filename. Returns NULL when there is nothing to undo (redo). */
+const UndoEntry *undolog_peekUndo(UndoLog *u, const char *name,
+                                  const char **nameOut);
+const UndoEntry *undolog_peekRedo(UndoLog *u, const char *name,
+                                  const char **nameOut);
+
+int  undolog_commitUndo(UndoLog *u, const char *name, int srcFd);
+/* saves the entry's `length` bytes at preSize in srcFd to the blob, then
+ * moves the undo top of name to its redo stack. The caller truncates
+ * afterwards (and, for a re-packed entry, writes the kept block back).
+ * returns 0, or -1 on error */
+
+int  undolog_commitRedo(UndoLog *u, const char *name);
+/* moves the redo top of name back to its undo stack */
+
+int  undolog_copyPayload(UndoLog *u, const UndoEntry *e, int dstFd);
+/* writes a redo entry's saved bytes to dstFd at e->preSize; 0 or -1.
+ * The caller cuts a re-packed entry's kept bytes off first. */
+
+void undolog_drop(UndoLog *u, const char *name, int redo);
+/* discards the undo (redo != 0: redo) top of name, e.g. after the file
+ * was changed outside the vault */
+
+#endif // UNDOLOG_H
@@ -1,10 +1,13 @@
 // view.c - console I/O, menu, prompts, password masking
 
+#define _GNU_SOURCE
+
 #include "view.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 static void clearStdin(void) {
@@ -19,7 +22,11 @@ void view_showMainMenu(void) {
     "3. Change Password\n"
     "4. Show Recent Files\n"
     "5. Undo Last Append\n"
-    "6. Exit\n");
+    "6. Redo Last Undo\n"
+    "7. Statistics\n"
+    "8. Search Files\n"
+    "9. Verify Vault\n"
+    "10. Exit\n");
 }
 
 void view_showMessage(const char *msg) {
@@ -44,6 +51,20 @@ int view_getInt(const char *prompt) {
     }
 }
 
+long long view_getCount(const char *prompt) {
+    long long value;
+    while (1) {
+        printf("%s", prompt);
+        if (scanf("%lld", &value) == 1 && value >= 0) {
+            clearStdin();
+            return value;
+        } else {
+            clearStdin();
+            printf("Enter a number of 0 or more. Try again.\n");
+        }
+    }
+}
+
 void view_getString(const char *prompt, char *buf, size_t len) {
     printf("%s", prompt);
     if (fgets(buf, (int)len, stdin) == NULL) {
@@ -88,70 +109,124 @@ void view_getPassword(const char *prompt, char *password, size_t len) {
     tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
 }
 
-char *view_getMultilineText(void) {
-    printf("Enter text to append (single dot \".\" on its own line to finish):\n");
-
-    size_t capacity = 256;
-    size_t length   = 0;
-    char  *buffer   = (char *)malloc(capacity);
-    if (!buffer) return NULL;
+/* ---------- helper: multiline text ---------- */
 
-    buffer[0] = '\0';
-    char line[256];
+static int isTerminator(const char *line, size_t len) {
+    return (len == 1 && line[0] == '.') ||
+           (len == 2 && memcmp(line, ".\n", 2) == 0) ||
+           (len == 3 && memcmp(line, ".\r\n", 3) == 0);
+}
 
-    while (fgets(line, sizeof(line), stdin)) {
-        if (strcmp(line, ".\n") == 0 || strcmp(line, ".\r\n") == 0 ||
-            strcmp(line, ".") == 0) {
-            break;
-            }
+int view_beginMultilineText(ViewTextReader *r) {
+    printf("Enter text to append (single dot \".\" on its own line to finish):\n");
+    fflush(stdout);
 
-            size_t lineLen = strlen(line);
+    r->buf       = (char *)malloc(VIEW_TEXT_BLOCK);
+    r->lineStart = 1;
+    r->done      = 0;
+    return r->buf ? 0 : -1;
+}
 
-        if (length + lineLen + 1 > capacity) {
-            capacity *= 2;
-            char *newBuf = (char *)realloc(buffer, capacity);
-            if (!newBuf) {
-                free(buffer);
-                return NULL;
-            }
-            buffer = newBuf;
+long view_readTextBlock(void *ctx, const char **data) {
+    ViewTextReader *r    = (ViewTextReader *)ctx;
+    size_t          used = 0;
+
+    /* stdio reads ahead in blocks and fgets finds each newline with
+     * memchr; lines go straight into the block, and the terminator is
+     * only looked for where a line starts. The 4 bytes of headroom keep
+     * ".\r\n" from being split across blocks. */
+    while (!r->done && VIEW_TEXT_BLOCK - used >= 4) {
+        char *line = r->buf + used;
+        if (!fgets_unlocked(line, (int)(VIEW_TEXT_BLOCK - used), stdin)) {
+            r->done = 1;
+            break;
         }
-
-        memcpy(buffer + length, line, lineLen);
-        length += lineLen;
-        buffer[length] = '\0';
+        size_t len = strlen(line);
+        if (len == 0) continue;   /* a NUL byte; text is C strings */
+        if (r->lineStart && isTerminator(line, len)) {
+            r->done = 1;
+            break;
+        }
+        r->lineStart = line[len - 1] == '\n';
+        used += len;
     }
 
-    if (length == 0) {
-        free(buffer);
-        return NULL;
-    }
-    return buffer;
+    *data = r->buf;
+    return (long)used;
 }
 
-void view_showFileContent(const char *filename, const char *content) {
+void view_endMultilineText(ViewTextReader *r) {
+    free(r->buf);
+    r->buf = NULL;
+}
+
+void view_beginFileContent(const char *filename) {
     printf("Contents of %s:\n", filename);
-    if (content) {
-        printf("%s", content);
-        if (content[strlen(content) - 1] != '\n')
-            printf("\n");
-    } else {
+    fflush(stdout);   /* the body bypasses stdio */
+}
+
+void view_endFileContent(int lastChar, int ok) {
+    if (!ok) {
         printf("(no content or error reading)\n");
+    } else if (lastChar >= 0 && lastChar != '\n') {
+        printf("\n");
     }
 }
 
-void view_showRecentFiles(char names[][MAX_LEN], int count) {
+void view_showRecentFiles(char names[][MAX_LEN], int count, int more) {
     printf("Recent files (1 = most recent):\n");
     for (int i = 0; i < count; i++) {
         printf("%d. %s\n", i + 1, names[i]);
     }
+    if (more) {
+        printf("%d. More...\n", count + 1);
+    }
+}
+
+void view_showSearchHit(const char *filename, long long hits) {
+    printf("%s (%lld match%s)\n", filename, hits, hits == 1 ? "" : "es");
+}
+
+void view_showVerifyProblem(const char *filename, const char *problem) {
+    printf("%s: %s\n", filename, problem);
+}
+
+void view_showVersion(long long number, const ModelVersion *ver) {
+    char      when[32] = "?";
+    time_t    secs     = (time_t)(ver->time / 1000);
+    struct tm tm;
+    if (localtime_r(&secs, &tm)) strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%6lld  %s  +%lld bytes at %lld  check %08x\n", number, when, ver->length,
+           ver->offset, (unsigned)ver->check);
 }
 
-int view_chooseRecentFile(int count) {
+int view_chooseRecentFile(int count, int more) {
     int choice = view_getInt("Enter a number to open that file (0 to cancel): ");
-    if (choice < 0 || choice > count) {
+    if (choice < 0 || choice > count + (more ? 1 : 0)) {
         printf("Invalid choice.\n");
         return 0;
     }
     return choice;
 }
+
+void view_showStats(const StatsSnapshot *s) {
+    if (!s->enabled) {
+        printf("Statistics are off; start fv with FV_STATS set to collect them.\n");
+        return;
+    }
+
+    printf("%-16s %9s %10s %10s %10s %10s %10s\n", "operation", "count",
+           "mean us", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (int i = 0; i < STAT_OP_COUNT; i++) {
+        const StatsOpSummary *o = &s->ops[i];
+        if (o->count == 0) continue;
+        printf("%-16s %9llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", o->name,
+               (unsigned long long)o->count, o->meanUs, o->p50Us, o->p99Us,
+               o->p999Us, o->maxUs);
+    }
+    printf("\n");
+    for (int i = 0; i < STAT_COUNTER_COUNT; i++) {
+        printf("%-16s %llu\n", s->counterNames[i],
+               (unsigned long long)s->counters[i]);
+    }
+}
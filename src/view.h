@@ -4,6 +4,7 @@
 #define VIEW_H
 
 #include "model.h"  // for MAX_LEN
+#include "stats.h"
 
 void view_showMainMenu(void);
 void view_showMessage(const char *msg);
@@ -12,20 +13,52 @@ void view_showError(const char *msg);
 /* Reads an integer from user, with a prompt. */
 int  view_getInt(const char *prompt);
 
+/* Reads a count or offset (>= 0), with a prompt. */
+long long view_getCount(const char *prompt);
+
 /* Reads a line of text (no newline at end). */
 void view_getString(const char *prompt, char *buf, size_t len);
 
 /* Reads a password without echoing characters. */
 void view_getPassword(const char *prompt, char *buf, size_t len);
 
-/* Multiline input until single '.' line; returns malloc'd text or NULL. */
-char *view_getMultilineText(void);
+/* Multiline input until a single '.' line (or end of input), handed out
+ * in blocks of up to VIEW_TEXT_BLOCK bytes so input of any size can be
+ * streamed. view_readTextBlock is a ModelSourceFn. */
+#define VIEW_TEXT_BLOCK (1024 * 1024)
+
+typedef struct {
+    char *buf;
+    int   lineStart;   /* the next byte read begins a line */
+    int   done;        /* terminator or end of input seen */
+} ViewTextReader;
 
-/* Shows contents of a file. */
-void view_showFileContent(const char *filename, const char *content);
+int  view_beginMultilineText(ViewTextReader *r);
+/* prompts. returns 0, or -1 if out of memory */
+long view_readTextBlock(void *reader, const char **data);
+void view_endMultilineText(ViewTextReader *r);
+
+/* Shows contents of a file: the header, then the caller streams the
+ * bytes to STDOUT_FILENO, then the footer. lastChar is the final byte
+ * written (-1 if none); ok is 0 if reading failed. */
+void view_beginFileContent(const char *filename);
+void view_endFileContent(int lastChar, int ok);
 
 /* Recent files display & choice */
-void view_showRecentFiles(char names[][MAX_LEN], int count);
-int  view_chooseRecentFile(int count);
+/* more: offer "count + 1. More..." for the next page */
+void view_showRecentFiles(char names[][MAX_LEN], int count, int more);
+int  view_chooseRecentFile(int count, int more);
+
+/* One search result: a file and its number of matches */
+void view_showSearchHit(const char *filename, long long hits);
+
+/* One file that failed verification, and why */
+void view_showVerifyProblem(const char *filename, const char *problem);
+
+/* One line of a file's version history */
+void view_showVersion(long long number, const ModelVersion *ver);
+
+/* Latency and I/O statistics table */
+void view_showStats(const StatsSnapshot *s);
 
 #endif // VIEW_H
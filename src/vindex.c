@@ -0,0 +1,236 @@
+// vindex.c - binary vault index: writer, mapping and lookups
+
+#include "vindex.h"
+#include "hashindex.h"
+#include "journal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIC        "FVINDEX\n"
+#define HEADER_SIZE  64
+#define HEADER_CRC   60           /* the CRC covers bytes before this */
+#define SLOT_SIZE    8
+#define ENTRY_FIXED  8            /* crc, nameLen, secretLen */
+#define MIN_SLOTS    16
+#define ENTRY_MAX    0xffff       /* longest name or secret */
+
+/* ---------- helper: little-endian fields ---------- */
+
+static uint32_t get16(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+static uint32_t get32(const unsigned char *p) {
+    return get16(p) | get16(p + 2) << 16;
+}
+
+static uint64_t get64(const unsigned char *p) {
+    return (uint64_t)get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+static void put16(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static void put64(unsigned char *p, uint64_t v) {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static size_t entrySize(size_t nameLen, size_t secretLen) {
+    return (ENTRY_FIXED + nameLen + 1 + secretLen + 1 + 3) & ~(size_t)3;
+}
+
+/* the entry at off, or NULL if it does not fit in the heap or fails its
+ * checksum; *size receives its aligned size */
+static const unsigned char *entryAt(const VaultIndex *ix, uint64_t off,
+                                    size_t *size) {
+    if (off % 4 != 0 || off + ENTRY_FIXED > ix->heapLen) return NULL;
+    const unsigned char *e  = ix->heap + off;
+    size_t               nl = get16(e + 4);
+    size_t               sl = get16(e + 6);
+    size_t               n  = entrySize(nl, sl);
+    if (off + n > ix->heapLen || e[ENTRY_FIXED + nl] != '\0' ||
+        e[ENTRY_FIXED + nl + 1 + sl] != '\0')
+        return NULL;
+    if (journal_crc(e + 4, ENTRY_FIXED - 4 + nl + 1 + sl + 1) != get32(e))
+        return NULL;
+    *size = n;
+    return e;
+}
+
+/* ---------- public ---------- */
+
+int vindex_open(VaultIndex *ix, const char *path) {
+    memset(ix, 0, sizeof(*ix));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT ? 0 : -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size < HEADER_SIZE) {
+        close(fd);
+        return -2;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const unsigned char *h = (const unsigned char *)map;
+    uint32_t slots   = get32(h + 16);
+    uint64_t heapOff = get64(h + 24);
+    uint64_t heapLen = get64(h + 32);
+    int ok = memcmp(h, MAGIC, 8) == 0 && get32(h + 8) == VINDEX_VERSION &&
+             journal_crc(h, HEADER_CRC) == get32(h + HEADER_CRC) &&
+             slots >= MIN_SLOTS && (slots & (slots - 1)) == 0 &&
+             heapOff >= HEADER_SIZE + (uint64_t)slots * SLOT_SIZE &&
+             heapOff + heapLen == (uint64_t)st.st_size;
+    if (!ok) {
+        munmap(map, (size_t)st.st_size);
+        return -2;
+    }
+
+    ix->map       = (unsigned char *)map;
+    ix->size      = (size_t)st.st_size;
+    ix->count     = get32(h + 12);
+    ix->slotCount = slots;
+    ix->slots     = h + HEADER_SIZE;
+    ix->heap      = h + heapOff;
+    ix->heapLen   = heapLen;
+    return 0;
+}
+
+void vindex_close(VaultIndex *ix) {
+    if (ix->map) munmap(ix->map, ix->size);
+    memset(ix, 0, sizeof(*ix));
+}
+
+const char *vindex_find(const VaultIndex *ix, const char *name) {
+    if (!ix->map) return NULL;
+
+    uint32_t hash = hashindex_hash(name);
+    size_t   len  = strlen(name);
+    uint32_t mask = ix->slotCount - 1;
+
+    /* bounded, so a corrupt table with no empty slot still terminates */
+    for (uint32_t n = 0, i = hash & mask; n < ix->slotCount; n++, i = (i + 1) & mask) {
+        const unsigned char *s = ix->slots + (size_t)i * SLOT_SIZE;
+        uint32_t h = get32(s);
+        if (h == 0) return NULL;
+        if (h != hash) continue;
+
+        size_t               size;
+        const unsigned char *e = entryAt(ix, get32(s + 4), &size);
+        if (e && get16(e + 4) == len && memcmp(e + ENTRY_FIXED, name, len) == 0)
+            return (const char *)e + ENTRY_FIXED + len + 1;
+    }
+    return NULL;
+}
+
+int vindex_next(const VaultIndex *ix, uint64_t *pos,
+                const char **name, const char **secret) {
+    if (!ix->map || *pos >= ix->heapLen) return 0;
+
+    size_t               size;
+    const unsigned char *e = entryAt(ix, *pos, &size);
+    if (!e) return -1;
+    *name   = (const char *)e + ENTRY_FIXED;
+    *secret = *name + get16(e + 4) + 1;
+    *pos   += size;
+    return 1;
+}
+
+int vindex_verify(const VaultIndex *ix) {
+    if (!ix->map) return 0;
+    const unsigned char *h = ix->map;
+    int ok = journal_crc(ix->slots, (size_t)ix->slotCount * SLOT_SIZE) == get32(h + 20) &&
+             journal_crc(ix->heap, (size_t)ix->heapLen) == get32(h + 40);
+    return ok ? 0 : -1;
+}
+
+int vindex_write(const char *path, const char *const *names,
+                 const char *const *secrets, uint32_t count) {
+    /* half full at most, so probe runs stay short */
+    uint32_t slots = MIN_SLOTS;
+    while (slots < 2 * (uint64_t)count) {
+        if (slots > UINT32_MAX / 4) return -1;
+        slots *= 2;
+    }
+
+    uint64_t heapLen = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t nl = strlen(names[i]), sl = strlen(secrets[i]);
+        if (nl > ENTRY_MAX || sl > ENTRY_MAX) return -1;
+        heapLen += entrySize(nl, sl);
+    }
+    if (heapLen > UINT32_MAX) return -1;   /* entry offsets are 32-bit */
+
+    uint64_t       heapOff = HEADER_SIZE + (uint64_t)slots * SLOT_SIZE;
+    size_t         size    = (size_t)(heapOff + heapLen);
+    unsigned char *buf     = (unsigned char *)calloc(1, size);
+    if (!buf) return -1;
+
+    unsigned char *slotBase = buf + HEADER_SIZE;
+    unsigned char *heap     = buf + heapOff;
+    uint32_t       mask     = slots - 1;
+    uint64_t       off      = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t         nl = strlen(names[i]), sl = strlen(secrets[i]);
+        unsigned char *e  = heap + off;
+        put16(e + 4, (uint32_t)nl);
+        put16(e + 6, (uint32_t)sl);
+        memcpy(e + ENTRY_FIXED, names[i], nl + 1);
+        memcpy(e + ENTRY_FIXED + nl + 1, secrets[i], sl + 1);
+        put32(e, journal_crc(e + 4, ENTRY_FIXED - 4 + nl + 1 + sl + 1));
+
+        uint32_t hash = hashindex_hash(names[i]);
+        uint32_t s    = hash & mask;
+        while (get32(slotBase + (size_t)s * SLOT_SIZE) != 0)
+            s = (s + 1) & mask;
+        put32(slotBase + (size_t)s * SLOT_SIZE, hash);
+        put32(slotBase + (size_t)s * SLOT_SIZE + 4, (uint32_t)off);
+        off += entrySize(nl, sl);
+    }
+
+    memcpy(buf, MAGIC, 8);
+    put32(buf + 8, VINDEX_VERSION);
+    put32(buf + 12, count);
+    put32(buf + 16, slots);
+    put32(buf + 20, journal_crc(slotBase, (size_t)slots * SLOT_SIZE));
+    put64(buf + 24, heapOff);
+    put64(buf + 32, heapLen);
+    put32(buf + 40, journal_crc(heap, (size_t)heapLen));
+    put32(buf + HEADER_CRC, journal_crc(buf, HEADER_CRC));
+
+    int rc = -1;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = write(fd, buf + done, size - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += (size_t)n;
+        }
+        if (done == size && fsync(fd) == 0) rc = 0;
+        if (close(fd) != 0) rc = -1;
+        if (rc != 0) unlink(path);
+    }
+    free(buf);
+    return rc;
+}
@@ -0,0 +1,65 @@
+// vindex.h - binary vault index: read-only, memory-mapped snapshot
+
+#ifndef VINDEX_H
+#define VINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * On-disk layout, all little-endian:
+ *
+ *   header   64 bytes: magic "FVINDEX\n", u32 version, u32 count,
+ *            u32 slotCount, u32 slotsCrc, u64 heapOff, u64 heapLen,
+ *            u32 heapCrc, reserved zeros, u32 CRC-32C of bytes 0..59
+ *   slots    slotCount x { u32 hash, u32 entry offset in the heap },
+ *            open addressing with linear probing; hash 0 = empty
+ *   heap     entries, each 4-byte aligned:
+ *            u32 CRC-32C of the rest | u16 nameLen | u16 secretLen |
+ *            name NUL secret NUL
+ *
+ * Opening maps the file and checks only the header, so it costs the
+ * same for any number of entries. Every lookup checks the CRC of the
+ * entry it returns; vindex_verify checks the slot table and the heap as
+ * a whole. Names may hold any byte but NUL.
+ */
+#define VINDEX_VERSION 1
+
+typedef struct {
+    unsigned char       *map;        /* NULL = empty index */
+    size_t               size;
+    uint32_t             count;
+    uint32_t             slotCount;
+    const unsigned char *slots;
+    const unsigned char *heap;
+    uint64_t             heapLen;
+} VaultIndex;
+
+int  vindex_open(VaultIndex *ix, const char *path);
+/* maps path read-only. A missing file opens as an empty index.
+ * returns:
+ *   0 = success
+ *  -1 = open/map error
+ *  -2 = not an index of this version, or its header is corrupt
+ */
+
+void vindex_close(VaultIndex *ix);
+
+const char *vindex_find(const VaultIndex *ix, const char *name);
+/* returns the secret stored for name (inside the mapping, valid until
+ * close), or NULL if absent or its entry fails its checksum */
+
+int  vindex_next(const VaultIndex *ix, uint64_t *pos,
+                 const char **name, const char **secret);
+/* walks the entries in heap order; start with *pos = 0.
+ * returns 1 = an entry, 0 = end, -1 = corrupt entry */
+
+int  vindex_verify(const VaultIndex *ix);
+/* checks the slot table and heap checksums. returns 0 or -1 */
+
+int  vindex_write(const char *path, const char *const *names,
+                  const char *const *secrets, uint32_t count);
+/* writes and fsyncs a complete index of distinct names; the caller
+ * renames it into place. returns 0, or -1 on error */
+
+#endif // VINDEX_H
@@ -0,0 +1,146 @@
+// vtable.c - growable vault table: filename -> password, struct-of-arrays
+
+#include "vtable.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define VTABLE_MIN_CAP 64
+
+/* ---------- helper: storage ---------- */
+
+static const char *tableKey(void *ctx, int id) {
+    return vtable_name((const VaultTable *)ctx, id);
+}
+
+static int reserve(VaultTable *t, int need) {
+    if (need <= t->cap) return 0;
+
+    int cap = t->cap ? t->cap : VTABLE_MIN_CAP;
+    while (cap < need) cap *= 2;
+
+    uint32_t *h = (uint32_t *)realloc(t->hashes, sizeof(uint32_t) * (size_t)cap);
+    if (!h) return -1;
+    t->hashes = h;
+    uint32_t *n = (uint32_t *)realloc(t->nameOff, sizeof(uint32_t) * (size_t)cap);
+    if (!n) return -1;
+    t->nameOff = n;
+    uint32_t *s = (uint32_t *)realloc(t->secretOff, sizeof(uint32_t) * (size_t)cap);
+    if (!s) return -1;
+    t->secretOff = s;
+
+    t->cap = cap;
+    return 0;
+}
+
+/* copy live strings into a fresh arena once half of it is garbage */
+static void compactStrings(VaultTable *t) {
+    if (t->strings.dead * 2 < t->strings.used || t->count == 0) return;
+
+    size_t    bytes   = sizeof(uint32_t) * (size_t)t->count;
+    uint32_t *names   = (uint32_t *)malloc(bytes);
+    uint32_t *secrets = (uint32_t *)malloc(bytes);
+    Arena     fresh;
+    arena_init(&fresh);
+
+    int ok = names && secrets;
+    for (int i = 0; ok && i < t->count; i++) {
+        names[i]   = arena_strdup(&fresh, vtable_name(t, i));
+        secrets[i] = arena_strdup(&fresh, vtable_secret(t, i));
+        ok = names[i] != ARENA_NONE && secrets[i] != ARENA_NONE;
+    }
+
+    if (ok) {   /* otherwise keep the old arena and retry next time */
+        memcpy(t->nameOff, names, bytes);
+        memcpy(t->secretOff, secrets, bytes);
+        arena_free(&t->strings);
+        t->strings = fresh;
+    } else {
+        arena_free(&fresh);
+    }
+    free(names);
+    free(secrets);
+}
+
+/* ---------- public ---------- */
+
+int vtable_init(VaultTable *t, int expected) {
+    memset(t, 0, sizeof(*t));
+    arena_init(&t->strings);
+    if (reserve(t, expected) != 0) return -1;
+    return hashindex_init(&t->index, (size_t)expected, tableKey, t);
+}
+
+void vtable_free(VaultTable *t) {
+    free(t->hashes);
+    free(t->nameOff);
+    free(t->secretOff);
+    arena_free(&t->strings);
+    hashindex_free(&t->index);
+    memset(t, 0, sizeof(*t));
+}
+
+int vtable_find(const VaultTable *t, const char *name) {
+    return hashindex_find(&t->index, name, hashindex_hash(name));
+}
+
+int vtable_put(VaultTable *t, const char *name, const char *secret) {
+    uint32_t hash = hashindex_hash(name);
+    int id = hashindex_find(&t->index, name, hash);
+    if (id >= 0)
+        return vtable_setSecret(t, id, secret) == 0 ? id : -1;
+
+    if (reserve(t, t->count + 1) != 0) return -1;
+
+    uint32_t n = arena_strdup(&t->strings, name);
+    if (n == ARENA_NONE) return -1;
+    uint32_t s = arena_strdup(&t->strings, secret);
+    if (s == ARENA_NONE) {
+        arena_release(&t->strings, n);
+        return -1;
+    }
+
+    id = t->count;
+    t->hashes[id]    = hash;
+    t->nameOff[id]   = n;
+    t->secretOff[id] = s;
+    if (hashindex_insert(&t->index, name, hash, id) != 0) {
+        arena_release(&t->strings, n);
+        arena_release(&t->strings, s);
+        return -1;
+    }
+    t->count++;
+    return id;
+}
+
+int vtable_setSecret(VaultTable *t, int id, const char *secret) {
+    if (strcmp(vtable_secret(t, id), secret) == 0) return 0;
+
+    uint32_t s = arena_strdup(&t->strings, secret);
+    if (s == ARENA_NONE) return -1;
+    arena_release(&t->strings, t->secretOff[id]);
+    t->secretOff[id] = s;
+    compactStrings(t);
+    return 0;
+}
+
+void vtable_remove(VaultTable *t, int id) {
+    hashindex_remove(&t->index, vtable_name(t, id), t->hashes[id]);
+    arena_release(&t->strings, t->nameOff[id]);
+    arena_release(&t->strings, t->secretOff[id]);
+
+    int last = t->count - 1;
+    if (id != last) {
+        t->hashes[id]    = t->hashes[last];
+        t->nameOff[id]   = t->nameOff[last];
+        t->secretOff[id] = t->secretOff[last];
+        hashindex_insert(&t->index, vtable_name(t, id), t->hashes[id], id);
+    }
+    t->count--;
+    compactStrings(t);
+}
+
+size_t vtable_memoryUsage(const VaultTable *t) {
+    return (size_t)t->cap * 3 * sizeof(uint32_t) +
+           t->strings.cap +
+           t->index.capacity * sizeof(HashSlot);
+}
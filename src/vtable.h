@@ -0,0 +1,53 @@
+// vtable.h - growable vault table: filename -> password, struct-of-arrays
+
+#ifndef VTABLE_H
+#define VTABLE_H
+
+#include "arena.h"
+#include "hashindex.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Entry i is described by hashes[i], nameOff[i] and secretOff[i]; the
+ * strings themselves live in the arena. Ids are dense (0..count-1) and
+ * stay stable except that vtable_remove moves the last entry into the
+ * freed id. */
+typedef struct {
+    uint32_t  *hashes;
+    uint32_t  *nameOff;
+    uint32_t  *secretOff;
+    int        count;
+    int        cap;
+    Arena      strings;
+    HashIndex  index;
+} VaultTable;
+
+int  vtable_init(VaultTable *t, int expected);
+/* returns 0, or -1 when out of memory */
+
+void vtable_free(VaultTable *t);
+
+int  vtable_find(const VaultTable *t, const char *name);
+/* returns id, or -1 if not present */
+
+int  vtable_put(VaultTable *t, const char *name, const char *secret);
+/* inserts, or replaces the secret of an existing name.
+ * returns id, or -1 when out of memory */
+
+int  vtable_setSecret(VaultTable *t, int id, const char *secret);
+/* returns 0, or -1 when out of memory */
+
+void vtable_remove(VaultTable *t, int id);
+
+static inline const char *vtable_name(const VaultTable *t, int id) {
+    return arena_str(&t->strings, t->nameOff[id]);
+}
+
+static inline const char *vtable_secret(const VaultTable *t, int id) {
+    return arena_str(&t->strings, t->secretOff[id]);
+}
+
+/* bytes currently allocated for the table, its strings and its index */
+size_t vtable_memoryUsage(const VaultTable *t);
+
+#endif // VTABLE_H